@@ -1,4 +1,5 @@
 #include "xbee.h"
+#include "xbee_timer.h"
 #include <assert.h>
 #include <errno.h>
 #include <string.h>
@@ -20,6 +21,66 @@ static inline void xbee_check(xbee_interface_t * xbee)
     assert(xbee->recv_size <= xbee->recv_max_size);
 }
 
+static inline void xbee_frame_id_set(uint8_t * bitmap, uint8_t frame_id)
+{
+    bitmap[frame_id >> 3] |= 1 << (frame_id & 7);
+}
+
+static inline void xbee_frame_id_clear(uint8_t * bitmap, uint8_t frame_id)
+{
+    bitmap[frame_id >> 3] &= ~(1 << (frame_id & 7));
+}
+
+static inline bool xbee_frame_id_test(const uint8_t * bitmap, uint8_t frame_id)
+{
+    return (bitmap[frame_id >> 3] & (1 << (frame_id & 7))) != 0;
+}
+
+/*! Frame id is no longer awaiting a response */
+static inline void xbee_release_frame_id(xbee_interface_t * xbee, uint8_t frame_id)
+{
+    xbee_frame_id_clear(xbee->pending, frame_id);
+    if(xbee->timers)
+    {
+        xbee_timer_cancel(xbee->timers, &xbee->frame_timers[frame_id]);
+    }
+}
+
+/*! Records frame_id as awaiting a response if the frame was written */
+static inline int xbee_track_frame_id(xbee_interface_t * xbee, uint8_t frame_id, int ret)
+{
+    if(frame_id != 0)
+    {
+        if(ret == 0)
+        {
+            xbee_frame_id_set(xbee->pending, frame_id);
+            if(xbee->timers)
+            {
+                xbee_timer_start(xbee->timers, &xbee->frame_timers[frame_id],
+                        xbee_now(xbee) + xbee->frame_timeout);
+            }
+        }
+        else
+        {
+            xbee_release_frame_id(xbee, frame_id);
+        }
+    }
+
+    return ret;
+}
+
+void xbee_sleep_ms(xbee_interface_t * xbee, uint32_t ms)
+{
+    if(xbee->uart->sleep_ms)
+    {
+        xbee->uart->sleep_ms(xbee->uart->clock_ptr, ms);
+    }
+    else
+    {
+        xbee->uart->sleep((ms + 999) / 1000);
+    }
+}
+
 /*! Configures XBee to match library expectations
  *
  * This library assumes that XBee is being used with hardware flow 
@@ -42,7 +103,7 @@ static int xbee_init(xbee_interface_t * xbee)
 
     /* Force XBee into AT command mode */
     c = '+';
-    xbee->uart->sleep(XBEE_GUARD_TIME);
+    xbee_sleep_ms(xbee, XBEE_GUARD_TIME*1000);
     int ret;
     for(int i = 0; i < 3; ++i)
     {
@@ -52,7 +113,7 @@ static int xbee_init(xbee_interface_t * xbee)
             return -1;
         }
     }
-    xbee->uart->sleep(XBEE_GUARD_TIME);
+    xbee_sleep_ms(xbee, XBEE_GUARD_TIME*1000);
 
     /* Should return "OK\r" if entered AT command mode */
     char buf[3];
@@ -92,7 +153,7 @@ static int xbee_init(xbee_interface_t * xbee)
 
     /* 1 second is more than enough for al AT command responses to have arrived assuming there
      * is buffering on the host */
-    xbee->uart->sleep(1);
+    xbee_sleep_ms(xbee, 1000);
 
     /* Verify each AT command (including CN) were OK'd */
     uint8_t check[3];
@@ -154,6 +215,8 @@ static int xbee_init(xbee_interface_t * xbee)
         {
             return -10;
         }
+
+        xbee_frame_id_clear(xbee->pending, f.frame_id);
     }
 
     return 0;
@@ -164,6 +227,7 @@ int xbee_open(xbee_interface_t * xbee, xbee_uart_interface_t * uart,
 {
     assert(xbee);
     assert(uart);
+    assert(uart->sleep || uart->sleep_ms);
     assert(recv_buffer);
 
     memset(xbee, 0, sizeof(*xbee));
@@ -173,6 +237,8 @@ int xbee_open(xbee_interface_t * xbee, xbee_uart_interface_t * uart,
     xbee->recv = recv_buffer;
     xbee->recv_idx = 0;
     xbee->recv_size = 0;
+    xbee->state = XBEE_STATE_READY;
+    xbee->next_frame_id = 1;
 
     return xbee_init(xbee);
 }
@@ -182,6 +248,42 @@ int xbee_open(xbee_interface_t * xbee, xbee_uart_interface_t * uart,
 #define XBEE_XON 0x11
 #define XBEE_XOFF 0x13
 
+static inline bool xbee_needs_escape(uint8_t byte)
+{
+    return byte == XBEE_FRAME_DELIM || byte == XBEE_FRAME_ESCAPE ||
+           byte == XBEE_XON || byte == XBEE_XOFF;
+}
+
+/*! Copies bytes to out with escaping
+ *
+ * \return Bytes put in out, at most 2*nbytes
+ */
+static size_t xbee_escape_bytes(uint8_t * out, 
+        size_t nbytes, const void * buf, uint8_t * accum) SPECIAL_SECTION;
+static size_t xbee_escape_bytes(uint8_t * out, 
+        size_t nbytes, const void * buf, uint8_t * accum)
+{
+    const uint8_t * bytes = buf;
+    size_t size = 0;
+
+    for(size_t i = 0; i < nbytes; ++i)
+    {
+        *accum += bytes[i];
+
+        if(xbee_needs_escape(bytes[i]))
+        {
+            out[size++] = XBEE_FRAME_ESCAPE;
+            out[size++] = bytes[i] ^ 0x20;
+        }
+        else
+        {
+            out[size++] = bytes[i];
+        }
+    }
+
+    return size;
+}
+
 /*! Writes bytes with escaping */
 static int xbee_write_bytes(xbee_interface_t * xbee, 
         size_t nbytes, const void * buf, uint8_t *accum) SPECIAL_SECTION;
@@ -189,7 +291,7 @@ static int xbee_write_bytes(xbee_interface_t * xbee,
         size_t nbytes, const void * buf, uint8_t *accum)
 {
     assert(xbee);
-    assert(buf);
+    assert(buf || nbytes == 0);
     assert(accum);
 
     const uint8_t * bytes = buf;
@@ -203,9 +305,7 @@ static int xbee_write_bytes(xbee_interface_t * xbee,
         *accum += bytes[i];
 
         /* Check if this byte needs to be escaped */
-        if(bytes[i] == XBEE_FRAME_DELIM || 
-           bytes[i] == XBEE_FRAME_ESCAPE || 
-           bytes[i] == XBEE_XON || bytes[i] == XBEE_XOFF)
+        if(xbee_needs_escape(bytes[i]))
         {
             /* Write everything up to the escaped byte */
             size_t to_write = i-off;
@@ -383,6 +483,32 @@ static bool xbee_find_if_have_next_delim(xbee_interface_t * xbee)
     return false;
 }
 
+/*! Sets rx_time from the read that brought in the last byte of the frame
+ * just removed from the buffer */
+static void xbee_stamp_frame(xbee_interface_t * xbee)
+{
+    if(!xbee->uart->clock)
+    {
+        return;
+    }
+
+    /* Bytes read after the frame's last byte are still in the buffer */
+    size_t behind = xbee->recv_size;
+    for(size_t i = 1; i <= XBEE_FILL_RECORDS; ++i)
+    {
+        const xbee_fill_record_t * fill = 
+            &xbee->fills[(xbee->fill_next + XBEE_FILL_RECORDS - i) % XBEE_FILL_RECORDS];
+
+        /* Past the oldest record, the oldest time is the best estimate */
+        xbee->rx_time = fill->time;
+        if(behind < fill->size)
+        {
+            return;
+        }
+        behind -= fill->size;
+    }
+}
+
 int xbee_decode_frame(xbee_interface_t * xbee, 
         size_t frame_out_size, void * frame_out)
 {
@@ -440,35 +566,23 @@ int xbee_decode_frame(xbee_interface_t * xbee,
         for(size_t i = 0; i < length+1; ++i)
         {
             ret = xbee_get_next_byte(xbee, &idx, &bytes_out[i]);
-            if(ret == XBEE_NOT_ENOUGH_DATA)
-            {
-                if(xbee->recv_size == xbee->recv_max_size)
-                {
-                    /* FIXME: Handle overflow better */
-                    xbee_drop_byte(xbee);
-                    continue;
-                }
-                else if(xbee_find_if_have_next_delim(xbee))
-                {
-                    /* Check if we have a packet behind this one */
-                    xbee_drop_byte(xbee);
-                    continue;
-                }
-                else
-                {
-                    return 0;
-                }
-            }
-            else if(ret != 0)
+            if(ret != 0)
             {
-                xbee_drop_byte(xbee);
-                continue;
+                break;
             }
 
             accum += bytes_out[i];
         }
 
-        if(accum == 0xFF)
+        if(ret == XBEE_NOT_ENOUGH_DATA &&
+           xbee->recv_size < xbee->recv_max_size &&
+           !xbee_find_if_have_next_delim(xbee))
+        {
+            /* Rest of the frame has not arrived yet */
+            return 0;
+        }
+
+        if(ret == 0 && accum == 0xFF)
         {
             /* Found a good frame, remove from buffer now that it is copied out */
             xbee->recv_idx += idx;
@@ -477,13 +591,13 @@ int xbee_decode_frame(xbee_interface_t * xbee,
                 xbee->recv_idx -= xbee->recv_max_size;
             }
             xbee->recv_size -= idx;
+            xbee_stamp_frame(xbee);
             return length;
         }
-        else
-        {
-            xbee_drop_byte(xbee);
-            continue;
-        }
+
+        /* Bad checksum, or cut short by another frame's delimiter or a
+         * full buffer: resynchronise on the next delimiter */
+        xbee_drop_byte(xbee);
     }
 
     return 0;
@@ -504,10 +618,23 @@ static void xbee_dump_recv_buffer(xbee_interface_t * xbee)
 }
 #endif
 
-int xbee_fill_buffer(xbee_interface_t * xbee)
+/*! Records a read of size bytes for xbee_stamp_frame */
+static void xbee_record_fill(xbee_interface_t * xbee, int size)
 {
-    xbee_check(xbee);
+    if(size <= 0 || !xbee->uart->clock)
+    {
+        return;
+    }
 
+    xbee_fill_record_t * fill = &xbee->fills[xbee->fill_next];
+    fill->time = xbee_now(xbee);
+    fill->size = size;
+    xbee->fill_next = (xbee->fill_next + 1) % XBEE_FILL_RECORDS;
+}
+
+static int xbee_read_buffer(xbee_interface_t * xbee) SPECIAL_SECTION;
+static int xbee_read_buffer(xbee_interface_t * xbee)
+{
     size_t read_start = xbee->recv_idx + xbee->recv_size;
     size_t read_end;
     if(read_start < xbee->recv_max_size)
@@ -570,6 +697,15 @@ int xbee_fill_buffer(xbee_interface_t * xbee)
     }
 }
 
+int xbee_fill_buffer(xbee_interface_t * xbee)
+{
+    xbee_check(xbee);
+
+    int ret = xbee_read_buffer(xbee);
+    xbee_record_fill(xbee, ret);
+    return ret;
+}
+
 int xbee_recv_frame(xbee_interface_t * xbee, 
         size_t frame_out_size, void * frame_out)
 {
@@ -590,7 +726,10 @@ int xbee_recv_frame(xbee_interface_t * xbee,
     return xbee_decode_frame(xbee, frame_out_size, frame_out);
 }
 
-int xbee_at_command(xbee_interface_t * xbee, 
+static int xbee_write_at_frame(xbee_interface_t * xbee, xbee_api_id_t api_id, 
+        uint8_t frame_id, char * at_command, 
+        size_t param_size, const void * param) SPECIAL_SECTION;
+static int xbee_write_at_frame(xbee_interface_t * xbee, xbee_api_id_t api_id, 
         uint8_t frame_id, char * at_command, 
         size_t param_size, const void * param)
 {
@@ -602,7 +741,7 @@ int xbee_at_command(xbee_interface_t * xbee,
     }
 
     uint8_t buf[4];
-    buf[0] = XBEE_AT_COMMAND;
+    buf[0] = api_id;
     buf[1] = frame_id;
     buf[2] = at_command[0];
     buf[3] = at_command[1];
@@ -622,39 +761,331 @@ int xbee_at_command(xbee_interface_t * xbee,
     return xbee_finish_frame(xbee, accum);
 }
 
-int xbee_at_queue_parameter(xbee_interface_t * xbee, 
+static xbee_at_cache_entry_t * xbee_at_cache_find(xbee_interface_t * xbee, 
+        const char * at_command) SPECIAL_SECTION;
+static xbee_at_cache_entry_t * xbee_at_cache_find(xbee_interface_t * xbee, 
+        const char * at_command)
+{
+    for(size_t i = 0; i < XBEE_AT_CACHE_SIZE; ++i)
+    {
+        xbee_at_cache_entry_t * e = &xbee->at_cache[i];
+        if(e->flags != 0 && 
+           e->at_command[0] == at_command[0] && 
+           e->at_command[1] == at_command[1])
+        {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+/*! Finds entry for at_command, or takes over an unused (or the oldest) entry */
+static xbee_at_cache_entry_t * xbee_at_cache_get(xbee_interface_t * xbee, 
+        const char * at_command) SPECIAL_SECTION;
+static xbee_at_cache_entry_t * xbee_at_cache_get(xbee_interface_t * xbee, 
+        const char * at_command)
+{
+    xbee_at_cache_entry_t * e = xbee_at_cache_find(xbee, at_command);
+    if(e != NULL)
+    {
+        return e;
+    }
+
+    for(size_t i = 0; i < XBEE_AT_CACHE_SIZE && e == NULL; ++i)
+    {
+        if(xbee->at_cache[i].flags == 0)
+        {
+            e = &xbee->at_cache[i];
+        }
+    }
+
+    if(e == NULL)
+    {
+        e = &xbee->at_cache[xbee->at_cache_next];
+        xbee->at_cache_next = (xbee->at_cache_next + 1) % XBEE_AT_CACHE_SIZE;
+    }
+
+    memset(e, 0, sizeof(*e));
+    e->at_command[0] = at_command[0];
+    e->at_command[1] = at_command[1];
+    return e;
+}
+
+void xbee_at_cache_invalidate(xbee_interface_t * xbee, const char * at_command)
+{
+    assert(xbee);
+    assert(at_command);
+
+    xbee_at_cache_entry_t * e = xbee_at_cache_find(xbee, at_command);
+    if(e != NULL)
+    {
+        e->flags = 0;
+    }
+}
+
+/*! Returns true for commands whose response is a measurement or the result
+ * of an action rather than a parameter value */
+static bool xbee_at_cache_uncacheable(const char * at_command)
+{
+    static const char uncacheable[][2] = {
+        {'N', 'D'}, {'I', 'S'}, {'E', 'D'}, {'A', 'S'}, 
+        {'D', 'B'}, {'E', 'C'}, {'E', 'A'}, {'%', 'V'}, {'T', 'P'},
+    };
+
+    for(size_t i = 0; i < sizeof(uncacheable)/sizeof(uncacheable[0]); ++i)
+    {
+        if(uncacheable[i][0] == at_command[0] && uncacheable[i][1] == at_command[1])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*! Returns true for commands that change many parameters at once */
+static bool xbee_at_cache_flushes(const char * at_command)
+{
+    return (at_command[0] == 'R' && at_command[1] == 'E') ||
+           (at_command[0] == 'F' && at_command[1] == 'R');
+}
+
+/*! Forgets entries with any of flags awaiting frame_id */
+static void xbee_at_cache_forget(xbee_interface_t * xbee, uint8_t frame_id, uint8_t flags)
+{
+    for(size_t i = 0; i < XBEE_AT_CACHE_SIZE; ++i)
+    {
+        xbee_at_cache_entry_t * e = &xbee->at_cache[i];
+        if((e->flags & flags) != 0 && frame_id != 0 && e->frame_id == frame_id)
+        {
+            e->flags = 0;
+        }
+    }
+}
+
+/*! Marks the values now valid as saved, on a WR's OK */
+static void xbee_at_cache_saved(xbee_interface_t * xbee)
+{
+    for(size_t i = 0; i < XBEE_AT_CACHE_SIZE; ++i)
+    {
+        xbee_at_cache_entry_t * e = &xbee->at_cache[i];
+        if(e->flags & XBEE_AT_CACHE_VALID)
+        {
+            e->flags |= XBEE_AT_CACHE_SAVED;
+        }
+    }
+}
+
+static void xbee_at_cache_response(xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * parsed_frame) SPECIAL_SECTION;
+static void xbee_at_cache_response(xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * parsed_frame)
+{
+    const char * at_command = parsed_frame->frame.at_command_response.at_command;
+    uint8_t status = parsed_frame->frame.at_command_response.status;
+    size_t data_size = parsed_frame->frame.at_command_response.data_size;
+
+    /* Responses come in order, any earlier ones have been seen */
+    xbee_at_cache_forget(xbee, parsed_frame->frame_id, XBEE_AT_CACHE_QUEUED);
+
+    if(status == 0 && at_command[0] == 'W' && at_command[1] == 'R')
+    {
+        xbee_at_cache_saved(xbee);
+    }
+
+    xbee_at_cache_entry_t * e = xbee_at_cache_find(xbee, at_command);
+    if(e != NULL && (e->flags & XBEE_AT_CACHE_QUEUED))
+    {
+        /* May be the value before or after the queued one */
+        return;
+    }
+
+    if(e != NULL && (e->flags & (XBEE_AT_CACHE_WRITE | XBEE_AT_CACHE_QUERY)) != 0)
+    {
+        if(parsed_frame->frame_id != e->frame_id)
+        {
+            /* Stale response to an older query, wait for ours */
+            return;
+        }
+
+        if(status != 0)
+        {
+            e->flags = 0;
+            return;
+        }
+
+        if(e->flags & XBEE_AT_CACHE_WRITE)
+        {
+            e->flags = XBEE_AT_CACHE_VALID;
+            return;
+        }
+    }
+
+    if(status != 0 || data_size == 0 || data_size > XBEE_MAX_AT_PARAM ||
+       xbee_at_cache_uncacheable(at_command))
+    {
+        if(e != NULL && (e->flags & XBEE_AT_CACHE_QUERY))
+        {
+            e->flags = 0;
+        }
+        return;
+    }
+
+    if(e == NULL)
+    {
+        e = xbee_at_cache_get(xbee, at_command);
+    }
+
+    /* Read again unchanged, still the saved value */
+    uint8_t saved = e->flags & XBEE_AT_CACHE_SAVED;
+    if(e->value_size != data_size ||
+       memcmp(e->value, parsed_frame->frame.at_command_response.data, data_size) != 0)
+    {
+        saved = 0;
+    }
+
+    e->flags = XBEE_AT_CACHE_VALID | saved;
+    e->frame_id = 0;
+    e->value_size = data_size;
+    memcpy(e->value, parsed_frame->frame.at_command_response.data, data_size);
+}
+
+/*! Queued values are applied by the command sent with frame_id
+ *
+ * Responses to queries sent before it may show the old values, so they
+ * are ignored until its own response comes.  Without a frame id, that
+ * can't be told and the values are simply forgotten.
+ */
+static void xbee_at_cache_applied(xbee_interface_t * xbee, uint8_t frame_id)
+{
+    for(size_t i = 0; i < XBEE_AT_CACHE_SIZE; ++i)
+    {
+        xbee_at_cache_entry_t * e = &xbee->at_cache[i];
+        if((e->flags & XBEE_AT_CACHE_QUEUED) && e->frame_id == 0)
+        {
+            e->frame_id = frame_id;
+            if(frame_id == 0)
+            {
+                e->flags = 0;
+            }
+        }
+    }
+}
+
+void xbee_at_cache_flush(xbee_interface_t * xbee)
+{
+    assert(xbee);
+
+    memset(xbee->at_cache, 0, sizeof(xbee->at_cache));
+    xbee->at_cache_next = 0;
+}
+
+int xbee_at_command(xbee_interface_t * xbee, 
         uint8_t frame_id, char * at_command, 
         size_t param_size, const void * param)
 {
-    uint8_t accum;
-    int ret = xbee_start_frame(xbee, 4+param_size, &accum);
+    int ret = xbee_write_at_frame(xbee, XBEE_AT_COMMAND, 
+            frame_id, at_command, param_size, param);
     if(ret != 0)
     {
-        return ret;
+        return xbee_track_frame_id(xbee, frame_id, ret);
     }
 
-    uint8_t buf[4];
-    buf[0] = XBEE_AT_QUEUE_PARAMETER;
-    buf[1] = frame_id;
-    buf[2] = at_command[0];
-    buf[3] = at_command[1];
+    /* Any AT command frame applies queued values, as AC does */
+    xbee_at_cache_applied(xbee, frame_id);
 
-    ret = xbee_write_bytes(xbee, sizeof(buf), buf, &accum);
-    if(ret != 0)
+    if(xbee_at_cache_flushes(at_command))
     {
-        return ret;
+        xbee_at_cache_flush(xbee);
+    }
+    else if(param_size > 0)
+    {
+        if(frame_id != 0 && param_size <= XBEE_MAX_AT_PARAM && 
+           !xbee_at_cache_uncacheable(at_command))
+        {
+            /* Value is known to be current once the XBee OK's the write */
+            xbee_at_cache_entry_t * e = xbee_at_cache_get(xbee, at_command);
+            e->flags = XBEE_AT_CACHE_WRITE;
+            e->frame_id = frame_id;
+            e->value_size = param_size;
+            memcpy(e->value, param, param_size);
+        }
+        else
+        {
+            xbee_at_cache_invalidate(xbee, at_command);
+        }
     }
 
-    ret = xbee_write_bytes(xbee, param_size, param, &accum);
+    return xbee_track_frame_id(xbee, frame_id, ret);
+}
+
+int xbee_at_queue_parameter(xbee_interface_t * xbee, 
+        uint8_t frame_id, char * at_command, 
+        size_t param_size, const void * param)
+{
+    int ret = xbee_write_at_frame(xbee, XBEE_AT_QUEUE_PARAMETER, 
+            frame_id, at_command, param_size, param);
+    if(ret == 0 && param_size > 0)
+    {
+        /* Queued value takes effect at some later AC, value is unknown until then */
+        xbee_at_cache_entry_t * e = xbee_at_cache_get(xbee, at_command);
+        e->flags = XBEE_AT_CACHE_QUEUED;
+        e->frame_id = 0;
+    }
+
+    return xbee_track_frame_id(xbee, frame_id, ret);
+}
+
+int xbee_at_cached(xbee_interface_t * xbee, char * at_command, bool refresh,
+        size_t value_out_size, void * value_out)
+{
+    assert(xbee);
+    assert(at_command);
+    assert(value_out || value_out_size == 0);
+
+    xbee_at_cache_entry_t * e = xbee_at_cache_find(xbee, at_command);
+    if(e != NULL && !refresh && (e->flags & XBEE_AT_CACHE_VALID))
+    {
+        if(e->value_size > value_out_size)
+        {
+            return XBEE_ERR_TOO_LARGE;
+        }
+
+        memcpy(value_out, e->value, e->value_size);
+        return e->value_size;
+    }
+
+    if(e != NULL && (e->flags & (XBEE_AT_CACHE_WRITE | XBEE_AT_CACHE_QUERY)) != 0)
+    {
+        /* Response already on its way */
+        return XBEE_ERR_CACHE_MISS;
+    }
+
+    uint8_t frame_id = xbee_alloc_frame_id(xbee);
+    if(frame_id == 0)
+    {
+        return XBEE_ERR_NOT_READY;
+    }
+
+    int ret = xbee_at_command(xbee, frame_id, at_command, 0, NULL);
     if(ret != 0)
     {
         return ret;
     }
 
-    return xbee_finish_frame(xbee, accum);
+    e = xbee_at_cache_get(xbee, at_command);
+    e->flags = XBEE_AT_CACHE_QUERY | (e->flags & XBEE_AT_CACHE_SAVED);
+    e->frame_id = frame_id;
+
+    return XBEE_ERR_CACHE_MISS;
 }
 
-int xbee_remote_at_command(xbee_interface_t * xbee, 
+static int xbee_write_remote_at_command(xbee_interface_t * xbee, 
+        const xbee_address_t * address, uint8_t options,
+        uint8_t frame_id, char * at_command, 
+        size_t param_size, const void * param) SPECIAL_SECTION;
+static int xbee_write_remote_at_command(xbee_interface_t * xbee, 
         const xbee_address_t * address, uint8_t options,
         uint8_t frame_id, char * at_command, 
         size_t param_size, const void * param)
@@ -717,14 +1148,32 @@ int xbee_remote_at_command(xbee_interface_t * xbee,
     return xbee_finish_frame(xbee, accum);
 }
 
-int xbee_transmit(xbee_interface_t * xbee, uint8_t frame_id, 
-        const xbee_address_t * address, uint8_t option, 
-        size_t data_size, const void * data)
+int xbee_remote_at_command(xbee_interface_t * xbee, 
+        const xbee_address_t * address, uint8_t options,
+        uint8_t frame_id, char * at_command, 
+        size_t param_size, const void * param)
+{
+    if(xbee->state != XBEE_STATE_READY)
+    {
+        return xbee_track_frame_id(xbee, frame_id, XBEE_ERR_NOT_READY);
+    }
+
+    int ret = xbee_write_remote_at_command(xbee, address, options, 
+            frame_id, at_command, param_size, param);
+    return xbee_track_frame_id(xbee, frame_id, ret);
+}
+
+/*! Fills buf with the transmit frame header for address
+ *
+ * \return Header size, or 0 for an address type without a transmit frame
+ */
+static size_t xbee_transmit_header(uint8_t buf[XBEE_TRANSMIT_HEADER_SIZE], uint8_t frame_id, 
+        const xbee_address_t * address, uint8_t option) SPECIAL_SECTION;
+static size_t xbee_transmit_header(uint8_t buf[XBEE_TRANSMIT_HEADER_SIZE], uint8_t frame_id, 
+        const xbee_address_t * address, uint8_t option)
 {
-    uint8_t accum;
     if(address->type == XBEE_16_BIT || address->type == XBEE_16_BIT_BROADCAST)
     {
-        uint8_t buf[5];
         buf[0] = XBEE_TRANSMIT_16_BIT;
         buf[1] = frame_id;
 
@@ -740,22 +1189,10 @@ int xbee_transmit(xbee_interface_t * xbee, uint8_t frame_id,
         }
 
         buf[4] = option;
-
-        int ret = xbee_start_frame(xbee, sizeof(buf)+data_size, &accum);
-        if(ret != 0)
-        {
-            return ret;
-        }
-
-        ret = xbee_write_bytes(xbee, sizeof(buf), buf, &accum);
-        if(ret != 0)
-        {
-            return ret;
-        }
+        return 5;
     }
     else if(address->type == XBEE_64_BIT || address->type == XBEE_64_BIT_BROADCAST)
     {
-        uint8_t buf[11];
         buf[0] = XBEE_TRANSMIT;
         buf[1] = frame_id;
 
@@ -778,29 +1215,152 @@ int xbee_transmit(xbee_interface_t * xbee, uint8_t frame_id,
         }
 
         buf[10] = option;
+        return 11;
+    }
+
+    return 0;
+}
 
-        int ret = xbee_start_frame(xbee, sizeof(buf)+data_size, &accum);
+static int xbee_write_transmit(xbee_interface_t * xbee, uint8_t frame_id, 
+        const xbee_address_t * address, uint8_t option, 
+        size_t count, const xbee_buffer_t * buffers) SPECIAL_SECTION;
+static int xbee_write_transmit(xbee_interface_t * xbee, uint8_t frame_id, 
+        const xbee_address_t * address, uint8_t option, 
+        size_t count, const xbee_buffer_t * buffers)
+{
+    size_t data_size = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        data_size += buffers[i].size;
+    }
+
+    uint8_t accum;
+    uint8_t buf[XBEE_TRANSMIT_HEADER_SIZE];
+    size_t header_size = xbee_transmit_header(buf, frame_id, address, option);
+    if(header_size > 0)
+    {
+        int ret = xbee_start_frame(xbee, header_size+data_size, &accum);
         if(ret != 0)
         {
             return ret;
         }
 
-        ret = xbee_write_bytes(xbee, sizeof(buf), buf, &accum);
+        ret = xbee_write_bytes(xbee, header_size, buf, &accum);
         if(ret != 0)
         {
             return ret;
         }
     }
 
-    int ret = xbee_write_bytes(xbee, data_size, data, &accum);
-    if(ret != 0)
+    for(size_t i = 0; i < count; ++i)
     {
-        return ret;
+        int ret = xbee_write_bytes(xbee, buffers[i].size, buffers[i].data, &accum);
+        if(ret != 0)
+        {
+            return ret;
+        }
     }
 
     return xbee_finish_frame(xbee, accum);
 }
 
+int xbee_transmit_gather(xbee_interface_t * xbee, uint8_t frame_id, 
+        const xbee_address_t * address, uint8_t option, 
+        size_t count, const xbee_buffer_t * buffers)
+{
+    assert(count == 0 || buffers);
+
+    if(xbee->state != XBEE_STATE_READY)
+    {
+        return xbee_track_frame_id(xbee, frame_id, XBEE_ERR_NOT_READY);
+    }
+
+    int ret = xbee_write_transmit(xbee, frame_id, address, option, count, buffers);
+    if(ret == 0)
+    {
+        xbee->stats.tx_frames += 1;
+        for(size_t i = 0; i < count; ++i)
+        {
+            xbee->stats.tx_bytes += buffers[i].size;
+        }
+    }
+
+    return xbee_track_frame_id(xbee, frame_id, ret);
+}
+
+int xbee_transmit(xbee_interface_t * xbee, uint8_t frame_id, 
+        const xbee_address_t * address, uint8_t option, 
+        size_t data_size, const void * data)
+{
+    xbee_buffer_t buffer = { data_size, data };
+    return xbee_transmit_gather(xbee, frame_id, address, option, 1, &buffer);
+}
+
+int xbee_encode_transmit(xbee_encoded_frame_t * encoded, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t data_size, const void * data)
+{
+    assert(encoded);
+    assert(address);
+    assert(data || data_size == 0);
+
+    if(data_size > XBEE_MAX_RF_PAYLOAD)
+    {
+        return XBEE_ERR_TOO_LARGE;
+    }
+
+    uint8_t header[XBEE_TRANSMIT_HEADER_SIZE];
+    size_t header_size = xbee_transmit_header(header, frame_id, address, option);
+    assert(header_size > 0);
+
+    uint8_t length[2];
+    length[0] = (header_size + data_size) >> 8;
+    length[1] = (header_size + data_size) & 0xFF;
+
+    uint8_t accum = 0;
+    size_t size = 0;
+    encoded->data[size++] = XBEE_FRAME_DELIM;
+    size += xbee_escape_bytes(encoded->data + size, sizeof(length), length, &accum);
+
+    /* Checksum covers the frame data only */
+    accum = 0;
+    size += xbee_escape_bytes(encoded->data + size, header_size, header, &accum);
+    size += xbee_escape_bytes(encoded->data + size, data_size, data, &accum);
+
+    uint8_t checksum = 0xFF - accum;
+    size += xbee_escape_bytes(encoded->data + size, 1, &checksum, &accum);
+
+    encoded->frame_id = frame_id;
+    encoded->payload_size = data_size;
+    encoded->size = size;
+    return 0;
+}
+
+int xbee_transmit_encoded(xbee_interface_t * xbee, const xbee_encoded_frame_t * encoded)
+{
+    assert(xbee);
+    assert(encoded);
+
+    if(xbee->state != XBEE_STATE_READY)
+    {
+        return xbee_track_frame_id(xbee, encoded->frame_id, XBEE_ERR_NOT_READY);
+    }
+
+    int ret = write(encoded->data, encoded->size);
+    if(ret == encoded->size)
+    {
+        ret = 0;
+        xbee->stats.tx_frames += 1;
+        xbee->stats.tx_bytes += encoded->payload_size;
+    }
+    else if(ret >= 0)
+    {
+        ret = -13;
+    }
+
+    return xbee_track_frame_id(xbee, encoded->frame_id, ret);
+}
+
 int xbee_parse_frame(xbee_parsed_frame_t * parsed_frame,
         size_t frame_size, const void * frame)
 {
@@ -869,7 +1429,7 @@ int xbee_parse_frame(xbee_parsed_frame_t * parsed_frame,
         addr = 0;
         for(size_t i = 0; i < 8; ++i)
         {
-            addr |= b[2+i] << (64-8*(i-1));
+            addr |= (uint64_t)b[2+i] << (64-8*(i+1));
         }
         parsed_frame->frame.at_command_response.responder_address = addr;
 
@@ -897,7 +1457,7 @@ int xbee_parse_frame(xbee_parsed_frame_t * parsed_frame,
         addr = 0;
         for(size_t i = 0; i < 8; ++i)
         {
-            addr |= b[1+i] << (64-8*(i-1));
+            addr |= (uint64_t)b[1+i] << (64-8*(i+1));
         }
         parsed_frame->frame.receive.responder_address = addr;
 
@@ -916,7 +1476,7 @@ int xbee_parse_frame(xbee_parsed_frame_t * parsed_frame,
         }
 
         parsed_frame->frame.receive.responder_network_address = b[1] << 8;
-        parsed_frame->frame.receive.responder_network_address = b[2];
+        parsed_frame->frame.receive.responder_network_address |= b[2];
 
         parsed_frame->frame.receive.rssi = b[3];
         parsed_frame->frame.receive.options = b[4];
@@ -930,3 +1490,464 @@ int xbee_parse_frame(xbee_parsed_frame_t * parsed_frame,
         return XBEE_UNKNOWN_API_ID;
     }
 }
+
+void xbee_add_handler(xbee_interface_t * xbee, xbee_handler_t * handler)
+{
+    assert(xbee);
+    assert(handler);
+
+    xbee_handler_t ** h = &xbee->handlers;
+    while(*h != NULL)
+    {
+        assert(*h != handler);
+        h = &(*h)->next;
+    }
+
+    handler->next = NULL;
+    *h = handler;
+}
+
+void xbee_add_observer(xbee_interface_t * xbee, xbee_handler_t * handler)
+{
+    assert(xbee);
+    assert(handler);
+
+    for(xbee_handler_t * h = xbee->handlers; h != NULL; h = h->next)
+    {
+        assert(h != handler);
+    }
+
+    handler->next = xbee->handlers;
+    xbee->handlers = handler;
+}
+
+void xbee_remove_handler(xbee_interface_t * xbee, xbee_handler_t * handler)
+{
+    assert(xbee);
+    assert(handler);
+
+    for(xbee_handler_t ** h = &xbee->handlers; *h != NULL; h = &(*h)->next)
+    {
+        if(*h == handler)
+        {
+            *h = handler->next;
+            handler->next = NULL;
+            return;
+        }
+    }
+}
+
+uint8_t xbee_alloc_frame_id(xbee_interface_t * xbee)
+{
+    assert(xbee);
+
+    for(size_t i = 0; i < 255; ++i)
+    {
+        uint8_t frame_id = xbee->next_frame_id;
+
+        xbee->next_frame_id += 1;
+        if(xbee->next_frame_id == 0)
+        {
+            xbee->next_frame_id = 1;
+        }
+
+        if(frame_id != 0 && !xbee_frame_id_test(xbee->pending, frame_id))
+        {
+            xbee_frame_id_set(xbee->pending, frame_id);
+            return frame_id;
+        }
+    }
+
+    return 0;
+}
+
+void xbee_free_frame_id(xbee_interface_t * xbee, uint8_t frame_id)
+{
+    assert(xbee);
+
+    xbee_release_frame_id(xbee, frame_id);
+}
+
+void xbee_set_restore_settings(xbee_interface_t * xbee, 
+        size_t count, const xbee_at_setting_t * settings)
+{
+    assert(xbee);
+    assert(count == 0 || settings);
+
+    xbee->restore_count = count;
+    xbee->restore = settings;
+}
+
+static void xbee_fail_frame_id(xbee_interface_t * xbee, uint8_t frame_id, int reason) SPECIAL_SECTION;
+static void xbee_fail_frame_id(xbee_interface_t * xbee, uint8_t frame_id, int reason)
+{
+    xbee_release_frame_id(xbee, frame_id);
+    xbee_at_cache_forget(xbee, frame_id,
+            XBEE_AT_CACHE_WRITE | XBEE_AT_CACHE_QUERY | XBEE_AT_CACHE_QUEUED);
+
+    xbee_handler_t * next;
+    for(xbee_handler_t * h = xbee->handlers; h != NULL; h = next)
+    {
+        next = h->next;
+        if(h->failed)
+        {
+            h->failed(h->ptr, xbee, frame_id, reason);
+        }
+    }
+}
+
+/*! Sends settings without waiting for the responses */
+static int xbee_apply_settings(xbee_interface_t * xbee, 
+        size_t count, const xbee_at_setting_t * settings) SPECIAL_SECTION;
+static int xbee_apply_settings(xbee_interface_t * xbee, 
+        size_t count, const xbee_at_setting_t * settings)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        uint8_t frame_id = xbee_alloc_frame_id(xbee);
+        if(frame_id == 0)
+        {
+            return XBEE_ERR_NOT_READY;
+        }
+
+        xbee_frame_id_set(xbee->recovery, frame_id);
+
+        char at_command[2] = {settings[i].at_command[0], settings[i].at_command[1]};
+        int ret = xbee_at_command(xbee, frame_id, at_command, 
+                settings[i].param_size, settings[i].param);
+        if(ret != 0)
+        {
+            xbee_frame_id_clear(xbee->recovery, frame_id);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+/*! Recovers from XBee reset
+ *
+ * Unlike xbee_init, the XBee is already talking API mode (otherwise
+ * XBEE_MODEM_STATUS would not have been received), so settings are 
+ * re-applied with AT command frames and no guard times.  All frames are
+ * written back to back and the responses are checked by xbee_poll.
+ */
+static int xbee_recover(xbee_interface_t * xbee) SPECIAL_SECTION;
+static int xbee_recover(xbee_interface_t * xbee)
+{
+    /* XBee will never respond to frames sent before the reset */
+    for(size_t frame_id = 1; frame_id < 256; ++frame_id)
+    {
+        if(xbee_frame_id_test(xbee->pending, frame_id))
+        {
+            xbee_fail_frame_id(xbee, frame_id, XBEE_FAIL_MODULE_RESET);
+        }
+    }
+
+    memset(xbee->recovery, 0, sizeof(xbee->recovery));
+    xbee_at_cache_flush(xbee);
+    xbee->state = XBEE_STATE_RECOVERING;
+    xbee->stats.resets += 1;
+
+    static const xbee_at_setting_t api_settings[] = {
+        { {'A', 'P'}, 1, {2} },
+        { {'D', '7'}, 1, {1} },
+        { {'D', '6'}, 1, {1} },
+    };
+
+    int ret = xbee_apply_settings(xbee, 
+            sizeof(api_settings)/sizeof(api_settings[0]), api_settings);
+    if(ret == 0)
+    {
+        ret = xbee_apply_settings(xbee, xbee->restore_count, xbee->restore);
+    }
+
+    if(ret != 0)
+    {
+        xbee->state = XBEE_STATE_FAILED;
+    }
+
+    return ret;
+}
+
+static bool xbee_bitmap_empty(const uint8_t * bitmap)
+{
+    for(size_t i = 0; i < XBEE_FRAME_ID_BITMAP_SIZE; ++i)
+    {
+        if(bitmap[i] != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void xbee_frame_timeout(void * ptr, xbee_timer_t * timer) SPECIAL_SECTION;
+static void xbee_frame_timeout(void * ptr, xbee_timer_t * timer)
+{
+    xbee_interface_t * xbee = ptr;
+    uint8_t frame_id = timer - xbee->frame_timers;
+
+    /* Recovery cannot complete without this setting */
+    if(xbee_frame_id_test(xbee->recovery, frame_id))
+    {
+        xbee_frame_id_clear(xbee->recovery, frame_id);
+        xbee->state = XBEE_STATE_FAILED;
+    }
+
+    xbee_fail_frame_id(xbee, frame_id, XBEE_FAIL_TIMEOUT);
+}
+
+void xbee_set_frame_timeout(xbee_interface_t * xbee, xbee_timer_wheel_t * timers,
+        uint32_t timeout, xbee_timer_t * frame_timers)
+{
+    assert(xbee);
+    assert(timers == NULL || frame_timers);
+    assert(timers == NULL || xbee->uart->clock);
+
+    if(xbee->timers)
+    {
+        for(size_t frame_id = 0; frame_id < 256; ++frame_id)
+        {
+            xbee_timer_cancel(xbee->timers, &xbee->frame_timers[frame_id]);
+        }
+    }
+
+    xbee->timers = timers;
+    xbee->frame_timeout = timeout;
+    xbee->frame_timers = frame_timers;
+
+    if(timers == NULL)
+    {
+        return;
+    }
+
+    /* Frames already outstanding get a full timeout from now */
+    uint32_t deadline = xbee_now(xbee) + timeout;
+    for(size_t frame_id = 0; frame_id < 256; ++frame_id)
+    {
+        xbee_timer_init(&frame_timers[frame_id], xbee_frame_timeout, xbee);
+        if(frame_id != 0 && xbee_frame_id_test(xbee->pending, frame_id))
+        {
+            xbee_timer_start(timers, &frame_timers[frame_id], deadline);
+        }
+    }
+}
+
+uint32_t xbee_now(const xbee_interface_t * xbee)
+{
+    assert(xbee);
+    assert(xbee->uart->clock);
+
+    return xbee->uart->clock(xbee->uart->clock_ptr);
+}
+
+uint32_t xbee_virtual_clock_now(void * ptr)
+{
+    const xbee_virtual_clock_t * clock = ptr;
+
+    assert(clock);
+    return clock->now;
+}
+
+void xbee_virtual_clock_sleep(void * ptr, uint32_t ms)
+{
+    xbee_virtual_clock_t * clock = ptr;
+
+    assert(clock);
+    clock->now += ms;
+}
+
+bool xbee_idle(const xbee_interface_t * xbee)
+{
+    assert(xbee);
+    return xbee->state == XBEE_STATE_READY && xbee_bitmap_empty(xbee->pending);
+}
+
+int xbee_poll(xbee_interface_t * xbee, size_t frame_out_size, void * frame_out, 
+        xbee_parsed_frame_t * parsed_frame)
+{
+    assert(xbee);
+    assert(parsed_frame);
+
+    if(xbee->timers)
+    {
+        xbee_timer_run(xbee->timers, xbee_now(xbee));
+    }
+
+    /* UART carries a raw byte stream, not frames */
+    if(xbee->state == XBEE_STATE_TRANSPARENT)
+    {
+        return 0;
+    }
+
+    int frame_size = xbee_recv_frame(xbee, frame_out_size, frame_out);
+    if(frame_size <= 0)
+    {
+        return frame_size;
+    }
+
+    int ret = xbee_parse_frame(parsed_frame, frame_size, frame_out);
+    if(ret == XBEE_UNKNOWN_API_ID)
+    {
+        /* Caller may understand frames this library does not */
+        return frame_size;
+    }
+    else if(ret != 0)
+    {
+        return 0;
+    }
+
+    switch(parsed_frame->api_id)
+    {
+    case XBEE_MODEM_STATUS:
+        if(parsed_frame->frame.status == XBEE_MODEM_HARDWARE_RESET ||
+           parsed_frame->frame.status == XBEE_MODEM_WATCHDOG_RESET)
+        {
+            ret = xbee_recover(xbee);
+            if(ret != 0)
+            {
+                return ret;
+            }
+        }
+        break;
+    case XBEE_AT_RESPONSE:
+        xbee_at_cache_response(xbee, parsed_frame);
+
+        if(parsed_frame->frame_id != 0 && 
+           xbee_frame_id_test(xbee->recovery, parsed_frame->frame_id))
+        {
+            xbee_release_frame_id(xbee, parsed_frame->frame_id);
+            xbee_frame_id_clear(xbee->recovery, parsed_frame->frame_id);
+
+            if(parsed_frame->frame.at_command_response.status != 0)
+            {
+                xbee->state = XBEE_STATE_FAILED;
+            }
+            else if(xbee->state == XBEE_STATE_RECOVERING && 
+                    xbee_bitmap_empty(xbee->recovery))
+            {
+                xbee->state = XBEE_STATE_READY;
+            }
+
+            return 0;
+        }
+        /* Fall through */
+    case XBEE_REMOTE_AT_RESPONSE:
+        if(parsed_frame->frame_id != 0)
+        {
+            xbee_release_frame_id(xbee, parsed_frame->frame_id);
+        }
+        break;
+    case XBEE_TRANSMIT_STATUS:
+        if(parsed_frame->frame.status != 0)
+        {
+            xbee->stats.tx_failures += 1;
+        }
+
+        if(parsed_frame->frame_id != 0)
+        {
+            xbee_release_frame_id(xbee, parsed_frame->frame_id);
+        }
+        break;
+    case XBEE_RECEIVE:
+    case XBEE_RECEIVE_16_BIT:
+        xbee->stats.rx_frames += 1;
+        xbee->stats.rx_bytes += parsed_frame->frame.receive.packet_size;
+        break;
+    default:
+        break;
+    }
+
+    xbee_handler_t * next;
+    for(xbee_handler_t * h = xbee->handlers; h != NULL; h = next)
+    {
+        next = h->next;
+        if(h->frame && h->frame(h->ptr, xbee, parsed_frame))
+        {
+            return 0;
+        }
+    }
+
+    return frame_size;
+}
+
+int xbee_frame_source(const xbee_parsed_frame_t * frame, xbee_address_t * source)
+{
+    assert(frame);
+    assert(source);
+
+    memset(source, 0, sizeof(*source));
+    if(frame->api_id == XBEE_RECEIVE_16_BIT)
+    {
+        source->type = XBEE_16_BIT;
+        source->addr.network_address = frame->frame.receive.responder_network_address;
+    }
+    else if(frame->api_id == XBEE_RECEIVE)
+    {
+        source->type = XBEE_64_BIT;
+        source->addr.address = frame->frame.receive.responder_address;
+    }
+    else
+    {
+        return XBEE_UNKNOWN_API_ID;
+    }
+
+    return 0;
+}
+
+int xbee_parse_io_sample(xbee_io_sample_t * sample, size_t data_size, const void * data)
+{
+    assert(sample);
+    assert(data || data_size == 0);
+
+    const uint8_t * b = data;
+    if(data_size < 3 || b[0] == 0)
+    {
+        return XBEE_WRONG_LENGTH_FOR_API;
+    }
+
+    memset(sample, 0, sizeof(*sample));
+
+    uint16_t channels = b[1] << 8 | b[2];
+    sample->digital_mask = channels & 0x1FF;
+    sample->analog_mask = (channels >> 9) & 0x3F;
+
+    size_t expected = 3;
+    if(sample->digital_mask != 0)
+    {
+        expected += 2;
+    }
+
+    for(size_t i = 0; i < 6; ++i)
+    {
+        if(sample->analog_mask & (1 << i))
+        {
+            expected += 2;
+        }
+    }
+
+    if(data_size < expected)
+    {
+        return XBEE_WRONG_LENGTH_FOR_API;
+    }
+
+    size_t idx = 3;
+    if(sample->digital_mask != 0)
+    {
+        sample->digital = (b[idx] << 8 | b[idx+1]) & sample->digital_mask;
+        idx += 2;
+    }
+
+    for(size_t i = 0; i < 6; ++i)
+    {
+        if(sample->analog_mask & (1 << i))
+        {
+            sample->analog[i] = (b[idx] << 8 | b[idx+1]) & 0x3FF;
+            idx += 2;
+        }
+    }
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #ifndef _XBEE_H_
 #define _XBEE_H_
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -15,6 +16,8 @@
 typedef int (*xbee_write_fun_t)(void * ptr, const void *buf, size_t nbyte);
 typedef int (*xbee_read_fun_t)(void * ptr, void *buf, size_t nbyte);
 typedef unsigned (*xbee_sleep_t)(unsigned sec);
+typedef uint32_t (*xbee_clock_t)(void * ptr);
+typedef void (*xbee_sleep_ms_t)(void * ptr, uint32_t ms);
 
 /*! xbee_uart_interface_t provides an abstration to a uart interface
  *
@@ -22,15 +25,125 @@ typedef unsigned (*xbee_sleep_t)(unsigned sec);
  * xbee_uart_interface_t assumes nonblocking reads and writes
  * xbee_uart_interface_t assumes that the UART and XBee initially share the same baud rate
  *
+ * All waiting done by the library goes through sleep_ms (or sleep if sleep_ms 
+ * is NULL), and xbee_now reads clock.  A simulator can provide both in virtual 
+ * time (see xbee_virtual_clock_t) so guard times and timeouts take no real time.
+ * clock_ptr is separate from ptr so several XBees can share one clock.
+ *
  * */
 typedef struct {
     void * ptr;
 
     xbee_write_fun_t write;             /*! Write bytes to UART, conform to posix write interface */
     xbee_read_fun_t read;               /*! Read bytes from UART, conform to posix read interface */
-    xbee_sleep_t sleep;
+    xbee_sleep_t sleep;                 /*! Sleep seconds, used if sleep_ms is NULL */
+
+    void * clock_ptr;
+    xbee_clock_t clock;                 /*! Milliseconds from a monotonic clock, wraps */
+    xbee_sleep_ms_t sleep_ms;           /*! Optional, sleep milliseconds */
 } xbee_uart_interface_t;
 
+/*! Clock that only moves when slept on, for simulations
+ *
+ * Set clock_ptr to the xbee_virtual_clock_t, clock to xbee_virtual_clock_now
+ * and sleep_ms to xbee_virtual_clock_sleep.
+ */
+typedef struct {
+    uint32_t now;
+} xbee_virtual_clock_t;
+
+uint32_t xbee_virtual_clock_now(void * ptr) SPECIAL_SECTION;
+void xbee_virtual_clock_sleep(void * ptr, uint32_t ms) SPECIAL_SECTION;
+
+#ifndef XBEE_MAX_AT_PARAM
+#define XBEE_MAX_AT_PARAM 8
+#endif /* XBEE_MAX_AT_PARAM */
+
+/*! Volatile AT setting that is re-applied after the XBee resets
+ *
+ * Settings applied without ATWR are lost when the XBee resets, so the 
+ * library re-applies every setting in this table once the XBee reports
+ * (via XBEE_MODEM_STATUS) that it has come back up.
+ */
+typedef struct {
+    char at_command[2];
+    uint8_t param_size;
+    uint8_t param[XBEE_MAX_AT_PARAM];
+} xbee_at_setting_t;
+
+#ifndef XBEE_AT_CACHE_SIZE
+#define XBEE_AT_CACHE_SIZE 16
+#endif /* XBEE_AT_CACHE_SIZE */
+
+#define XBEE_AT_CACHE_VALID (0x01)  /*! value is the XBee's current value */
+#define XBEE_AT_CACHE_WRITE (0x02)  /*! value was written, awaiting response to frame_id */
+#define XBEE_AT_CACHE_QUERY (0x04)  /*! value was queried, awaiting response to frame_id */
+#define XBEE_AT_CACHE_QUEUED (0x08) /*! a value was queued, unknown until applied */
+#define XBEE_AT_CACHE_SAVED (0x10)  /*! value is in non-volatile memory too, it was valid
+                                        when the XBee OK'd a WR and is unchanged since */
+
+/*! Cached value of a local AT parameter, entry is unused when flags is 0 */
+typedef struct {
+    char at_command[2];
+    uint8_t flags;
+    uint8_t frame_id;
+    uint8_t value_size;
+    uint8_t value[XBEE_MAX_AT_PARAM];
+} xbee_at_cache_entry_t;
+
+typedef enum {
+    XBEE_STATE_READY,       /*! XBee is configured and accepts traffic */
+    XBEE_STATE_RECOVERING,  /*! XBee reset, settings are being re-applied */
+    XBEE_STATE_FAILED,      /*! XBee rejected a setting during recovery, xbee_open is required */
+    XBEE_STATE_TRANSPARENT, /*! XBee is in transparent mode (AP 0), see xbee_transparent_t */
+} xbee_state_t;
+
+/*! Radio health counters, as reported by the XBee */
+typedef struct {
+    uint8_t valid;          /*! XBEE_HEALTH_* bits of fields that have been read */
+    uint8_t rssi;           /*! DB, -dBm of last received packet */
+    uint16_t cca_failures;  /*! EC, clear channel assessment failures */
+    uint16_t ack_failures;  /*! EA, transmissions without MAC ACK */
+    int16_t temperature;    /*! TP, degrees C */
+    uint16_t voltage;       /*! %V, supply voltage in the XBee's units */
+    uint32_t updated;       /*! Time of the last field update */
+} xbee_health_t;
+
+#define XBEE_HEALTH_RSSI        (0x01)
+#define XBEE_HEALTH_CCA         (0x02)
+#define XBEE_HEALTH_ACK         (0x04)
+#define XBEE_HEALTH_TEMPERATURE (0x08)
+#define XBEE_HEALTH_VOLTAGE     (0x10)
+
+/*! Traffic counters maintained by the library */
+typedef struct {
+    uint32_t tx_frames;     /*! Frames written with xbee_transmit */
+    uint32_t tx_bytes;      /*! Payload bytes written with xbee_transmit */
+    uint32_t tx_failures;   /*! XBEE_TRANSMIT_STATUS with non-zero status */
+    uint32_t rx_frames;     /*! XBEE_RECEIVE and XBEE_RECEIVE_16_BIT seen by xbee_poll */
+    uint32_t rx_bytes;
+    uint32_t resets;        /*! XBee resets recovered from */
+
+    xbee_health_t health;   /*! Local radio, see xbee_health_poller_t */
+} xbee_stats_t;
+
+typedef struct xbee_handler xbee_handler_t;
+typedef struct xbee_timer xbee_timer_t;
+typedef struct xbee_timer_wheel xbee_timer_wheel_t;
+
+#define XBEE_FRAME_ID_BITMAP_SIZE (256/8)
+
+/*! Reads remembered to time frame arrivals, see xbee_interface_t::rx_time */
+#ifndef XBEE_FILL_RECORDS
+#define XBEE_FILL_RECORDS 8
+#endif /* XBEE_FILL_RECORDS */
+
+/*! Bytes read by one xbee_fill_buffer and when */
+typedef struct {
+    uint32_t time;
+    uint32_t size;
+} xbee_fill_record_t;
+
 typedef struct {
     xbee_uart_interface_t * uart;
 
@@ -38,12 +151,43 @@ typedef struct {
     uint8_t * recv;
     size_t recv_idx;
     size_t recv_size;
+
+    xbee_state_t state;
+    uint8_t next_frame_id;
+    uint8_t pending[XBEE_FRAME_ID_BITMAP_SIZE];     /*! Frame ids awaiting a response */
+    uint8_t recovery[XBEE_FRAME_ID_BITMAP_SIZE];    /*! Frame ids sent by reset recovery */
+
+    size_t restore_count;
+    const xbee_at_setting_t * restore;
+
+    xbee_handler_t * handlers;
+
+    size_t at_cache_next;   /*! Next entry to evict when at_cache is full */
+    xbee_at_cache_entry_t at_cache[XBEE_AT_CACHE_SIZE];
+
+    xbee_timer_wheel_t * timers;    /*! Run by xbee_poll, see xbee_set_frame_timeout */
+    uint32_t frame_timeout;
+    xbee_timer_t * frame_timers;
+
+    xbee_stats_t stats;
+
+    /*! While a clock is set, xbee_fill_buffer records each read so the
+     * frames decoded from it can be given the time their last byte was
+     * read, rather than when the caller got around to them.  rx_time is
+     * that time for the frame last returned by xbee_recv_frame (and so
+     * the frame xbee_poll is passing to handlers). */
+    xbee_fill_record_t fills[XBEE_FILL_RECORDS];
+    size_t fill_next;
+    uint32_t rx_time;
 } xbee_interface_t;
 
 
 #define XBEE_REC_BUF_SIZE (234)
 #define XBEE_MAX_FRAME_SIZE (117)
 
+/*! Largest RF payload of a Series 1 (802.15.4) XBee */
+#define XBEE_MAX_RF_PAYLOAD (100)
+
 /*! Opens XBee via provided uart interface
  *
  * \param[out] xbee New structure to xbee
@@ -122,6 +266,19 @@ int xbee_remote_at_command(xbee_interface_t * xbee,
         const xbee_address_t * address, uint8_t options,
         uint8_t frame_id, char * at_command, size_t param_size, const void * param) SPECIAL_SECTION;
 
+/*! xbee_remote_at_command options */
+#define XBEE_REMOTE_APPLY_CHANGES (0x02) /*! Apply change immediately, otherwise queue until AC */
+
+/*! Returned by xbee_transmit and xbee_remote_at_command while the XBee 
+ * is not in XBEE_STATE_READY.  Caller should hold the traffic and retry 
+ * once xbee_poll reports the XBee has recovered.  The frame id is
+ * released, as on any failed write, so allocate a new one for the retry.
+ */
+#define XBEE_ERR_NOT_READY      (-15)
+
+#define XBEE_ERR_CACHE_MISS     (-16)
+#define XBEE_ERR_TOO_LARGE      (-17)
+
 #define XBEE_DISABLE_ACK        (0x01)
 #define XBEE_BROADCAST_PAN_ID   (0x04)
 
@@ -132,6 +289,50 @@ int xbee_remote_at_command(xbee_interface_t * xbee,
  * */
 int xbee_transmit(xbee_interface_t * xbee, uint8_t frame_id, const xbee_address_t * address, uint8_t option, size_t data_size, const void * data) SPECIAL_SECTION;
 
+typedef struct {
+    size_t size;
+    const void * data;
+} xbee_buffer_t;
+
+/*! Transmit packet made of several buffers, without copying them together
+ *
+ * Same as xbee_transmit, with the payload being the concatenation of buffers.
+ * */
+int xbee_transmit_gather(xbee_interface_t * xbee, uint8_t frame_id, const xbee_address_t * address, uint8_t option, 
+        size_t count, const xbee_buffer_t * buffers) SPECIAL_SECTION;
+
+/*! Largest transmit frame header, for a 64 bit address */
+#define XBEE_TRANSMIT_HEADER_SIZE (11)
+
+/*! Largest transmit frame once escaped: delimiter, then length, header,
+ * payload and checksum with every byte possibly escaped */
+#define XBEE_MAX_ENCODED_TRANSMIT (1 + 2*(2 + XBEE_TRANSMIT_HEADER_SIZE + XBEE_MAX_RF_PAYLOAD + 1))
+
+/*! Transmit frame framed and escaped ahead of time, so writing it is a
+ * single UART write */
+typedef struct {
+    uint8_t frame_id;
+    uint8_t payload_size;
+    uint16_t size;
+    uint8_t data[XBEE_MAX_ENCODED_TRANSMIT];
+} xbee_encoded_frame_t;
+
+/*! Encodes the frame xbee_transmit would write, without writing it
+ *
+ * \return 0 on success, XBEE_ERR_TOO_LARGE if data is over XBEE_MAX_RF_PAYLOAD
+ */
+int xbee_encode_transmit(xbee_encoded_frame_t * encoded, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t data_size, const void * data) SPECIAL_SECTION;
+
+/*! Writes a frame from xbee_encode_transmit, tracking its frame id like
+ * xbee_transmit
+ *
+ * \return 0 on success, XBEE_ERR_NOT_READY, or <0 if the write failed
+ */
+int xbee_transmit_encoded(xbee_interface_t * xbee,
+        const xbee_encoded_frame_t * encoded) SPECIAL_SECTION;
+
 typedef struct {
     xbee_api_id_t api_id;
     uint8_t frame_id; /* XBEE_MODEM_STATUS, XBEE_TRANSMIT_STATUS, XBEE_AT_RESPONSE, XBEE_REMOTE_AT_RESPONSE */
@@ -172,7 +373,173 @@ typedef struct {
  */
 int xbee_parse_frame(xbee_parsed_frame_t * parsed_frame, size_t frame_size, const void * frame) SPECIAL_SECTION;
 
+/*! Gets source address of XBEE_RECEIVE or XBEE_RECEIVE_16_BIT frame
+ *
+ * \return 0 if frame is a receive frame, XBEE_UNKNOWN_API_ID otherwise
+ */
+int xbee_frame_source(const xbee_parsed_frame_t * frame, xbee_address_t * source) SPECIAL_SECTION;
+
+/*! First IO sample of an XBee IO sample set */
+typedef struct {
+    uint16_t digital_mask;  /*! Bit n set if DIOn is enabled, DIO0-8 */
+    uint8_t analog_mask;    /*! Bit n set if ADn is enabled, AD0-5 */
+    uint16_t digital;       /*! DIO line states */
+    uint16_t analog[6];     /*! 10-bit ADC reading of enabled ADn */
+} xbee_io_sample_t;
+
+/*! Parses IO sample set, as returned by the IS command
+ *
+ * \return 0 if sample was parsed, XBEE_WRONG_LENGTH_FOR_API otherwise
+ */
+int xbee_parse_io_sample(xbee_io_sample_t * sample, size_t data_size, const void * data) SPECIAL_SECTION;
+
 int xbee_decode_frame(xbee_interface_t * xbee, size_t frame_out_size, void * frame_out) SPECIAL_SECTION;
+
+typedef enum {
+    XBEE_MODEM_HARDWARE_RESET = 0x00,
+    XBEE_MODEM_WATCHDOG_RESET = 0x01,
+    XBEE_MODEM_ASSOCIATED = 0x02,
+    XBEE_MODEM_DISASSOCIATED = 0x03,
+    XBEE_MODEM_SYNC_LOST = 0x04,
+    XBEE_MODEM_COORDINATOR_REALIGNMENT = 0x05,
+    XBEE_MODEM_COORDINATOR_STARTED = 0x06,
+} xbee_modem_status_t;
+
+/*! Reasons passed to xbee_handler_t::failed */
+#define XBEE_FAIL_MODULE_RESET (1)
+#define XBEE_FAIL_TIMEOUT (2)       /*! No response within the frame timeout */
+
+/*! Hook into frames dispatched by xbee_poll
+ *
+ * Handlers are called in registration order, after the observers 
+ * registered with xbee_add_observer.  
+ */
+struct xbee_handler {
+    xbee_handler_t * next;
+    void * ptr;
+
+    /*! Called for every parsed frame, return non-zero to consume the frame */
+    int (*frame)(void * ptr, xbee_interface_t * xbee, const xbee_parsed_frame_t * frame);
+
+    /*! Called when the library fails an outstanding frame id without a 
+     * response from the XBee (e.g. XBEE_FAIL_MODULE_RESET) */
+    void (*failed)(void * ptr, xbee_interface_t * xbee, uint8_t frame_id, int reason);
+};
+
+void xbee_add_handler(xbee_interface_t * xbee, xbee_handler_t * handler) SPECIAL_SECTION;
+
+/*! Registers handler ahead of every handler already registered
+ *
+ * For handlers that never consume a frame but must see every one, 
+ * including those a later consuming handler (e.g. xbee_port_mux_t) takes.
+ */
+void xbee_add_observer(xbee_interface_t * xbee, xbee_handler_t * handler) SPECIAL_SECTION;
+void xbee_remove_handler(xbee_interface_t * xbee, xbee_handler_t * handler) SPECIAL_SECTION;
+
+/*! Returns a frame id that is not awaiting a response and marks it pending
+ *
+ * \return Frame id, or 0 if all 255 frame ids are outstanding
+ */
+uint8_t xbee_alloc_frame_id(xbee_interface_t * xbee) SPECIAL_SECTION;
+
+/*! Returns a frame id from xbee_alloc_frame_id that was never written, or
+ * whose response its user has given up on
+ *
+ * A response that still arrives for a given up frame id goes to whoever
+ * holds the id then, so give up only after the XBee's own retries are over.
+ */
+void xbee_free_frame_id(xbee_interface_t * xbee, uint8_t frame_id) SPECIAL_SECTION;
+
+/*! Times out frame ids that get no response
+ *
+ * Every frame id written is given a timer in timers that expires timeout 
+ * ms (per xbee_now) later, and is cancelled by the XBEE_TRANSMIT_STATUS, 
+ * XBEE_AT_RESPONSE or XBEE_REMOTE_AT_RESPONSE for it.  An expired frame id
+ * is failed with XBEE_FAIL_TIMEOUT.  xbee_poll runs timers, so other 
+ * layers may put their own timers on the same wheel.
+ *
+ * frame_timers is an array of 256 timers, indexed by frame id, that must 
+ * remain valid while set.  A NULL timers disables frame timeouts.
+ */
+void xbee_set_frame_timeout(xbee_interface_t * xbee, xbee_timer_wheel_t * timers,
+        uint32_t timeout, xbee_timer_t * frame_timers) SPECIAL_SECTION;
+
+/*! Returns milliseconds from the UART interface's clock, which must be set
+ *
+ * Pass to the now parameter of the layers built on this library.
+ */
+uint32_t xbee_now(const xbee_interface_t * xbee) SPECIAL_SECTION;
+
+/*! Sleeps through the UART interface's sleep_ms, or sleep rounded up to seconds */
+void xbee_sleep_ms(xbee_interface_t * xbee, uint32_t ms) SPECIAL_SECTION;
+
+/*! Returns true if the XBee is ready and no frame id is awaiting a response */
+bool xbee_idle(const xbee_interface_t * xbee) SPECIAL_SECTION;
+
+/*! Sets table of volatile AT settings to re-apply after XBee resets
+ *
+ * AP 2, D7 1 and D6 1 are always re-applied and do not need to be in the table.
+ * settings must remain valid while xbee is open.
+ */
+void xbee_set_restore_settings(xbee_interface_t * xbee, 
+        size_t count, const xbee_at_setting_t * settings) SPECIAL_SECTION;
+
+/*! Receives, parses and dispatches one frame
+ *
+ * Frames are first handled by the library (frame id tracking, reset
+ * recovery), then passed to each handler.  On XBEE_MODEM_STATUS reporting
+ * a hardware or watchdog reset, outstanding frame ids are failed
+ * immediately and the restore settings are re-applied in API mode.
+ * Check xbee->state to learn when the XBee is ready for traffic again.
+ * Nothing is read while xbee->state is XBEE_STATE_TRANSPARENT.
+ *
+ * \param[out] parsed_frame Parsed frame, points into frame_out
+ *
+ * \return >0 indicates frame was read and not consumed, frame_out and parsed_frame are valid
+ *          0 indicates no frame was read, or the frame was consumed
+ *         <0 indicates error reading or writing data
+ */
+int xbee_poll(xbee_interface_t * xbee, size_t frame_out_size, void * frame_out, 
+        xbee_parsed_frame_t * parsed_frame) SPECIAL_SECTION;
+
+/*! Reads local AT parameter from the cache, without a round trip to the XBee
+ *
+ * The cache is filled by XBEE_AT_RESPONSE frames seen by xbee_poll, is
+ * updated by writes made with xbee_at_command, is invalidated by 
+ * xbee_at_queue_parameter and is flushed when the XBee resets.
+ *
+ * The cache holds the values the XBee is running with.  A value queued
+ * with xbee_at_queue_parameter is not cached, nor are responses for it,
+ * until the next xbee_at_command (AC or any other) applies it, after
+ * which it is queried again.  WR saves the running values to non-volatile
+ * memory without changing them, so it leaves the values as they are; once
+ * the XBee OKs a WR sent with a frame id, the values valid at that point
+ * are marked XBEE_AT_CACHE_SAVED.  RE and FR flush the cache.
+ *
+ * On a miss (or when refresh is set), a query is sent to the XBee and 
+ * xbee_poll fills the cache when the response arrives.
+ *
+ * \param refresh Ignore cached value and query the XBee
+ *
+ * \return >=0 size of value copied into value_out
+ *         XBEE_ERR_CACHE_MISS if the value is not cached yet, query is in flight
+ *         XBEE_ERR_TOO_LARGE if value does not fit in value_out
+ *         <0 otherwise, error from sending the query
+ */
+int xbee_at_cached(xbee_interface_t * xbee, char * at_command, bool refresh,
+        size_t value_out_size, void * value_out) SPECIAL_SECTION;
+
+/*! Forgets every cached AT parameter */
+void xbee_at_cache_flush(xbee_interface_t * xbee) SPECIAL_SECTION;
+
+/*! Forgets the cached value of at_command, for changes made other than
+ * through xbee_at_command, e.g. in command mode */
+void xbee_at_cache_invalidate(xbee_interface_t * xbee, const char * at_command) SPECIAL_SECTION;
+
+/*! Reads what the UART has into the receive buffer, recording when for rx_time
+ *
+ * \return Bytes read, or error from xbee_read_fun_t
+ */
 int xbee_fill_buffer(xbee_interface_t * xbee) SPECIAL_SECTION;
 
 #endif /* _XBEE_H_ */
@@ -0,0 +1,659 @@
+#include "xbee_aead.h"
+#include <assert.h>
+#include <string.h>
+
+#if defined(XBEE_AEAD_SOFTWARE)
+#elif defined(__AES__)
+#define XBEE_AES_NI
+#include <wmmintrin.h>
+#elif defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES)
+#define XBEE_AES_ARMV8
+#include <arm_neon.h>
+#endif
+
+#define XBEE_AEAD_NONCE_SIZE (13)
+
+/* Software AES works on 4 bytes at once in a uint32_t.  Byte order within
+ * the word does not matter, every operation below is bytewise.
+ *
+ * SubBytes computes the S-box instead of looking it up: the inverse in
+ * GF(2^8) as x^254 with constant time multiplies, then the affine map.
+ */
+
+static uint32_t xbee_aes_xtime4(uint32_t x)
+{
+    return ((x & 0x7f7f7f7f) << 1) ^ (((x >> 7) & 0x01010101) * 0x1b);
+}
+
+static uint32_t xbee_aes_mul4(uint32_t a, uint32_t b)
+{
+    uint32_t r = 0;
+    for(int i = 0; i < 8; ++i)
+    {
+        r ^= a & (((b >> i) & 0x01010101) * 0xff);
+        a = xbee_aes_xtime4(a);
+    }
+
+    return r;
+}
+
+static uint32_t xbee_aes_rotl4(uint32_t x, int n)
+{
+    uint32_t high = 0x01010101 * ((0xff << n) & 0xff);
+    return ((x << n) & high) | ((x >> (8 - n)) & ~high);
+}
+
+static uint32_t xbee_aes_sub4(uint32_t x)
+{
+    uint32_t x2 = xbee_aes_mul4(x, x);
+    uint32_t x3 = xbee_aes_mul4(x2, x);
+    uint32_t x6 = xbee_aes_mul4(x3, x3);
+    uint32_t x12 = xbee_aes_mul4(x6, x6);
+    uint32_t x15 = xbee_aes_mul4(x12, x3);
+    uint32_t x240 = x15;
+    for(int i = 0; i < 4; ++i)
+    {
+        x240 = xbee_aes_mul4(x240, x240);
+    }
+    uint32_t inv = xbee_aes_mul4(xbee_aes_mul4(x240, x12), x2);
+
+    return inv ^ xbee_aes_rotl4(inv, 1) ^ xbee_aes_rotl4(inv, 2) ^
+           xbee_aes_rotl4(inv, 3) ^ xbee_aes_rotl4(inv, 4) ^ 0x63636363;
+}
+
+static void xbee_aes_sub_bytes(uint8_t * b, size_t size)
+{
+    for(size_t i = 0; i < size; i += 4)
+    {
+        uint32_t w;
+        memcpy(&w, &b[i], 4);
+        w = xbee_aes_sub4(w);
+        memcpy(&b[i], &w, 4);
+    }
+}
+
+static uint8_t xbee_aes_xtime(uint8_t x)
+{
+    return (x << 1) ^ ((x >> 7) * 0x1b);
+}
+
+void xbee_aes_set_key(xbee_aes_key_t * key, const uint8_t secret[XBEE_AES_KEY_SIZE])
+{
+    assert(key);
+    assert(secret);
+
+    uint8_t * w = key->round_keys;
+    uint8_t rcon = 1;
+
+    memcpy(w, secret, XBEE_AES_KEY_SIZE);
+    for(size_t i = XBEE_AES_KEY_SIZE; i < sizeof(key->round_keys); i += 4)
+    {
+        uint8_t t[4];
+        memcpy(t, &w[i - 4], 4);
+
+        if(i % XBEE_AES_KEY_SIZE == 0)
+        {
+            uint8_t r = t[0];
+            t[0] = t[1];
+            t[1] = t[2];
+            t[2] = t[3];
+            t[3] = r;
+            xbee_aes_sub_bytes(t, 4);
+            t[0] ^= rcon;
+            rcon = xbee_aes_xtime(rcon);
+        }
+
+        for(size_t j = 0; j < 4; ++j)
+        {
+            w[i + j] = w[i + j - XBEE_AES_KEY_SIZE] ^ t[j];
+        }
+    }
+}
+
+#if !defined(XBEE_AES_NI) && !defined(XBEE_AES_ARMV8)
+static void xbee_aes_add_round_key(uint8_t * s, const uint8_t * k)
+{
+    for(size_t i = 0; i < XBEE_AES_BLOCK_SIZE; ++i)
+    {
+        s[i] ^= k[i];
+    }
+}
+
+/* State is column major, s[4*column + row] */
+static void xbee_aes_shift_rows(uint8_t * s)
+{
+    uint8_t t;
+
+    t = s[1]; s[1] = s[5]; s[5] = s[9]; s[9] = s[13]; s[13] = t;
+    t = s[2]; s[2] = s[10]; s[10] = t;
+    t = s[6]; s[6] = s[14]; s[14] = t;
+    t = s[15]; s[15] = s[11]; s[11] = s[7]; s[7] = s[3]; s[3] = t;
+}
+
+static void xbee_aes_mix_columns(uint8_t * s)
+{
+    for(size_t c = 0; c < 4; ++c)
+    {
+        uint8_t * col = &s[4*c];
+        uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+        uint8_t first = col[0];
+
+        col[0] ^= all ^ xbee_aes_xtime(col[0] ^ col[1]);
+        col[1] ^= all ^ xbee_aes_xtime(col[1] ^ col[2]);
+        col[2] ^= all ^ xbee_aes_xtime(col[2] ^ col[3]);
+        col[3] ^= all ^ xbee_aes_xtime(col[3] ^ first);
+    }
+}
+#endif
+
+void xbee_aes_encrypt(const xbee_aes_key_t * key,
+        const uint8_t in[XBEE_AES_BLOCK_SIZE], uint8_t out[XBEE_AES_BLOCK_SIZE])
+{
+    assert(key);
+    assert(in);
+    assert(out);
+
+    const uint8_t * k = key->round_keys;
+
+#if defined(XBEE_AES_NI)
+    __m128i s = _mm_loadu_si128((const __m128i *)in);
+    s = _mm_xor_si128(s, _mm_loadu_si128((const __m128i *)k));
+    for(int r = 1; r < XBEE_AES_ROUNDS; ++r)
+    {
+        s = _mm_aesenc_si128(s, _mm_loadu_si128((const __m128i *)&k[16*r]));
+    }
+    s = _mm_aesenclast_si128(s, _mm_loadu_si128((const __m128i *)&k[16*XBEE_AES_ROUNDS]));
+    _mm_storeu_si128((__m128i *)out, s);
+#elif defined(XBEE_AES_ARMV8)
+    uint8x16_t s = vld1q_u8(in);
+    for(int r = 0; r < XBEE_AES_ROUNDS - 1; ++r)
+    {
+        s = vaesmcq_u8(vaeseq_u8(s, vld1q_u8(&k[16*r])));
+    }
+    s = vaeseq_u8(s, vld1q_u8(&k[16*(XBEE_AES_ROUNDS - 1)]));
+    s = veorq_u8(s, vld1q_u8(&k[16*XBEE_AES_ROUNDS]));
+    vst1q_u8(out, s);
+#else
+    uint8_t s[XBEE_AES_BLOCK_SIZE];
+    memcpy(s, in, sizeof(s));
+
+    xbee_aes_add_round_key(s, k);
+    for(int r = 1; r <= XBEE_AES_ROUNDS; ++r)
+    {
+        xbee_aes_sub_bytes(s, sizeof(s));
+        xbee_aes_shift_rows(s);
+        if(r != XBEE_AES_ROUNDS)
+        {
+            xbee_aes_mix_columns(s);
+        }
+        xbee_aes_add_round_key(s, &k[16*r]);
+    }
+
+    memcpy(out, s, sizeof(s));
+#endif
+}
+
+/*! Encrypts two independent blocks, in place
+ *
+ * CCM needs a CBC-MAC block and a counter block per data block, doing
+ * both together keeps the AES-NI pipeline full.
+ */
+static void xbee_aes_encrypt2(const xbee_aes_key_t * key, uint8_t * a, uint8_t * b)
+{
+#if defined(XBEE_AES_NI)
+    const uint8_t * k = key->round_keys;
+    __m128i rk = _mm_loadu_si128((const __m128i *)k);
+    __m128i s0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)a), rk);
+    __m128i s1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)b), rk);
+    for(int r = 1; r < XBEE_AES_ROUNDS; ++r)
+    {
+        rk = _mm_loadu_si128((const __m128i *)&k[16*r]);
+        s0 = _mm_aesenc_si128(s0, rk);
+        s1 = _mm_aesenc_si128(s1, rk);
+    }
+    rk = _mm_loadu_si128((const __m128i *)&k[16*XBEE_AES_ROUNDS]);
+    _mm_storeu_si128((__m128i *)a, _mm_aesenclast_si128(s0, rk));
+    _mm_storeu_si128((__m128i *)b, _mm_aesenclast_si128(s1, rk));
+#else
+    xbee_aes_encrypt(key, a, a);
+    xbee_aes_encrypt(key, b, b);
+#endif
+}
+
+static void xbee_aes_ccm_start(const xbee_aes_key_t * key, const uint8_t nonce[13],
+        size_t aad_size, const uint8_t * aad, size_t size, uint8_t mac[XBEE_AES_BLOCK_SIZE])
+{
+    assert(size <= 0xFFFF);
+    assert(aad_size < 0xFF00);
+
+    /* B0: flags (Adata, M, L), nonce, message length */
+    mac[0] = (aad_size > 0 ? 0x40 : 0) | (((XBEE_AEAD_TAG_SIZE - 2)/2) << 3) | (2 - 1);
+    memcpy(&mac[1], nonce, XBEE_AEAD_NONCE_SIZE);
+    mac[14] = size >> 8;
+    mac[15] = size;
+    xbee_aes_encrypt(key, mac, mac);
+
+    if(aad_size == 0)
+    {
+        return;
+    }
+
+    /* Associated data follows its 2 byte length, zero padded to blocks */
+    size_t idx = 2;
+    mac[0] ^= aad_size >> 8;
+    mac[1] ^= aad_size;
+    for(size_t i = 0; i < aad_size; ++i)
+    {
+        mac[idx++] ^= aad[i];
+        if(idx == XBEE_AES_BLOCK_SIZE)
+        {
+            xbee_aes_encrypt(key, mac, mac);
+            idx = 0;
+        }
+    }
+
+    if(idx != 0)
+    {
+        xbee_aes_encrypt(key, mac, mac);
+    }
+}
+
+static void xbee_aes_ccm_counter(uint8_t ctr[XBEE_AES_BLOCK_SIZE],
+        const uint8_t nonce[13], uint16_t i)
+{
+    ctr[0] = 2 - 1;
+    memcpy(&ctr[1], nonce, XBEE_AEAD_NONCE_SIZE);
+    ctr[14] = i >> 8;
+    ctr[15] = i;
+}
+
+/*! Runs CTR over in and CBC-MAC over the plaintext, leaves the tag in tag */
+static void xbee_aes_ccm(const xbee_aes_key_t * key, const uint8_t nonce[13],
+        size_t aad_size, const void * aad, size_t size, const uint8_t * in,
+        uint8_t * out, bool decrypt, uint8_t tag[XBEE_AEAD_TAG_SIZE]) SPECIAL_SECTION;
+static void xbee_aes_ccm(const xbee_aes_key_t * key, const uint8_t nonce[13],
+        size_t aad_size, const void * aad, size_t size, const uint8_t * in,
+        uint8_t * out, bool decrypt, uint8_t tag[XBEE_AEAD_TAG_SIZE])
+{
+    uint8_t mac[XBEE_AES_BLOCK_SIZE];
+    uint8_t ctr[XBEE_AES_BLOCK_SIZE];
+    bool mac_pending = false;
+
+    xbee_aes_ccm_start(key, nonce, aad_size, aad, size, mac);
+
+    for(size_t offset = 0, i = 1; offset < size; offset += XBEE_AES_BLOCK_SIZE, ++i)
+    {
+        size_t n = size - offset;
+        if(n > XBEE_AES_BLOCK_SIZE)
+        {
+            n = XBEE_AES_BLOCK_SIZE;
+        }
+
+        xbee_aes_ccm_counter(ctr, nonce, i);
+        if(mac_pending)
+        {
+            xbee_aes_encrypt2(key, mac, ctr);
+        }
+        else
+        {
+            xbee_aes_encrypt(key, ctr, ctr);
+        }
+
+        for(size_t j = 0; j < n; ++j)
+        {
+            uint8_t c = in[offset + j] ^ ctr[j];
+            mac[j] ^= decrypt ? c : in[offset + j];
+            out[offset + j] = c;
+        }
+        mac_pending = true;
+    }
+
+    xbee_aes_ccm_counter(ctr, nonce, 0);
+    if(mac_pending)
+    {
+        xbee_aes_encrypt2(key, mac, ctr);
+    }
+    else
+    {
+        xbee_aes_encrypt(key, ctr, ctr);
+    }
+
+    for(size_t j = 0; j < XBEE_AEAD_TAG_SIZE; ++j)
+    {
+        tag[j] = mac[j] ^ ctr[j];
+    }
+}
+
+void xbee_aes_ccm_seal(const xbee_aes_key_t * key, const uint8_t nonce[13],
+        size_t aad_size, const void * aad, size_t size, const void * in,
+        void * out, uint8_t tag[XBEE_AEAD_TAG_SIZE])
+{
+    assert(key);
+    assert(nonce);
+    assert(aad || aad_size == 0);
+    assert((in && out) || size == 0);
+    assert(tag);
+
+    xbee_aes_ccm(key, nonce, aad_size, aad, size, in, out, false, tag);
+}
+
+int xbee_aes_ccm_open(const xbee_aes_key_t * key, const uint8_t nonce[13],
+        size_t aad_size, const void * aad, size_t size, const void * in,
+        void * out, const uint8_t tag[XBEE_AEAD_TAG_SIZE])
+{
+    assert(key);
+    assert(nonce);
+    assert(aad || aad_size == 0);
+    assert((in && out) || size == 0);
+    assert(tag);
+
+    uint8_t expected[XBEE_AEAD_TAG_SIZE];
+    xbee_aes_ccm(key, nonce, aad_size, aad, size, in, out, true, expected);
+
+    /* Compare in constant time, and never hand out unauthenticated plaintext */
+    uint8_t diff = 0;
+    for(size_t j = 0; j < XBEE_AEAD_TAG_SIZE; ++j)
+    {
+        diff |= expected[j] ^ tag[j];
+    }
+
+    if(diff != 0)
+    {
+        memset(out, 0, size);
+        return XBEE_ERR_AEAD_AUTH;
+    }
+
+    return 0;
+}
+
+static bool xbee_aead_same_address(const xbee_address_t * a, const xbee_address_t * b)
+{
+    if(a->type != b->type)
+    {
+        return false;
+    }
+
+    if(a->type == XBEE_16_BIT)
+    {
+        return a->addr.network_address == b->addr.network_address;
+    }
+
+    return a->addr.address == b->addr.address;
+}
+
+static xbee_aead_peer_t * xbee_aead_find(xbee_aead_t * aead, const xbee_address_t * address)
+{
+    for(size_t i = 0; i < aead->peer_count; ++i)
+    {
+        if(xbee_aead_same_address(&aead->peers[i].address, address))
+        {
+            return &aead->peers[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*! Nonce is address type, 64 bit address (or zero extended 16 bit), sequence */
+static void xbee_aead_nonce(uint8_t nonce[13], const xbee_address_t * sender, uint32_t sequence)
+{
+    uint64_t address = sender->type == XBEE_16_BIT ?
+        sender->addr.network_address : sender->addr.address;
+
+    nonce[0] = sender->type;
+    for(size_t i = 0; i < 8; ++i)
+    {
+        nonce[1 + i] = address >> (56 - 8*i);
+    }
+    nonce[9] = sequence >> 24;
+    nonce[10] = sequence >> 16;
+    nonce[11] = sequence >> 8;
+    nonce[12] = sequence;
+}
+
+void xbee_aead_set_key(xbee_aead_peer_t * peer, const xbee_address_t * address,
+        const uint8_t secret[XBEE_AES_KEY_SIZE])
+{
+    assert(peer);
+    assert(address);
+    assert(address->type == XBEE_16_BIT || address->type == XBEE_64_BIT);
+
+    memset(peer, 0, sizeof(*peer));
+    peer->address = *address;
+    xbee_aes_set_key(&peer->key, secret);
+}
+
+static int xbee_aead_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_aead_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_aead_t * aead = ptr;
+
+    xbee_address_t source;
+    if(xbee_frame_source(frame, &source) != 0)
+    {
+        return aead->inner->frame ? aead->inner->frame(aead->inner->ptr, xbee, frame) : 0;
+    }
+
+    /* Receive frames are never passed on unopened */
+    int size = xbee_aead_open(aead, &source, frame->frame.receive.packet_size,
+            frame->frame.receive.packet_data, aead->plain);
+    if(size < 0)
+    {
+        return 1;
+    }
+
+    xbee_parsed_frame_t plain = *frame;
+    plain.frame.receive.packet_size = size;
+    plain.frame.receive.packet_data = aead->plain;
+
+    if(aead->inner->frame)
+    {
+        aead->inner->frame(aead->inner->ptr, xbee, &plain);
+    }
+
+    return 1;
+}
+
+static void xbee_aead_failed(void * ptr, xbee_interface_t * xbee,
+        uint8_t frame_id, int reason) SPECIAL_SECTION;
+static void xbee_aead_failed(void * ptr, xbee_interface_t * xbee,
+        uint8_t frame_id, int reason)
+{
+    xbee_aead_t * aead = ptr;
+
+    if(aead->inner->failed)
+    {
+        aead->inner->failed(aead->inner->ptr, xbee, frame_id, reason);
+    }
+}
+
+void xbee_aead_init(xbee_aead_t * aead, xbee_interface_t * xbee,
+        const xbee_address_t * local, size_t peer_count, xbee_aead_peer_t * peers,
+        xbee_handler_t * inner)
+{
+    assert(aead);
+    assert(xbee);
+    assert(local);
+    assert(peers || peer_count == 0);
+
+    memset(aead, 0, sizeof(*aead));
+    aead->xbee = xbee;
+    aead->inner = inner;
+    aead->local = *local;
+    aead->peer_count = peer_count;
+    aead->peers = peers;
+
+    if(inner != NULL)
+    {
+        xbee_remove_handler(xbee, inner);
+
+        aead->handler.ptr = aead;
+        aead->handler.frame = xbee_aead_frame;
+        aead->handler.failed = xbee_aead_failed;
+        xbee_add_handler(xbee, &aead->handler);
+    }
+}
+
+void xbee_aead_stop(xbee_aead_t * aead)
+{
+    assert(aead);
+
+    if(aead->inner != NULL)
+    {
+        xbee_remove_handler(aead->xbee, &aead->handler);
+    }
+}
+
+int xbee_aead_seal(xbee_aead_t * aead, const xbee_address_t * address,
+        size_t size, const void * data, void * out)
+{
+    assert(aead);
+    assert(address);
+    assert(size <= XBEE_AEAD_MAX_PAYLOAD);
+    assert(data || size == 0);
+    assert(out);
+
+    xbee_aead_peer_t * peer = xbee_aead_find(aead, address);
+    if(peer == NULL)
+    {
+        return XBEE_ERR_AEAD_NO_KEY;
+    }
+
+    if(peer->tx_sequence == UINT32_MAX)
+    {
+        return XBEE_ERR_AEAD_EXHAUSTED;
+    }
+
+    /* Sequence is spent even if the frame never makes it out */
+    uint32_t sequence = ++peer->tx_sequence;
+
+    uint8_t nonce[XBEE_AEAD_NONCE_SIZE];
+    xbee_aead_nonce(nonce, &aead->local, sequence);
+
+    uint8_t * b = out;
+    b[0] = sequence >> 8;
+    b[1] = sequence;
+    xbee_aes_ccm_seal(&peer->key, nonce, 0, NULL, size, data,
+            &b[XBEE_AEAD_SEQUENCE_SIZE], &b[XBEE_AEAD_SEQUENCE_SIZE + size]);
+
+    return size + XBEE_AEAD_OVERHEAD;
+}
+
+/*! Full sequence number closest to the highest one seen with these low 16 bits */
+static uint32_t xbee_aead_sequence(uint32_t highest, uint16_t low)
+{
+    uint32_t sequence = (highest & 0xFFFF0000) | low;
+
+    if(sequence > highest && sequence - highest > 0x8000 && sequence >= 0x10000)
+    {
+        sequence -= 0x10000;
+    }
+    else if(sequence < highest && highest - sequence > 0x8000 && sequence < 0xFFFF0000)
+    {
+        sequence += 0x10000;
+    }
+
+    return sequence;
+}
+
+int xbee_aead_open(xbee_aead_t * aead, const xbee_address_t * source,
+        size_t size, const void * data, void * out)
+{
+    assert(aead);
+    assert(source);
+    assert(data || size == 0);
+    assert(out);
+
+    xbee_aead_peer_t * peer = xbee_aead_find(aead, source);
+    if(peer == NULL)
+    {
+        aead->unknown_peer += 1;
+        return XBEE_ERR_AEAD_NO_KEY;
+    }
+
+    /* A receive frame can carry more than any sealed payload, and out
+     * only has to hold XBEE_AEAD_MAX_PAYLOAD */
+    const uint8_t * b = data;
+    if(size < XBEE_AEAD_OVERHEAD || size - XBEE_AEAD_OVERHEAD > XBEE_AEAD_MAX_PAYLOAD)
+    {
+        aead->rejected += 1;
+        return XBEE_ERR_AEAD_AUTH;
+    }
+
+    uint32_t sequence = xbee_aead_sequence(peer->rx_sequence, (b[0] << 8) | b[1]);
+    uint32_t behind = peer->rx_sequence - sequence;
+    if(sequence == 0 || (sequence <= peer->rx_sequence &&
+       (behind >= 32 || (peer->rx_window & (1UL << behind)))))
+    {
+        aead->rejected += 1;
+        return XBEE_ERR_AEAD_AUTH;
+    }
+
+    uint8_t nonce[XBEE_AEAD_NONCE_SIZE];
+    xbee_aead_nonce(nonce, source, sequence);
+
+    size_t plain_size = size - XBEE_AEAD_OVERHEAD;
+    if(xbee_aes_ccm_open(&peer->key, nonce, 0, NULL, plain_size,
+            &b[XBEE_AEAD_SEQUENCE_SIZE], out, &b[XBEE_AEAD_SEQUENCE_SIZE + plain_size]) != 0)
+    {
+        aead->rejected += 1;
+        return XBEE_ERR_AEAD_AUTH;
+    }
+
+    /* Only authenticated sequence numbers move the replay window */
+    if(sequence > peer->rx_sequence)
+    {
+        uint32_t ahead = sequence - peer->rx_sequence;
+        peer->rx_window = ahead < 32 ? (peer->rx_window << ahead) | 1 : 1;
+        peer->rx_sequence = sequence;
+    }
+    else
+    {
+        peer->rx_window |= 1UL << behind;
+    }
+
+    aead->opened += 1;
+    return plain_size;
+}
+
+int xbee_aead_transmit_gather(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    xbee_aead_t * aead = ptr;
+
+    assert(aead);
+    assert(buffers || count == 0);
+
+    uint8_t plain[XBEE_AEAD_MAX_PAYLOAD];
+    size_t size = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(size + buffers[i].size > sizeof(plain))
+        {
+            return XBEE_ERR_TOO_LARGE;
+        }
+
+        memcpy(&plain[size], buffers[i].data, buffers[i].size);
+        size += buffers[i].size;
+    }
+
+    uint8_t sealed[XBEE_MAX_RF_PAYLOAD];
+    int ret = xbee_aead_seal(aead, address, size, plain, sealed);
+    if(ret < 0)
+    {
+        return ret;
+    }
+
+    return xbee_transmit(aead->xbee, frame_id, address, option, ret, sealed);
+}
+
+int xbee_aead_transmit(xbee_aead_t * aead, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t size, const void * data)
+{
+    xbee_buffer_t buffer = { size, data };
+    return xbee_aead_transmit_gather(aead, frame_id, address, option, 1, &buffer);
+}
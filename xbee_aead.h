@@ -0,0 +1,141 @@
+#ifndef _XBEE_AEAD_H_
+#define _XBEE_AEAD_H_
+
+#include "xbee.h"
+
+/*! Authenticated encryption of RF payloads with AES-128-CCM
+ *
+ * Every payload is sent as
+ *
+ *   sequence (2 bytes), ciphertext, tag (XBEE_AEAD_TAG_SIZE bytes)
+ *
+ * The 13 byte CCM nonce is not sent, it is built from the sender's address
+ * and a 32 bit per peer sequence number, of which only the low 16 bits are
+ * on air.  The receiver recovers the rest from the highest sequence it has
+ * authenticated, and rejects replays with a sliding window.
+ *
+ * Keys are per peer and pairwise: a frame to or from a peer is sealed
+ * with that peer's key.  Broadcasts are not supported.
+ *
+ * AES uses AES-NI when built with __AES__ (e.g. -maes), the ARMv8 crypto
+ * extension when built with __ARM_FEATURE_CRYPTO, and otherwise a
+ * software implementation without lookup tables, so its timing does not
+ * depend on keys or data.  Define XBEE_AEAD_SOFTWARE to force software.
+ */
+
+#define XBEE_AEAD_SEQUENCE_SIZE (2)
+#define XBEE_AEAD_TAG_SIZE (8)
+#define XBEE_AEAD_OVERHEAD (XBEE_AEAD_SEQUENCE_SIZE + XBEE_AEAD_TAG_SIZE)
+#define XBEE_AEAD_MAX_PAYLOAD (XBEE_MAX_RF_PAYLOAD - XBEE_AEAD_OVERHEAD)
+
+#define XBEE_AES_KEY_SIZE (16)
+#define XBEE_AES_BLOCK_SIZE (16)
+#define XBEE_AES_ROUNDS (10)
+
+#define XBEE_ERR_AEAD_NO_KEY (-27)      /*! No key for peer address */
+#define XBEE_ERR_AEAD_AUTH (-28)        /*! Tag mismatch, replay or payload of impossible size */
+#define XBEE_ERR_AEAD_EXHAUSTED (-29)   /*! Sequence numbers used up, peer needs a new key */
+
+/*! Expanded AES-128 encryption key */
+typedef struct {
+    uint8_t round_keys[(XBEE_AES_ROUNDS + 1)*XBEE_AES_BLOCK_SIZE];
+} xbee_aes_key_t;
+
+void xbee_aes_set_key(xbee_aes_key_t * key, const uint8_t secret[XBEE_AES_KEY_SIZE]) SPECIAL_SECTION;
+
+void xbee_aes_encrypt(const xbee_aes_key_t * key,
+        const uint8_t in[XBEE_AES_BLOCK_SIZE], uint8_t out[XBEE_AES_BLOCK_SIZE]) SPECIAL_SECTION;
+
+/*! CCM with 13 byte nonce (L = 2) and XBEE_AEAD_TAG_SIZE byte tag, as RFC 3610
+ *
+ * out may be in.
+ */
+void xbee_aes_ccm_seal(const xbee_aes_key_t * key, const uint8_t nonce[13],
+        size_t aad_size, const void * aad, size_t size, const void * in,
+        void * out, uint8_t tag[XBEE_AEAD_TAG_SIZE]) SPECIAL_SECTION;
+
+/*! \return 0 if tag matches, otherwise XBEE_ERR_AEAD_AUTH and out is zeroed */
+int xbee_aes_ccm_open(const xbee_aes_key_t * key, const uint8_t nonce[13],
+        size_t aad_size, const void * aad, size_t size, const void * in,
+        void * out, const uint8_t tag[XBEE_AEAD_TAG_SIZE]) SPECIAL_SECTION;
+
+typedef struct {
+    xbee_address_t address;
+    xbee_aes_key_t key;
+
+    uint32_t tx_sequence;       /*! Last sequence sealed to peer */
+    uint32_t rx_sequence;       /*! Highest sequence opened from peer */
+    uint32_t rx_window;         /*! Bit n set if rx_sequence - n was opened */
+} xbee_aead_peer_t;
+
+/*! Sets peer's address and key and resets its sequence numbers
+ *
+ * Sequence numbers must never repeat under one key, so a node that loses
+ * its peer state must also get a new key.
+ */
+void xbee_aead_set_key(xbee_aead_peer_t * peer, const xbee_address_t * address,
+        const uint8_t secret[XBEE_AES_KEY_SIZE]) SPECIAL_SECTION;
+
+/*! Encryption stage between the XBee and an inner handler
+ *
+ * Receive frames are opened and passed to inner with the plaintext as
+ * packet data, frames that fail to open are dropped.  Other frames and
+ * failed frame ids are passed through to inner unchanged.
+ *
+ * local is this node's address as peers see it as the source of frames.
+ */
+typedef struct {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+    xbee_handler_t * inner;
+
+    xbee_address_t local;
+    size_t peer_count;
+    xbee_aead_peer_t * peers;
+
+    uint8_t plain[XBEE_AEAD_MAX_PAYLOAD];
+
+    uint32_t opened;
+    uint32_t rejected;          /*! Tag mismatches and replays */
+    uint32_t unknown_peer;
+} xbee_aead_t;
+
+/*! Registers stage with xbee, inner is removed from xbee if registered
+ *
+ * inner may be NULL to only use xbee_aead_open directly.
+ */
+void xbee_aead_init(xbee_aead_t * aead, xbee_interface_t * xbee,
+        const xbee_address_t * local, size_t peer_count, xbee_aead_peer_t * peers,
+        xbee_handler_t * inner) SPECIAL_SECTION;
+
+void xbee_aead_stop(xbee_aead_t * aead) SPECIAL_SECTION;
+
+/*! Seals plaintext to address into out, which must hold size + XBEE_AEAD_OVERHEAD
+ *
+ * \return Size of sealed payload, or XBEE_ERR_AEAD_NO_KEY or XBEE_ERR_AEAD_EXHAUSTED
+ */
+int xbee_aead_seal(xbee_aead_t * aead, const xbee_address_t * address,
+        size_t size, const void * data, void * out) SPECIAL_SECTION;
+
+/*! Opens payload from source into out, which must hold size - XBEE_AEAD_OVERHEAD
+ * or XBEE_AEAD_MAX_PAYLOAD, whichever is smaller
+ *
+ * \return Size of plaintext, or XBEE_ERR_AEAD_NO_KEY or XBEE_ERR_AEAD_AUTH,
+ *      which includes payloads too short or too long to have been sealed
+ */
+int xbee_aead_open(xbee_aead_t * aead, const xbee_address_t * source,
+        size_t size, const void * data, void * out) SPECIAL_SECTION;
+
+/*! Sealing xbee_transmit_gather, ptr is the xbee_aead_t
+ *
+ * Signature matches xbee_port_transmit_t, so a port mux can send through it.
+ */
+int xbee_aead_transmit_gather(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers) SPECIAL_SECTION;
+
+int xbee_aead_transmit(xbee_aead_t * aead, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t size, const void * data) SPECIAL_SECTION;
+
+#endif /* _XBEE_AEAD_H_ */
@@ -0,0 +1,97 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "xbee_aead.h"
+
+/* Seals and opens payloads between two peers as fast as it can for a
+ * second, at a few payload sizes.  The radio carries at most 250 kbps, so anything
+ * well above that leaves the gateway's CPU for other work; on an MCU
+ * it is what the software AES costs per packet. */
+
+#define BENCH_US (1000000)          /*! Each size runs about this long */
+#define BENCH_BATCH (250)
+#define BENCH_LINE_RATE (250000/8)  /*! 802.15.4 bytes/s, before any overhead */
+
+#if defined(XBEE_AEAD_SOFTWARE) || (!defined(__AES__) && \
+    !defined(__ARM_FEATURE_CRYPTO) && !defined(__ARM_FEATURE_AES))
+#define BENCH_AES "software"
+#elif defined(__AES__)
+#define BENCH_AES "AES-NI"
+#else
+#define BENCH_AES "ARMv8 crypto"
+#endif
+
+static uint64_t bench_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const uint8_t secret[XBEE_AES_KEY_SIZE] = "0123456789abcdef";
+    static const size_t sizes[] = {8, 32, XBEE_AEAD_MAX_PAYLOAD};
+
+    xbee_address_t a = {XBEE_16_BIT, {.network_address = 1}};
+    xbee_address_t b = {XBEE_16_BIT, {.network_address = 2}};
+    xbee_interface_t xbee;
+    memset(&xbee, 0, sizeof(xbee));
+
+    printf("AES-128-CCM in %s\n", BENCH_AES);
+    printf("  %7s %10s %10s %10s %13s\n", "payload", "seal us", "open us", "kB/s",
+            "x line rate");
+    for(size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s)
+    {
+        /* New keys each size, so sequence numbers start over */
+        xbee_aead_peer_t a_peer, b_peer;
+        xbee_aead_t sender, receiver;
+        xbee_aead_set_key(&b_peer, &b, secret);
+        xbee_aead_set_key(&a_peer, &a, secret);
+        xbee_aead_init(&sender, &xbee, &a, 1, &b_peer, NULL);
+        xbee_aead_init(&receiver, &xbee, &b, 1, &a_peer, NULL);
+
+        size_t size = sizes[s];
+        static uint8_t sealed[BENCH_BATCH][XBEE_MAX_RF_PAYLOAD];
+        uint8_t plain[XBEE_AEAD_MAX_PAYLOAD];
+        memset(plain, 'p', sizeof(plain));
+
+        /* Timed a batch at a time, so the clock costs little per packet */
+        uint64_t seal_us = 0, open_us = 0;
+        uint32_t packets = 0;
+        for(; seal_us + open_us < BENCH_US; packets += BENCH_BATCH)
+        {
+            uint64_t start = bench_us();
+            for(size_t j = 0; j < BENCH_BATCH; ++j)
+            {
+                int sealed_size = xbee_aead_seal(&sender, &b, size, plain, sealed[j]);
+                assert(sealed_size == (int)(size + XBEE_AEAD_OVERHEAD));
+            }
+            uint64_t middle = bench_us();
+            for(size_t j = 0; j < BENCH_BATCH; ++j)
+            {
+                int opened_size = xbee_aead_open(&receiver, &a, size + XBEE_AEAD_OVERHEAD,
+                        sealed[j], plain);
+                assert(opened_size == (int)size);
+            }
+            uint64_t end = bench_us();
+
+            seal_us += middle - start;
+            open_us += end - middle;
+        }
+        assert(receiver.opened == packets);
+
+        /* Payload bytes a node could both seal and open per second */
+        double rate = (double)size*packets*1000000/(seal_us + open_us);
+        printf("  %7zu %10.3f %10.3f %10.0f %13.0f\n", size,
+                (double)seal_us/packets, (double)open_us/packets,
+                rate/1000, rate/BENCH_LINE_RATE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,274 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_aead.h"
+#include "xbee_sim.h"
+
+/* Known answers check whichever AES path xbee_aead.c was built with,
+ * see xbee_aead.h */
+
+/*! FIPS-197 appendix C.1 */
+void test_aes_known_answer(void)
+{
+    const uint8_t secret[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    };
+    const uint8_t plain[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    };
+    const uint8_t cipher[16] = {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a,
+    };
+
+    xbee_aes_key_t key;
+    uint8_t out[16];
+    xbee_aes_set_key(&key, secret);
+    xbee_aes_encrypt(&key, plain, out);
+    assert(memcmp(out, cipher, sizeof(cipher)) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! RFC 3610 packet vector #1 */
+void test_ccm_known_answer(void)
+{
+    const uint8_t secret[16] = {
+        0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+        0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+    };
+    const uint8_t nonce[13] = {
+        0x00, 0x00, 0x00, 0x03, 0x02, 0x01, 0x00, 0xa0,
+        0xa1, 0xa2, 0xa3, 0xa4, 0xa5,
+    };
+    const uint8_t aad[8] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07};
+    uint8_t plain[23];
+    for(size_t i = 0; i < sizeof(plain); ++i)
+    {
+        plain[i] = 0x08 + i;
+    }
+    const uint8_t cipher[23] = {
+        0x58, 0x8c, 0x97, 0x9a, 0x61, 0xc6, 0x63, 0xd2,
+        0xf0, 0x66, 0xd0, 0xc2, 0xc0, 0xf9, 0x89, 0x80,
+        0x6d, 0x5f, 0x6b, 0x61, 0xda, 0xc3, 0x84,
+    };
+    const uint8_t tag[8] = {0x17, 0xe8, 0xd1, 0x2c, 0xfd, 0xf9, 0x26, 0xe0};
+
+    xbee_aes_key_t key;
+    xbee_aes_set_key(&key, secret);
+
+    uint8_t out[sizeof(plain)];
+    uint8_t out_tag[XBEE_AEAD_TAG_SIZE];
+    xbee_aes_ccm_seal(&key, nonce, sizeof(aad), aad, sizeof(plain), plain, out, out_tag);
+    assert(memcmp(out, cipher, sizeof(cipher)) == 0);
+    assert(memcmp(out_tag, tag, sizeof(tag)) == 0);
+
+    assert(xbee_aes_ccm_open(&key, nonce, sizeof(aad), aad, sizeof(cipher), cipher, out, tag) == 0);
+    assert(memcmp(out, plain, sizeof(plain)) == 0);
+
+    /* In place */
+    memcpy(out, plain, sizeof(plain));
+    xbee_aes_ccm_seal(&key, nonce, sizeof(aad), aad, sizeof(out), out, out, out_tag);
+    assert(memcmp(out, cipher, sizeof(cipher)) == 0);
+
+    /* Any flipped bit fails, and leaves nothing of the plaintext */
+    uint8_t bad[sizeof(cipher)];
+    memcpy(bad, cipher, sizeof(bad));
+    bad[5] ^= 0x10;
+    assert(xbee_aes_ccm_open(&key, nonce, sizeof(aad), aad, sizeof(bad), bad, out, tag) == XBEE_ERR_AEAD_AUTH);
+    for(size_t i = 0; i < sizeof(out); ++i)
+    {
+        assert(out[i] == 0);
+    }
+
+    uint8_t bad_tag[8];
+    memcpy(bad_tag, tag, sizeof(bad_tag));
+    bad_tag[7] ^= 0x01;
+    assert(xbee_aes_ccm_open(&key, nonce, sizeof(aad), aad, sizeof(cipher), cipher, out, bad_tag) == XBEE_ERR_AEAD_AUTH);
+
+    printf("%s passed\n", __func__);
+}
+
+static const uint8_t test_secret[16] = "0123456789abcdef";
+
+/*! Sealing to a peer and opening from it, replays and reordering */
+void test_aead_seal_open(void)
+{
+    xbee_address_t a = {XBEE_16_BIT, {.network_address = 1}};
+    xbee_address_t b = {XBEE_16_BIT, {.network_address = 2}};
+    xbee_interface_t xbee;
+    memset(&xbee, 0, sizeof(xbee));
+
+    xbee_aead_peer_t a_peer, b_peer;
+    xbee_aead_t sender, receiver;
+    xbee_aead_set_key(&b_peer, &b, test_secret);
+    xbee_aead_set_key(&a_peer, &a, test_secret);
+    xbee_aead_init(&sender, &xbee, &a, 1, &b_peer, NULL);
+    xbee_aead_init(&receiver, &xbee, &b, 1, &a_peer, NULL);
+
+    uint8_t sealed[4][XBEE_MAX_RF_PAYLOAD];
+    int sizes[4];
+    uint8_t plain[XBEE_AEAD_MAX_PAYLOAD];
+    for(size_t i = 0; i < 4; ++i)
+    {
+        memset(plain, 'a' + i, sizeof(plain));
+        sizes[i] = xbee_aead_seal(&sender, &b, 10 + i, plain, sealed[i]);
+        assert(sizes[i] == (int)(10 + i + XBEE_AEAD_OVERHEAD));
+    }
+
+    /* Out of order within the window, then replays */
+    size_t order[4] = {1, 0, 3, 2};
+    for(size_t i = 0; i < 4; ++i)
+    {
+        size_t k = order[i];
+        int size = xbee_aead_open(&receiver, &a, sizes[k], sealed[k], plain);
+        assert(size == (int)(10 + k));
+        for(int j = 0; j < size; ++j)
+        {
+            assert(plain[j] == 'a' + k);
+        }
+    }
+    for(size_t k = 0; k < 4; ++k)
+    {
+        assert(xbee_aead_open(&receiver, &a, sizes[k], sealed[k], plain) == XBEE_ERR_AEAD_AUTH);
+    }
+    assert(receiver.opened == 4);
+    assert(receiver.rejected == 4);
+
+    /* Sealed to b, not something a accepts from b */
+    assert(xbee_aead_open(&sender, &b, sizes[0], sealed[0], plain) == XBEE_ERR_AEAD_AUTH);
+
+    xbee_address_t c = {XBEE_16_BIT, {.network_address = 3}};
+    assert(xbee_aead_open(&receiver, &c, sizes[0], sealed[0], plain) == XBEE_ERR_AEAD_NO_KEY);
+    assert(xbee_aead_seal(&sender, &c, 1, plain, sealed[0]) == XBEE_ERR_AEAD_NO_KEY);
+
+    /* Largest payload both ways */
+    memset(plain, 'z', sizeof(plain));
+    int size = xbee_aead_seal(&sender, &b, XBEE_AEAD_MAX_PAYLOAD, plain, sealed[0]);
+    assert(size == XBEE_MAX_RF_PAYLOAD);
+    memset(plain, 0, sizeof(plain));
+    assert(xbee_aead_open(&receiver, &a, size, sealed[0], plain) == XBEE_AEAD_MAX_PAYLOAD);
+    assert(plain[XBEE_AEAD_MAX_PAYLOAD - 1] == 'z');
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Payloads of a size no seal produces are rejected before decrypting */
+void test_aead_open_size(void)
+{
+    xbee_address_t a = {XBEE_16_BIT, {.network_address = 1}};
+    xbee_address_t b = {XBEE_16_BIT, {.network_address = 2}};
+    xbee_interface_t xbee;
+    memset(&xbee, 0, sizeof(xbee));
+
+    xbee_aead_peer_t a_peer;
+    xbee_aead_t receiver;
+    xbee_aead_set_key(&a_peer, &a, test_secret);
+    xbee_aead_init(&receiver, &xbee, &b, 1, &a_peer, NULL);
+
+    struct {
+        uint8_t plain[XBEE_AEAD_MAX_PAYLOAD];
+        uint8_t guard[32];
+    } out;
+    memset(&out, 0x55, sizeof(out));
+
+    uint8_t data[XBEE_MAX_FRAME_SIZE];
+    memset(data, 0, sizeof(data));
+    data[1] = 1;
+
+    assert(xbee_aead_open(&receiver, &a, XBEE_AEAD_OVERHEAD - 1, data, out.plain) == XBEE_ERR_AEAD_AUTH);
+    assert(xbee_aead_open(&receiver, &a, XBEE_MAX_RF_PAYLOAD + 1, data, out.plain) == XBEE_ERR_AEAD_AUTH);
+    assert(xbee_aead_open(&receiver, &a, sizeof(data), data, out.plain) == XBEE_ERR_AEAD_AUTH);
+    for(size_t i = 0; i < sizeof(out.guard); ++i)
+    {
+        assert(out.guard[i] == 0x55);
+    }
+    assert(receiver.rejected == 3);
+
+    printf("%s passed\n", __func__);
+}
+
+typedef struct {
+    size_t count;
+    size_t size;
+    uint8_t data[XBEE_MAX_FRAME_SIZE];
+} test_inner_t;
+
+static int test_inner_frame(void * ptr, xbee_interface_t * xbee, const xbee_parsed_frame_t * frame)
+{
+    test_inner_t * inner = ptr;
+    (void)xbee;
+
+    if(frame->api_id == XBEE_RECEIVE || frame->api_id == XBEE_RECEIVE_16_BIT)
+    {
+        inner->count += 1;
+        inner->size = frame->frame.receive.packet_size;
+        memcpy(inner->data, frame->frame.receive.packet_data, inner->size);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*! Frames from the XBee go through the stage, including ones too long
+ * for its plaintext buffer */
+void test_aead_stage(void)
+{
+    static xbee_sim_t sim;
+    assert(xbee_sim_init(&sim, 2, 1) == 0);
+
+    xbee_address_t a, b;
+    xbee_sim_address16(&sim, 0, &a);
+    xbee_sim_address16(&sim, 1, &b);
+
+    xbee_aead_peer_t a_peer, b_peer;
+    xbee_aead_set_key(&b_peer, &b, test_secret);
+    xbee_aead_set_key(&a_peer, &a, test_secret);
+
+    test_inner_t inner_a, inner_b;
+    memset(&inner_a, 0, sizeof(inner_a));
+    memset(&inner_b, 0, sizeof(inner_b));
+    xbee_handler_t handler_a = { .ptr = &inner_a, .frame = test_inner_frame };
+    xbee_handler_t handler_b = { .ptr = &inner_b, .frame = test_inner_frame };
+
+    xbee_aead_t aead_a, aead_b;
+    xbee_aead_init(&aead_a, &sim.nodes[0].xbee, &a, 1, &b_peer, &handler_a);
+    xbee_aead_init(&aead_b, &sim.nodes[1].xbee, &b, 1, &a_peer, &handler_b);
+
+    assert(xbee_aead_transmit(&aead_a, 0, &b, 0, 5, "hello") == 0);
+    xbee_sim_step(&sim);
+    assert(inner_b.count == 1);
+    assert(inner_b.size == 5 && memcmp(inner_b.data, "hello", 5) == 0);
+
+    /* A receive frame as long as the host will take, 112 bytes of RF data */
+    uint8_t frame[XBEE_MAX_FRAME_SIZE - 1] = {XBEE_RECEIVE_16_BIT, 0x00, 0x01, 40, 0x00};
+    memset(&frame[5], 0xAA, sizeof(frame) - 5);
+    frame[5] = 0x00;
+    frame[6] = 0x02;
+    xbee_sim_push_frame(&sim, 1, sizeof(frame), frame);
+    xbee_sim_step(&sim);
+    assert(inner_b.count == 1);
+    assert(aead_b.rejected == 1);
+
+    xbee_aead_stop(&aead_a);
+    xbee_aead_stop(&aead_b);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_aes_known_answer();
+    test_ccm_known_answer();
+    test_aead_seal_open();
+    test_aead_open_size();
+    test_aead_stage();
+
+    return 0;
+}
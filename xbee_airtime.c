@@ -0,0 +1,329 @@
+#include "xbee_airtime.h"
+#include <assert.h>
+#include <string.h>
+
+/* 2.4 GHz O-QPSK PHY: 250 kbit/s, 16 us symbols */
+#define XBEE_AIRTIME_BYTE_US (32)
+#define XBEE_AIRTIME_PHY_HEADER (6)     /*! Preamble, SFD and length */
+#define XBEE_AIRTIME_SIFS_US (12*16)
+#define XBEE_AIRTIME_LIFS_US (40*16)
+#define XBEE_AIRTIME_MAX_SIFS_FRAME (18)
+#define XBEE_AIRTIME_TURNAROUND_US (12*16)
+#define XBEE_AIRTIME_ACK_FRAME (5)
+
+uint32_t xbee_airtime_us(xbee_address_type_t destination, bool source_16_bit,
+        size_t payload_size)
+{
+    bool broadcast = destination == XBEE_16_BIT_BROADCAST ||
+                     destination == XBEE_64_BIT_BROADCAST;
+    bool destination_16_bit = destination == XBEE_16_BIT ||
+                              destination == XBEE_16_BIT_BROADCAST;
+
+    /* Frame control, sequence, PAN id (compressed), addresses, payload, FCS */
+    size_t mac_size = 2 + 1 + 2 + (destination_16_bit ? 2 : 8) +
+        (source_16_bit ? 2 : 8) + payload_size + 2;
+
+    uint32_t us = (XBEE_AIRTIME_PHY_HEADER + mac_size)*XBEE_AIRTIME_BYTE_US;
+    us += mac_size > XBEE_AIRTIME_MAX_SIFS_FRAME ? XBEE_AIRTIME_LIFS_US : XBEE_AIRTIME_SIFS_US;
+
+    if(!broadcast)
+    {
+        us += XBEE_AIRTIME_TURNAROUND_US +
+            (XBEE_AIRTIME_PHY_HEADER + XBEE_AIRTIME_ACK_FRAME)*XBEE_AIRTIME_BYTE_US;
+    }
+
+    return us;
+}
+
+static bool xbee_airtime_same_address(const xbee_address_t * a, const xbee_address_t * b)
+{
+    if(a->type != b->type)
+    {
+        return false;
+    }
+
+    if(a->type == XBEE_16_BIT)
+    {
+        return a->addr.network_address == b->addr.network_address;
+    }
+
+    return a->addr.address == b->addr.address;
+}
+
+static uint32_t xbee_airtime_sum(const uint32_t * buckets)
+{
+    uint32_t sum = 0;
+    for(size_t i = 0; i < XBEE_AIRTIME_BUCKETS; ++i)
+    {
+        sum += buckets[i];
+    }
+
+    return sum;
+}
+
+/*! Slides the window up to now, clearing buckets that fell out of it */
+static void xbee_airtime_advance(xbee_airtime_t * airtime)
+{
+    uint32_t now = xbee_now(airtime->xbee);
+    uint32_t width = airtime->window / XBEE_AIRTIME_BUCKETS;
+
+    for(size_t n = 0; now - airtime->bucket_start >= width; ++n)
+    {
+        if(n == XBEE_AIRTIME_BUCKETS)
+        {
+            /* Whole window passed, no need to step through it */
+            airtime->bucket_start = now;
+            break;
+        }
+
+        airtime->bucket = (airtime->bucket + 1) % XBEE_AIRTIME_BUCKETS;
+        airtime->bucket_start += width;
+
+        for(size_t i = 0; i < XBEE_AIRTIME_NODES; ++i)
+        {
+            airtime->nodes[i].tx[airtime->bucket] = 0;
+            airtime->nodes[i].rx[airtime->bucket] = 0;
+        }
+    }
+}
+
+static xbee_airtime_node_t * xbee_airtime_find(xbee_airtime_t * airtime,
+        const xbee_address_t * address, bool create)
+{
+    xbee_airtime_node_t * victim = NULL;
+    uint32_t victim_airtime = 0;
+
+    for(size_t i = 0; i < XBEE_AIRTIME_NODES; ++i)
+    {
+        xbee_airtime_node_t * n = &airtime->nodes[i];
+        if(!n->valid)
+        {
+            if(victim == NULL || victim->valid)
+            {
+                victim = n;
+            }
+            continue;
+        }
+
+        if(xbee_airtime_same_address(&n->address, address))
+        {
+            return n;
+        }
+
+        uint32_t total = xbee_airtime_sum(n->tx) + xbee_airtime_sum(n->rx);
+        if(victim == NULL || (victim->valid && total < victim_airtime))
+        {
+            victim = n;
+            victim_airtime = total;
+        }
+    }
+
+    if(!create)
+    {
+        return NULL;
+    }
+
+    if(victim->valid)
+    {
+        /* Statuses still to come for the evicted node must not charge
+         * whichever node takes its place */
+        uint8_t index = victim - airtime->nodes;
+        for(size_t id = 1; id < 256; ++id)
+        {
+            if(airtime->frame_node[id] == index)
+            {
+                airtime->frames[id >> 3] &= ~(1 << (id & 7));
+            }
+        }
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    victim->address = *address;
+    victim->valid = true;
+    return victim;
+}
+
+static int xbee_airtime_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_airtime_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_airtime_t * airtime = ptr;
+    xbee_airtime_advance(airtime);
+
+    if(frame->api_id == XBEE_TRANSMIT_STATUS)
+    {
+        uint8_t id = frame->frame_id;
+        if((airtime->frames[id >> 3] & (1 << (id & 7))) == 0)
+        {
+            return 0;
+        }
+
+        airtime->frames[id >> 3] &= ~(1 << (id & 7));
+
+        /* No ACK means every retry went out too */
+        xbee_airtime_node_t * n = &airtime->nodes[airtime->frame_node[id]];
+        if(frame->frame.status == 1)
+        {
+            n->tx[airtime->bucket] += airtime->max_retries*airtime->frame_airtime[id];
+        }
+        return 0;
+    }
+
+    xbee_address_t source;
+    if(xbee_frame_source(frame, &source) != 0)
+    {
+        return 0;
+    }
+
+    /* Receive frame options bit 1 and 2 mark address and PAN broadcasts */
+    bool broadcast = (frame->frame.receive.options & 0x06) != 0;
+    xbee_airtime_node_t * n = xbee_airtime_find(airtime, &source, true);
+    n->rx[airtime->bucket] += xbee_airtime_us(
+            broadcast ? XBEE_16_BIT_BROADCAST : (airtime->source_16_bit ? XBEE_16_BIT : XBEE_64_BIT),
+            source.type == XBEE_16_BIT, frame->frame.receive.packet_size);
+
+    return 0;
+}
+
+void xbee_airtime_init(xbee_airtime_t * airtime, xbee_interface_t * xbee,
+        bool source_16_bit, uint8_t max_retries, uint32_t window, uint32_t budget,
+        xbee_port_transmit_t transmit, void * transmit_ptr)
+{
+    assert(airtime);
+    assert(xbee);
+    assert(window >= XBEE_AIRTIME_BUCKETS);
+    assert(transmit);
+
+    memset(airtime, 0, sizeof(*airtime));
+    airtime->xbee = xbee;
+    airtime->transmit = transmit;
+    airtime->transmit_ptr = transmit_ptr;
+    airtime->source_16_bit = source_16_bit;
+    airtime->max_retries = max_retries;
+    airtime->window = window;
+    airtime->budget = budget;
+    airtime->bucket_start = xbee_now(xbee);
+
+    airtime->handler.ptr = airtime;
+    airtime->handler.frame = xbee_airtime_frame;
+    xbee_add_observer(xbee, &airtime->handler);
+}
+
+void xbee_airtime_stop(xbee_airtime_t * airtime)
+{
+    assert(airtime);
+
+    xbee_remove_handler(airtime->xbee, &airtime->handler);
+}
+
+int xbee_airtime_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    xbee_airtime_t * airtime = ptr;
+
+    assert(airtime);
+    assert(address);
+    assert(buffers || count == 0);
+
+    int ret = airtime->transmit(airtime->transmit_ptr, frame_id, address, option,
+            count, buffers);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    size_t size = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        size += buffers[i].size;
+    }
+
+    xbee_airtime_advance(airtime);
+    xbee_airtime_node_t * n = xbee_airtime_find(airtime, address, true);
+    uint32_t us = xbee_airtime_us(address->type, airtime->source_16_bit, size);
+    n->tx[airtime->bucket] += us;
+
+    if(frame_id != 0)
+    {
+        airtime->frame_node[frame_id] = n - airtime->nodes;
+        airtime->frame_airtime[frame_id] = us;
+        airtime->frames[frame_id >> 3] |= 1 << (frame_id & 7);
+    }
+
+    return 0;
+}
+
+bool xbee_airtime_admit(void * ptr, const xbee_address_t * address, 
+        uint8_t priority, size_t size)
+{
+    xbee_airtime_t * airtime = ptr;
+
+    assert(airtime);
+    assert(address);
+
+    if(airtime->budget == 0)
+    {
+        return true;
+    }
+
+    xbee_airtime_advance(airtime);
+    xbee_airtime_node_t * n = xbee_airtime_find(airtime, address, false);
+    if(n == NULL)
+    {
+        return true;
+    }
+
+    if(xbee_airtime_sum(n->tx) >= airtime->budget ||
+       xbee_airtime_sum(n->rx) >= airtime->budget)
+    {
+        n->deferred += 1;
+        return false;
+    }
+
+    return true;
+}
+
+size_t xbee_airtime_top(xbee_airtime_t * airtime, size_t count,
+        xbee_airtime_report_t * reports)
+{
+    assert(airtime);
+    assert(reports || count == 0);
+
+    xbee_airtime_advance(airtime);
+
+    size_t used = 0;
+    for(size_t i = 0; i < XBEE_AIRTIME_NODES; ++i)
+    {
+        const xbee_airtime_node_t * n = &airtime->nodes[i];
+        if(!n->valid)
+        {
+            continue;
+        }
+
+        xbee_airtime_report_t r;
+        r.address = n->address;
+        r.tx_us = xbee_airtime_sum(n->tx);
+        r.rx_us = xbee_airtime_sum(n->rx);
+        r.deferred = n->deferred;
+
+        /* Insertion into the sorted reports, dropping the smallest */
+        size_t j = used < count ? used++ : count;
+        while(j > 0 && reports[j - 1].tx_us + reports[j - 1].rx_us < r.tx_us + r.rx_us)
+        {
+            if(j < count)
+            {
+                reports[j] = reports[j - 1];
+            }
+            j -= 1;
+        }
+
+        if(j < count)
+        {
+            reports[j] = r;
+        }
+    }
+
+    return used;
+}
@@ -0,0 +1,101 @@
+#ifndef _XBEE_AIRTIME_H_
+#define _XBEE_AIRTIME_H_
+
+#include "xbee_port.h"
+
+/*! Nodes tracked, the node with the least airtime is evicted for a new one */
+#ifndef XBEE_AIRTIME_NODES
+#define XBEE_AIRTIME_NODES 32
+#endif /* XBEE_AIRTIME_NODES */
+
+/*! Sliding window resolution, the window slides a bucket at a time */
+#ifndef XBEE_AIRTIME_BUCKETS
+#define XBEE_AIRTIME_BUCKETS 8
+#endif /* XBEE_AIRTIME_BUCKETS */
+
+/*! Microseconds one transmission attempt of an 802.15.4 frame occupies
+ * the 2.4 GHz channel
+ *
+ * Counts PHY and MAC framing for the destination and source address
+ * sizes, interframe spacing and, for unicast, the ACK.  CSMA backoff is
+ * not counted, the channel is free for others meanwhile.
+ */
+uint32_t xbee_airtime_us(xbee_address_type_t destination, bool source_16_bit,
+        size_t payload_size) SPECIAL_SECTION;
+
+typedef struct {
+    xbee_address_t address;
+    bool valid;
+    uint32_t tx[XBEE_AIRTIME_BUCKETS];      /*! us spent sending to node */
+    uint32_t rx[XBEE_AIRTIME_BUCKETS];      /*! us node spent sending to us */
+    uint32_t deferred;                      /*! Admissions refused by budget */
+} xbee_airtime_node_t;
+
+typedef struct {
+    xbee_address_t address;
+    uint32_t tx_us;
+    uint32_t rx_us;
+    uint32_t deferred;
+} xbee_airtime_report_t;
+
+/*! Sliding window airtime per node, with a per node budget
+ *
+ * Airtime to a node is charged when a frame is written, assuming one
+ * attempt, and a failed XBEE_TRANSMIT_STATUS (no ACK) adds max_retries
+ * more.  Airtime from a node is charged for every frame received from it.
+ * A node evicted for a new one takes its pending retry charges with it.
+ *
+ * xbee_airtime_admit refuses frames to nodes whose airtime in either
+ * direction over the window has reached budget, so a chatty node is not
+ * also served ahead of the quiet ones.  Refused frames stay queued.
+ *
+ * Time comes from xbee_now, so the XBee's clock must be set.
+ */
+typedef struct {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+
+    xbee_port_transmit_t transmit;  /*! Next transmit stage */
+    void * transmit_ptr;
+
+    bool source_16_bit;     /*! This XBee sends with a 16 bit source (MY set) */
+    uint8_t max_retries;    /*! MAC retries charged for a failed transmit */
+    uint32_t window;        /*! ms */
+    uint32_t budget;        /*! us per window per node and direction, 0 for none */
+
+    size_t bucket;
+    uint32_t bucket_start;
+    xbee_airtime_node_t nodes[XBEE_AIRTIME_NODES];
+
+    uint8_t frame_node[256];        /*! Node charged for each frame id */
+    uint32_t frame_airtime[256];    /*! us charged per attempt */
+    uint8_t frames[XBEE_FRAME_ID_BITMAP_SIZE];
+} xbee_airtime_t;
+
+/*! Registers handler as an observer, see xbee_add_observer, so it sees the 
+ * frames of a mux initialised before it.  transmit is the stage frames go 
+ * to after being charged, e.g. xbee_transmit_gather wrapped as in xbee_port */
+void xbee_airtime_init(xbee_airtime_t * airtime, xbee_interface_t * xbee,
+        bool source_16_bit, uint8_t max_retries, uint32_t window, uint32_t budget,
+        xbee_port_transmit_t transmit, void * transmit_ptr) SPECIAL_SECTION;
+
+void xbee_airtime_stop(xbee_airtime_t * airtime) SPECIAL_SECTION;
+
+/*! Charges and sends frame, signature matches xbee_port_transmit_t, ptr is
+ * the xbee_airtime_t */
+int xbee_airtime_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers) SPECIAL_SECTION;
+
+/*! Budget check, signature matches xbee_port_admit_t, ptr is the xbee_airtime_t */
+bool xbee_airtime_admit(void * ptr, const xbee_address_t * address, 
+        uint8_t priority, size_t size) SPECIAL_SECTION;
+
+/*! Writes up to count nodes with the most airtime over the window, most first
+ *
+ * \return Number of reports written
+ */
+size_t xbee_airtime_top(xbee_airtime_t * airtime, size_t count,
+        xbee_airtime_report_t * reports) SPECIAL_SECTION;
+
+#endif /* _XBEE_AIRTIME_H_ */
@@ -0,0 +1,308 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_airtime.h"
+#include "xbee_node.h"
+#include "xbee_sim.h"
+
+#define TEST_RETRIES (3)
+
+static int test_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    return xbee_transmit_gather(ptr, frame_id, address, option, count, buffers);
+}
+
+static const xbee_airtime_node_t * test_node(const xbee_airtime_t * airtime,
+        const xbee_address_t * address)
+{
+    for(size_t i = 0; i < XBEE_AIRTIME_NODES; ++i)
+    {
+        const xbee_airtime_node_t * n = &airtime->nodes[i];
+        if(n->valid && n->address.type == address->type &&
+           n->address.addr.network_address == address->addr.network_address)
+        {
+            return n;
+        }
+    }
+
+    return NULL;
+}
+
+static uint32_t test_sum(const uint32_t * buckets)
+{
+    uint32_t sum = 0;
+    for(size_t i = 0; i < XBEE_AIRTIME_BUCKETS; ++i)
+    {
+        sum += buckets[i];
+    }
+
+    return sum;
+}
+
+/*! Observers set up after the mux still see the frames it consumes */
+void test_airtime_after_mux(void)
+{
+    static xbee_sim_t sim;
+    static xbee_port_mux_t mux[2];
+    static xbee_port_t ports[2];
+    static xbee_port_message_t queues[2][4];
+    static xbee_airtime_t airtime;
+    static xbee_node_table_t table;
+    assert(xbee_sim_init(&sim, 2, 5) == 0);
+
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    for(size_t i = 0; i < 2; ++i)
+    {
+        xbee_port_mux_init(&mux[i], &sim.nodes[i].xbee, 4);
+        xbee_port_open(&mux[i], &ports[i], 1, 0, 4, 4, queues[i], NULL, NULL);
+    }
+    xbee_airtime_init(&airtime, xbee, true, TEST_RETRIES, 1000, 0, test_transmit, xbee);
+    xbee_port_mux_set_transmit(&mux[0], xbee_airtime_transmit, &airtime);
+    xbee_node_table_init(&table, xbee);
+
+    xbee_address_t peer, local, nobody = {XBEE_16_BIT, {.network_address = 0x99}};
+    xbee_sim_address16(&sim, 1, &peer);
+    xbee_sim_address16(&sim, 0, &local);
+    uint32_t us = xbee_airtime_us(XBEE_16_BIT, true, XBEE_PORT_HEADER_SIZE + 3);
+
+    assert(xbee_port_send(&mux[0], &ports[0], &nobody, 0, 3, "abc") == 0);
+    xbee_sim_step(&sim);
+    assert(ports[0].failed == 1);
+    assert(test_sum(test_node(&airtime, &nobody)->tx) == (1 + TEST_RETRIES)*us);
+
+    assert(xbee_port_send(&mux[1], &ports[1], &local, 0, 3, "abc") == 0);
+    xbee_sim_step(&sim);
+    assert(ports[0].received == 1);
+    assert(test_sum(test_node(&airtime, &peer)->rx) == us);
+
+    const xbee_node_t * n = xbee_node_find(&table, &peer, false);
+    assert(n != NULL);
+    assert(n->rssi == sim.rssi);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A node evicted with a frame in flight doesn't pass its retries on to
+ * the node that takes its slot */
+void test_airtime_evicted(void)
+{
+    static xbee_sim_t sim;
+    static xbee_airtime_t airtime;
+    assert(xbee_sim_init(&sim, 1, 5) == 0);
+
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    xbee_airtime_init(&airtime, xbee, true, TEST_RETRIES, 1000, 0, test_transmit, xbee);
+    uint32_t us = xbee_airtime_us(XBEE_16_BIT, true, 3);
+    xbee_buffer_t buffer = {3, "abc"};
+
+    /* Nobody answers, so every status reports no ACK */
+    for(size_t i = 0; i <= XBEE_AIRTIME_NODES; ++i)
+    {
+        xbee_address_t address = {XBEE_16_BIT, {.network_address = 0x100 + i}};
+        uint8_t frame_id = xbee_alloc_frame_id(xbee);
+        assert(frame_id != 0);
+        assert(xbee_airtime_transmit(&airtime, frame_id, &address, 0, 1, &buffer) == 0);
+    }
+    xbee_sim_step(&sim);
+
+    xbee_address_t first = {XBEE_16_BIT, {.network_address = 0x100}};
+    xbee_address_t last = {XBEE_16_BIT, {.network_address = 0x100 + XBEE_AIRTIME_NODES}};
+    assert(test_node(&airtime, &first) == NULL);
+    assert(test_sum(test_node(&airtime, &last)->tx) == (1 + TEST_RETRIES)*us);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Frames to or from a node over budget are refused until the window
+ * slides past them, other nodes are still admitted */
+void test_airtime_admit(void)
+{
+    static xbee_sim_t sim;
+    static xbee_airtime_t airtime;
+    assert(xbee_sim_init(&sim, 3, 5) == 0);
+
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    uint32_t us = xbee_airtime_us(XBEE_16_BIT, true, 3);
+    xbee_airtime_init(&airtime, xbee, true, TEST_RETRIES, 80, 2*us, test_transmit, xbee);
+    xbee_buffer_t buffer = {3, "abc"};
+
+    xbee_address_t local, near, far;
+    xbee_sim_address16(&sim, 0, &local);
+    xbee_sim_address16(&sim, 1, &near);
+    xbee_sim_address16(&sim, 2, &far);
+
+    /* Unknown nodes are under budget */
+    assert(xbee_airtime_admit(&airtime, &near, 0, 3));
+    assert(xbee_airtime_transmit(&airtime, 0, &near, 0, 1, &buffer) == 0);
+    assert(xbee_airtime_admit(&airtime, &near, 0, 3));
+    assert(xbee_airtime_transmit(&airtime, 0, &near, 0, 1, &buffer) == 0);
+    assert(!xbee_airtime_admit(&airtime, &near, 0, 3));
+    assert(!xbee_airtime_admit(&airtime, &near, 0, 3));
+    assert(test_node(&airtime, &near)->deferred == 2);
+    assert(xbee_airtime_admit(&airtime, &far, 0, 3));
+
+    /* Half the window on, the frames still count */
+    xbee_sim_advance(&sim, 40);
+    assert(!xbee_airtime_admit(&airtime, &near, 0, 3));
+
+    /* Airtime from a node counts against frames to it */
+    for(size_t i = 0; i < 2; ++i)
+    {
+        assert(xbee_transmit(&sim.nodes[2].xbee, 0, &local, 0, 3, "abc") == 0);
+    }
+    xbee_sim_step(&sim);
+    assert(test_sum(test_node(&airtime, &far)->rx) >= 2*us);
+    assert(!xbee_airtime_admit(&airtime, &far, 0, 3));
+
+    xbee_sim_advance(&sim, 40);
+    assert(xbee_airtime_admit(&airtime, &near, 0, 3));
+    assert(!xbee_airtime_admit(&airtime, &far, 0, 3));
+    xbee_sim_advance(&sim, 40);
+    assert(xbee_airtime_admit(&airtime, &far, 0, 3));
+
+    printf("%s passed\n", __func__);
+}
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_airtime_t airtime;
+    xbee_port_mux_t mux[3];
+    xbee_port_t ports[3][2];
+    xbee_port_message_t queues[3][2][8];
+    size_t received[3];
+    char log[3][16];                /*! First bytes of what each node received */
+} test_mux_t;
+
+static void test_mux_receive(void * ptr, xbee_port_t * port,
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data)
+{
+    test_mux_t * t = ptr;
+    size_t node = port == &t->ports[1][0] || port == &t->ports[1][1] ? 1 : 2;
+    if(t->received[node] < sizeof(t->log[node]) - 1)
+    {
+        t->log[node][t->received[node]] = ((const char *)data)[0];
+    }
+    t->received[node] += 1;
+}
+
+/*! Node 0 sends through the airtime stages to nodes 1 and 2, on ports 1
+ * and 2 of equal priority */
+static void test_mux_setup(test_mux_t * t, uint32_t window, uint32_t budget)
+{
+    memset(t, 0, sizeof(*t));
+    assert(xbee_sim_init(&t->sim, 3, 5) == 0);
+
+    xbee_interface_t * xbee = &t->sim.nodes[0].xbee;
+    for(size_t i = 0; i < 3; ++i)
+    {
+        xbee_port_mux_init(&t->mux[i], &t->sim.nodes[i].xbee, 4);
+        for(size_t p = 0; p < 2; ++p)
+        {
+            xbee_port_open(&t->mux[i], &t->ports[i][p], 1 + p, 0, 2, 8, t->queues[i][p],
+                    test_mux_receive, t);
+        }
+    }
+    xbee_airtime_init(&t->airtime, xbee, true, TEST_RETRIES, window, budget,
+            test_transmit, xbee);
+    xbee_port_mux_set_transmit(&t->mux[0], xbee_airtime_transmit, &t->airtime);
+    xbee_port_mux_set_admit(&t->mux[0], xbee_airtime_admit, &t->airtime);
+}
+
+/*! A port always full for node 1 gets no more than the budget, and the
+ * port with a message for node 2 every 10 ms is served in full */
+void test_airtime_fairness(void)
+{
+    static test_mux_t t;
+    uint32_t us = xbee_airtime_us(XBEE_16_BIT, true, XBEE_PORT_HEADER_SIZE + 1);
+    test_mux_setup(&t, 80, 10*us);
+
+    xbee_address_t chatty, quiet;
+    xbee_sim_address16(&t.sim, 1, &chatty);
+    xbee_sim_address16(&t.sim, 2, &quiet);
+
+    for(uint32_t ms = 0; ms < 800; ++ms)
+    {
+        while(xbee_port_send(&t.mux[0], &t.ports[0][0], &chatty, 0, 1, "c") == 0)
+        {
+        }
+        if(ms % 10 == 0)
+        {
+            assert(xbee_port_send(&t.mux[0], &t.ports[0][1], &quiet, 0, 1, "q") == 0);
+        }
+        xbee_sim_advance(&t.sim, 1);
+        assert(xbee_port_mux_run(&t.mux[0]) == 0);
+    }
+    xbee_sim_step(&t.sim);
+
+    /* 10 windows of 10 frames, each bucket's worth the window slides on
+     * freeing room for at most one more frame */
+    assert(t.received[2] == 80);
+    assert(t.received[1] >= 100 && t.received[1] <= 100 + 10 + XBEE_AIRTIME_BUCKETS*10);
+    assert(test_node(&t.airtime, &chatty)->deferred > 0);
+    assert(test_node(&t.airtime, &quiet)->deferred == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Messages for an over budget node don't hold back those for another
+ * node queued behind them on the same port, and go out in order later */
+void test_airtime_head_of_line(void)
+{
+    static test_mux_t t;
+    uint32_t us = xbee_airtime_us(XBEE_16_BIT, true, XBEE_PORT_HEADER_SIZE + 1);
+    test_mux_setup(&t, 80, 3*us);
+
+    xbee_address_t chatty, quiet;
+    xbee_sim_address16(&t.sim, 1, &chatty);
+    xbee_sim_address16(&t.sim, 2, &quiet);
+    xbee_port_t * port = &t.ports[0][0];
+
+    for(size_t i = 0; i < 3; ++i)
+    {
+        assert(xbee_port_send(&t.mux[0], port, &chatty, 0, 1, "a") == 0);
+        xbee_sim_step(&t.sim);
+    }
+    assert(t.received[1] == 3);
+
+    /* Node 1 is over budget now */
+    assert(xbee_port_send(&t.mux[0], port, &chatty, 0, 1, "b") == 0);
+    assert(xbee_port_send(&t.mux[0], port, &quiet, 0, 1, "x") == 0);
+    assert(xbee_port_send(&t.mux[0], port, &chatty, 0, 1, "c") == 0);
+    assert(xbee_port_send(&t.mux[0], port, &quiet, 0, 1, "y") == 0);
+    for(size_t i = 0; i < 4; ++i)
+    {
+        xbee_sim_step(&t.sim);
+        assert(xbee_port_mux_run(&t.mux[0]) == 0);
+    }
+    assert(strcmp(t.log[2], "xy") == 0);
+    assert(t.received[1] == 3 && port->count == 2);
+    assert(test_node(&t.airtime, &chatty)->deferred > 0);
+
+    /* Node 1's budget frees up as the window slides, b then c */
+    for(uint32_t ms = 0; ms < 200 && port->count > 0; ++ms)
+    {
+        xbee_sim_advance(&t.sim, 1);
+        assert(xbee_port_mux_run(&t.mux[0]) == 0);
+    }
+    xbee_sim_step(&t.sim);
+    assert(strcmp(t.log[1], "aaabc") == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_airtime_after_mux();
+    test_airtime_evicted();
+    test_airtime_admit();
+    test_airtime_fairness();
+    test_airtime_head_of_line();
+
+    return 0;
+}
@@ -0,0 +1,426 @@
+#include "xbee_coord.h"
+#include <assert.h>
+#include <string.h>
+
+/*! Message layout
+ *
+ * byte 0: XBEE_COORD_UPLINK or XBEE_COORD_DOWNLINK
+ * byte 1: gateway id
+ * byte 2: address type (XBEE_16_BIT or XBEE_64_BIT)
+ * byte 3-10: address, big endian
+ * byte 11: RSSI (uplink) or transmit option (downlink)
+ * byte 12-15: gateway receive time (uplink) or 0 (downlink), big endian,
+ *             by the gateway's clock, so not compared across gateways
+ * byte 16-: payload
+ */
+#define XBEE_COORD_UPLINK   (0x01)
+#define XBEE_COORD_DOWNLINK (0x02)
+#define XBEE_COORD_HEADER_SIZE (16)
+
+static void xbee_coord_write_header(uint8_t * header, uint8_t type, uint8_t gateway, 
+        const xbee_address_t * address, uint8_t extra, uint32_t time)
+{
+    uint64_t addr = address->type == XBEE_16_BIT ? 
+        address->addr.network_address : address->addr.address;
+
+    header[0] = type;
+    header[1] = gateway;
+    header[2] = address->type;
+    for(size_t i = 0; i < 8; ++i)
+    {
+        header[3+i] = (addr >> (64 - 8*(i+1))) & 0xFF;
+    }
+    header[11] = extra;
+    header[12] = time >> 24;
+    header[13] = time >> 16;
+    header[14] = time >> 8;
+    header[15] = time;
+}
+
+static int xbee_coord_read_header(size_t size, const uint8_t * message, 
+        xbee_address_t * address)
+{
+    if(size < XBEE_COORD_HEADER_SIZE || 
+       (message[2] != XBEE_16_BIT && message[2] != XBEE_64_BIT))
+    {
+        return XBEE_ERR_COORD_MESSAGE;
+    }
+
+    uint64_t addr = 0;
+    for(size_t i = 0; i < 8; ++i)
+    {
+        addr |= (uint64_t)message[3+i] << (64 - 8*(i+1));
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->type = message[2];
+    if(address->type == XBEE_16_BIT)
+    {
+        address->addr.network_address = addr;
+    }
+    else
+    {
+        address->addr.address = addr;
+    }
+
+    return 0;
+}
+
+static bool xbee_coord_same_address(const xbee_address_t * a, const xbee_address_t * b)
+{
+    if(a->type != b->type)
+    {
+        return false;
+    }
+
+    if(a->type == XBEE_16_BIT)
+    {
+        return a->addr.network_address == b->addr.network_address;
+    }
+
+    return a->addr.address == b->addr.address;
+}
+
+static int xbee_coord_link_send(const xbee_coord_link_t * link, 
+        const uint8_t * header, size_t size, const void * data) SPECIAL_SECTION;
+static int xbee_coord_link_send(const xbee_coord_link_t * link, 
+        const uint8_t * header, size_t size, const void * data)
+{
+    uint8_t message[XBEE_COORD_MAX_MESSAGE];
+    if(XBEE_COORD_HEADER_SIZE + size > sizeof(message))
+    {
+        return XBEE_ERR_TOO_LARGE;
+    }
+
+    memcpy(message, header, XBEE_COORD_HEADER_SIZE);
+    memcpy(message + XBEE_COORD_HEADER_SIZE, data, size);
+
+    int ret = link->send(link->ptr, message, XBEE_COORD_HEADER_SIZE + size);
+    if(ret != (int)(XBEE_COORD_HEADER_SIZE + size))
+    {
+        return ret < 0 ? ret : XBEE_ERR_COORD_MESSAGE;
+    }
+
+    return 0;
+}
+
+static int xbee_gateway_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_gateway_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_gateway_t * gateway = ptr;
+
+    xbee_address_t source;
+    if(xbee_frame_source(frame, &source) != 0)
+    {
+        return 0;
+    }
+
+    uint8_t header[XBEE_COORD_HEADER_SIZE];
+    xbee_coord_write_header(header, XBEE_COORD_UPLINK, gateway->id, 
+            &source, frame->frame.receive.rssi, xbee->rx_time);
+
+    if(xbee_coord_link_send(&gateway->link, header, 
+                frame->frame.receive.packet_size, frame->frame.receive.packet_data) == 0)
+    {
+        gateway->reported += 1;
+    }
+    else
+    {
+        gateway->errors += 1;
+    }
+
+    return 1;
+}
+
+void xbee_gateway_init(xbee_gateway_t * gateway, xbee_interface_t * xbee,
+        uint8_t id, const xbee_coord_link_t * link)
+{
+    assert(gateway);
+    assert(xbee);
+    assert(link && link->send);
+
+    memset(gateway, 0, sizeof(*gateway));
+    gateway->xbee = xbee;
+    gateway->id = id;
+    gateway->link = *link;
+
+    gateway->handler.ptr = gateway;
+    gateway->handler.frame = xbee_gateway_frame;
+    xbee_add_handler(xbee, &gateway->handler);
+}
+
+void xbee_gateway_stop(xbee_gateway_t * gateway)
+{
+    assert(gateway);
+    xbee_remove_handler(gateway->xbee, &gateway->handler);
+}
+
+int xbee_gateway_input(xbee_gateway_t * gateway, size_t size, const void * message)
+{
+    assert(gateway);
+    assert(message);
+
+    const uint8_t * m = message;
+    xbee_address_t destination;
+    int ret = xbee_coord_read_header(size, m, &destination);
+    if(ret != 0 || m[0] != XBEE_COORD_DOWNLINK || m[1] != gateway->id)
+    {
+        gateway->errors += 1;
+        return XBEE_ERR_COORD_MESSAGE;
+    }
+
+    ret = xbee_transmit(gateway->xbee, 0, &destination, m[11], 
+            size - XBEE_COORD_HEADER_SIZE, m + XBEE_COORD_HEADER_SIZE);
+    if(ret == 0)
+    {
+        gateway->transmitted += 1;
+    }
+    else
+    {
+        gateway->errors += 1;
+    }
+
+    return ret;
+}
+
+void xbee_coord_init(xbee_coord_t * coord, size_t gateway_count, 
+        const xbee_coord_link_t * gateways, uint32_t window, uint32_t rssi_max_age,
+        xbee_coord_deliver_t deliver, void * ptr)
+{
+    assert(coord);
+    assert(gateway_count > 0 && gateway_count <= XBEE_COORD_GATEWAYS);
+    assert(gateways);
+    assert((XBEE_COORD_DEDUP_SIZE & (XBEE_COORD_DEDUP_SIZE-1)) == 0);
+    assert(XBEE_COORD_GATEWAYS <= 32);
+
+    memset(coord, 0, sizeof(*coord));
+    coord->gateway_count = gateway_count;
+    memcpy(coord->gateways, gateways, gateway_count*sizeof(gateways[0]));
+    coord->window = window;
+    coord->rssi_max_age = rssi_max_age;
+    coord->deliver = deliver;
+    coord->ptr = ptr;
+}
+
+static xbee_coord_node_t * xbee_coord_find_node(const xbee_coord_t * coord, 
+        const xbee_address_t * address) SPECIAL_SECTION;
+static xbee_coord_node_t * xbee_coord_find_node(const xbee_coord_t * coord, 
+        const xbee_address_t * address)
+{
+    for(size_t i = 0; i < XBEE_COORD_NODES; ++i)
+    {
+        const xbee_coord_node_t * n = &coord->nodes[i];
+        if(n->valid && xbee_coord_same_address(&n->address, address))
+        {
+            return (xbee_coord_node_t *)n;
+        }
+    }
+
+    return NULL;
+}
+
+static void xbee_coord_heard(xbee_coord_t * coord, uint32_t now, 
+        const xbee_address_t * source, uint8_t gateway, uint8_t rssi) SPECIAL_SECTION;
+static void xbee_coord_heard(xbee_coord_t * coord, uint32_t now, 
+        const xbee_address_t * source, uint8_t gateway, uint8_t rssi)
+{
+    xbee_coord_node_t * n = xbee_coord_find_node(coord, source);
+    if(n == NULL)
+    {
+        /* Replace a free entry, or the node heard least recently */
+        n = &coord->nodes[0];
+        for(size_t i = 0; i < XBEE_COORD_NODES; ++i)
+        {
+            xbee_coord_node_t * e = &coord->nodes[i];
+            if(!e->valid)
+            {
+                n = e;
+                break;
+            }
+
+            if(now - e->last_heard > now - n->last_heard)
+            {
+                n = e;
+            }
+        }
+
+        memset(n, 0, sizeof(*n));
+        n->address = *source;
+        n->valid = true;
+    }
+
+    if(now - n->heard[gateway] > coord->rssi_max_age || n->rssi[gateway] == 0)
+    {
+        n->rssi[gateway] = rssi;
+    }
+    else
+    {
+        /* Smooth out fading, 3/4 history */
+        n->rssi[gateway] = (3*n->rssi[gateway] + rssi + 2)/4;
+    }
+
+    n->heard[gateway] = now;
+    n->last_heard = now;
+}
+
+/*! FNV-1a over source and payload */
+static uint32_t xbee_coord_hash(const xbee_address_t * source, size_t size, const uint8_t * data)
+{
+    uint32_t hash = 2166136261u;
+    uint64_t addr = source->type == XBEE_16_BIT ? 
+        source->addr.network_address : source->addr.address;
+
+    for(size_t i = 0; i < 8; ++i)
+    {
+        hash = (hash ^ ((addr >> (8*i)) & 0xFF)) * 16777619u;
+    }
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/*! Returns true if another gateway reported uplink just before, and
+ * records it otherwise */
+static bool xbee_coord_seen(xbee_coord_t * coord, uint32_t now,
+        const xbee_address_t * source, uint32_t hash, uint8_t gateway) SPECIAL_SECTION;
+static bool xbee_coord_seen(xbee_coord_t * coord, uint32_t now,
+        const xbee_address_t * source, uint32_t hash, uint8_t gateway)
+{
+    xbee_coord_seen_t * slot = NULL;
+    size_t idx = hash & (XBEE_COORD_DEDUP_SIZE-1);
+    uint32_t bit = (uint32_t)1 << gateway;
+
+    /* Open addressing, probe ends at a never used entry.  Expired entries
+     * are reused, but live entries may follow them in the probe sequence.
+     * A node repeating a payload has an entry per frame. */
+    for(size_t i = 0; i < XBEE_COORD_DEDUP_SIZE; ++i)
+    {
+        xbee_coord_seen_t * s = &coord->seen[(idx + i) & (XBEE_COORD_DEDUP_SIZE-1)];
+        if(!s->valid)
+        {
+            if(slot == NULL)
+            {
+                slot = s;
+            }
+            break;
+        }
+
+        if(now - s->time > coord->window)
+        {
+            if(slot == NULL)
+            {
+                slot = s;
+            }
+            continue;
+        }
+
+        if(s->hash == hash && xbee_coord_same_address(&s->source, source) &&
+           (s->gateways & bit) == 0 && now - s->time <= XBEE_COORD_ARRIVAL_TOLERANCE)
+        {
+            s->gateways |= bit;
+            return true;
+        }
+    }
+
+    if(slot == NULL)
+    {
+        /* Table full of live entries, evict the home slot */
+        slot = &coord->seen[idx];
+    }
+
+    slot->source = *source;
+    slot->hash = hash;
+    slot->time = now;
+    slot->gateways = bit;
+    slot->valid = true;
+    return false;
+}
+
+int xbee_coord_input(xbee_coord_t * coord, uint32_t now, 
+        size_t size, const void * message)
+{
+    assert(coord);
+    assert(message);
+
+    const uint8_t * m = message;
+    xbee_address_t source;
+    int ret = xbee_coord_read_header(size, m, &source);
+    if(ret != 0 || m[0] != XBEE_COORD_UPLINK || m[1] >= coord->gateway_count)
+    {
+        return XBEE_ERR_COORD_MESSAGE;
+    }
+
+    const uint8_t * data = m + XBEE_COORD_HEADER_SIZE;
+    size -= XBEE_COORD_HEADER_SIZE;
+
+    xbee_coord_heard(coord, now, &source, m[1], m[11]);
+
+    if(xbee_coord_seen(coord, now, &source, xbee_coord_hash(&source, size, data), m[1]))
+    {
+        coord->duplicates += 1;
+        return 0;
+    }
+
+    coord->delivered += 1;
+    if(coord->deliver)
+    {
+        coord->deliver(coord->ptr, coord, &source, size, data);
+    }
+
+    return 0;
+}
+
+int xbee_coord_best_gateway(const xbee_coord_t * coord, uint32_t now, 
+        const xbee_address_t * node)
+{
+    assert(coord);
+    assert(node);
+
+    const xbee_coord_node_t * n = xbee_coord_find_node(coord, node);
+    if(n == NULL)
+    {
+        return -1;
+    }
+
+    int best = -1;
+    for(size_t i = 0; i < coord->gateway_count; ++i)
+    {
+        if(n->rssi[i] == 0 || now - n->heard[i] > coord->rssi_max_age)
+        {
+            continue;
+        }
+
+        /* RSSI is -dBm, lower is stronger */
+        if(best < 0 || n->rssi[i] < n->rssi[best])
+        {
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+int xbee_coord_send(xbee_coord_t * coord, uint32_t now, const xbee_address_t * destination, 
+        uint8_t option, size_t size, const void * data)
+{
+    assert(coord);
+    assert(destination);
+    assert(destination->type == XBEE_16_BIT || destination->type == XBEE_64_BIT);
+
+    int gateway = xbee_coord_best_gateway(coord, now, destination);
+    if(gateway < 0)
+    {
+        return XBEE_ERR_NO_GATEWAY;
+    }
+
+    uint8_t header[XBEE_COORD_HEADER_SIZE];
+    xbee_coord_write_header(header, XBEE_COORD_DOWNLINK, gateway, destination, option, 0);
+
+    return xbee_coord_link_send(&coord->gateways[gateway], header, size, data);
+}
@@ -0,0 +1,147 @@
+#ifndef _XBEE_COORD_H_
+#define _XBEE_COORD_H_
+
+#include "xbee.h"
+
+#ifndef XBEE_COORD_GATEWAYS
+#define XBEE_COORD_GATEWAYS 4
+#endif /* XBEE_COORD_GATEWAYS */
+
+#ifndef XBEE_COORD_NODES
+#define XBEE_COORD_NODES 64
+#endif /* XBEE_COORD_NODES */
+
+/*! Number of (source, hash) pairs remembered, must be a power of 2 */
+#ifndef XBEE_COORD_DEDUP_SIZE
+#define XBEE_COORD_DEDUP_SIZE 128
+#endif /* XBEE_COORD_DEDUP_SIZE */
+
+/*! Reports of one payload reaching the coordinator further apart than
+ * this, ms, are different frames
+ *
+ * Covers the spread in latency between the gateways' links, and must be
+ * below the shortest interval a node sends the same payload again at.
+ */
+#ifndef XBEE_COORD_ARRIVAL_TOLERANCE
+#define XBEE_COORD_ARRIVAL_TOLERANCE 50
+#endif /* XBEE_COORD_ARRIVAL_TOLERANCE */
+
+/*! Largest coordinator message, header plus a full RF payload */
+#define XBEE_COORD_MAX_MESSAGE (16 + XBEE_MAX_RF_PAYLOAD)
+
+/*! Datagram link between a gateway and the coordinator, e.g. a Unix socket 
+ *
+ * send conforms to the posix send interface, and must write whole datagrams.
+ */
+typedef struct {
+    void * ptr;
+    int (*send)(void * ptr, const void * buf, size_t nbyte);
+} xbee_coord_link_t;
+
+/*! Gateway side, registered as a handler on the gateway's radio
+ *
+ * Every received frame is reported to the coordinator with its RSSI and
+ * receive time (xbee_interface_t::rx_time, 0 without a clock) instead of
+ * being passed on to later handlers.  Downlinks from the coordinator are
+ * transmitted with xbee_gateway_input.
+ */
+typedef struct {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+    uint8_t id;
+    xbee_coord_link_t link;
+
+    uint32_t reported;
+    uint32_t transmitted;
+    uint32_t errors;
+} xbee_gateway_t;
+
+void xbee_gateway_init(xbee_gateway_t * gateway, xbee_interface_t * xbee,
+        uint8_t id, const xbee_coord_link_t * link) SPECIAL_SECTION;
+
+void xbee_gateway_stop(xbee_gateway_t * gateway) SPECIAL_SECTION;
+
+/*! Handles datagram received from the coordinator
+ *
+ * \return 0 on success, otherwise error from xbee_transmit
+ */
+int xbee_gateway_input(xbee_gateway_t * gateway, size_t size, const void * message) SPECIAL_SECTION;
+
+typedef struct {
+    xbee_address_t address;
+    bool valid;
+    uint8_t rssi[XBEE_COORD_GATEWAYS];      /*! Smoothed -dBm, as heard by each gateway */
+    uint32_t heard[XBEE_COORD_GATEWAYS];    /*! Time node was last heard by each gateway */
+    uint32_t last_heard;
+} xbee_coord_node_t;
+
+typedef struct {
+    xbee_address_t source;
+    uint32_t hash;
+    uint32_t time;              /*! Arrival of the first report */
+    uint32_t gateways;          /*! Bit n set once gateway n reported it */
+    bool valid;
+} xbee_coord_seen_t;
+
+typedef struct xbee_coord xbee_coord_t;
+
+/*! Called once per distinct uplink, however many gateways heard it */
+typedef void (*xbee_coord_deliver_t)(void * ptr, xbee_coord_t * coord, 
+        const xbee_address_t * source, size_t size, const void * data);
+
+/*! Coordinator of redundant gateways
+ *
+ * Uplinks reported by several gateways are delivered once.  A report is a
+ * copy of an earlier one if it has the same source and payload hash,
+ * comes from another gateway, and reaches the coordinator within
+ * XBEE_COORD_ARRIVAL_TOLERANCE of it.  Arrival is by the coordinator's
+ * own clock, the gateways' clocks needn't agree.  A gateway never reports
+ * a frame twice, so a node sending the same payload again is delivered
+ * again.  Each report 
+ * also updates the node's RSSI as heard by that gateway, and downlinks are
+ * sent only through the gateway that heard the node best within 
+ * rssi_max_age.
+ *
+ * Times are in milliseconds from any monotonic clock, and may wrap.
+ */
+struct xbee_coord {
+    size_t gateway_count;
+    xbee_coord_link_t gateways[XBEE_COORD_GATEWAYS];
+
+    uint32_t window;
+    uint32_t rssi_max_age;
+
+    xbee_coord_deliver_t deliver;
+    void * ptr;
+
+    xbee_coord_node_t nodes[XBEE_COORD_NODES];
+    xbee_coord_seen_t seen[XBEE_COORD_DEDUP_SIZE];
+
+    uint32_t delivered;
+    uint32_t duplicates;
+};
+
+#define XBEE_ERR_COORD_MESSAGE (-21)    /*! Malformed coordinator message */
+#define XBEE_ERR_NO_GATEWAY    (-22)    /*! No gateway heard the node recently */
+
+void xbee_coord_init(xbee_coord_t * coord, size_t gateway_count, 
+        const xbee_coord_link_t * gateways, uint32_t window, uint32_t rssi_max_age,
+        xbee_coord_deliver_t deliver, void * ptr) SPECIAL_SECTION;
+
+/*! Handles datagram received from a gateway */
+int xbee_coord_input(xbee_coord_t * coord, uint32_t now, 
+        size_t size, const void * message) SPECIAL_SECTION;
+
+/*! Sends downlink through the gateway that hears destination best
+ *
+ * \return 0 on success, XBEE_ERR_NO_GATEWAY if no gateway heard 
+ *         destination within rssi_max_age, otherwise error from the link
+ */
+int xbee_coord_send(xbee_coord_t * coord, uint32_t now, const xbee_address_t * destination, 
+        uint8_t option, size_t size, const void * data) SPECIAL_SECTION;
+
+/*! Returns gateway that hears node best, or -1 if none heard it recently */
+int xbee_coord_best_gateway(const xbee_coord_t * coord, uint32_t now, 
+        const xbee_address_t * node) SPECIAL_SECTION;
+
+#endif /* _XBEE_COORD_H_ */
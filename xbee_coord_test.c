@@ -0,0 +1,221 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xbee_coord_unix.h"
+#include "xbee_sim.h"
+
+#define TEST_GATEWAYS (2)
+#define TEST_WINDOW (1000)
+
+/* Node 0 is the sensor, nodes 1 and 2 the gateways' radios.  Gateways
+ * and coordinator talk over Unix datagram sockets. */
+typedef struct {
+    xbee_sim_t sim;
+    xbee_gateway_t gateways[TEST_GATEWAYS];
+    xbee_coord_t coord;
+
+    int coord_fd;
+    int gateway_fds[TEST_GATEWAYS];
+    xbee_unix_link_t up[TEST_GATEWAYS];
+    xbee_unix_link_t down[TEST_GATEWAYS];
+    char coord_path[64];
+    char gateway_paths[TEST_GATEWAYS][80];
+
+    size_t delivered;
+} test_setup_t;
+
+static test_setup_t test;
+
+static void test_deliver(void * ptr, xbee_coord_t * coord,
+        const xbee_address_t * source, size_t size, const void * data)
+{
+    test.delivered += 1;
+}
+
+static void test_setup(void)
+{
+    memset(&test, 0, sizeof(test));
+    assert(xbee_sim_init(&test.sim, 1 + TEST_GATEWAYS, 37) == 0);
+
+    snprintf(test.coord_path, sizeof(test.coord_path), "/tmp/xbee_coord_test.%d", (int)getpid());
+    test.coord_fd = xbee_unix_socket(test.coord_path);
+    assert(test.coord_fd >= 0);
+
+    xbee_coord_link_t links[TEST_GATEWAYS];
+    for(size_t i = 0; i < TEST_GATEWAYS; ++i)
+    {
+        snprintf(test.gateway_paths[i], sizeof(test.gateway_paths[i]), "%s.%zu",
+                test.coord_path, i);
+        test.gateway_fds[i] = xbee_unix_socket(test.gateway_paths[i]);
+        assert(test.gateway_fds[i] >= 0);
+
+        xbee_coord_link_t up;
+        assert(xbee_unix_link_init(&test.up[i], test.gateway_fds[i], test.coord_path, &up) == 0);
+        assert(xbee_unix_link_init(&test.down[i], test.coord_fd, test.gateway_paths[i],
+                &links[i]) == 0);
+        xbee_gateway_init(&test.gateways[i], &test.sim.nodes[1 + i].xbee, i, &up);
+    }
+
+    xbee_coord_init(&test.coord, TEST_GATEWAYS, links, TEST_WINDOW, 60000,
+            test_deliver, NULL);
+}
+
+static void test_teardown(void)
+{
+    close(test.coord_fd);
+    unlink(test.coord_path);
+    for(size_t i = 0; i < TEST_GATEWAYS; ++i)
+    {
+        close(test.gateway_fds[i]);
+        unlink(test.gateway_paths[i]);
+    }
+}
+
+/*! Passes every datagram waiting on the sockets on */
+static void test_pump(void)
+{
+    uint8_t message[XBEE_COORD_MAX_MESSAGE];
+    int size;
+
+    while((size = xbee_unix_recv(test.coord_fd, message, sizeof(message))) > 0)
+    {
+        assert(xbee_coord_input(&test.coord, test.sim.clock.now, size, message) == 0);
+    }
+
+    for(size_t i = 0; i < TEST_GATEWAYS; ++i)
+    {
+        while((size = xbee_unix_recv(test.gateway_fds[i], message, sizeof(message))) > 0)
+        {
+            assert(xbee_gateway_input(&test.gateways[i], size, message) == 0);
+        }
+    }
+}
+
+/*! Gateway hears the sensor send payload */
+static void test_hear(size_t gateway, uint8_t rssi, const char * payload)
+{
+    uint8_t frame[32] = {XBEE_RECEIVE_16_BIT, 0x00, 0x01, rssi, 0x00};
+    size_t size = strlen(payload);
+    memcpy(&frame[5], payload, size);
+    xbee_sim_push_frame(&test.sim, 1 + gateway, 5 + size, frame);
+}
+
+/*! One frame heard by both gateways is delivered once, the same payload
+ * sent again is delivered again */
+void test_coord_repeat(void)
+{
+    test_setup();
+
+    test_hear(0, 40, "t=21");
+    test_hear(1, 50, "t=21");
+    xbee_sim_step(&test.sim);
+    test_pump();
+    assert(test.delivered == 1 && test.coord.duplicates == 1);
+
+    xbee_sim_advance(&test.sim, 100);
+    test_hear(1, 50, "t=21");
+    test_hear(0, 40, "t=21");
+    xbee_sim_step(&test.sim);
+    test_pump();
+    assert(test.delivered == 2 && test.coord.duplicates == 2);
+
+    /* A gateway that missed the first frame and hears a later one */
+    xbee_sim_advance(&test.sim, 100);
+    test_hear(0, 40, "t=22");
+    xbee_sim_step(&test.sim);
+    test_pump();
+    xbee_sim_advance(&test.sim, 100);
+    test_hear(0, 40, "t=22");
+    test_hear(1, 50, "t=22");
+    xbee_sim_step(&test.sim);
+    test_pump();
+    assert(test.delivered == 4 && test.coord.duplicates == 3);
+
+    test_teardown();
+    printf("%s passed\n", __func__);
+}
+
+/*! Gateway 1's clock, an hour ahead of gateway 0's */
+static uint32_t test_ahead_clock(void * ptr)
+{
+    xbee_sim_t * sim = ptr;
+    return sim->clock.now + 3600000;
+}
+
+/*! Gateways whose clocks disagree, and whose reports reach the
+ * coordinator some ms apart, still have their copies recognised */
+void test_coord_clock_offset(void)
+{
+    test_setup();
+    test.sim.nodes[2].uart.clock = test_ahead_clock;
+
+    test_hear(0, 40, "t=23");
+    test_hear(1, 50, "t=23");
+    xbee_sim_step(&test.sim);
+    test_pump();
+    assert(test.delivered == 1 && test.coord.duplicates == 1);
+
+    /* Gateway 1's report is held up on its way */
+    xbee_sim_advance(&test.sim, 100);
+    test_hear(0, 40, "t=24");
+    xbee_sim_step(&test.sim);
+    test_pump();
+    xbee_sim_advance(&test.sim, XBEE_COORD_ARRIVAL_TOLERANCE);
+    test_hear(1, 50, "t=24");
+    xbee_sim_step(&test.sim);
+    test_pump();
+    assert(test.delivered == 2 && test.coord.duplicates == 2);
+
+    /* Sent again later, heard by gateway 1 alone */
+    xbee_sim_advance(&test.sim, 100);
+    test_hear(1, 50, "t=24");
+    xbee_sim_step(&test.sim);
+    test_pump();
+    assert(test.delivered == 3 && test.coord.duplicates == 2);
+
+    test_teardown();
+    printf("%s passed\n", __func__);
+}
+
+/*! Downlinks go out once, from the gateway hearing the sensor best */
+void test_coord_downlink(void)
+{
+    test_setup();
+
+    test_hear(0, 70, "hello");
+    test_hear(1, 45, "hello");
+    xbee_sim_step(&test.sim);
+    test_pump();
+
+    xbee_address_t sensor;
+    xbee_sim_address16(&test.sim, 0, &sensor);
+    assert(xbee_coord_best_gateway(&test.coord, test.sim.clock.now, &sensor) == 1);
+
+    uint32_t delivered = test.sim.delivered;
+    assert(xbee_coord_send(&test.coord, test.sim.clock.now, &sensor, 0, 2, "on") == 0);
+    test_pump();
+    xbee_sim_step(&test.sim);
+    assert(test.gateways[0].transmitted == 0 && test.gateways[1].transmitted == 1);
+    assert(test.sim.delivered == delivered + 1);
+
+    xbee_address_t nobody = {XBEE_16_BIT, {.network_address = 0x99}};
+    assert(xbee_coord_send(&test.coord, test.sim.clock.now, &nobody, 0, 2, "on") ==
+            XBEE_ERR_NO_GATEWAY);
+
+    test_teardown();
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_coord_repeat();
+    test_coord_clock_offset();
+    test_coord_downlink();
+
+    return 0;
+}
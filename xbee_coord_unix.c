@@ -0,0 +1,80 @@
+#include "xbee_coord_unix.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+int xbee_unix_socket(const char * path)
+{
+    struct sockaddr_un addr;
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    unlink(path);
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+       fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+int xbee_unix_link_init(xbee_unix_link_t * link, int fd, const char * peer_path,
+        xbee_coord_link_t * coord_link)
+{
+    if(strlen(peer_path) >= sizeof(link->peer.sun_path))
+    {
+        return -1;
+    }
+
+    memset(link, 0, sizeof(*link));
+    link->fd = fd;
+    link->peer.sun_family = AF_UNIX;
+    strcpy(link->peer.sun_path, peer_path);
+
+    coord_link->ptr = link;
+    coord_link->send = xbee_unix_send;
+    return 0;
+}
+
+int xbee_unix_send(void * ptr, const void * buf, size_t nbyte)
+{
+    xbee_unix_link_t * link = ptr;
+
+    int ret = sendto(link->fd, buf, nbyte, 0, 
+            (struct sockaddr *)&link->peer, sizeof(link->peer));
+    if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return 0;
+    }
+
+    return ret;
+}
+
+int xbee_unix_recv(int fd, void * buf, size_t nbyte)
+{
+    int ret = recv(fd, buf, nbyte, 0);
+    if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return 0;
+    }
+
+    return ret;
+}
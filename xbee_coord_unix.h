@@ -0,0 +1,38 @@
+#ifndef _XBEE_COORD_UNIX_H_
+#define _XBEE_COORD_UNIX_H_
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "xbee_coord.h"
+
+/*! Unix datagram socket link between gateway and coordinator processes */
+typedef struct {
+    int fd;
+    struct sockaddr_un peer;
+} xbee_unix_link_t;
+
+/*! Opens nonblocking Unix datagram socket bound to path
+ *
+ * \return File descriptor, or -1 and errno set
+ */
+int xbee_unix_socket(const char * path);
+
+/*! Sets up link to send from fd to the socket bound at peer_path, and 
+ * fills coord_link to send over it
+ *
+ * \return 0 on success, -1 if peer_path is too long
+ */
+int xbee_unix_link_init(xbee_unix_link_t * link, int fd, const char * peer_path,
+        xbee_coord_link_t * coord_link);
+
+/*! Send datagram, conforms to xbee_coord_link_t send */
+int xbee_unix_send(void * ptr, const void * buf, size_t nbyte);
+
+/*! Receives one datagram, conforms to posix read interface
+ *
+ * \return Size of datagram, 0 if none is waiting, <0 on error
+ */
+int xbee_unix_recv(int fd, void * buf, size_t nbyte);
+
+#endif /* _XBEE_COORD_UNIX_H_ */
@@ -0,0 +1,233 @@
+#include "xbee_duty_cycle.h"
+#include <assert.h>
+#include <string.h>
+
+#define XBEE_DUTY_CYCLE_RING (XBEE_DUTY_CYCLE_BUCKETS + 1)
+
+/*! Rounded up, so the buckets never span less than the window */
+static uint32_t xbee_duty_cycle_width(const xbee_duty_cycle_t * duty)
+{
+    return (duty->window + XBEE_DUTY_CYCLE_BUCKETS - 1) / XBEE_DUTY_CYCLE_BUCKETS;
+}
+
+/*! Moves to the bucket holding now, dropping buckets wholly outside the window
+ *
+ * The window spans XBEE_DUTY_CYCLE_BUCKETS bucket widths, which may touch
+ * XBEE_DUTY_CYCLE_BUCKETS + 1 buckets, so that many are kept.
+ */
+static void xbee_duty_cycle_advance(xbee_duty_cycle_t * duty)
+{
+    uint32_t now = xbee_now(duty->xbee);
+    uint32_t width = xbee_duty_cycle_width(duty);
+
+    for(size_t n = 0; now - duty->bucket_start >= width; ++n)
+    {
+        if(n == XBEE_DUTY_CYCLE_RING)
+        {
+            /* Everything has left the window, start over at now */
+            duty->bucket_start = now;
+            break;
+        }
+
+        duty->bucket = (duty->bucket + 1) % XBEE_DUTY_CYCLE_RING;
+        duty->bucket_start += width;
+        duty->used -= duty->buckets[duty->bucket];
+        duty->buckets[duty->bucket] = 0;
+    }
+}
+
+static void xbee_duty_cycle_charge(xbee_duty_cycle_t * duty, uint32_t us)
+{
+    duty->buckets[duty->bucket] += us;
+    duty->used += us;
+}
+
+/*! Takes us back off the bucket that started at start, if it is still counted */
+static void xbee_duty_cycle_refund(xbee_duty_cycle_t * duty, uint32_t start, uint32_t us)
+{
+    uint32_t width = xbee_duty_cycle_width(duty);
+    uint32_t age = duty->bucket_start - start;
+    if(age >= XBEE_DUTY_CYCLE_RING*width)
+    {
+        return;
+    }
+
+    size_t bucket = (duty->bucket + XBEE_DUTY_CYCLE_RING - age/width) % XBEE_DUTY_CYCLE_RING;
+    if(us > duty->buckets[bucket])
+    {
+        us = duty->buckets[bucket];
+    }
+
+    duty->buckets[bucket] -= us;
+    duty->used -= us;
+}
+
+/*! Airtime a priority may use of the limit */
+static uint32_t xbee_duty_cycle_allowed(const xbee_duty_cycle_t * duty, uint8_t priority)
+{
+    return priority <= duty->reserved_priority ? duty->limit : duty->limit - duty->reserve;
+}
+
+static int xbee_duty_cycle_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_duty_cycle_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_duty_cycle_t * duty = ptr;
+    uint8_t id = frame->frame_id;
+
+    if(frame->api_id != XBEE_TRANSMIT_STATUS ||
+       (duty->frames[id >> 3] & (1 << (id & 7))) == 0)
+    {
+        return 0;
+    }
+
+    duty->frames[id >> 3] &= ~(1 << (id & 7));
+
+    /* No ACK means every retry went out, otherwise they were not needed */
+    if(frame->frame.status != 1)
+    {
+        xbee_duty_cycle_advance(duty);
+        xbee_duty_cycle_refund(duty, duty->frame_start[id],
+                duty->max_retries*duty->frame_airtime[id]);
+    }
+
+    return 0;
+}
+
+void xbee_duty_cycle_init(xbee_duty_cycle_t * duty, xbee_interface_t * xbee,
+        uint32_t bitrate, uint16_t frame_overhead, uint8_t max_retries,
+        uint32_t window, uint32_t limit, uint32_t reserve, uint8_t reserved_priority,
+        xbee_port_transmit_t transmit, void * transmit_ptr)
+{
+    assert(duty);
+    assert(xbee);
+    assert(bitrate > 0);
+    assert(window >= XBEE_DUTY_CYCLE_BUCKETS);
+    assert(reserve <= limit);
+    assert(transmit);
+
+    memset(duty, 0, sizeof(*duty));
+    duty->xbee = xbee;
+    duty->transmit = transmit;
+    duty->transmit_ptr = transmit_ptr;
+    duty->bitrate = bitrate;
+    duty->frame_overhead = frame_overhead;
+    duty->max_retries = max_retries;
+    duty->window = window;
+    duty->limit = limit;
+    duty->reserve = reserve;
+    duty->reserved_priority = reserved_priority;
+    duty->bucket_start = xbee_now(xbee);
+
+    duty->handler.ptr = duty;
+    duty->handler.frame = xbee_duty_cycle_frame;
+    xbee_add_observer(xbee, &duty->handler);
+}
+
+void xbee_duty_cycle_stop(xbee_duty_cycle_t * duty)
+{
+    assert(duty);
+
+    xbee_remove_handler(duty->xbee, &duty->handler);
+}
+
+uint32_t xbee_duty_cycle_airtime(const xbee_duty_cycle_t * duty, size_t size)
+{
+    assert(duty);
+
+    uint64_t bits = 8*(uint64_t)(duty->frame_overhead + size);
+    return (bits*1000000 + duty->bitrate - 1) / duty->bitrate;
+}
+
+int xbee_duty_cycle_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    xbee_duty_cycle_t * duty = ptr;
+
+    assert(duty);
+    assert(buffers || count == 0);
+
+    int ret = duty->transmit(duty->transmit_ptr, frame_id, address, option,
+            count, buffers);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    size_t size = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        size += buffers[i].size;
+    }
+
+    /* Every retry is reserved until the transmit status says otherwise,
+     * so the count never falls short while the frame is in flight */
+    uint32_t us = xbee_duty_cycle_airtime(duty, size);
+    xbee_duty_cycle_advance(duty);
+    xbee_duty_cycle_charge(duty, (1 + duty->max_retries)*us);
+
+    if(frame_id != 0)
+    {
+        duty->frame_airtime[frame_id] = us;
+        duty->frame_start[frame_id] = duty->bucket_start;
+        duty->frames[frame_id >> 3] |= 1 << (frame_id & 7);
+    }
+
+    return 0;
+}
+
+bool xbee_duty_cycle_admit(void * ptr, const xbee_address_t * address,
+        uint8_t priority, size_t size)
+{
+    xbee_duty_cycle_t * duty = ptr;
+
+    assert(duty);
+
+    xbee_duty_cycle_advance(duty);
+
+    uint64_t worst = (uint64_t)(1 + duty->max_retries)*xbee_duty_cycle_airtime(duty, size);
+    if(duty->used + worst > xbee_duty_cycle_allowed(duty, priority))
+    {
+        duty->deferred += 1;
+        return false;
+    }
+
+    duty->admitted += 1;
+    return true;
+}
+
+int xbee_duty_cycle_next(xbee_duty_cycle_t * duty, uint8_t priority, size_t size,
+        uint32_t * when)
+{
+    assert(duty);
+    assert(when);
+
+    xbee_duty_cycle_advance(duty);
+
+    uint64_t worst = (uint64_t)(1 + duty->max_retries)*xbee_duty_cycle_airtime(duty, size);
+    uint32_t allowed = xbee_duty_cycle_allowed(duty, priority);
+    if(worst > allowed)
+    {
+        return XBEE_ERR_TOO_LARGE;
+    }
+
+    uint32_t width = xbee_duty_cycle_width(duty);
+    uint32_t used = duty->used;
+    *when = xbee_now(duty->xbee);
+
+    /* Buckets drop out oldest first, one per width, at the bucket
+     * boundaries, the current one last once all the others are gone */
+    uint32_t boundary = duty->bucket_start;
+    for(size_t i = 1; used + worst > allowed; ++i)
+    {
+        assert(i <= XBEE_DUTY_CYCLE_RING);
+
+        boundary += width;
+        used -= duty->buckets[(duty->bucket + i) % XBEE_DUTY_CYCLE_RING];
+        *when = boundary;
+    }
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef _XBEE_DUTY_CYCLE_H_
+#define _XBEE_DUTY_CYCLE_H_
+
+#include "xbee_port.h"
+
+/*! Sliding window resolution, at most one bucket of budget goes unused */
+#ifndef XBEE_DUTY_CYCLE_BUCKETS
+#define XBEE_DUTY_CYCLE_BUCKETS 60
+#endif /* XBEE_DUTY_CYCLE_BUCKETS */
+
+/*! Regulatory duty cycle limit on the transmit path
+ *
+ * Airtime transmitted in any window ms long never exceeds limit us (e.g.
+ * 36 s per hour for 1%).  Airtime in the window is counted per bucket,
+ * and a bucket is counted until it lies entirely outside the window, so
+ * the count never underestimates.
+ *
+ * A frame is admitted only if it fits even if every MAC retry goes out.
+ * Once sent, every retry is charged, and the retries are refunded when a
+ * transmit status reports anything but no ACK.  Frames sent with frame
+ * id 0 get no status and stay charged in full.  The last reserve us of the
+ * limit are kept for ports with priority at most reserved_priority
+ * (lower values are more important, as in xbee_port).
+ *
+ * Time comes from xbee_now, so the XBee's clock must be set.
+ */
+typedef struct {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+
+    xbee_port_transmit_t transmit;  /*! Next transmit stage */
+    void * transmit_ptr;
+
+    uint32_t bitrate;           /*! On air bit/s */
+    uint16_t frame_overhead;    /*! Bytes on air besides the payload */
+    uint8_t max_retries;
+
+    uint32_t window;            /*! ms */
+    uint32_t limit;             /*! us per window */
+    uint32_t reserve;           /*! us of limit only for reserved priorities */
+    uint8_t reserved_priority;
+
+    size_t bucket;
+    uint32_t bucket_start;
+    uint32_t used;              /*! Sum of buckets */
+    uint32_t buckets[XBEE_DUTY_CYCLE_BUCKETS + 1];
+
+    uint32_t frame_airtime[256];        /*! us of one attempt, per frame id */
+    uint32_t frame_start[256];          /*! Start of the bucket charged, per frame id */
+    uint8_t frames[XBEE_FRAME_ID_BITMAP_SIZE];
+
+    uint32_t admitted;          /*! Admission checks passed */
+    uint32_t deferred;          /*! Admission checks failed */
+} xbee_duty_cycle_t;
+
+/*! Registers handler as an observer, see xbee_add_observer, so it sees the 
+ * statuses of a mux initialised before it.  transmit is the stage frames
+ * go to after being charged */
+void xbee_duty_cycle_init(xbee_duty_cycle_t * duty, xbee_interface_t * xbee,
+        uint32_t bitrate, uint16_t frame_overhead, uint8_t max_retries,
+        uint32_t window, uint32_t limit, uint32_t reserve, uint8_t reserved_priority,
+        xbee_port_transmit_t transmit, void * transmit_ptr) SPECIAL_SECTION;
+
+void xbee_duty_cycle_stop(xbee_duty_cycle_t * duty) SPECIAL_SECTION;
+
+/*! us on air for one attempt at a size byte payload */
+uint32_t xbee_duty_cycle_airtime(const xbee_duty_cycle_t * duty, size_t size) SPECIAL_SECTION;
+
+/*! Charges and sends frame, signature matches xbee_port_transmit_t
+ *
+ * Does not check the limit, see xbee_duty_cycle_admit.
+ */
+int xbee_duty_cycle_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers) SPECIAL_SECTION;
+
+/*! Limit check, signature matches xbee_port_admit_t */
+bool xbee_duty_cycle_admit(void * ptr, const xbee_address_t * address,
+        uint8_t priority, size_t size) SPECIAL_SECTION;
+
+/*! Predicts when a size byte payload of priority will be admitted
+ *
+ * Assumes nothing else is sent meanwhile.  A scheduler can sleep until
+ * *when instead of polling the limit.
+ *
+ * \return 0 and sets *when, or XBEE_ERR_TOO_LARGE if the frame can never
+ *         fit the limit
+ */
+int xbee_duty_cycle_next(xbee_duty_cycle_t * duty, uint8_t priority, size_t size,
+        uint32_t * when) SPECIAL_SECTION;
+
+#endif /* _XBEE_DUTY_CYCLE_H_ */
@@ -0,0 +1,162 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_duty_cycle.h"
+#include "xbee_sim.h"
+
+#define TEST_WINDOW (3600000)       /* 1% of an hour */
+#define TEST_LIMIT (36000000)
+#define TEST_BITRATE (250000)
+#define TEST_RETRIES (3)
+
+static int test_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    return xbee_transmit_gather(ptr, frame_id, address, option, count, buffers);
+}
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_port_mux_t mux;
+    xbee_duty_cycle_t duty;
+    xbee_port_t ports[2];
+    xbee_port_message_t queues[2][8];
+} test_setup_t;
+
+static void test_setup(test_setup_t * t, uint32_t reserve)
+{
+    assert(xbee_sim_init(&t->sim, 2, 1) == 0);
+
+    xbee_interface_t * xbee = &t->sim.nodes[0].xbee;
+    xbee_port_mux_init(&t->mux, xbee, 4);
+    xbee_duty_cycle_init(&t->duty, xbee, TEST_BITRATE, 0, TEST_RETRIES,
+            TEST_WINDOW, TEST_LIMIT, reserve, 0, test_transmit, xbee);
+    xbee_port_mux_set_transmit(&t->mux, xbee_duty_cycle_transmit, &t->duty);
+    xbee_port_mux_set_admit(&t->mux, xbee_duty_cycle_admit, &t->duty);
+
+    xbee_port_open(&t->mux, &t->ports[0], 1, 0, 1, 8, t->queues[0], NULL, NULL);
+    xbee_port_open(&t->mux, &t->ports[1], 2, 5, 1, 8, t->queues[1], NULL, NULL);
+}
+
+/*! Retries are held while a frame is in flight and given back on an ACK */
+void test_duty_cycle_refund(void)
+{
+    static test_setup_t t;
+    test_setup(&t, 0);
+
+    uint8_t payload[XBEE_PORT_MAX_PAYLOAD];
+    memset(payload, 0, sizeof(payload));
+    uint32_t us = xbee_duty_cycle_airtime(&t.duty, XBEE_PORT_HEADER_SIZE + sizeof(payload));
+
+    xbee_address_t peer, nobody = {XBEE_16_BIT, {.network_address = 0x99}};
+    xbee_sim_address16(&t.sim, 1, &peer);
+
+    assert(xbee_port_send(&t.mux, &t.ports[1], &peer, 0, sizeof(payload), payload) == 0);
+    assert(t.duty.used == (1 + TEST_RETRIES)*us);
+    xbee_sim_step(&t.sim);
+    assert(t.ports[1].sent == 1);
+    assert(t.duty.used == us);
+
+    assert(xbee_port_send(&t.mux, &t.ports[1], &nobody, 0, sizeof(payload), payload) == 0);
+    xbee_sim_step(&t.sim);
+    assert(t.ports[1].failed == 1);
+    assert(t.duty.used == us + (1 + TEST_RETRIES)*us);
+
+    /* A status for a bucket that has left the window gives nothing back */
+    assert(xbee_port_send(&t.mux, &t.ports[1], &peer, 0, sizeof(payload), payload) == 0);
+    t.sim.clock.now += 2*TEST_WINDOW;
+    xbee_sim_step(&t.sim);
+    assert(t.ports[1].sent == 2);
+    assert(t.duty.used == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! 100 byte frames 1 ms apart fill the whole budget within one bucket,
+ * so only the current bucket leaving frees any of it */
+void test_duty_cycle_next_current_bucket(void)
+{
+    static test_setup_t t;
+    test_setup(&t, 0);
+
+    xbee_address_t peer;
+    xbee_sim_address16(&t.sim, 1, &peer);
+    uint8_t payload[XBEE_PORT_MAX_PAYLOAD];
+    memset(payload, 0, sizeof(payload));
+
+    uint32_t start = t.sim.clock.now;
+    while(t.duty.deferred == 0)
+    {
+        xbee_port_send(&t.mux, &t.ports[1], &peer, 0, sizeof(payload), payload);
+        xbee_sim_advance(&t.sim, 1);
+    }
+    uint32_t full = t.sim.clock.now;
+    assert(full - start < TEST_WINDOW/XBEE_DUTY_CYCLE_BUCKETS);
+
+    uint32_t when;
+    assert(xbee_duty_cycle_next(&t.duty, 5, XBEE_PORT_HEADER_SIZE + sizeof(payload), &when) == 0);
+    assert((int32_t)(when - full) > 0);
+    assert(when - start <= TEST_WINDOW + 2*TEST_WINDOW/XBEE_DUTY_CYCLE_BUCKETS);
+
+    /* Held until then, and no longer */
+    size_t sent = t.ports[1].sent;
+    t.sim.clock.now = when - 1;
+    xbee_port_mux_run(&t.mux);
+    xbee_sim_step(&t.sim);
+    assert(t.ports[1].sent == sent);
+
+    t.sim.clock.now = when;
+    xbee_port_mux_run(&t.mux);
+    xbee_sim_step(&t.sim);
+    assert(t.ports[1].sent == sent + 1);
+
+    printf("%s passed, %zu frames then %u s wait\n", __func__, sent, (when - full)/1000);
+}
+
+/*! Only the port the mux would serve is put to the admission check */
+void test_duty_cycle_counters(void)
+{
+    static test_setup_t t;
+    uint32_t us = 8*(XBEE_PORT_HEADER_SIZE + 10)*1000000/TEST_BITRATE;
+    test_setup(&t, TEST_LIMIT - 2*(1 + TEST_RETRIES)*us);
+
+    /* Unacknowledged, so each frame keeps its worst case charged and the
+     * budget outside the reserve takes two */
+    xbee_address_t nobody = {XBEE_16_BIT, {.network_address = 0x99}};
+    for(size_t i = 0; i < 4; ++i)
+    {
+        xbee_port_send(&t.mux, &t.ports[1], &nobody, 0, 10, "0123456789");
+        xbee_sim_step(&t.sim);
+    }
+    xbee_port_send(&t.mux, &t.ports[0], &nobody, 0, 10, "0123456789");
+    xbee_sim_step(&t.sim);
+
+    assert(t.ports[0].failed == 1);
+    assert(t.ports[1].failed == 2);
+    assert(t.ports[1].count == 2);
+    assert(t.duty.admitted == 3);
+    assert(t.duty.deferred > 0);
+
+    /* One check per port served or held back, none for idle ports */
+    uint32_t admitted = t.duty.admitted;
+    uint32_t deferred = t.duty.deferred;
+    xbee_port_mux_run(&t.mux);
+    assert(t.duty.admitted == admitted);
+    assert(t.duty.deferred == deferred + 1);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_duty_cycle_refund();
+    test_duty_cycle_next_current_bucket();
+    test_duty_cycle_counters();
+
+    return 0;
+}
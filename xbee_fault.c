@@ -0,0 +1,134 @@
+#include "xbee_fault.h"
+#include <assert.h>
+#include <string.h>
+
+static uint32_t xbee_fault_random(xbee_fault_t * fault)
+{
+    uint32_t x = fault->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    fault->random = x;
+    return x;
+}
+
+static bool xbee_fault_chance(xbee_fault_t * fault, uint32_t rate)
+{
+    return rate != 0 && xbee_fault_random(fault) % 1000000 < rate;
+}
+
+static int xbee_fault_write(void * ptr, const void * buf, size_t nbyte) SPECIAL_SECTION;
+static int xbee_fault_write(void * ptr, const void * buf, size_t nbyte)
+{
+    xbee_fault_t * fault = ptr;
+
+    return fault->inner->write(fault->inner->ptr, buf, nbyte);
+}
+
+/*! Reads a chunk from the wrapped interface into the empty buffer, faulted */
+static int xbee_fault_fill(xbee_fault_t * fault) SPECIAL_SECTION;
+static int xbee_fault_fill(xbee_fault_t * fault)
+{
+    uint8_t chunk[XBEE_FAULT_CHUNK];
+
+    int ret = fault->inner->read(fault->inner->ptr, chunk, sizeof(chunk));
+    if(ret <= 0)
+    {
+        return ret;
+    }
+
+    fault->bytes_in += ret;
+    fault->buffer_idx = 0;
+    fault->buffer_size = 0;
+
+    const xbee_fault_rates_t * rates = &fault->rates;
+    for(int i = 0; i < ret; ++i)
+    {
+        uint8_t b = chunk[i];
+
+        if(xbee_fault_chance(fault, rates->drop))
+        {
+            fault->drops += 1;
+            continue;
+        }
+
+        if(xbee_fault_chance(fault, rates->bit_flip))
+        {
+            fault->bit_flips += 1;
+            b ^= 1 << (xbee_fault_random(fault) & 7);
+        }
+
+        fault->buffer[fault->buffer_size++] = b;
+
+        if(xbee_fault_chance(fault, rates->duplicate))
+        {
+            fault->duplicates += 1;
+            fault->buffer[fault->buffer_size++] = b;
+        }
+
+        if(xbee_fault_chance(fault, rates->burst))
+        {
+            fault->bursts += 1;
+
+            uint32_t r = xbee_fault_random(fault);
+            size_t length = 1 + r % XBEE_FAULT_BURST_MAX;
+            for(size_t j = 0; j < length; ++j)
+            {
+                fault->buffer[fault->buffer_size++] = 
+                    (r >> (8 + j)) & 1 ? 0x7E : 0x7D;
+            }
+        }
+    }
+
+    return ret;
+}
+
+static int xbee_fault_read(void * ptr, void * buf, size_t nbyte) SPECIAL_SECTION;
+static int xbee_fault_read(void * ptr, void * buf, size_t nbyte)
+{
+    xbee_fault_t * fault = ptr;
+
+    if(fault->buffer_idx == fault->buffer_size)
+    {
+        int ret = xbee_fault_fill(fault);
+        if(ret <= 0)
+        {
+            return ret;
+        }
+    }
+
+    size_t size = fault->buffer_size - fault->buffer_idx;
+    if(size > nbyte)
+    {
+        size = nbyte;
+    }
+
+    if(size > 1 && xbee_fault_chance(fault, fault->rates.short_read))
+    {
+        fault->short_reads += 1;
+        size = 1 + xbee_fault_random(fault) % (size - 1);
+    }
+
+    memcpy(buf, fault->buffer + fault->buffer_idx, size);
+    fault->buffer_idx += size;
+    fault->bytes_out += size;
+    return size;
+}
+
+void xbee_fault_init(xbee_fault_t * fault, xbee_uart_interface_t * inner,
+        const xbee_fault_rates_t * rates, uint32_t seed)
+{
+    assert(fault);
+    assert(inner);
+    assert(rates);
+
+    memset(fault, 0, sizeof(*fault));
+    fault->inner = inner;
+    fault->rates = *rates;
+    fault->random = seed != 0 ? seed : 1;
+
+    fault->uart = *inner;
+    fault->uart.ptr = fault;
+    fault->uart.write = xbee_fault_write;
+    fault->uart.read = xbee_fault_read;
+}
@@ -0,0 +1,59 @@
+#ifndef _XBEE_FAULT_H_
+#define _XBEE_FAULT_H_
+
+#include "xbee.h"
+
+/*! Bytes read from the wrapped UART at a time */
+#ifndef XBEE_FAULT_CHUNK
+#define XBEE_FAULT_CHUNK 32
+#endif /* XBEE_FAULT_CHUNK */
+
+/*! Longest run of 0x7E and 0x7D bytes a burst inserts */
+#ifndef XBEE_FAULT_BURST_MAX
+#define XBEE_FAULT_BURST_MAX 8
+#endif /* XBEE_FAULT_BURST_MAX */
+
+/*! A byte read can come out as itself, a duplicate and a burst */
+#define XBEE_FAULT_BUFFER_SIZE (XBEE_FAULT_CHUNK*(2 + XBEE_FAULT_BURST_MAX))
+
+/*! Fault rates, per million bytes read except short_read */
+typedef struct {
+    uint32_t bit_flip;          /*! One random bit of the byte flipped */
+    uint32_t drop;              /*! Byte lost */
+    uint32_t duplicate;         /*! Byte delivered twice */
+    uint32_t burst;             /*! 1 to XBEE_FAULT_BURST_MAX random delimiters and escapes follow */
+    uint32_t short_read;        /*! Per million reads, read returns fewer bytes than it has, at least 1 */
+} xbee_fault_rates_t;
+
+/*! UART wrapper injecting receive faults, for testing the decoder
+ *
+ * Pass uart to xbee_open in place of the wrapped interface.  Writes,
+ * sleeps and the clock go straight to the wrapped interface; reads are
+ * taken XBEE_FAULT_CHUNK bytes at a time and faulted byte by byte.  The
+ * random number generator is xorshift32, so a seed replays the same
+ * faults for the same bytes and reads.
+ */
+typedef struct {
+    xbee_uart_interface_t uart;
+    xbee_uart_interface_t * inner;
+    xbee_fault_rates_t rates;
+    uint32_t random;
+
+    uint8_t buffer[XBEE_FAULT_BUFFER_SIZE];     /*! Faulted bytes not read yet */
+    size_t buffer_idx;
+    size_t buffer_size;
+
+    uint32_t bytes_in;          /*! Read from the wrapped interface */
+    uint32_t bytes_out;         /*! Returned from read */
+    uint32_t bit_flips;
+    uint32_t drops;
+    uint32_t duplicates;
+    uint32_t bursts;
+    uint32_t short_reads;
+} xbee_fault_t;
+
+/*! \param seed Any value, 0 is taken as 1 */
+void xbee_fault_init(xbee_fault_t * fault, xbee_uart_interface_t * inner,
+        const xbee_fault_rates_t * rates, uint32_t seed) SPECIAL_SECTION;
+
+#endif /* _XBEE_FAULT_H_ */
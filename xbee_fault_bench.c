@@ -0,0 +1,143 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "xbee_fault.h"
+#include "xbee_sim.h"
+
+/* Receive frames with 5-100 byte payloads, many of whose bytes need
+ * escaping, pushed through xbee_fault_t into the decoder.  A frame
+ * counts as recovered if it comes out exactly as sent, and any other
+ * frame decoded is a false accept. */
+
+#define BENCH_FRAMES (200000)
+#define BENCH_BATCH (50)
+
+typedef struct {
+    const char * name;
+    xbee_fault_rates_t rates;
+} bench_config_t;
+
+static const bench_config_t bench_configs[] = {
+    {"none",             {0, 0, 0, 0, 0}},
+    {"short reads 50%",  {0, 0, 0, 0, 500000}},
+    {"bit flip 1e-4",    {100, 0, 0, 0, 0}},
+    {"drop 1e-3",        {0, 1000, 0, 0, 0}},
+    {"duplicate 1e-3",   {0, 0, 1000, 0, 0}},
+    {"burst 1e-3",       {0, 0, 0, 1000, 0}},
+    {"all 1e-3 + short", {1000, 1000, 1000, 1000, 500000}},
+    {"bit flip 1e-2",    {10000, 0, 0, 0, 0}},
+    {"all 1e-2 + short", {10000, 10000, 10000, 10000, 500000}},
+};
+
+static xbee_sim_t bench_sim;
+static xbee_fault_t bench_fault;
+static uint8_t bench_recovered[BENCH_FRAMES/8];
+
+/*! Builds frame k, the same every time
+ *
+ * \return Frame size
+ */
+static size_t bench_frame(uint32_t k, uint8_t * frame)
+{
+    static const uint8_t escaped[] = {0x7E, 0x7D, 0x11, 0x13};
+    uint32_t random = k*2654435761u + 1;
+    size_t size = 0;
+
+    frame[size++] = XBEE_RECEIVE_16_BIT;
+    frame[size++] = 0x00;
+    frame[size++] = 0x02;
+    frame[size++] = 40;
+    frame[size++] = 0x00;
+    frame[size++] = k >> 24;
+    frame[size++] = k >> 16;
+    frame[size++] = k >> 8;
+    frame[size++] = k;
+
+    random ^= random << 13; random ^= random >> 17; random ^= random << 5;
+    size_t payload = 5 + random % 96;
+    for(size_t i = 4; i < payload; ++i)
+    {
+        random ^= random << 13; random ^= random >> 17; random ^= random << 5;
+        frame[size++] = random % 4 == 0 ? escaped[(random >> 8) % 4] : random >> 16;
+    }
+
+    return size;
+}
+
+static bool bench_pending(void)
+{
+    const xbee_sim_fifo_t * fifo = &bench_sim.nodes[0].to_host;
+    return fifo->size > fifo->head || bench_fault.buffer_idx < bench_fault.buffer_size;
+}
+
+static void bench_run(const bench_config_t * config)
+{
+    assert(xbee_sim_init(&bench_sim, 1, 67) == 0);
+    xbee_interface_t * xbee = &bench_sim.nodes[0].xbee;
+    xbee_fault_init(&bench_fault, xbee->uart, &config->rates, 71);
+    /* Open already, only the reads from here on are faulted */
+    xbee->uart = &bench_fault.uart;
+    memset(bench_recovered, 0, sizeof(bench_recovered));
+
+    uint32_t recovered = 0, false_accepts = 0;
+    clock_t decode = 0;
+    uint8_t sent[XBEE_MAX_FRAME_SIZE], got[XBEE_MAX_FRAME_SIZE];
+
+    for(uint32_t k = 0; k < BENCH_FRAMES; k += BENCH_BATCH)
+    {
+        for(uint32_t i = k; i < k + BENCH_BATCH; ++i)
+        {
+            xbee_sim_push_frame(&bench_sim, 0, bench_frame(i, sent), sent);
+        }
+
+        clock_t start = clock();
+        for(;;)
+        {
+            int ret = xbee_recv_frame(xbee, sizeof(got), got);
+            assert(ret >= 0);
+            if(ret == 0)
+            {
+                if(!bench_pending())
+                {
+                    break;
+                }
+                continue;
+            }
+
+            uint32_t n = ret < 9 ? BENCH_FRAMES :
+                (uint32_t)got[5] << 24 | got[6] << 16 | got[7] << 8 | got[8];
+            if(n < BENCH_FRAMES && (size_t)ret == bench_frame(n, sent) &&
+               memcmp(sent, got, ret) == 0 && !(bench_recovered[n/8] & (1 << n%8)))
+            {
+                bench_recovered[n/8] |= 1 << n%8;
+                recovered += 1;
+            }
+            else
+            {
+                false_accepts += 1;
+            }
+        }
+        decode += clock() - start;
+    }
+
+    double ms = 1000.0*decode/CLOCKS_PER_SEC;
+    printf("  %-18s %7.2f%%  %6u        %6.1f\n", config->name,
+            100.0*recovered/BENCH_FRAMES, false_accepts, ms/(bench_fault.bytes_in/1e6));
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    printf("%u frames, %u byte UART chunks\n", BENCH_FRAMES, XBEE_FAULT_CHUNK);
+    printf("  faults per byte     recovered  false accepts  decode ms/MB\n");
+    for(size_t i = 0; i < sizeof(bench_configs)/sizeof(bench_configs[0]); ++i)
+    {
+        bench_run(&bench_configs[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,231 @@
+#include "xbee_group.h"
+#include <assert.h>
+#include <string.h>
+
+static bool xbee_group_same_address(const xbee_address_t * a, const xbee_address_t * b)
+{
+    if(a->type != b->type)
+    {
+        return false;
+    }
+
+    if(a->type == XBEE_16_BIT)
+    {
+        return a->addr.network_address == b->addr.network_address;
+    }
+
+    return a->addr.address == b->addr.address;
+}
+
+static bool xbee_group_weak(const xbee_groups_t * groups, const xbee_node_t * node)
+{
+    return node->rssi == 0 || node->rssi >= groups->weak_rssi;
+}
+
+static void xbee_group_receive(void * ptr, xbee_port_t * port, 
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data) SPECIAL_SECTION;
+static void xbee_group_receive(void * ptr, xbee_port_t * port, 
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data)
+{
+    xbee_groups_t * groups = ptr;
+    const uint8_t * m = data;
+
+    if(size < 2 || m[0] >= XBEE_GROUP_MAX)
+    {
+        return;
+    }
+
+    uint8_t group = m[0];
+    if((groups->member[group >> 3] & (1 << (group & 7))) == 0)
+    {
+        groups->filtered += 1;
+        return;
+    }
+
+    /* A weak member gets the broadcast and the unicast back to back, 
+     * possibly with other senders' messages between them */
+    size_t i = 0;
+    while(i < XBEE_GROUP_SENDERS - 1 && groups->last[i].valid &&
+          (groups->last[i].group != group ||
+           !xbee_group_same_address(&groups->last[i].source, source)))
+    {
+        i += 1;
+    }
+
+    xbee_group_last_t last = groups->last[i];
+    bool found = last.valid && last.group == group &&
+                 xbee_group_same_address(&last.source, source);
+    if(found && last.sequence == m[1])
+    {
+        groups->duplicates += 1;
+        return;
+    }
+
+    /* Move to the front, so the sender heard longest ago is last */
+    memmove(&groups->last[1], &groups->last[0], i*sizeof(groups->last[0]));
+    last.source = *source;
+    last.group = group;
+    last.sequence = m[1];
+    last.valid = true;
+    groups->last[0] = last;
+
+    if(groups->receive)
+    {
+        groups->receive(groups->ptr, group, source, size - 2, &m[2]);
+    }
+}
+
+void xbee_groups_init(xbee_groups_t * groups, 
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number, uint8_t priority,
+        size_t queue_size, xbee_port_message_t * queue,
+        xbee_node_table_t * nodes, uint8_t weak_rssi,
+        xbee_group_fun_t receive, void * ptr)
+{
+    assert(groups);
+    assert(mux);
+    assert(port);
+    assert(nodes);
+
+    memset(groups, 0, sizeof(*groups));
+    groups->mux = mux;
+    groups->port = port;
+    groups->nodes = nodes;
+    groups->weak_rssi = weak_rssi;
+    groups->receive = receive;
+    groups->ptr = ptr;
+
+    xbee_port_open(mux, port, number, priority, 1, queue_size, queue, 
+            xbee_group_receive, groups);
+}
+
+void xbee_groups_stop(xbee_groups_t * groups)
+{
+    assert(groups);
+
+    xbee_port_close(groups->mux, groups->port);
+}
+
+int xbee_group_add_member(xbee_groups_t * groups, uint8_t group, 
+        const xbee_address_t * address)
+{
+    assert(groups);
+    assert(group < XBEE_GROUP_MAX);
+    assert(address);
+
+    xbee_node_t * n = xbee_node_find(groups->nodes, address, true);
+    if(n == NULL)
+    {
+        return XBEE_ERR_NODE_TABLE_FULL;
+    }
+
+    n->groups[group >> 3] |= 1 << (group & 7);
+    return 0;
+}
+
+void xbee_group_remove_member(xbee_groups_t * groups, uint8_t group, 
+        const xbee_address_t * address)
+{
+    assert(groups);
+    assert(group < XBEE_GROUP_MAX);
+    assert(address);
+
+    xbee_node_t * n = xbee_node_find(groups->nodes, address, false);
+    if(n != NULL)
+    {
+        n->groups[group >> 3] &= ~(1 << (group & 7));
+    }
+}
+
+void xbee_group_join(xbee_groups_t * groups, uint8_t group)
+{
+    assert(groups);
+    assert(group < XBEE_GROUP_MAX);
+
+    groups->member[group >> 3] |= 1 << (group & 7);
+}
+
+void xbee_group_leave(xbee_groups_t * groups, uint8_t group)
+{
+    assert(groups);
+    assert(group < XBEE_GROUP_MAX);
+
+    groups->member[group >> 3] &= ~(1 << (group & 7));
+
+    size_t kept = 0;
+    for(size_t i = 0; i < XBEE_GROUP_SENDERS; ++i)
+    {
+        if(groups->last[i].valid && groups->last[i].group != group)
+        {
+            groups->last[kept++] = groups->last[i];
+        }
+    }
+    memset(&groups->last[kept], 0, (XBEE_GROUP_SENDERS - kept)*sizeof(groups->last[0]));
+}
+
+int xbee_group_send(xbee_groups_t * groups, uint8_t group, 
+        size_t size, const void * data)
+{
+    assert(groups);
+    assert(group < XBEE_GROUP_MAX);
+    assert(data || size == 0);
+
+    uint8_t message[XBEE_PORT_MAX_PAYLOAD];
+    if(size > XBEE_GROUP_MAX_PAYLOAD)
+    {
+        return XBEE_ERR_TOO_LARGE;
+    }
+
+    message[0] = group;
+    message[1] = groups->sequence[group];
+    memcpy(&message[2], data, size);
+
+    size_t members = 0;
+    size_t weak = 0;
+    for(size_t i = 0; i < XBEE_NODE_TABLE_SIZE; ++i)
+    {
+        const xbee_node_t * n = &groups->nodes->nodes[i];
+        if(n->valid && xbee_node_in_group(n, group))
+        {
+            members += 1;
+            weak += xbee_group_weak(groups, n);
+        }
+    }
+
+    /* Broadcasts are not acked, so weak members still get a unicast */
+    bool broadcast = 1 + weak < members;
+    if(broadcast)
+    {
+        xbee_address_t address;
+        memset(&address, 0, sizeof(address));
+        address.type = XBEE_16_BIT_BROADCAST;
+
+        groups->broadcasts += 1;
+        int ret = xbee_port_send(groups->mux, groups->port, &address, 0, 
+                size + 2, message);
+        if(ret != 0)
+        {
+            return ret;
+        }
+    }
+
+    for(size_t i = 0; i < XBEE_NODE_TABLE_SIZE; ++i)
+    {
+        const xbee_node_t * n = &groups->nodes->nodes[i];
+        if(!n->valid || !xbee_node_in_group(n, group) || 
+           (broadcast && !xbee_group_weak(groups, n)))
+        {
+            continue;
+        }
+
+        groups->unicasts += 1;
+        int ret = xbee_port_send(groups->mux, groups->port, &n->address, 0, 
+                size + 2, message);
+        if(ret != 0)
+        {
+            return ret;
+        }
+    }
+
+    groups->sequence[group] += 1;
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef _XBEE_GROUP_H_
+#define _XBEE_GROUP_H_
+
+#include "xbee_port.h"
+#include "xbee_node.h"
+
+/*! Group header is group id and sequence number */
+#define XBEE_GROUP_MAX_PAYLOAD (XBEE_PORT_MAX_PAYLOAD - 2)
+
+/*! Senders per group whose last message is remembered for dropping repeats,
+ * over all groups joined */
+#ifndef XBEE_GROUP_SENDERS
+#define XBEE_GROUP_SENDERS 16
+#endif /* XBEE_GROUP_SENDERS */
+
+typedef void (*xbee_group_fun_t)(void * ptr, uint8_t group, 
+        const xbee_address_t * source, size_t size, const void * data);
+
+/*! Last message accepted from a sender to a group */
+typedef struct {
+    xbee_address_t source;
+    uint8_t group;
+    uint8_t sequence;
+    bool valid;
+} xbee_group_last_t;
+
+/*! Multicast groups over a port
+ *
+ * Members of the groups this node sends to are kept in the node table.
+ * A group send unicasts (acked) to every member, unless one broadcast
+ * plus unicasts to the weak members is fewer frames.  Members are weak
+ * if their smoothed RSSI is at or below weak_rssi (-dBm at or above), or
+ * has not been heard yet, since they may miss an unacked broadcast.
+ *
+ * Receivers drop messages for groups not joined by a bitmap lookup, and
+ * drop the second copy a weak member gets of a message both broadcast
+ * and unicast to it, or a retried send brings again.  The last sequence
+ * number is kept per group and sender, for XBEE_GROUP_SENDERS of them,
+ * the longest unheard replaced first.
+ */
+typedef struct {
+    xbee_port_mux_t * mux;
+    xbee_port_t * port;
+    xbee_node_table_t * nodes;
+    uint8_t weak_rssi;
+
+    xbee_group_fun_t receive;
+    void * ptr;
+
+    uint8_t member[XBEE_GROUP_MAX/8];   /*! Bit n set if this node joined group n */
+    uint8_t sequence[XBEE_GROUP_MAX];   /*! Next sequence number sent per group */
+    xbee_group_last_t last[XBEE_GROUP_SENDERS];     /*! Most recent first */
+
+    uint32_t unicasts;
+    uint32_t broadcasts;
+    uint32_t filtered;          /*! Messages for groups not joined */
+    uint32_t duplicates;
+} xbee_groups_t;
+
+void xbee_groups_init(xbee_groups_t * groups, 
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number, uint8_t priority,
+        size_t queue_size, xbee_port_message_t * queue,
+        xbee_node_table_t * nodes, uint8_t weak_rssi,
+        xbee_group_fun_t receive, void * ptr) SPECIAL_SECTION;
+
+void xbee_groups_stop(xbee_groups_t * groups) SPECIAL_SECTION;
+
+/*! Adds address to the members group sends go to
+ *
+ * \return 0 on success, XBEE_ERR_NODE_TABLE_FULL if the node table has no room
+ */
+int xbee_group_add_member(xbee_groups_t * groups, uint8_t group, 
+        const xbee_address_t * address) SPECIAL_SECTION;
+
+void xbee_group_remove_member(xbee_groups_t * groups, uint8_t group, 
+        const xbee_address_t * address) SPECIAL_SECTION;
+
+/*! Starts receiving messages sent to group */
+void xbee_group_join(xbee_groups_t * groups, uint8_t group) SPECIAL_SECTION;
+
+void xbee_group_leave(xbee_groups_t * groups, uint8_t group) SPECIAL_SECTION;
+
+/*! Sends payload to every member of group
+ *
+ * If the port queue fills part way, the copies already queued still go
+ * out and the sequence number is kept, so sending the same payload again
+ * reaches the rest while the members that got it drop the repeat.
+ *
+ * \return 0 if every copy was queued, otherwise error from xbee_port_send
+ */
+int xbee_group_send(xbee_groups_t * groups, uint8_t group, 
+        size_t size, const void * data) SPECIAL_SECTION;
+
+#endif /* _XBEE_GROUP_H_ */
@@ -0,0 +1,253 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_group.h"
+#include "xbee_sim.h"
+
+#define TEST_NODES (4)
+#define TEST_PORT (7)
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_port_mux_t mux[TEST_NODES];
+    xbee_node_table_t nodes[TEST_NODES];
+    xbee_groups_t groups[TEST_NODES];
+    xbee_port_t ports[TEST_NODES];
+    xbee_port_message_t queues[TEST_NODES][2];
+    size_t received[TEST_NODES];
+    uint8_t last[TEST_NODES];
+} test_setup_t;
+
+static test_setup_t test;
+
+static void test_receive(void * ptr, uint8_t group,
+        const xbee_address_t * source, size_t size, const void * data)
+{
+    size_t node = (xbee_groups_t *)ptr - test.groups;
+    test.received[node] += 1;
+    test.last[node] = size > 0 ? ((const uint8_t *)data)[0] : 0;
+}
+
+static void test_setup(void)
+{
+    memset(&test, 0, sizeof(test));
+    assert(xbee_sim_init(&test.sim, TEST_NODES, 17) == 0);
+
+    for(size_t i = 0; i < TEST_NODES; ++i)
+    {
+        xbee_interface_t * xbee = &test.sim.nodes[i].xbee;
+        xbee_port_mux_init(&test.mux[i], xbee, 4);
+        xbee_node_table_init(&test.nodes[i], xbee);
+        xbee_groups_init(&test.groups[i], &test.mux[i], &test.ports[i], TEST_PORT, 0,
+                2, test.queues[i], &test.nodes[i], 60, test_receive, &test.groups[i]);
+    }
+}
+
+/*! Pushes group message to node as if received from the node at source */
+static void test_push(size_t node, uint16_t source, uint8_t group, uint8_t sequence)
+{
+    uint8_t frame[] = {XBEE_RECEIVE_16_BIT, source >> 8, source & 0xFF, 40, 0x00,
+        TEST_PORT, group, sequence, 'x'};
+    xbee_sim_push_frame(&test.sim, node, sizeof(frame), frame);
+    xbee_sim_step(&test.sim);
+}
+
+/*! Sending again after the queue filled part way reaches the members left
+ * out, and no member twice */
+void test_group_send_retry(void)
+{
+    test_setup();
+
+    for(size_t i = 1; i < TEST_NODES; ++i)
+    {
+        xbee_address_t address;
+        xbee_sim_address16(&test.sim, i, &address);
+        assert(xbee_group_add_member(&test.groups[0], 2, &address) == 0);
+        xbee_group_join(&test.groups[i], 2);
+    }
+    xbee_address_t first;
+    xbee_sim_address16(&test.sim, 1, &first);
+    assert(xbee_group_add_member(&test.groups[0], 1, &first) == 0);
+
+    /* Group 1's message in flight and every member unheard, so weak and
+     * unicast: room for two of group 2's three copies */
+    assert(xbee_group_send(&test.groups[0], 1, 1, "a") == 0);
+    assert(xbee_group_send(&test.groups[0], 2, 1, "b") == XBEE_ERR_QUEUE_FULL);
+    for(size_t i = 0; i < 5; ++i)
+    {
+        xbee_sim_step(&test.sim);
+    }
+    assert(xbee_group_send(&test.groups[0], 2, 1, "b") == 0);
+    for(size_t i = 0; i < 5; ++i)
+    {
+        xbee_sim_step(&test.sim);
+    }
+
+    for(size_t i = 1; i < TEST_NODES; ++i)
+    {
+        assert(test.received[i] == 1);
+        assert(test.last[i] == 'b');
+    }
+    assert(test.groups[1].duplicates + test.groups[2].duplicates +
+           test.groups[3].duplicates == 2);
+
+    /* A new message gets a new sequence number */
+    assert(xbee_group_send(&test.groups[0], 2, 1, "c") == 0);
+    for(size_t i = 0; i < 5; ++i)
+    {
+        xbee_sim_step(&test.sim);
+    }
+    for(size_t i = 1; i < TEST_NODES; ++i)
+    {
+        assert(test.received[i] == 2);
+    }
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Repeats are recognised per group and sender, whatever came between */
+void test_group_duplicates(void)
+{
+    test_setup();
+    xbee_group_join(&test.groups[3], 4);
+    xbee_group_join(&test.groups[3], 5);
+
+    test_push(3, 1, 4, 9);
+    test_push(3, 2, 4, 9);
+    test_push(3, 1, 5, 9);
+    assert(test.received[3] == 3);
+
+    test_push(3, 1, 4, 9);
+    test_push(3, 2, 4, 9);
+    assert(test.received[3] == 3);
+    assert(test.groups[3].duplicates == 2);
+
+    /* The sender heard longest ago is forgotten first */
+    for(uint16_t source = 10; source < 10 + XBEE_GROUP_SENDERS - 1; ++source)
+    {
+        test_push(3, source, 4, 0);
+    }
+    test_push(3, 1, 5, 9);
+    test_push(3, 1, 4, 9);
+    assert(test.groups[3].duplicates == 3);
+    assert(test.received[3] == 3 + XBEE_GROUP_SENDERS - 1 + 1);
+
+    /* Leaving forgets the group's senders */
+    xbee_group_leave(&test.groups[3], 5);
+    xbee_group_join(&test.groups[3], 5);
+    test_push(3, 1, 5, 9);
+    assert(test.groups[3].duplicates == 3);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A node heard by its 16 bit address is one entry with its 64 bit one
+ * once that is learnt */
+void test_node_merge(void)
+{
+    test_setup();
+
+    xbee_node_table_t * table = &test.nodes[0];
+    xbee_interface_t * xbee = &test.sim.nodes[0].xbee;
+    xbee_address_t address16, address64;
+    xbee_sim_address16(&test.sim, 1, &address16);
+    xbee_sim_address64(&test.sim, 1, &address64);
+
+    /* Heard by 16 bit address, added to a group by 64 bit address */
+    test_push(0, 2, 0, 0);
+    assert(xbee_group_add_member(&test.groups[0], 3, &address16) == 0);
+    assert(xbee_group_add_member(&test.groups[0], 6, &address64) == 0);
+    xbee_node_t * n16 = xbee_node_find(table, &address16, false);
+    xbee_node_t * n64 = xbee_node_find(table, &address64, false);
+    assert(n16 != NULL && n64 != NULL && n16 != n64);
+
+    /* Remote AT responses carry both addresses */
+    uint8_t frame_id = xbee_alloc_frame_id(xbee);
+    assert(xbee_remote_at_command(xbee, &address64, 0, frame_id, "MY", 0, NULL) == 0);
+    xbee_sim_step(&test.sim);
+
+    assert(!n16->valid);
+    assert(xbee_node_find(table, &address16, false) == n64);
+    assert(n64->network_address == address16.addr.network_address);
+    assert(xbee_node_in_group(n64, 3) && xbee_node_in_group(n64, 6));
+    assert(n64->rssi == 40);
+
+    size_t valid = 0;
+    for(size_t i = 0; i < XBEE_NODE_TABLE_SIZE; ++i)
+    {
+        valid += table->nodes[i].valid;
+    }
+    assert(valid == 1);
+
+    /* Heard again by its 16 bit address, no new entry */
+    test_push(0, 2, 0, 0);
+    valid = 0;
+    for(size_t i = 0; i < XBEE_NODE_TABLE_SIZE; ++i)
+    {
+        valid += table->nodes[i].valid;
+    }
+    assert(valid == 1);
+
+    printf("%s passed\n", __func__);
+}
+
+static int test_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    return xbee_transmit_gather(ptr, frame_id, address, option, count, buffers);
+}
+
+static void test_port_receive(void * ptr, xbee_port_t * port,
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data)
+{
+    size_t * received = ptr;
+    *received += 1;
+}
+
+/*! Frames to a node known by both addresses go out by its 16 bit one */
+void test_node_transmit(void)
+{
+    static xbee_port_t ports[2];
+    static xbee_port_message_t queues[2][2];
+    size_t received = 0;
+    test_setup();
+
+    xbee_node_table_t * table = &test.nodes[0];
+    xbee_interface_t * xbee = &test.sim.nodes[0].xbee;
+    xbee_node_table_set_transmit(table, test_transmit, xbee);
+    xbee_port_mux_set_transmit(&test.mux[0], xbee_node_transmit, table);
+    for(size_t i = 0; i < 2; ++i)
+    {
+        xbee_port_open(&test.mux[i], &ports[i], 9, 0, 2, 2, queues[i],
+                test_port_receive, &received);
+    }
+
+    xbee_address_t address64;
+    xbee_sim_address64(&test.sim, 1, &address64);
+    assert(xbee_port_send(&test.mux[0], &ports[0], &address64, 0, 3, "abc") == 0);
+    xbee_sim_step(&test.sim);
+    assert(received == 1 && table->resolved == 0);
+
+    xbee_node_find(table, &address64, true)->network_address = 2;
+    assert(xbee_port_send(&test.mux[0], &ports[0], &address64, 0, 3, "abc") == 0);
+    xbee_sim_step(&test.sim);
+    assert(received == 2 && table->resolved == 1);
+    assert(ports[0].sent == 2);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_group_send_retry();
+    test_group_duplicates();
+    test_node_merge();
+    test_node_transmit();
+
+    return 0;
+}
@@ -0,0 +1,285 @@
+#include "xbee_health_poller.h"
+#include <assert.h>
+#include <string.h>
+
+typedef struct {
+    char at_command[3];
+    uint8_t bit;
+} xbee_health_field_t;
+
+static const xbee_health_field_t xbee_health_fields[] = {
+    { "DB", XBEE_HEALTH_RSSI },
+    { "EC", XBEE_HEALTH_CCA },
+    { "EA", XBEE_HEALTH_ACK },
+    { "TP", XBEE_HEALTH_TEMPERATURE },
+    { "%V", XBEE_HEALTH_VOLTAGE },
+};
+
+#define XBEE_HEALTH_FIELDS (sizeof(xbee_health_fields)/sizeof(xbee_health_fields[0]))
+
+/*! AT status returned for commands the radio does not implement */
+#define XBEE_AT_INVALID_COMMAND (2)
+
+static xbee_health_t * xbee_health_target(xbee_health_poller_t * poller, 
+        uint8_t ** unsupported) SPECIAL_SECTION;
+static xbee_health_t * xbee_health_target(xbee_health_poller_t * poller, 
+        uint8_t ** unsupported)
+{
+    if(poller->target == 0)
+    {
+        *unsupported = &poller->local_unsupported;
+        return &poller->xbee->stats.health;
+    }
+
+    xbee_health_remote_t * remote = &poller->remotes[poller->target-1];
+    *unsupported = &remote->unsupported;
+    return &remote->health;
+}
+
+static void xbee_health_advance(xbee_health_poller_t * poller)
+{
+    poller->field += 1;
+    if(poller->field == XBEE_HEALTH_FIELDS)
+    {
+        poller->field = 0;
+        poller->target += 1;
+        if(poller->target > poller->count)
+        {
+            poller->target = 0;
+        }
+    }
+}
+
+static void xbee_health_result(xbee_health_poller_t * poller, uint8_t status,
+        size_t data_size, const uint8_t * data) SPECIAL_SECTION;
+static void xbee_health_result(xbee_health_poller_t * poller, uint8_t status,
+        size_t data_size, const uint8_t * data)
+{
+    uint8_t * unsupported;
+    xbee_health_t * health = xbee_health_target(poller, &unsupported);
+    const xbee_health_field_t * field = &xbee_health_fields[poller->field];
+
+    poller->frame_id = 0;
+    xbee_health_advance(poller);
+
+    if(status == XBEE_AT_INVALID_COMMAND)
+    {
+        *unsupported |= field->bit;
+        return;
+    }
+
+    if(status != 0 || data_size == 0 || data_size > 2)
+    {
+        return;
+    }
+
+    uint16_t value = data[0];
+    if(data_size == 2)
+    {
+        value = value << 8 | data[1];
+    }
+
+    switch(field->bit)
+    {
+    case XBEE_HEALTH_RSSI:
+        health->rssi = value;
+        break;
+    case XBEE_HEALTH_CCA:
+        health->cca_failures = value;
+        break;
+    case XBEE_HEALTH_ACK:
+        health->ack_failures = value;
+        break;
+    case XBEE_HEALTH_TEMPERATURE:
+        health->temperature = (int16_t)value;
+        break;
+    case XBEE_HEALTH_VOLTAGE:
+        health->voltage = value;
+        break;
+    default:
+        assert(false);
+        return;
+    }
+
+    health->valid |= field->bit;
+    health->updated = poller->last_query;
+}
+
+static int xbee_health_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_health_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_health_poller_t * poller = ptr;
+
+    if(poller->frame_id == 0 || frame->frame_id != poller->frame_id)
+    {
+        return 0;
+    }
+
+    if((poller->target == 0 && frame->api_id != XBEE_AT_RESPONSE) ||
+       (poller->target != 0 && frame->api_id != XBEE_REMOTE_AT_RESPONSE))
+    {
+        return 0;
+    }
+
+    xbee_health_result(poller, frame->frame.at_command_response.status,
+            frame->frame.at_command_response.data_size,
+            frame->frame.at_command_response.data);
+    return 1;
+}
+
+static void xbee_health_failed(void * ptr, xbee_interface_t * xbee, 
+        uint8_t frame_id, int reason) SPECIAL_SECTION;
+static void xbee_health_failed(void * ptr, xbee_interface_t * xbee, 
+        uint8_t frame_id, int reason)
+{
+    xbee_health_poller_t * poller = ptr;
+
+    if(poller->frame_id != 0 && frame_id == poller->frame_id)
+    {
+        poller->frame_id = 0;
+        xbee_health_advance(poller);
+    }
+}
+
+void xbee_health_poller_init(xbee_health_poller_t * poller, xbee_interface_t * xbee,
+        size_t count, xbee_health_remote_t * remotes,
+        uint32_t min_interval, uint32_t max_interval, uint32_t timeout)
+{
+    assert(poller);
+    assert(xbee);
+    assert(count == 0 || remotes);
+    assert(min_interval <= max_interval);
+    assert(timeout > 0);
+
+    memset(poller, 0, sizeof(*poller));
+    poller->xbee = xbee;
+    poller->count = count;
+    poller->remotes = remotes;
+    poller->min_interval = min_interval;
+    poller->max_interval = max_interval;
+    poller->interval = min_interval;
+    poller->timeout = timeout;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        memset(&remotes[i].health, 0, sizeof(remotes[i].health));
+        remotes[i].unsupported = 0;
+    }
+
+    poller->handler.ptr = poller;
+    poller->handler.frame = xbee_health_frame;
+    poller->handler.failed = xbee_health_failed;
+    xbee_add_handler(xbee, &poller->handler);
+}
+
+void xbee_health_poller_stop(xbee_health_poller_t * poller)
+{
+    assert(poller);
+    xbee_remove_handler(poller->xbee, &poller->handler);
+}
+
+int xbee_health_poller_run(xbee_health_poller_t * poller, uint32_t now)
+{
+    assert(poller);
+
+    if(poller->frame_id != 0)
+    {
+        if(now - poller->last_query < poller->timeout)
+        {
+            return 0;
+        }
+
+        /* A late response now matches nothing */
+        xbee_free_frame_id(poller->xbee, poller->frame_id);
+        poller->frame_id = 0;
+        xbee_health_advance(poller);
+    }
+
+    if(poller->started && now - poller->last_query < poller->interval)
+    {
+        return 0;
+    }
+
+    uint32_t traffic = poller->xbee->stats.tx_frames + poller->xbee->stats.rx_frames;
+    bool busy = traffic != poller->last_traffic || !xbee_idle(poller->xbee);
+
+    poller->started = true;
+    poller->last_query = now;
+    poller->last_traffic = traffic;
+
+    if(busy)
+    {
+        if(poller->interval < poller->max_interval)
+        {
+            /* Give this slot to data traffic */
+            poller->interval = poller->interval > poller->max_interval/2 ? 
+                poller->max_interval : poller->interval*2;
+            if(poller->interval == 0)
+            {
+                poller->interval = 1;
+            }
+            return 0;
+        }
+    }
+    else if(poller->interval > poller->min_interval)
+    {
+        poller->interval /= 2;
+        if(poller->interval < poller->min_interval)
+        {
+            poller->interval = poller->min_interval;
+        }
+    }
+
+    /* Skip fields the target rejected, at most one full pass */
+    uint8_t * unsupported;
+    for(size_t i = 0; i < XBEE_HEALTH_FIELDS*(poller->count+1); ++i)
+    {
+        xbee_health_target(poller, &unsupported);
+        if((*unsupported & xbee_health_fields[poller->field].bit) == 0)
+        {
+            break;
+        }
+        xbee_health_advance(poller);
+    }
+
+    xbee_health_target(poller, &unsupported);
+    if(*unsupported & xbee_health_fields[poller->field].bit)
+    {
+        return 0;
+    }
+
+    uint8_t frame_id = xbee_alloc_frame_id(poller->xbee);
+    if(frame_id == 0)
+    {
+        return 0;
+    }
+
+    char at_command[2] = {
+        xbee_health_fields[poller->field].at_command[0],
+        xbee_health_fields[poller->field].at_command[1],
+    };
+
+    int ret;
+    if(poller->target == 0)
+    {
+        ret = xbee_at_command(poller->xbee, frame_id, at_command, 0, NULL);
+    }
+    else
+    {
+        ret = xbee_remote_at_command(poller->xbee, 
+                &poller->remotes[poller->target-1].address, 0,
+                frame_id, at_command, 0, NULL);
+    }
+
+    if(ret != 0)
+    {
+        /* Same field is asked again with a new id on a later run */
+        xbee_free_frame_id(poller->xbee, frame_id);
+        return ret == XBEE_ERR_NOT_READY ? 0 : ret;
+    }
+
+    poller->frame_id = frame_id;
+    return 0;
+}
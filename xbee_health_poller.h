@@ -0,0 +1,65 @@
+#ifndef _XBEE_HEALTH_POLLER_H_
+#define _XBEE_HEALTH_POLLER_H_
+
+#include "xbee.h"
+
+/*! Remote radio whose health is polled */
+typedef struct {
+    xbee_address_t address;
+    xbee_health_t health;
+    uint8_t unsupported;        /*! XBEE_HEALTH_* bits the remote rejected */
+} xbee_health_remote_t;
+
+/*! Low priority background poller of DB, EC, EA, TP and %V
+ *
+ * Local results are stored in xbee->stats.health, remote results in each
+ * xbee_health_remote_t.  One query is in flight at a time, and queries are
+ * only sent when the interface is idle.  The interval between queries 
+ * doubles (up to max_interval) whenever data traffic was seen since the
+ * last query and halves (down to min_interval) when the link is quiet.  At
+ * max_interval a query is sent even if the link is busy, so health 
+ * numbers never go completely stale.
+ *
+ * Commands the radio rejects (e.g. TP on modules without a temperature 
+ * sensor) are not asked again.  A query not answered within timeout is
+ * given up on and the next one sent, without relying on
+ * xbee_set_frame_timeout.
+ *
+ * Times are in milliseconds from any monotonic clock, and may wrap.
+ */
+typedef struct {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+
+    size_t count;
+    xbee_health_remote_t * remotes;
+
+    uint32_t min_interval;
+    uint32_t max_interval;
+    uint32_t interval;          /*! Current interval between queries */
+    uint32_t timeout;           /*! Time a query is waited on */
+
+    bool started;
+    uint32_t last_query;        /*! When the last slot came up, and the query in flight was sent */
+    uint32_t last_traffic;      /*! tx_frames + rx_frames at last_query */
+
+    size_t target;              /*! 0 is local radio, n is remotes[n-1] */
+    size_t field;               /*! Next health field of target */
+    uint8_t frame_id;           /*! Query in flight, 0 if none */
+    uint8_t local_unsupported;
+} xbee_health_poller_t;
+
+void xbee_health_poller_init(xbee_health_poller_t * poller, xbee_interface_t * xbee,
+        size_t count, xbee_health_remote_t * remotes,
+        uint32_t min_interval, uint32_t max_interval, uint32_t timeout) SPECIAL_SECTION;
+
+void xbee_health_poller_stop(xbee_health_poller_t * poller) SPECIAL_SECTION;
+
+/*! Gives up on a query older than timeout and sends the next health query
+ * if a slot is free, call from the poll loop
+ *
+ * \return 0 on success, otherwise error from sending the query
+ */
+int xbee_health_poller_run(xbee_health_poller_t * poller, uint32_t now) SPECIAL_SECTION;
+
+#endif /* _XBEE_HEALTH_POLLER_H_ */
@@ -0,0 +1,140 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_health_poller.h"
+#include "xbee_sim.h"
+
+#define TEST_MAX_INTERVAL (100)
+#define TEST_TIMEOUT (500)
+
+static xbee_sim_t test_sim;
+static xbee_health_poller_t test_poller;
+static size_t test_drop;
+
+/*! Loses the next test_drop local AT commands */
+static bool test_request(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    if(frame[0] != XBEE_AT_COMMAND || test_drop == 0)
+    {
+        return false;
+    }
+
+    test_drop -= 1;
+    return true;
+}
+
+/*! Frame ids that can be allocated, every one held is freed again */
+static size_t test_free_frame_ids(xbee_interface_t * xbee)
+{
+    uint8_t held[255];
+    size_t count = 0;
+    for(uint8_t id; (id = xbee_alloc_frame_id(xbee)) != 0; )
+    {
+        held[count++] = id;
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        xbee_free_frame_id(xbee, held[i]);
+    }
+
+    return count;
+}
+
+/*! A lost response holds the poller up until the timeout, not for good */
+void test_health_poller_lost(void)
+{
+    assert(xbee_sim_init(&test_sim, 1, 23) == 0);
+    test_sim.request = test_request;
+    test_drop = 1;
+    xbee_sim_set_register(&test_sim, 0, "DB", 1, "\x28");
+    xbee_sim_set_register(&test_sim, 0, "EC", 2, "\x00\x07");
+
+    xbee_interface_t * xbee = &test_sim.nodes[0].xbee;
+    xbee_health_poller_init(&test_poller, xbee, 0, NULL, 10, TEST_MAX_INTERVAL, TEST_TIMEOUT);
+
+    /* DB is lost */
+    assert(xbee_health_poller_run(&test_poller, test_sim.clock.now) == 0);
+    uint8_t lost_id = test_poller.frame_id;
+    assert(lost_id != 0);
+    xbee_sim_step(&test_sim);
+
+    xbee_sim_advance(&test_sim, TEST_TIMEOUT - 1);
+    assert(xbee_health_poller_run(&test_poller, test_sim.clock.now) == 0);
+    assert(test_poller.frame_id == lost_id);
+
+    /* Given up on, and EC asked next */
+    for(size_t i = 0; i < 10 && (xbee->stats.health.valid & XBEE_HEALTH_CCA) == 0; ++i)
+    {
+        xbee_sim_advance(&test_sim, TEST_MAX_INTERVAL);
+        assert(xbee_health_poller_run(&test_poller, test_sim.clock.now) == 0);
+        xbee_sim_step(&test_sim);
+    }
+    assert(xbee->stats.health.valid == XBEE_HEALTH_CCA);
+    assert(xbee->stats.health.cca_failures == 7);
+
+    xbee_health_poller_stop(&test_poller);
+    printf("%s passed\n", __func__);
+}
+
+/*! Remote queries refused while the XBee recovers from a reset keep no
+ * frame ids, and are asked again once it is ready */
+void test_health_poller_not_ready(void)
+{
+    static xbee_health_remote_t remote;
+    assert(xbee_sim_init(&test_sim, 2, 41) == 0);
+    xbee_sim_set_register(&test_sim, 1, "DB", 1, "\x30");
+    xbee_sim_address16(&test_sim, 1, &remote.address);
+
+    /* Every interval is taken, busy or not */
+    xbee_interface_t * xbee = &test_sim.nodes[0].xbee;
+    xbee_health_poller_init(&test_poller, xbee, 1, &remote, 10, 10, TEST_TIMEOUT);
+
+    /* The local module supports none of the fields, so the remote is
+     * asked once they are all tried */
+    for(size_t i = 0; i < 10 && test_poller.target == 0; ++i)
+    {
+        xbee_sim_advance(&test_sim, 10);
+        assert(xbee_health_poller_run(&test_poller, test_sim.clock.now) == 0);
+        xbee_sim_step(&test_sim);
+    }
+    assert(test_poller.target == 1 && test_poller.field == 0);
+
+    const uint8_t reset[] = {XBEE_MODEM_STATUS, XBEE_MODEM_HARDWARE_RESET};
+    xbee_sim_push_frame(&test_sim, 0, sizeof(reset), reset);
+    xbee_sim_step(&test_sim);
+    assert(xbee->state == XBEE_STATE_RECOVERING);
+
+    uint32_t now = test_sim.clock.now;
+    for(size_t i = 0; i < 300; ++i)
+    {
+        now += 10;
+        assert(xbee_health_poller_run(&test_poller, now) == 0);
+        assert(test_poller.frame_id == 0);
+    }
+
+    xbee_sim_step(&test_sim);
+    assert(xbee->state == XBEE_STATE_READY);
+    assert(test_free_frame_ids(xbee) == 255);
+
+    assert(xbee_health_poller_run(&test_poller, now + 10) == 0);
+    xbee_sim_step(&test_sim);
+    assert(remote.health.valid == XBEE_HEALTH_RSSI && remote.health.rssi == 0x30);
+    assert(test_free_frame_ids(xbee) == 255);
+
+    xbee_health_poller_stop(&test_poller);
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_health_poller_lost();
+    test_health_poller_not_ready();
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+#include "xbee_jitter.h"
+#include <assert.h>
+#include <string.h>
+
+static bool xbee_jitter_same_address(const xbee_address_t * a, const xbee_address_t * b)
+{
+    if(a->type != b->type)
+    {
+        return false;
+    }
+
+    if(a->type == XBEE_16_BIT)
+    {
+        return a->addr.network_address == b->addr.network_address;
+    }
+
+    return a->addr.address == b->addr.address;
+}
+
+/*! Adds a packet's arrival less seq*period to the window and sets base
+ * and delay from its minimum and quantile */
+static void xbee_jitter_update_delay(xbee_jitter_t * jitter, uint32_t arrival)
+{
+    int32_t sorted[XBEE_JITTER_WINDOW];
+
+    jitter->arrivals[jitter->arrival_next] = arrival;
+    jitter->arrival_next = (jitter->arrival_next + 1) % XBEE_JITTER_WINDOW;
+    if(jitter->arrival_count < XBEE_JITTER_WINDOW)
+    {
+        jitter->arrival_count += 1;
+    }
+
+    /* Relative to the newest, so wrapping clocks compare correctly */
+    size_t count = jitter->arrival_count;
+    for(size_t i = 0; i < count; ++i)
+    {
+        int32_t value = (int32_t)(jitter->arrivals[i] - arrival);
+
+        size_t j = i;
+        for(; j > 0 && sorted[j-1] > value; --j)
+        {
+            sorted[j] = sorted[j-1];
+        }
+        sorted[j] = value;
+    }
+
+    /* Frame 0's due time follows a rising quantile at once and a falling
+     * one slowly, so a spike leaving the window doesn't cost a skip and
+     * then a stretch when the next one comes */
+    uint32_t due = jitter->base + jitter->delay;
+    uint32_t target = arrival + sorted[(count - 1)*jitter->quantile/100];
+    int32_t fall = (int32_t)(due - target);
+    if(count == 1 || fall < 0)
+    {
+        due = target;
+    }
+    else
+    {
+        due -= (fall + XBEE_JITTER_DECAY - 1) / XBEE_JITTER_DECAY;
+    }
+
+    jitter->base = arrival + sorted[0];
+    jitter->delay = due - jitter->base;
+}
+
+static void xbee_jitter_receive(void * ptr, xbee_port_t * port,
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data) SPECIAL_SECTION;
+static void xbee_jitter_receive(void * ptr, xbee_port_t * port,
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data)
+{
+    xbee_jitter_t * jitter = ptr;
+    const uint8_t * m = data;
+
+    if(!xbee_jitter_same_address(source, &jitter->source) ||
+       size != XBEE_JITTER_HEADER_SIZE + jitter->frame_size)
+    {
+        return;
+    }
+
+    uint16_t seq = m[0] << 8 | m[1];
+    if(!jitter->started)
+    {
+        jitter->started = true;
+        jitter->play_seq = seq;
+    }
+
+    uint32_t ext = jitter->play_seq + (int16_t)(seq - (uint16_t)jitter->play_seq);
+    jitter->received += 1;
+
+    /* Timing is valid even for a packet that comes too late to play */
+    xbee_jitter_update_delay(jitter, jitter->mux->xbee->rx_time - ext*jitter->period);
+
+    if((int32_t)(ext - jitter->play_seq) < 0)
+    {
+        if(jitter->playing)
+        {
+            jitter->late += 1;
+            return;
+        }
+
+        /* Reordered ahead of the first packet, start from it instead */
+        jitter->play_seq = ext;
+    }
+    else if(ext - jitter->play_seq >= XBEE_JITTER_SLOTS)
+    {
+        /* Playout is far behind, it skips forward as the delay drops */
+        jitter->late += 1;
+        return;
+    }
+
+    xbee_jitter_slot_t * slot = &jitter->slots[ext & (XBEE_JITTER_SLOTS - 1)];
+    if(slot->valid && slot->seq == seq)
+    {
+        jitter->duplicates += 1;
+        return;
+    }
+
+    slot->valid = true;
+    slot->seq = seq;
+    memcpy(slot->data, m + XBEE_JITTER_HEADER_SIZE, jitter->frame_size);
+}
+
+void xbee_jitter_open(xbee_jitter_t * jitter,
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number,
+        const xbee_address_t * source, uint32_t period, size_t frame_size,
+        uint8_t quantile)
+{
+    assert(jitter);
+    assert(mux);
+    assert(mux->xbee->uart->clock);
+    assert(source);
+    assert(period > 0);
+    assert(frame_size > 0 && frame_size <= XBEE_JITTER_MAX_FRAME);
+    assert(quantile <= 100);
+
+    memset(jitter, 0, sizeof(*jitter));
+    jitter->mux = mux;
+    jitter->port = port;
+    jitter->source = *source;
+    jitter->period = period;
+    jitter->frame_size = frame_size;
+    jitter->quantile = quantile;
+
+    xbee_port_open(mux, port, number, 0, 1, 0, NULL, xbee_jitter_receive, jitter);
+}
+
+void xbee_jitter_close(xbee_jitter_t * jitter)
+{
+    assert(jitter);
+
+    xbee_port_close(jitter->mux, jitter->port);
+}
+
+int xbee_jitter_pull(xbee_jitter_t * jitter, void * frame_out)
+{
+    assert(jitter);
+    assert(frame_out);
+
+    if(!jitter->started)
+    {
+        return XBEE_JITTER_BUFFERING;
+    }
+
+    /* How long ago the next frame was due */
+    uint32_t now = xbee_now(jitter->mux->xbee);
+    int32_t overdue = (int32_t)(now - (jitter->base +
+                jitter->play_seq*jitter->period + jitter->delay));
+
+    if(!jitter->playing)
+    {
+        if(overdue < 0)
+        {
+            return XBEE_JITTER_BUFFERING;
+        }
+        jitter->playing = true;
+    }
+
+    if(overdue < 0)
+    {
+        /* Delay grew, hold the next frame back a pull */
+        jitter->stretched += 1;
+        memcpy(frame_out, jitter->last, jitter->frame_size);
+        return XBEE_JITTER_STRETCHED;
+    }
+
+    xbee_jitter_slot_t * slot = &jitter->slots[jitter->play_seq & (XBEE_JITTER_SLOTS - 1)];
+    if(overdue >= 2*(int32_t)jitter->period)
+    {
+        /* Delay shrank, drop a frame to catch up */
+        jitter->skipped += 1;
+        slot->valid = false;
+        jitter->play_seq += 1;
+        slot = &jitter->slots[jitter->play_seq & (XBEE_JITTER_SLOTS - 1)];
+    }
+
+    int ret;
+    if(slot->valid && slot->seq == (uint16_t)jitter->play_seq)
+    {
+        jitter->played += 1;
+        memcpy(jitter->last, slot->data, jitter->frame_size);
+        ret = XBEE_JITTER_PLAYED;
+    }
+    else
+    {
+        jitter->concealed += 1;
+        ret = XBEE_JITTER_CONCEALED;
+    }
+
+    memcpy(frame_out, jitter->last, jitter->frame_size);
+    slot->valid = false;
+    jitter->play_seq += 1;
+    return ret;
+}
@@ -0,0 +1,119 @@
+#ifndef _XBEE_JITTER_H_
+#define _XBEE_JITTER_H_
+
+#include "xbee_port.h"
+
+/*! Frames held for playout, a power of two */
+#ifndef XBEE_JITTER_SLOTS
+#define XBEE_JITTER_SLOTS 32
+#endif /* XBEE_JITTER_SLOTS */
+
+#if (XBEE_JITTER_SLOTS & (XBEE_JITTER_SLOTS - 1)) != 0
+#error XBEE_JITTER_SLOTS must be a power of two
+#endif
+
+/*! Recent packets whose delay sets the playout delay */
+#ifndef XBEE_JITTER_WINDOW
+#define XBEE_JITTER_WINDOW 64
+#endif /* XBEE_JITTER_WINDOW */
+
+/*! A falling playout delay moves this fraction of the way per packet */
+#ifndef XBEE_JITTER_DECAY
+#define XBEE_JITTER_DECAY 32
+#endif /* XBEE_JITTER_DECAY */
+
+/*! Packet is a 16 bit sequence number and one frame */
+#define XBEE_JITTER_HEADER_SIZE (2)
+#define XBEE_JITTER_MAX_FRAME (XBEE_PORT_MAX_PAYLOAD - XBEE_JITTER_HEADER_SIZE)
+
+/*! xbee_jitter_pull results */
+#define XBEE_JITTER_BUFFERING (0)   /*! Playout has not started, nothing to play */
+#define XBEE_JITTER_PLAYED (1)      /*! frame_out holds the frame due */
+#define XBEE_JITTER_CONCEALED (2)   /*! Frame due is missing, frame_out repeats the last one */
+#define XBEE_JITTER_STRETCHED (3)   /*! Delay grew, frame_out repeats the last one while the due frame waits */
+
+typedef struct {
+    bool valid;
+    uint16_t seq;
+    uint8_t data[XBEE_JITTER_MAX_FRAME];
+} xbee_jitter_slot_t;
+
+/*! Playout buffer for an isochronous stream from one source
+ *
+ * The source sends one frame_size frame every period ms on the port, each
+ * prefixed with a big endian sequence number.  Frames come out of
+ * xbee_jitter_pull, called every period ms, in sequence.
+ *
+ * Each packet's arrival time (xbee->rx_time, when xbee_fill_buffer read
+ * it) less its sequence number times the period is its delay up to an
+ * unknown constant.  Over the last XBEE_JITTER_WINDOW packets, the
+ * smallest such value is the base, and the playout delay is the
+ * quantile'th percentile less the base, so that share of packets arrive
+ * before they are due.  Frame n is due base + n*period + delay, and is
+ * played by the first pull at or after that.  A rising delay is taken at
+ * once, a falling one 1/XBEE_JITTER_DECAY of the way per packet.
+ *
+ * When the delay shrinks, playout falls behind, and a frame is skipped
+ * per pull until it has caught up; when it grows, the last frame is
+ * repeated per pull (XBEE_JITTER_STRETCHED) until the due frame catches
+ * up.  A frame missing when due (lost or late) is concealed by repeating
+ * the last frame played, zeros before any, and the caller is told so it
+ * can do better.  Packets that arrive after their frame was played are
+ * dropped.
+ *
+ * Time comes from xbee_now, so the XBee's clock must be set.
+ */
+typedef struct {
+    xbee_port_mux_t * mux;
+    xbee_port_t * port;
+    xbee_address_t source;
+    uint32_t period;
+    size_t frame_size;
+    uint8_t quantile;
+
+    bool started;               /*! A packet arrived, base and delay are set */
+    bool playing;               /*! First frame was due */
+    uint32_t play_seq;          /*! Sequence number the next pull plays, extended to 32 bits */
+    uint32_t base;
+    uint32_t delay;             /*! Playout delay past base, ms */
+
+    uint32_t arrivals[XBEE_JITTER_WINDOW];  /*! Arrival less seq*period */
+    size_t arrival_count;
+    size_t arrival_next;
+
+    xbee_jitter_slot_t slots[XBEE_JITTER_SLOTS];
+    uint8_t last[XBEE_JITTER_MAX_FRAME];    /*! Last frame played */
+
+    uint32_t received;
+    uint32_t late;              /*! Arrived after being played or concealed, or too far ahead */
+    uint32_t duplicates;
+    uint32_t played;
+    uint32_t concealed;         /*! Pulls whose frame was missing (underruns) */
+    uint32_t skipped;           /*! Frames dropped to shorten the delay */
+    uint32_t stretched;         /*! Pulls repeating a frame to lengthen the delay */
+} xbee_jitter_t;
+
+/*! Opens a receive-only port for the stream from source
+ *
+ * \param period ms between frames
+ * \param frame_size bytes per frame, at most XBEE_JITTER_MAX_FRAME
+ * \param quantile Percent of packets that should arrive before they are
+ *        due, e.g. 95
+ */
+void xbee_jitter_open(xbee_jitter_t * jitter,
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number,
+        const xbee_address_t * source, uint32_t period, size_t frame_size,
+        uint8_t quantile) SPECIAL_SECTION;
+
+void xbee_jitter_close(xbee_jitter_t * jitter) SPECIAL_SECTION;
+
+/*! Gets the frame due now, call every period ms
+ *
+ * \param frame_out frame_size bytes
+ *
+ * \return XBEE_JITTER_BUFFERING, XBEE_JITTER_PLAYED, XBEE_JITTER_CONCEALED
+ *         or XBEE_JITTER_STRETCHED
+ */
+int xbee_jitter_pull(xbee_jitter_t * jitter, void * frame_out) SPECIAL_SECTION;
+
+#endif /* _XBEE_JITTER_H_ */
@@ -0,0 +1,112 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_jitter.h"
+#include "xbee_sim.h"
+
+/* Node 1 sends a 20 byte frame every 20 ms to a jitter buffer on node 0,
+ * pulled every 20 ms.  The sim loses frames at the given rate and holds
+ * each for a fixed 10 ms plus up to jitter ms, so later frames can
+ * overtake earlier ones.  Underruns are pulls whose frame was missing:
+ * lost, or later than the playout delay allowed for. */
+
+#define BENCH_PORT (14)
+#define BENCH_PERIOD (20)
+#define BENCH_FRAME_SIZE (20)
+#define BENCH_FRAMES (5000)
+#define BENCH_DELAY (10)
+#define BENCH_QUANTILE (95)
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_port_mux_t mux[2];
+    xbee_port_t port[2];
+    xbee_port_message_t queue[4];
+    xbee_jitter_t jitter;
+
+    uint32_t pulls;                 /*! Since playout started */
+    uint64_t delay;                 /*! Sum of the playout delay over pulls, ms */
+} bench_t;
+
+static bench_t bench;
+
+/*! Streams BENCH_FRAMES frames with loss per million and jitter ms */
+static void bench_run(uint32_t loss, uint32_t jitter)
+{
+    memset(&bench, 0, sizeof(bench));
+    assert(xbee_sim_init(&bench.sim, 2, 53) == 0);
+    bench.sim.loss = loss;
+    bench.sim.delay = BENCH_DELAY;
+    bench.sim.jitter = jitter;
+
+    xbee_port_mux_init(&bench.mux[0], &bench.sim.nodes[0].xbee, 4);
+    xbee_port_mux_init(&bench.mux[1], &bench.sim.nodes[1].xbee, 4);
+    xbee_address_t source, sink;
+    xbee_sim_address16(&bench.sim, 1, &source);
+    xbee_sim_address16(&bench.sim, 0, &sink);
+    xbee_jitter_open(&bench.jitter, &bench.mux[0], &bench.port[0], BENCH_PORT, &source,
+            BENCH_PERIOD, BENCH_FRAME_SIZE, BENCH_QUANTILE);
+    xbee_port_open(&bench.mux[1], &bench.port[1], BENCH_PORT, 0, 4, 4, bench.queue,
+            NULL, NULL);
+
+    uint16_t seq = 0;
+    /* Runs on past the last frame sent until it has been due */
+    for(uint32_t t = 0; t < (BENCH_FRAMES + 10)*BENCH_PERIOD; ++t)
+    {
+        if(t % BENCH_PERIOD == 0)
+        {
+            if(seq < BENCH_FRAMES)
+            {
+                uint8_t packet[XBEE_JITTER_HEADER_SIZE + BENCH_FRAME_SIZE];
+                packet[0] = seq >> 8;
+                packet[1] = seq & 0xFF;
+                memset(&packet[XBEE_JITTER_HEADER_SIZE], seq, BENCH_FRAME_SIZE);
+                assert(xbee_port_send(&bench.mux[1], &bench.port[1], &sink, 0,
+                        sizeof(packet), packet) == 0);
+                seq += 1;
+            }
+
+            uint8_t frame[BENCH_FRAME_SIZE];
+            if(bench.jitter.play_seq < BENCH_FRAMES &&
+               xbee_jitter_pull(&bench.jitter, frame) != XBEE_JITTER_BUFFERING)
+            {
+                bench.pulls += 1;
+                bench.delay += bench.jitter.delay;
+            }
+        }
+
+        xbee_sim_advance(&bench.sim, 1);
+        for(size_t i = 0; i < 2; ++i)
+        {
+            assert(xbee_port_mux_run(&bench.mux[i]) == 0);
+        }
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const uint32_t losses[] = {0, 10000, 50000, 100000};
+    static const uint32_t jitters[] = {0, 20, 60};
+
+    printf("%u frames every %u ms, %u ms fixed delay, quantile %u\n",
+            BENCH_FRAMES, BENCH_PERIOD, BENCH_DELAY, BENCH_QUANTILE);
+    printf("  %5s %6s %9s %6s %7s %9s %10s\n", "loss%", "jitter", "underrun%", "late",
+            "skipped", "stretched", "mean delay");
+    for(size_t l = 0; l < sizeof(losses)/sizeof(losses[0]); ++l)
+    {
+        for(size_t j = 0; j < sizeof(jitters)/sizeof(jitters[0]); ++j)
+        {
+            bench_run(losses[l], jitters[j]);
+            const xbee_jitter_t * jb = &bench.jitter;
+            printf("  %5.1f %6u %9.2f %6u %7u %9u %10.1f\n", losses[l]/10000.0, jitters[j],
+                    100.0*jb->concealed/bench.pulls, jb->late, jb->skipped, jb->stretched,
+                    (double)bench.delay/bench.pulls);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_jitter.h"
+#include "xbee_sim.h"
+
+#define TEST_PORT (14)
+#define TEST_PERIOD (20)
+
+static xbee_sim_t test_sim;
+static xbee_port_mux_t test_mux;
+static xbee_port_t test_port;
+static xbee_jitter_t test_jitter;
+
+/*! Frame seq from node 1 arrives now */
+static void test_arrive(uint16_t seq)
+{
+    uint8_t frame[] = {XBEE_RECEIVE_16_BIT, 0x00, 0x02, 40, 0x00, TEST_PORT,
+        seq >> 8, seq & 0xFF, 'a' + seq};
+    xbee_sim_push_frame(&test_sim, 0, sizeof(frame), frame);
+    xbee_sim_step(&test_sim);
+}
+
+/*! Pulls at time, returning the result and the frame played */
+static int test_pull(uint32_t time, char * frame)
+{
+    test_sim.clock.now = time;
+    return xbee_jitter_pull(&test_jitter, frame);
+}
+
+static void test_setup(uint8_t quantile)
+{
+    assert(xbee_sim_init(&test_sim, 2, 47) == 0);
+    xbee_port_mux_init(&test_mux, &test_sim.nodes[0].xbee, 4);
+    xbee_address_t source;
+    xbee_sim_address16(&test_sim, 1, &source);
+    xbee_jitter_open(&test_jitter, &test_mux, &test_port, TEST_PORT, &source,
+            TEST_PERIOD, 1, quantile);
+}
+
+/*! A pull held back because the delay grew is told apart from a loss */
+void test_jitter_stretched(void)
+{
+    test_setup(100);
+
+    uint32_t start = test_sim.clock.now;
+    char frame;
+    test_arrive(0);
+    assert(test_pull(start, &frame) == XBEE_JITTER_PLAYED && frame == 'a');
+
+    test_sim.clock.now = start + TEST_PERIOD;
+    test_arrive(1);
+    assert(test_pull(start + TEST_PERIOD, &frame) == XBEE_JITTER_PLAYED && frame == 'b');
+
+    /* Frame 1 again, 19 ms late: frame 2 is now due 19 ms later */
+    test_sim.clock.now = start + 2*TEST_PERIOD - 1;
+    test_arrive(1);
+    test_arrive(2);
+    assert(test_pull(start + 2*TEST_PERIOD, &frame) == XBEE_JITTER_STRETCHED && frame == 'b');
+    assert(test_jitter.stretched == 1 && test_jitter.concealed == 0);
+    assert(test_pull(start + 3*TEST_PERIOD, &frame) == XBEE_JITTER_PLAYED && frame == 'c');
+
+    /* Frame 3 never arrives */
+    assert(test_pull(start + 4*TEST_PERIOD, &frame) == XBEE_JITTER_CONCEALED && frame == 'c');
+    assert(test_jitter.concealed == 1);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A packet again is dropped, one after its frame was concealed is late */
+void test_jitter_duplicate_late(void)
+{
+    test_setup(50);
+
+    uint32_t start = test_sim.clock.now;
+    char frame;
+    test_arrive(0);
+    test_arrive(1);
+    test_arrive(1);
+    assert(test_jitter.duplicates == 1);
+    assert(test_pull(start, &frame) == XBEE_JITTER_PLAYED && frame == 'a');
+    assert(test_pull(start + TEST_PERIOD, &frame) == XBEE_JITTER_PLAYED && frame == 'b');
+
+    /* Frame 2 is concealed, then comes */
+    assert(test_pull(start + 2*TEST_PERIOD, &frame) == XBEE_JITTER_CONCEALED && frame == 'b');
+    test_sim.clock.now = start + 2*TEST_PERIOD;
+    test_arrive(2);
+    assert(test_jitter.late == 1);
+
+    /* The concealed frame doesn't come out later, nor does a replay of
+     * one already played */
+    test_arrive(3);
+    test_arrive(0);
+    assert(test_jitter.late == 2);
+    assert(test_pull(start + 3*TEST_PERIOD, &frame) == XBEE_JITTER_PLAYED && frame == 'd');
+    assert(test_jitter.played == 3 && test_jitter.concealed == 1);
+    assert(test_jitter.received == 6);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Playout runs on across the 16 bit sequence number wrap */
+void test_jitter_wrap(void)
+{
+    test_setup(100);
+
+    uint32_t start = test_sim.clock.now;
+    for(uint32_t i = 0; i < 8; ++i)
+    {
+        uint16_t seq = 65532 + i;
+        test_sim.clock.now = start + i*TEST_PERIOD;
+        test_arrive(seq);
+
+        char frame;
+        assert(test_pull(start + i*TEST_PERIOD, &frame) == XBEE_JITTER_PLAYED);
+        assert(frame == (char)('a' + seq));
+    }
+    assert(test_jitter.played == 8 && test_jitter.late == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! When the network speeds up, frames are skipped until the playout
+ * delay has come down with it, and none goes missing meanwhile */
+void test_jitter_skipped(void)
+{
+    test_setup(95);
+
+    /* Frame n is sent at n*period, 100 ms on the way for the first 70 */
+    uint32_t start = test_sim.clock.now;
+    for(uint32_t t = 0; t < 200*TEST_PERIOD; t += TEST_PERIOD)
+    {
+        test_sim.clock.now = start + t;
+        if(t >= 100 && (t - 100)/TEST_PERIOD < 70)
+        {
+            test_arrive((t - 100)/TEST_PERIOD);
+        }
+        if(t/TEST_PERIOD >= 70)
+        {
+            test_arrive(t/TEST_PERIOD);
+        }
+
+        char frame;
+        test_pull(start + t, &frame);
+    }
+
+    assert(test_jitter.skipped > 0);
+    assert(test_jitter.delay < 100/2);
+    assert(test_jitter.concealed == 0 && test_jitter.late == 0);
+    assert(test_jitter.played + test_jitter.skipped + test_jitter.stretched > 150);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Over the sim with loss and jittered delay, underruns come from the
+ * losses and about 1 in 20 late packets for quantile 95 */
+void test_jitter_sim(void)
+{
+    test_setup(95);
+    test_sim.loss = 20000;
+    test_sim.delay = 10;
+    test_sim.jitter = 40;
+
+    static xbee_port_mux_t mux;
+    static xbee_port_t port;
+    static xbee_port_message_t queue[4];
+    xbee_port_mux_init(&mux, &test_sim.nodes[1].xbee, 4);
+    xbee_port_open(&mux, &port, TEST_PORT, 0, 4, 4, queue, NULL, NULL);
+    xbee_address_t sink;
+    xbee_sim_address16(&test_sim, 0, &sink);
+
+    uint32_t pulls = 0;
+    for(uint16_t seq = 0; seq < 1000; ++seq)
+    {
+        uint8_t packet[] = {seq >> 8, seq & 0xFF, 'a' + seq};
+        assert(xbee_port_send(&mux, &port, &sink, 0, sizeof(packet), packet) == 0);
+
+        char frame;
+        pulls += xbee_jitter_pull(&test_jitter, &frame) != XBEE_JITTER_BUFFERING;
+        for(uint32_t t = 0; t < TEST_PERIOD; ++t)
+        {
+            xbee_sim_advance(&test_sim, 1);
+            assert(xbee_port_mux_run(&mux) == 0);
+            assert(xbee_port_mux_run(&test_mux) == 0);
+        }
+    }
+
+    uint32_t sent = test_sim.delivered + test_sim.lost;
+    assert(test_sim.lost > 0 && test_jitter.late > 0);
+    assert(test_jitter.received <= test_sim.delivered);
+    assert(test_jitter.concealed >= test_sim.lost - (1000 - pulls));
+    assert(test_jitter.concealed <= test_sim.lost + sent/20);
+    assert(test_jitter.delay > 20 && test_jitter.delay <= 40);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_jitter_stretched();
+    test_jitter_duplicate_late();
+    test_jitter_wrap();
+    test_jitter_skipped();
+    test_jitter_sim();
+
+    return 0;
+}
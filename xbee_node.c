@@ -0,0 +1,253 @@
+#include "xbee_node.h"
+#include <assert.h>
+#include <string.h>
+
+static bool xbee_node_same_address(const xbee_address_t * a, const xbee_address_t * b)
+{
+    if(a->type != b->type)
+    {
+        return false;
+    }
+
+    if(a->type == XBEE_16_BIT)
+    {
+        return a->addr.network_address == b->addr.network_address;
+    }
+
+    return a->addr.address == b->addr.address;
+}
+
+static bool xbee_node_grouped(const xbee_node_t * node)
+{
+    for(size_t i = 0; i < sizeof(node->groups); ++i)
+    {
+        if(node->groups[i] != 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*! True if node is the one address names, also when address is the 16 bit
+ * address learnt for a node known by its 64 bit one */
+static bool xbee_node_is(const xbee_node_t * node, const xbee_address_t * address)
+{
+    if(xbee_node_same_address(&node->address, address))
+    {
+        return true;
+    }
+
+    return address->type == XBEE_16_BIT && node->address.type == XBEE_64_BIT &&
+           address->addr.network_address != XBEE_NODE_NO_NETWORK_ADDRESS &&
+           node->network_address == address->addr.network_address;
+}
+
+/*! Gives node, just taught its 16 bit address, whatever was recorded under
+ * that address alone, and takes the address from any other node holding it */
+static void xbee_node_merge(xbee_node_table_t * table, xbee_node_t * node) SPECIAL_SECTION;
+static void xbee_node_merge(xbee_node_table_t * table, xbee_node_t * node)
+{
+    uint32_t now = xbee_now(table->xbee);
+
+    for(size_t i = 0; i < XBEE_NODE_TABLE_SIZE; ++i)
+    {
+        xbee_node_t * n = &table->nodes[i];
+        if(!n->valid || n == node)
+        {
+            continue;
+        }
+
+        if(n->address.type == XBEE_64_BIT && n->network_address == node->network_address)
+        {
+            /* Address was reassigned */
+            n->network_address = XBEE_NODE_NO_NETWORK_ADDRESS;
+            continue;
+        }
+
+        if(n->address.type != XBEE_16_BIT || 
+           n->address.addr.network_address != node->network_address)
+        {
+            continue;
+        }
+
+        for(size_t g = 0; g < sizeof(node->groups); ++g)
+        {
+            node->groups[g] |= n->groups[g];
+        }
+
+        if(n->rssi != 0 && (node->rssi == 0 || 
+           now - n->last_heard < now - node->last_heard))
+        {
+            node->rssi = n->rssi;
+            node->last_heard = n->last_heard;
+        }
+
+        n->valid = false;
+    }
+}
+
+static int xbee_node_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_node_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_node_table_t * table = ptr;
+
+    if(frame->api_id == XBEE_REMOTE_AT_RESPONSE)
+    {
+        uint16_t network_address = frame->frame.at_command_response.responder_network_address;
+        if(network_address < XBEE_NODE_NO_NETWORK_ADDRESS)
+        {
+            xbee_address_t address = {XBEE_64_BIT, 
+                {.address = frame->frame.at_command_response.responder_address}};
+            xbee_node_t * n = xbee_node_find(table, &address, true);
+            if(n != NULL && n->network_address != network_address)
+            {
+                n->network_address = network_address;
+                xbee_node_merge(table, n);
+            }
+        }
+        return 0;
+    }
+
+    xbee_address_t source;
+    if(xbee_frame_source(frame, &source) != 0)
+    {
+        return 0;
+    }
+
+    xbee_node_t * n = xbee_node_find(table, &source, true);
+    if(n == NULL)
+    {
+        return 0;
+    }
+
+    uint8_t rssi = frame->frame.receive.rssi;
+    n->rssi = n->rssi == 0 ? rssi : (3*n->rssi + rssi + 2)/4;
+    n->last_heard = xbee_now(xbee);
+
+    return 0;
+}
+
+void xbee_node_table_init(xbee_node_table_t * table, xbee_interface_t * xbee)
+{
+    assert(table);
+    assert(xbee);
+    assert(xbee->uart->clock);
+
+    memset(table, 0, sizeof(*table));
+    table->xbee = xbee;
+
+    table->handler.ptr = table;
+    table->handler.frame = xbee_node_frame;
+    xbee_add_observer(xbee, &table->handler);
+}
+
+void xbee_node_table_stop(xbee_node_table_t * table)
+{
+    assert(table);
+
+    xbee_remove_handler(table->xbee, &table->handler);
+}
+
+xbee_node_t * xbee_node_find(xbee_node_table_t * table, 
+        const xbee_address_t * address, bool create)
+{
+    assert(table);
+    assert(address);
+
+    xbee_node_t * victim = NULL;
+    uint32_t now = xbee_now(table->xbee);
+
+    for(size_t i = 0; i < XBEE_NODE_TABLE_SIZE; ++i)
+    {
+        xbee_node_t * n = &table->nodes[i];
+        if(!n->valid)
+        {
+            if(victim == NULL || victim->valid)
+            {
+                victim = n;
+            }
+            continue;
+        }
+
+        if(xbee_node_is(n, address))
+        {
+            return n;
+        }
+
+        if(!xbee_node_grouped(n) && 
+           (victim == NULL || (victim->valid && 
+            now - n->last_heard > now - victim->last_heard)))
+        {
+            victim = n;
+        }
+    }
+
+    if(!create || victim == NULL)
+    {
+        return NULL;
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    victim->address = *address;
+    victim->valid = true;
+    victim->network_address = XBEE_NODE_NO_NETWORK_ADDRESS;
+    victim->last_heard = now;
+    return victim;
+}
+
+bool xbee_node_resolve(xbee_node_table_t * table, 
+        const xbee_address_t * address, xbee_address_t * out)
+{
+    assert(table);
+    assert(address);
+    assert(out);
+
+    *out = *address;
+    if(address->type != XBEE_64_BIT)
+    {
+        return false;
+    }
+
+    xbee_node_t * n = xbee_node_find(table, address, false);
+    if(n == NULL || n->network_address == XBEE_NODE_NO_NETWORK_ADDRESS)
+    {
+        return false;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->type = XBEE_16_BIT;
+    out->addr.network_address = n->network_address;
+    return true;
+}
+
+void xbee_node_table_set_transmit(xbee_node_table_t * table,
+        xbee_port_transmit_t transmit, void * transmit_ptr)
+{
+    assert(table);
+    assert(transmit);
+
+    table->transmit = transmit;
+    table->transmit_ptr = transmit_ptr;
+}
+
+int xbee_node_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    xbee_node_table_t * table = ptr;
+
+    assert(table);
+    assert(table->transmit);
+
+    xbee_address_t resolved;
+    if(xbee_node_resolve(table, address, &resolved))
+    {
+        table->resolved += 1;
+    }
+
+    return table->transmit(table->transmit_ptr, frame_id, &resolved, option, count, buffers);
+}
@@ -0,0 +1,97 @@
+#ifndef _XBEE_NODE_H_
+#define _XBEE_NODE_H_
+
+#include "xbee_port.h"
+
+#ifndef XBEE_NODE_TABLE_SIZE
+#define XBEE_NODE_TABLE_SIZE 32
+#endif /* XBEE_NODE_TABLE_SIZE */
+
+/*! Multicast groups, ids 0 to XBEE_GROUP_MAX-1 */
+#ifndef XBEE_GROUP_MAX
+#define XBEE_GROUP_MAX 32
+#endif /* XBEE_GROUP_MAX */
+
+#define XBEE_ERR_NODE_TABLE_FULL (-30)  /*! Every node is in a group, none can be evicted */
+
+/*! xbee_node_t::network_address of a node whose 16 bit address is unknown,
+ * also what an XBee with MY unset reports */
+#define XBEE_NODE_NO_NETWORK_ADDRESS (0xFFFE)
+
+typedef struct {
+    xbee_address_t address;
+    bool valid;
+    uint8_t rssi;               /*! Smoothed -dBm of frames heard, 0 if none yet */
+    uint16_t network_address;   /*! 16 bit address of a 64 bit node, see xbee_node_resolve */
+    uint32_t last_heard;
+    uint8_t groups[XBEE_GROUP_MAX/8];   /*! Bit n set if member of group n */
+} xbee_node_t;
+
+/*! Nodes this XBee hears or sends to
+ *
+ * Received frames update each source's smoothed RSSI and last heard time.
+ * XBEE_REMOTE_AT_RESPONSE frames carry both of the responder's addresses,
+ * so they teach the 16 bit address of a node known by its 64 bit one.
+ * From then on the node is found by either address, and an entry made
+ * for the 16 bit address alone is merged into it.
+ * When full, a node in no group is evicted, the one heard least recently.
+ *
+ * Time comes from xbee_now, so the XBee's clock must be set.
+ */
+typedef struct {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+
+    xbee_node_t nodes[XBEE_NODE_TABLE_SIZE];
+
+    xbee_port_transmit_t transmit;  /*! Next stage of xbee_node_transmit */
+    void * transmit_ptr;
+    uint32_t resolved;          /*! Frames xbee_node_transmit sent to a 16 bit address */
+} xbee_node_table_t;
+
+/*! Registers handler as an observer, see xbee_add_observer, so it hears 
+ * the frames of a mux initialised before it */
+void xbee_node_table_init(xbee_node_table_t * table, xbee_interface_t * xbee) SPECIAL_SECTION;
+
+void xbee_node_table_stop(xbee_node_table_t * table) SPECIAL_SECTION;
+
+/*! Finds node, adding it if create is set
+ *
+ * \return Node, or NULL if not found or no node can be evicted
+ */
+xbee_node_t * xbee_node_find(xbee_node_table_t * table, 
+        const xbee_address_t * address, bool create) SPECIAL_SECTION;
+
+/*! Gets the address to send to address with, its 16 bit address if known
+ *
+ * A 16 bit address takes a shorter transmit header, leaving more of
+ * XBEE_MAX_RF_PAYLOAD to the payload.
+ *
+ * \return true if out is a known 16 bit address for address
+ */
+bool xbee_node_resolve(xbee_node_table_t * table, 
+        const xbee_address_t * address, xbee_address_t * out) SPECIAL_SECTION;
+
+/*! Sets the stage xbee_node_transmit passes frames on to */
+void xbee_node_table_set_transmit(xbee_node_table_t * table,
+        xbee_port_transmit_t transmit, void * transmit_ptr) SPECIAL_SECTION;
+
+/*! Sends frame to the address xbee_node_resolve gives, signature matches
+ * xbee_port_transmit_t, ptr is the table
+ *
+ * Set with xbee_port_mux_set_transmit so frames to a 64 bit node take the
+ * shorter header once its 16 bit address is known.  Statuses still come
+ * back on frame_id, so callers keep the address they sent to.
+ *
+ * \return Result of the next stage
+ */
+int xbee_node_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers) SPECIAL_SECTION;
+
+static inline bool xbee_node_in_group(const xbee_node_t * node, uint8_t group)
+{
+    return (node->groups[group >> 3] & (1 << (group & 7))) != 0;
+}
+
+#endif /* _XBEE_NODE_H_ */
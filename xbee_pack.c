@@ -0,0 +1,217 @@
+#include "xbee_pack.h"
+#include <assert.h>
+
+void xbee_pack_bits(uint8_t * data, size_t bit, uint8_t width, uint32_t value)
+{
+    assert(data);
+    assert(width >= 1 && width <= 32);
+
+    while(width > 0)
+    {
+        uint8_t offset = bit & 7;
+        uint8_t chunk = 8 - offset < width ? 8 - offset : width;
+        uint8_t shift = 8 - offset - chunk;
+        uint8_t mask = ((1 << chunk) - 1) << shift;
+        uint8_t part = (value >> (width - chunk)) & ((1 << chunk) - 1);
+
+        data[bit >> 3] = (data[bit >> 3] & ~mask) | (part << shift);
+        bit += chunk;
+        width -= chunk;
+    }
+}
+
+uint32_t xbee_unpack_bits(const void * data, size_t bit, uint8_t width)
+{
+    const uint8_t * bytes = data;
+    uint32_t value = 0;
+
+    assert(data);
+    assert(width >= 1 && width <= 32);
+
+    while(width > 0)
+    {
+        uint8_t offset = bit & 7;
+        uint8_t chunk = 8 - offset < width ? 8 - offset : width;
+        uint8_t shift = 8 - offset - chunk;
+
+        value = (value << chunk) | ((bytes[bit >> 3] >> shift) & ((1 << chunk) - 1));
+        bit += chunk;
+        width -= chunk;
+    }
+
+    return value;
+}
+
+void xbee_packer_init(xbee_packer_t * packer, size_t size, void * data)
+{
+    assert(packer);
+    assert(data || size == 0);
+
+    packer->data = data;
+    packer->size = size;
+    packer->bit = 0;
+    packer->error = 0;
+}
+
+void xbee_pack_uint(xbee_packer_t * packer, uint8_t width, uint32_t value)
+{
+    assert(packer);
+
+    if(packer->error != 0)
+    {
+        return;
+    }
+    if(width < 32 && (value >> width) != 0)
+    {
+        packer->error = XBEE_ERR_PACK_RANGE;
+        return;
+    }
+    if(packer->bit + width > 8*packer->size)
+    {
+        packer->error = XBEE_ERR_TOO_LARGE;
+        return;
+    }
+
+    xbee_pack_bits(packer->data, packer->bit, width, value);
+    packer->bit += width;
+}
+
+void xbee_pack_int(xbee_packer_t * packer, uint8_t width, int32_t value)
+{
+    assert(packer);
+    assert(width >= 1 && width <= 32);
+
+    int64_t limit = (int64_t)1 << (width - 1);
+    if(value < -limit || value >= limit)
+    {
+        if(packer->error == 0)
+        {
+            packer->error = XBEE_ERR_PACK_RANGE;
+        }
+        return;
+    }
+
+    uint32_t bits = (uint32_t)value;
+    if(width < 32)
+    {
+        bits &= ((uint32_t)1 << width) - 1;
+    }
+    xbee_pack_uint(packer, width, bits);
+}
+
+void xbee_pack_varint(xbee_packer_t * packer, uint32_t value)
+{
+    do
+    {
+        uint8_t group = value & 0x7F;
+        value >>= 7;
+        xbee_pack_uint(packer, 8, value != 0 ? group | 0x80 : group);
+    }
+    while(value != 0);
+}
+
+void xbee_pack_svarint(xbee_packer_t * packer, int32_t value)
+{
+    /* Zigzag, so small negative numbers stay short */
+    xbee_pack_varint(packer, ((uint32_t)value << 1) ^ -(uint32_t)(value < 0));
+}
+
+int xbee_packer_finish(const xbee_packer_t * packer)
+{
+    assert(packer);
+
+    if(packer->error != 0)
+    {
+        return packer->error;
+    }
+
+    return (packer->bit + 7) / 8;
+}
+
+void xbee_unpacker_init(xbee_unpacker_t * unpacker, size_t size, const void * data)
+{
+    assert(unpacker);
+    assert(data || size == 0);
+
+    unpacker->data = data;
+    unpacker->size = size;
+    unpacker->bit = 0;
+    unpacker->error = 0;
+}
+
+uint32_t xbee_unpack_uint(xbee_unpacker_t * unpacker, uint8_t width)
+{
+    assert(unpacker);
+
+    if(unpacker->error != 0)
+    {
+        return 0;
+    }
+    if(unpacker->bit + width > 8*unpacker->size)
+    {
+        unpacker->error = XBEE_ERR_PACK_MALFORMED;
+        return 0;
+    }
+
+    uint32_t value = xbee_unpack_bits(unpacker->data, unpacker->bit, width);
+    unpacker->bit += width;
+    return value;
+}
+
+int32_t xbee_unpack_int(xbee_unpacker_t * unpacker, uint8_t width)
+{
+    return xbee_sign_extend(xbee_unpack_uint(unpacker, width), width);
+}
+
+uint32_t xbee_unpack_varint(xbee_unpacker_t * unpacker)
+{
+    uint32_t value = 0;
+
+    for(uint8_t shift = 0; shift < 35; shift += 7)
+    {
+        uint8_t group = xbee_unpack_uint(unpacker, 8);
+
+        /* The fifth group carries the top 4 bits and must be the last */
+        if(shift == 28 && group > 0x0F)
+        {
+            xbee_unpacker_fail(unpacker);
+            return 0;
+        }
+
+        value |= (uint32_t)(group & 0x7F) << shift;
+        if((group & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+
+    return value;
+}
+
+int32_t xbee_unpack_svarint(xbee_unpacker_t * unpacker)
+{
+    uint32_t value = xbee_unpack_varint(unpacker);
+    return (int32_t)((value >> 1) ^ -(value & 1));
+}
+
+void xbee_unpacker_fail(xbee_unpacker_t * unpacker)
+{
+    assert(unpacker);
+
+    if(unpacker->error == 0)
+    {
+        unpacker->error = XBEE_ERR_PACK_MALFORMED;
+    }
+}
+
+int xbee_unpacker_finish(const xbee_unpacker_t * unpacker)
+{
+    assert(unpacker);
+
+    if(unpacker->error != 0)
+    {
+        return unpacker->error;
+    }
+
+    return (unpacker->bit + 7) / 8;
+}
@@ -0,0 +1,77 @@
+#ifndef _XBEE_PACK_H_
+#define _XBEE_PACK_H_
+
+#include "xbee.h"
+
+/*! Largest encoded message xbee_schema output may declare, checked at
+ * compile time.  Lower it for messages sent through a port, AEAD or
+ * another layer that adds a header, e.g. to XBEE_PORT_MAX_PAYLOAD. */
+#ifndef XBEE_SCHEMA_PAYLOAD_LIMIT
+#define XBEE_SCHEMA_PAYLOAD_LIMIT XBEE_MAX_RF_PAYLOAD
+#endif /* XBEE_SCHEMA_PAYLOAD_LIMIT */
+
+/*! Varints hold up to 32 bits, 7 per byte */
+#define XBEE_PACK_VARINT_MAX_BITS (40)
+
+#define XBEE_ERR_PACK_RANGE (-33)       /*! Field value does not fit its width */
+#define XBEE_ERR_PACK_MALFORMED (-34)   /*! Truncated, wrong message id or overlong varint */
+
+/*! Bit-packed encoding used by xbee_schema generated code
+ *
+ * Fields are written most significant bit first with no padding, so a
+ * field that happens to be byte aligned reads as a big endian integer.
+ * Varints are LEB128 groups of 7 bits, signed ones zigzag encoded, and
+ * need not be byte aligned either.
+ *
+ * The packer and unpacker keep the first error and ignore everything
+ * after it, so generated code checks once, at finish.
+ */
+typedef struct {
+    uint8_t * data;
+    size_t size;
+    size_t bit;
+    int error;
+} xbee_packer_t;
+
+typedef struct {
+    const uint8_t * data;
+    size_t size;
+    size_t bit;
+    int error;
+} xbee_unpacker_t;
+
+/*! Writes the low width bits of value at bit offset bit, width 1 to 32 */
+void xbee_pack_bits(uint8_t * data, size_t bit, uint8_t width, uint32_t value) SPECIAL_SECTION;
+
+/*! Reads width bits at bit offset bit, width 1 to 32 */
+uint32_t xbee_unpack_bits(const void * data, size_t bit, uint8_t width) SPECIAL_SECTION;
+
+static inline int32_t xbee_sign_extend(uint32_t value, uint8_t width)
+{
+    uint32_t sign = (uint32_t)1 << (width - 1);
+    return (int32_t)((value ^ sign) - sign);
+}
+
+void xbee_packer_init(xbee_packer_t * packer, size_t size, void * data) SPECIAL_SECTION;
+void xbee_pack_uint(xbee_packer_t * packer, uint8_t width, uint32_t value) SPECIAL_SECTION;
+void xbee_pack_int(xbee_packer_t * packer, uint8_t width, int32_t value) SPECIAL_SECTION;
+void xbee_pack_varint(xbee_packer_t * packer, uint32_t value) SPECIAL_SECTION;
+void xbee_pack_svarint(xbee_packer_t * packer, int32_t value) SPECIAL_SECTION;
+
+/*! \return Bytes written, XBEE_ERR_TOO_LARGE if data was too small,
+ *          or XBEE_ERR_PACK_RANGE */
+int xbee_packer_finish(const xbee_packer_t * packer) SPECIAL_SECTION;
+
+void xbee_unpacker_init(xbee_unpacker_t * unpacker, size_t size, const void * data) SPECIAL_SECTION;
+uint32_t xbee_unpack_uint(xbee_unpacker_t * unpacker, uint8_t width) SPECIAL_SECTION;
+int32_t xbee_unpack_int(xbee_unpacker_t * unpacker, uint8_t width) SPECIAL_SECTION;
+uint32_t xbee_unpack_varint(xbee_unpacker_t * unpacker) SPECIAL_SECTION;
+int32_t xbee_unpack_svarint(xbee_unpacker_t * unpacker) SPECIAL_SECTION;
+
+/*! Fails the unpacker with XBEE_ERR_PACK_MALFORMED, e.g. on a wrong message id */
+void xbee_unpacker_fail(xbee_unpacker_t * unpacker) SPECIAL_SECTION;
+
+/*! \return Bytes read, or XBEE_ERR_PACK_MALFORMED */
+int xbee_unpacker_finish(const xbee_unpacker_t * unpacker) SPECIAL_SECTION;
+
+#endif /* _XBEE_PACK_H_ */
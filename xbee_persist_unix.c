@@ -0,0 +1,377 @@
+#define _DEFAULT_SOURCE
+#include "xbee_persist_unix.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define XBEE_PERSIST_MAGIC (0x58425053)     /* "XBPS" */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t node_count;
+    uint32_t node_size;
+    uint32_t at_count;
+    uint32_t at_size;
+    uint32_t checksum;
+} xbee_persist_header_t;
+
+/* Records are always built from zero, so padding compares equal */
+typedef struct {
+    uint32_t checksum;
+    uint32_t valid;
+    uint64_t module;            /* SH, SL of the XBee the AT records came from */
+} xbee_persist_module_t;
+
+typedef struct {
+    uint32_t checksum;
+    uint64_t address;
+    uint16_t network_address;
+    uint8_t type;
+    uint8_t valid;
+    uint8_t rssi;
+    uint8_t groups[XBEE_GROUP_MAX/8];
+} xbee_persist_node_t;
+
+typedef struct {
+    uint32_t checksum;
+    char at_command[2];
+    uint8_t value_size;         /* 0 if the slot holds no valid value */
+    uint8_t value[XBEE_MAX_AT_PARAM];
+} xbee_persist_at_t;
+
+typedef struct {
+    xbee_persist_header_t header;
+    xbee_persist_module_t module;
+    xbee_persist_node_t nodes[XBEE_NODE_TABLE_SIZE];
+    xbee_persist_at_t at[XBEE_AT_CACHE_SIZE];
+} xbee_persist_file_t;
+
+/*! FNV-1a */
+static uint32_t xbee_persist_hash(const void * data, size_t size)
+{
+    const uint8_t * b = data;
+    uint32_t hash = 2166136261u;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ b[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/*! Checksum of a record, which covers what follows its leading checksum */
+static uint32_t xbee_persist_checksum(const void * record, size_t size)
+{
+    return xbee_persist_hash((const uint8_t *)record + sizeof(uint32_t),
+            size - sizeof(uint32_t));
+}
+
+static void xbee_persist_make_header(xbee_persist_header_t * header)
+{
+    memset(header, 0, sizeof(*header));
+    header->magic = XBEE_PERSIST_MAGIC;
+    header->version = XBEE_PERSIST_VERSION;
+    header->node_count = XBEE_NODE_TABLE_SIZE;
+    header->node_size = sizeof(xbee_persist_node_t);
+    header->at_count = XBEE_AT_CACHE_SIZE;
+    header->at_size = sizeof(xbee_persist_at_t);
+    header->checksum = xbee_persist_hash(header, offsetof(xbee_persist_header_t, checksum));
+}
+
+static void xbee_persist_make_module(xbee_persist_module_t * record, bool valid, uint64_t module)
+{
+    memset(record, 0, sizeof(*record));
+    if(valid)
+    {
+        record->valid = 1;
+        record->module = module;
+    }
+    record->checksum = xbee_persist_checksum(record, sizeof(*record));
+}
+
+static void xbee_persist_make_node(xbee_persist_node_t * record, const xbee_node_t * node)
+{
+    memset(record, 0, sizeof(*record));
+    if(node->valid)
+    {
+        record->valid = 1;
+        record->type = node->address.type;
+        if(node->address.type == XBEE_16_BIT)
+        {
+            record->address = node->address.addr.network_address;
+        }
+        else
+        {
+            record->address = node->address.addr.address;
+        }
+        record->network_address = node->network_address;
+        record->rssi = node->rssi;
+        memcpy(record->groups, node->groups, sizeof(record->groups));
+    }
+    record->checksum = xbee_persist_checksum(record, sizeof(*record));
+}
+
+static void xbee_persist_make_at(xbee_persist_at_t * record, const xbee_at_cache_entry_t * e)
+{
+    memset(record, 0, sizeof(*record));
+    if(e->flags == (XBEE_AT_CACHE_VALID | XBEE_AT_CACHE_SAVED))
+    {
+        memcpy(record->at_command, e->at_command, sizeof(record->at_command));
+        record->value_size = e->value_size;
+        memcpy(record->value, e->value, e->value_size);
+    }
+    record->checksum = xbee_persist_checksum(record, sizeof(*record));
+}
+
+int xbee_persist_open(xbee_persist_t * persist, const char * path,
+        xbee_interface_t * xbee, xbee_node_table_t * table)
+{
+    assert(persist);
+    assert(path);
+    assert(xbee);
+    assert(table);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    size_t size = sizeof(xbee_persist_file_t);
+    void * map = MAP_FAILED;
+    if(ftruncate(fd, size) == 0)
+    {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    if(map == MAP_FAILED)
+    {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    memset(persist, 0, sizeof(*persist));
+    persist->fd = fd;
+    persist->map = map;
+    persist->xbee = xbee;
+    persist->table = table;
+
+    /* Another version or build's file, or a new one the truncate zeroed */
+    xbee_persist_file_t * file = map;
+    xbee_persist_header_t header;
+    xbee_persist_make_header(&header);
+    if(memcmp(&file->header, &header, sizeof(header)) != 0)
+    {
+        xbee_node_t node;
+        xbee_at_cache_entry_t entry;
+        memset(&node, 0, sizeof(node));
+        memset(&entry, 0, sizeof(entry));
+
+        memset(file, 0, size);
+        file->header = header;
+        xbee_persist_make_module(&file->module, false, 0);
+        for(size_t i = 0; i < XBEE_NODE_TABLE_SIZE; ++i)
+        {
+            xbee_persist_make_node(&file->nodes[i], &node);
+        }
+        for(size_t i = 0; i < XBEE_AT_CACHE_SIZE; ++i)
+        {
+            xbee_persist_make_at(&file->at[i], &entry);
+        }
+    }
+
+    return 0;
+}
+
+static bool xbee_persist_at_cached(const xbee_interface_t * xbee, const char * at_command)
+{
+    for(size_t i = 0; i < XBEE_AT_CACHE_SIZE; ++i)
+    {
+        const xbee_at_cache_entry_t * e = &xbee->at_cache[i];
+        if(e->flags != 0 && memcmp(e->at_command, at_command, 2) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*! Restores the saved AT values to free cache slots */
+static void xbee_persist_load_at(xbee_persist_t * persist)
+{
+    xbee_persist_file_t * file = persist->map;
+
+    for(size_t i = 0; i < XBEE_AT_CACHE_SIZE; ++i)
+    {
+        const xbee_persist_at_t * record = &file->at[i];
+        xbee_at_cache_entry_t * e = &persist->xbee->at_cache[i];
+        if(record->checksum != xbee_persist_checksum(record, sizeof(*record)) ||
+           record->value_size == 0 || record->value_size > XBEE_MAX_AT_PARAM ||
+           e->flags != 0 || xbee_persist_at_cached(persist->xbee, record->at_command))
+        {
+            continue;
+        }
+
+        memset(e, 0, sizeof(*e));
+        memcpy(e->at_command, record->at_command, sizeof(e->at_command));
+        e->flags = XBEE_AT_CACHE_VALID | XBEE_AT_CACHE_SAVED;
+        e->value_size = record->value_size;
+        memcpy(e->value, record->value, record->value_size);
+        persist->at_restored += 1;
+    }
+}
+
+/*! Learns the XBee's SH and SL through the AT cache, then restores or
+ * drops the saved AT values depending on whether they were this XBee's */
+static void xbee_persist_identify(xbee_persist_t * persist)
+{
+    if(!persist->module_known)
+    {
+        uint8_t sh[4], sl[4];
+        if(xbee_at_cached(persist->xbee, "SH", false, sizeof(sh), sh) != sizeof(sh) ||
+           xbee_at_cached(persist->xbee, "SL", false, sizeof(sl), sl) != sizeof(sl))
+        {
+            /* Queries in flight, or sent again by the next sync */
+            return;
+        }
+
+        persist->module = 0;
+        for(size_t i = 0; i < 4; ++i)
+        {
+            persist->module = persist->module << 8 | sh[i];
+        }
+        for(size_t i = 0; i < 4; ++i)
+        {
+            persist->module = persist->module << 8 | sl[i];
+        }
+        persist->module_known = true;
+    }
+
+    if(!persist->at_pending)
+    {
+        return;
+    }
+
+    const xbee_persist_module_t * record = &((xbee_persist_file_t *)persist->map)->module;
+    if(record->checksum == xbee_persist_checksum(record, sizeof(*record)) &&
+       record->valid && record->module == persist->module)
+    {
+        xbee_persist_load_at(persist);
+    }
+    persist->at_pending = false;
+}
+
+int xbee_persist_load(xbee_persist_t * persist)
+{
+    assert(persist);
+
+    xbee_persist_file_t * file = persist->map;
+    uint32_t now = xbee_now(persist->xbee);
+    int restored = 0;
+
+    for(size_t i = 0; i < XBEE_NODE_TABLE_SIZE; ++i)
+    {
+        const xbee_persist_node_t * record = &file->nodes[i];
+        xbee_node_t * n = &persist->table->nodes[i];
+        if(record->checksum != xbee_persist_checksum(record, sizeof(*record)) ||
+           !record->valid || n->valid)
+        {
+            continue;
+        }
+
+        memset(n, 0, sizeof(*n));
+        n->valid = true;
+        n->address.type = record->type;
+        if(record->type == XBEE_16_BIT)
+        {
+            n->address.addr.network_address = record->address;
+        }
+        else
+        {
+            n->address.addr.address = record->address;
+        }
+        n->network_address = record->network_address;
+        n->rssi = record->rssi;
+        n->last_heard = now;
+        memcpy(n->groups, record->groups, sizeof(n->groups));
+        restored += 1;
+    }
+
+    /* AT values wait until SH and SL show they are this XBee's */
+    persist->at_pending = true;
+    xbee_persist_identify(persist);
+
+    return restored;
+}
+
+int xbee_persist_sync(xbee_persist_t * persist)
+{
+    assert(persist);
+
+    xbee_persist_file_t * file = persist->map;
+    int written = 0;
+
+    xbee_persist_identify(persist);
+    if(persist->at_pending)
+    {
+        /* Saved AT values are neither restored nor dropped yet, keep them */
+        return 0;
+    }
+
+    xbee_persist_module_t module;
+    xbee_persist_make_module(&module, persist->module_known, persist->module);
+    if(memcmp(&file->module, &module, sizeof(module)) != 0)
+    {
+        memcpy(&file->module, &module, sizeof(module));
+        written += 1;
+    }
+
+    for(size_t i = 0; i < XBEE_NODE_TABLE_SIZE; ++i)
+    {
+        xbee_persist_node_t record;
+        xbee_persist_make_node(&record, &persist->table->nodes[i]);
+        if(memcmp(&file->nodes[i], &record, sizeof(record)) != 0)
+        {
+            memcpy(&file->nodes[i], &record, sizeof(record));
+            written += 1;
+        }
+    }
+
+    for(size_t i = 0; i < XBEE_AT_CACHE_SIZE; ++i)
+    {
+        xbee_persist_at_t record;
+        xbee_persist_make_at(&record, &persist->xbee->at_cache[i]);
+        if(memcmp(&file->at[i], &record, sizeof(record)) != 0)
+        {
+            memcpy(&file->at[i], &record, sizeof(record));
+            written += 1;
+        }
+    }
+
+    persist->records_written += written;
+    return written;
+}
+
+int xbee_persist_close(xbee_persist_t * persist)
+{
+    assert(persist);
+
+    xbee_persist_sync(persist);
+
+    int ret = msync(persist->map, sizeof(xbee_persist_file_t), MS_SYNC);
+    munmap(persist->map, sizeof(xbee_persist_file_t));
+    close(persist->fd);
+    persist->map = NULL;
+    persist->fd = -1;
+
+    return ret;
+}
@@ -0,0 +1,77 @@
+#ifndef _XBEE_PERSIST_UNIX_H_
+#define _XBEE_PERSIST_UNIX_H_
+
+#include "xbee_node.h"
+
+/*! Bump when the record layout changes, older files are then discarded */
+#define XBEE_PERSIST_VERSION (3)
+
+/*! Node table and AT cache kept in a memory mapped file across restarts
+ *
+ * The file holds a header, one record per node table slot and one per AT
+ * cache slot, each with its own checksum.  xbee_persist_sync compares
+ * every record with its slot and rewrites only those that changed, so a
+ * sync that finds nothing to do touches no pages, and one that does
+ * dirties a page or two for the kernel to write back.  A record torn by a
+ * crash fails its checksum and is skipped by xbee_persist_load, the rest
+ * still load.
+ *
+ * Saved per node: its address, 16 bit address, smoothed RSSI and groups.
+ * Saved per AT cache entry: values the XBee has in non-volatile memory
+ * (XBEE_AT_CACHE_SAVED, valid at a WR), along with the SH and SL of the
+ * XBee they came from.  Values only set at run time are not saved, as
+ * the XBee loses them when it power cycles, which it may well have done
+ * by the time the host restarts.  Saved values are only restored once SH
+ * and SL, read through xbee_at_cached, show the same XBee is attached,
+ * so a swapped module isn't credited with the old one's settings.  The
+ * header records the version, table sizes and record sizes, and a file
+ * that doesn't match is reset rather than loaded.
+ */
+typedef struct {
+    int fd;
+    void * map;
+    xbee_interface_t * xbee;
+    xbee_node_table_t * table;
+
+    bool at_pending;            /*! Saved AT values wait for SH and SL */
+    bool module_known;
+    uint64_t module;            /*! SH, SL of the attached XBee */
+
+    uint32_t at_restored;
+    uint32_t records_written;
+} xbee_persist_t;
+
+/*! Opens path, creating it if needed, and maps it
+ *
+ * \return 0 on success, or -1 and errno set
+ */
+int xbee_persist_open(xbee_persist_t * persist, const char * path,
+        xbee_interface_t * xbee, xbee_node_table_t * table);
+
+/*! Restores saved nodes, once after xbee_open and xbee_node_table_init
+ * and before the first xbee_persist_sync
+ *
+ * Restored nodes count as heard now.  Saved AT values are restored by a
+ * later xbee_persist_sync once the XBee's SH and SL are known, and only
+ * if they match (see at_restored).
+ *
+ * \return Number of node records restored, 0 for a new or reset file
+ */
+int xbee_persist_load(xbee_persist_t * persist);
+
+/*! Writes the records that changed since the last sync, cheap enough to
+ * call every pass of the main loop
+ *
+ * Writes nothing until the saved AT values have been restored or dropped.
+ *
+ * \return Number of records written
+ */
+int xbee_persist_sync(xbee_persist_t * persist);
+
+/*! Syncs, flushes the file to disk and unmaps it
+ *
+ * \return 0 on success, or -1 and errno set
+ */
+int xbee_persist_close(xbee_persist_t * persist);
+
+#endif /* _XBEE_PERSIST_UNIX_H_ */
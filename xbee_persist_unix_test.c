@@ -0,0 +1,254 @@
+#define _DEFAULT_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xbee_persist_unix.h"
+#include "xbee_sim.h"
+
+static char test_path[] = "/tmp/xbee_persist_test.XXXXXX";
+
+static xbee_sim_t test_sim;
+static xbee_node_table_t test_table;
+static xbee_persist_t test_persist;
+
+/*! A freshly started XBee and host, with the file opened and loaded
+ *
+ * \return Nodes restored
+ */
+static int test_start(const uint8_t * sh)
+{
+    assert(xbee_sim_init(&test_sim, 2, 23) == 0);
+    xbee_sim_set_register(&test_sim, 0, "CH", 1, "\x0C");
+    /* Executed, answers OK without a value */
+    xbee_sim_set_register(&test_sim, 0, "WR", 0, "");
+    if(sh != NULL)
+    {
+        xbee_sim_set_register(&test_sim, 0, "SH", 4, sh);
+    }
+
+    xbee_node_table_init(&test_table, &test_sim.nodes[0].xbee);
+    assert(xbee_persist_open(&test_persist, test_path, &test_sim.nodes[0].xbee,
+            &test_table) == 0);
+    return xbee_persist_load(&test_persist);
+}
+
+/*! Runs the sim until the saved AT values are restored or dropped */
+static void test_identify(void)
+{
+    for(size_t i = 0; i < 5 && test_persist.at_pending; ++i)
+    {
+        xbee_sim_step(&test_sim);
+        xbee_persist_sync(&test_persist);
+    }
+    assert(!test_persist.at_pending);
+}
+
+/*! Saves node 1 with a 16 bit address and another node, and CH, which
+ * is only in the XBee's non-volatile memory once written with WR */
+static void test_save(bool write)
+{
+    assert(truncate(test_path, 0) == 0);
+    assert(test_start(NULL) == 0);
+    test_identify();
+
+    xbee_address_t peer, other = {XBEE_64_BIT, {.address = 0x0013A200DEADBEEFULL}};
+    xbee_sim_address64(&test_sim, 1, &peer);
+    xbee_node_t * n = xbee_node_find(&test_table, &peer, true);
+    n->network_address = 2;
+    n->rssi = 40;
+    n->groups[0] = 0x05;
+    assert(xbee_node_find(&test_table, &other, true) != NULL);
+
+    uint8_t ch;
+    assert(xbee_at_cached(&test_sim.nodes[0].xbee, "CH", false, 1, &ch) == XBEE_ERR_CACHE_MISS);
+    xbee_sim_step(&test_sim);
+    if(write)
+    {
+        xbee_interface_t * xbee = &test_sim.nodes[0].xbee;
+        assert(xbee_at_command(xbee, xbee_alloc_frame_id(xbee), "WR", 0, NULL) == 0);
+        xbee_sim_step(&test_sim);
+    }
+
+    assert(xbee_persist_sync(&test_persist) >= 2);
+    assert(xbee_persist_sync(&test_persist) == 0);
+    assert(xbee_persist_close(&test_persist) == 0);
+}
+
+/*! Rewrites byte offset of the file */
+static void test_poke(size_t offset, uint8_t value)
+{
+    FILE * f = fopen(test_path, "r+b");
+    assert(f != NULL);
+    assert(fseek(f, offset, SEEK_SET) == 0);
+    assert(fputc(value, f) == value);
+    assert(fclose(f) == 0);
+}
+
+/*! Offset of the first copy of the 64 bit address in the file */
+static size_t test_find(uint64_t address)
+{
+    static uint8_t data[65536];
+    FILE * f = fopen(test_path, "rb");
+    assert(f != NULL);
+    size_t size = fread(data, 1, sizeof(data), f);
+    assert(fclose(f) == 0);
+
+    for(size_t i = 0; i + sizeof(address) <= size; ++i)
+    {
+        if(memcmp(&data[i], &address, sizeof(address)) == 0)
+        {
+            return i;
+        }
+    }
+
+    assert(false);
+    return 0;
+}
+
+/*! Nodes and AT values come back after a restart, the node with its 16
+ * bit address */
+void test_persist_round_trip(void)
+{
+    test_save(true);
+
+    assert(test_start(NULL) == 2);
+    xbee_address_t peer, resolved;
+    xbee_sim_address64(&test_sim, 1, &peer);
+    xbee_node_t * n = xbee_node_find(&test_table, &peer, false);
+    assert(n != NULL);
+    assert(n->rssi == 40 && n->groups[0] == 0x05);
+    assert(xbee_node_resolve(&test_table, &peer, &resolved));
+    assert(resolved.addr.network_address == 2);
+
+    /* AT values wait for SH and SL, the file keeps them meanwhile */
+    assert(test_persist.at_pending);
+    assert(xbee_persist_sync(&test_persist) == 0);
+    test_identify();
+    assert(test_persist.at_restored == 1);
+
+    uint8_t ch;
+    size_t frames = test_sim.nodes[0].frames_in;
+    assert(xbee_at_cached(&test_sim.nodes[0].xbee, "CH", false, 1, &ch) == 1);
+    assert(ch == 0x0C);
+    xbee_sim_step(&test_sim);
+    assert(test_sim.nodes[0].frames_in == frames);
+
+    assert(xbee_persist_close(&test_persist) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Values not written with WR, or changed since, are gone when the XBee
+ * power cycles, so they aren't restored */
+void test_persist_unsaved(void)
+{
+    test_save(false);
+
+    assert(test_start(NULL) == 2);
+    test_identify();
+    assert(test_persist.at_restored == 0);
+
+    uint8_t ch;
+    assert(xbee_at_cached(&test_sim.nodes[0].xbee, "CH", false, 1, &ch) == XBEE_ERR_CACHE_MISS);
+    assert(xbee_persist_close(&test_persist) == 0);
+
+    /* Saved, then changed at run time */
+    test_save(true);
+    assert(test_start(NULL) == 2);
+    test_identify();
+    assert(test_persist.at_restored == 1);
+
+    xbee_interface_t * xbee = &test_sim.nodes[0].xbee;
+    assert(xbee_at_command(xbee, xbee_alloc_frame_id(xbee), "CH", 1, "\x0D") == 0);
+    xbee_sim_step(&test_sim);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == 1 && ch == 0x0D);
+    xbee_persist_sync(&test_persist);
+    assert(xbee_persist_close(&test_persist) == 0);
+
+    assert(test_start(NULL) == 2);
+    test_identify();
+    assert(test_persist.at_restored == 0);
+    assert(xbee_persist_close(&test_persist) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Another XBee attached gets the nodes but not the old one's AT values */
+void test_persist_other_module(void)
+{
+    test_save(true);
+
+    assert(test_start((const uint8_t *)"\x00\x13\xA2\x01") == 2);
+    test_identify();
+    assert(test_persist.at_restored == 0);
+
+    uint8_t ch;
+    assert(xbee_at_cached(&test_sim.nodes[0].xbee, "CH", false, 1, &ch) == XBEE_ERR_CACHE_MISS);
+    assert(xbee_persist_close(&test_persist) == 0);
+
+    /* The file now belongs to the new XBee */
+    assert(test_start(NULL) == 2);
+    test_identify();
+    assert(test_persist.at_restored == 0);
+    assert(xbee_persist_close(&test_persist) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A torn node record is skipped, the rest still load */
+void test_persist_torn(void)
+{
+    test_save(true);
+
+    size_t offset = test_find(0x0013A200DEADBEEFULL);
+    test_poke(offset, 0xEE);
+
+    assert(test_start(NULL) == 1);
+    xbee_address_t peer;
+    xbee_sim_address64(&test_sim, 1, &peer);
+    assert(xbee_node_find(&test_table, &peer, false) != NULL);
+    assert(xbee_persist_close(&test_persist) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A file written with another version is reset rather than loaded */
+void test_persist_version(void)
+{
+    test_save(true);
+
+    /* The header's version follows its magic */
+    test_poke(4, XBEE_PERSIST_VERSION + 1);
+
+    assert(test_start(NULL) == 0);
+    test_identify();
+    assert(test_persist.at_restored == 0);
+    assert(xbee_persist_close(&test_persist) == 0);
+
+    assert(test_start(NULL) == 0);
+    assert(xbee_persist_close(&test_persist) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    int fd = mkstemp(test_path);
+    assert(fd >= 0);
+    close(fd);
+
+    test_persist_round_trip();
+    test_persist_unsaved();
+    test_persist_other_module();
+    test_persist_torn();
+    test_persist_version();
+
+    unlink(test_path);
+    return 0;
+}
@@ -0,0 +1,421 @@
+#include "xbee_port.h"
+#include <assert.h>
+#include <string.h>
+
+static inline bool xbee_port_owns(const xbee_port_mux_t * mux, uint8_t frame_id)
+{
+    return frame_id != 0 && (mux->owned[frame_id >> 3] & (1 << (frame_id & 7))) != 0;
+}
+
+static inline void xbee_port_set_owned(xbee_port_mux_t * mux, uint8_t frame_id, bool owned)
+{
+    if(owned)
+    {
+        mux->owned[frame_id >> 3] |= 1 << (frame_id & 7);
+    }
+    else
+    {
+        mux->owned[frame_id >> 3] &= ~(1 << (frame_id & 7));
+    }
+}
+
+static void xbee_port_complete(xbee_port_mux_t * mux, uint8_t frame_id, 
+        bool ok) SPECIAL_SECTION;
+static void xbee_port_complete(xbee_port_mux_t * mux, uint8_t frame_id, 
+        bool ok)
+{
+    xbee_port_set_owned(mux, frame_id, false);
+    mux->in_flight -= 1;
+
+    if((mux->closed[frame_id >> 3] & (1 << (frame_id & 7))) != 0)
+    {
+        /* Port was closed with the frame in flight, its number may have
+         * been opened again since */
+        mux->closed[frame_id >> 3] &= ~(1 << (frame_id & 7));
+        return;
+    }
+
+    xbee_port_t * port = mux->ports[mux->frame_port[frame_id]];
+    assert(port);
+    assert(port->in_flight > 0);
+
+    port->in_flight -= 1;
+    if(ok)
+    {
+        port->sent += 1;
+    }
+    else
+    {
+        port->failed += 1;
+    }
+
+    if(port->status)
+    {
+        port->status(port->ptr, port, ok);
+    }
+}
+
+static int xbee_port_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_port_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_port_mux_t * mux = ptr;
+
+    if(frame->api_id == XBEE_TRANSMIT_STATUS)
+    {
+        if(!xbee_port_owns(mux, frame->frame_id))
+        {
+            return 0;
+        }
+
+        xbee_port_complete(mux, frame->frame_id, frame->frame.status == 0);
+
+        /* Flow control window opened, refill it */
+        xbee_port_mux_run(mux);
+        return 1;
+    }
+
+    xbee_address_t source;
+    if(xbee_frame_source(frame, &source) != 0 || 
+       frame->frame.receive.packet_size < XBEE_PORT_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    const uint8_t * data = frame->frame.receive.packet_data;
+    xbee_port_t * port = mux->ports[data[0]];
+    if(port == NULL)
+    {
+        /* Left for a handler behind the mux, such as xbee_router_t */
+        mux->unknown_port += 1;
+        return 0;
+    }
+
+    if(frame->frame.receive.packet_size - XBEE_PORT_HEADER_SIZE > XBEE_PORT_MAX_PAYLOAD)
+    {
+        /* No sender through a mux makes these, ports size buffers by it */
+        mux->oversized += 1;
+        return 1;
+    }
+
+    port->received += 1;
+    if(port->receive)
+    {
+        port->receive(port->ptr, port, &source, frame->frame.receive.rssi,
+                frame->frame.receive.packet_size - XBEE_PORT_HEADER_SIZE, 
+                data + XBEE_PORT_HEADER_SIZE);
+    }
+
+    return 1;
+}
+
+static void xbee_port_failed(void * ptr, xbee_interface_t * xbee, 
+        uint8_t frame_id, int reason) SPECIAL_SECTION;
+static void xbee_port_failed(void * ptr, xbee_interface_t * xbee, 
+        uint8_t frame_id, int reason)
+{
+    xbee_port_mux_t * mux = ptr;
+
+    if(xbee_port_owns(mux, frame_id))
+    {
+        xbee_port_complete(mux, frame_id, false);
+    }
+}
+
+static int xbee_port_transmit(void * ptr, uint8_t frame_id, 
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers) SPECIAL_SECTION;
+static int xbee_port_transmit(void * ptr, uint8_t frame_id, 
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    return xbee_transmit_gather(ptr, frame_id, address, option, count, buffers);
+}
+
+void xbee_port_mux_init(xbee_port_mux_t * mux, xbee_interface_t * xbee, 
+        size_t max_in_flight)
+{
+    assert(mux);
+    assert(xbee);
+    assert(max_in_flight > 0);
+
+    memset(mux, 0, sizeof(*mux));
+    mux->xbee = xbee;
+    mux->transmit = xbee_port_transmit;
+    mux->transmit_ptr = xbee;
+    mux->max_in_flight = max_in_flight;
+
+    mux->handler.ptr = mux;
+    mux->handler.frame = xbee_port_frame;
+    mux->handler.failed = xbee_port_failed;
+    xbee_add_handler(xbee, &mux->handler);
+}
+
+void xbee_port_mux_stop(xbee_port_mux_t * mux)
+{
+    assert(mux);
+    xbee_remove_handler(mux->xbee, &mux->handler);
+}
+
+void xbee_port_mux_set_transmit(xbee_port_mux_t * mux, 
+        xbee_port_transmit_t transmit, void * ptr)
+{
+    assert(mux);
+    assert(transmit);
+
+    mux->transmit = transmit;
+    mux->transmit_ptr = ptr;
+}
+
+void xbee_port_mux_set_admit(xbee_port_mux_t * mux, 
+        xbee_port_admit_t admit, void * ptr)
+{
+    assert(mux);
+
+    mux->admit = admit;
+    mux->admit_ptr = ptr;
+}
+
+void xbee_port_open(xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number,
+        uint8_t priority, uint8_t max_in_flight, 
+        size_t queue_size, xbee_port_message_t * queue,
+        xbee_port_receive_t receive, void * ptr)
+{
+    assert(mux);
+    assert(port);
+    assert(mux->ports[number] == NULL);
+    assert(max_in_flight > 0);
+    assert(queue_size == 0 || queue);
+
+    memset(port, 0, sizeof(*port));
+    port->number = number;
+    port->priority = priority;
+    port->max_in_flight = max_in_flight;
+    port->queue_size = queue_size;
+    port->queue = queue;
+    port->receive = receive;
+    port->ptr = ptr;
+
+    port->next = mux->list;
+    mux->list = port;
+    mux->ports[number] = port;
+}
+
+void xbee_port_close(xbee_port_mux_t * mux, xbee_port_t * port)
+{
+    assert(mux);
+    assert(port);
+    assert(mux->ports[port->number] == port);
+
+    mux->ports[port->number] = NULL;
+    for(size_t i = 1; i < 256 && port->in_flight > 0; ++i)
+    {
+        if(xbee_port_owns(mux, i) && mux->frame_port[i] == port->number &&
+           (mux->closed[i >> 3] & (1 << (i & 7))) == 0)
+        {
+            mux->closed[i >> 3] |= 1 << (i & 7);
+            port->in_flight -= 1;
+        }
+    }
+
+    for(xbee_port_t ** p = &mux->list; *p != NULL; p = &(*p)->next)
+    {
+        if(*p == port)
+        {
+            *p = port->next;
+            break;
+        }
+    }
+}
+
+void xbee_port_set_status(xbee_port_t * port, xbee_port_status_t status)
+{
+    assert(port);
+
+    port->status = status;
+}
+
+static bool xbee_port_same_address(const xbee_address_t * a, const xbee_address_t * b)
+{
+    if(a->type != b->type)
+    {
+        return false;
+    }
+
+    if(a->type == XBEE_16_BIT)
+    {
+        return a->addr.network_address == b->addr.network_address;
+    }
+
+    return a->addr.address == b->addr.address;
+}
+
+/*! Moves the first message of port's queue the admission check takes to 
+ * the head, so a refused address doesn't hold back the others behind it
+ *
+ * Messages to an address already refused are passed over unasked, so the
+ * messages to any one address keep their order.
+ *
+ * \return false if every address was refused
+ */
+static bool xbee_port_admit_first(xbee_port_mux_t * mux, xbee_port_t * port) SPECIAL_SECTION;
+static bool xbee_port_admit_first(xbee_port_mux_t * mux, xbee_port_t * port)
+{
+    if(mux->admit == NULL)
+    {
+        return true;
+    }
+
+    for(size_t i = 0; i < port->count; ++i)
+    {
+        xbee_port_message_t * m = &port->queue[(port->head + i) % port->queue_size];
+
+        bool refused = false;
+        for(size_t j = 0; j < i && !refused; ++j)
+        {
+            refused = xbee_port_same_address(
+                    &port->queue[(port->head + j) % port->queue_size].address, &m->address);
+        }
+
+        if(refused || !mux->admit(mux->admit_ptr, &m->address, port->priority, 
+                    XBEE_PORT_HEADER_SIZE + m->size))
+        {
+            continue;
+        }
+
+        if(i > 0)
+        {
+            xbee_port_message_t admitted = *m;
+            for(size_t j = i; j > 0; --j)
+            {
+                port->queue[(port->head + j) % port->queue_size] = 
+                    port->queue[(port->head + j - 1) % port->queue_size];
+            }
+            port->queue[port->head] = admitted;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+/*! Picks the port to serve next, lowest priority value first and least 
+ * recently served among equals
+ *
+ * The admission check is only asked about the port that would be picked,
+ * and then the next one if it refuses, so it sees one decision per 
+ * address served or held back.
+ */
+static xbee_port_t * xbee_port_next(xbee_port_mux_t * mux) SPECIAL_SECTION;
+static xbee_port_t * xbee_port_next(xbee_port_mux_t * mux)
+{
+    uint8_t refused[256/8];
+    memset(refused, 0, sizeof(refused));
+
+    for(;;)
+    {
+        xbee_port_t * best = NULL;
+        for(xbee_port_t * p = mux->list; p != NULL; p = p->next)
+        {
+            if(p->count == 0 || p->in_flight >= p->max_in_flight ||
+               (refused[p->number >> 3] & (1 << (p->number & 7))) != 0)
+            {
+                continue;
+            }
+
+            if(best == NULL || p->priority < best->priority ||
+               (p->priority == best->priority && 
+                (int32_t)(p->turn - best->turn) < 0))
+            {
+                best = p;
+            }
+        }
+
+        if(best == NULL)
+        {
+            return NULL;
+        }
+
+        if(xbee_port_admit_first(mux, best))
+        {
+            return best;
+        }
+
+        refused[best->number >> 3] |= 1 << (best->number & 7);
+    }
+}
+
+int xbee_port_mux_run(xbee_port_mux_t * mux)
+{
+    assert(mux);
+
+    while(mux->in_flight < mux->max_in_flight)
+    {
+        xbee_port_t * port = xbee_port_next(mux);
+        if(port == NULL)
+        {
+            return 0;
+        }
+
+        uint8_t frame_id = xbee_alloc_frame_id(mux->xbee);
+        if(frame_id == 0)
+        {
+            return 0;
+        }
+
+        xbee_port_message_t * m = &port->queue[port->head];
+        xbee_buffer_t buffers[2] = {
+            { XBEE_PORT_HEADER_SIZE, &port->number },
+            { m->size, m->data },
+        };
+
+        int ret = mux->transmit(mux->transmit_ptr, frame_id, &m->address, 
+                m->option, 2, buffers);
+        if(ret != 0)
+        {
+            /* Message stays queued, try again on the next run with a new id */
+            xbee_free_frame_id(mux->xbee, frame_id);
+            return ret == XBEE_ERR_NOT_READY ? 0 : ret;
+        }
+
+        port->head = (port->head + 1) % port->queue_size;
+        port->count -= 1;
+        port->in_flight += 1;
+        port->turn = ++mux->turn;
+
+        mux->in_flight += 1;
+        mux->frame_port[frame_id] = port->number;
+        xbee_port_set_owned(mux, frame_id, true);
+    }
+
+    return 0;
+}
+
+int xbee_port_send(xbee_port_mux_t * mux, xbee_port_t * port, 
+        const xbee_address_t * address, uint8_t option, 
+        size_t size, const void * data)
+{
+    assert(mux);
+    assert(port);
+    assert(address);
+    assert(size <= XBEE_PORT_MAX_PAYLOAD);
+    assert(data || size == 0);
+
+    if(port->count == port->queue_size)
+    {
+        port->queue_full += 1;
+        return XBEE_ERR_QUEUE_FULL;
+    }
+
+    xbee_port_message_t * m = &port->queue[(port->head + port->count) % port->queue_size];
+    m->address = *address;
+    m->option = option;
+    m->size = size;
+    memcpy(m->data, data, size);
+    port->count += 1;
+
+    /* Anything the XBee didn't take now goes out on a later run */
+    xbee_port_mux_run(mux);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#ifndef _XBEE_PORT_H_
+#define _XBEE_PORT_H_
+
+#include "xbee.h"
+
+#define XBEE_PORT_HEADER_SIZE (1)
+#define XBEE_PORT_MAX_PAYLOAD (XBEE_MAX_RF_PAYLOAD - XBEE_PORT_HEADER_SIZE)
+
+/*! Message waiting in a port's transmit queue */
+typedef struct {
+    xbee_address_t address;
+    uint8_t option;
+    uint8_t size;
+    uint8_t data[XBEE_PORT_MAX_PAYLOAD];
+} xbee_port_message_t;
+
+typedef struct xbee_port xbee_port_t;
+
+/*! Writes a transmit frame for the mux, see xbee_transmit_gather */
+typedef int (*xbee_port_transmit_t)(void * ptr, uint8_t frame_id, 
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers);
+
+/*! Returns false to hold back a size byte payload to address, from a port 
+ * of priority, for now */
+typedef bool (*xbee_port_admit_t)(void * ptr, const xbee_address_t * address, 
+        uint8_t priority, size_t size);
+
+/*! Called from xbee_poll with payload (port byte removed) received on port */
+typedef void (*xbee_port_receive_t)(void * ptr, xbee_port_t * port, 
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data);
+
+/*! Called from xbee_poll with the outcome of each frame sent from port,
+ * ok is false on a failed XBEE_TRANSMIT_STATUS or a failed frame id */
+typedef void (*xbee_port_status_t)(void * ptr, xbee_port_t * port, bool ok);
+
+/*! Logical port sharing the radio link with other ports
+ *
+ * Lower priority values are sent first.  max_in_flight bounds how many of
+ * the port's frames may await XBEE_TRANSMIT_STATUS at once, so a bulk port
+ * cannot fill the XBee's buffers ahead of a control port.
+ */
+struct xbee_port {
+    uint8_t number;
+    uint8_t priority;
+    uint8_t max_in_flight;
+
+    xbee_port_receive_t receive;
+    xbee_port_status_t status;  /*! Optional, see xbee_port_set_status */
+    void * ptr;
+
+    size_t queue_size;
+    xbee_port_message_t * queue;
+    size_t head;
+    size_t count;
+
+    /* Maintained by mux */
+    xbee_port_t * next;
+    uint8_t in_flight;
+    uint32_t turn;              /*! When port was last served, for round robin */
+
+    uint32_t sent;              /*! Frames OK'd by XBEE_TRANSMIT_STATUS */
+    uint32_t failed;            /*! Frames with failed transmit status */
+    uint32_t received;
+    uint32_t queue_full;
+};
+
+/*! Multiplexes ports over one XBee, with a 1 byte port number prefixed 
+ * to every payload 
+ *
+ * Receive frames are dispatched through a table indexed by port number.
+ */
+typedef struct {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+
+    xbee_port_transmit_t transmit;
+    void * transmit_ptr;
+
+    xbee_port_admit_t admit;    /*! Optional, ports with no message admitted are skipped */
+    void * admit_ptr;
+
+    size_t max_in_flight;       /*! Frames awaiting transmit status over all ports */
+    size_t in_flight;
+    uint32_t turn;
+
+    xbee_port_t * list;
+    xbee_port_t * ports[256];
+
+    uint8_t owned[XBEE_FRAME_ID_BITMAP_SIZE];   /*! Frame ids sent by mux */
+    uint8_t frame_port[256];                    /*! Port of each owned frame id */
+    uint8_t closed[XBEE_FRAME_ID_BITMAP_SIZE];  /*! Owned frame ids whose port was closed */
+
+    uint32_t unknown_port;      /*! Received for no open port, passed on to later handlers */
+    uint32_t oversized;         /*! Received payloads over XBEE_PORT_MAX_PAYLOAD, dropped */
+} xbee_port_mux_t;
+
+#define XBEE_ERR_QUEUE_FULL (-23)
+
+void xbee_port_mux_init(xbee_port_mux_t * mux, xbee_interface_t * xbee, 
+        size_t max_in_flight) SPECIAL_SECTION;
+
+void xbee_port_mux_stop(xbee_port_mux_t * mux) SPECIAL_SECTION;
+
+/*! Replaces how the mux writes frames, e.g. to seal them with xbee_aead */
+void xbee_port_mux_set_transmit(xbee_port_mux_t * mux, 
+        xbee_port_transmit_t transmit, void * ptr) SPECIAL_SECTION;
+
+/*! Sets admission check applied to each port's next message, e.g. xbee_airtime_admit
+ *
+ * A port whose next message is refused sends the first one behind it to
+ * an address the check takes instead.  Messages to one address are never
+ * reordered.
+ */
+void xbee_port_mux_set_admit(xbee_port_mux_t * mux, 
+        xbee_port_admit_t admit, void * ptr) SPECIAL_SECTION;
+
+/*! Registers port, queue of queue_size messages must remain valid while open */
+void xbee_port_open(xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number,
+        uint8_t priority, uint8_t max_in_flight, 
+        size_t queue_size, xbee_port_message_t * queue,
+        xbee_port_receive_t receive, void * ptr) SPECIAL_SECTION;
+
+/*! Unregisters port, statuses of its frames still in flight are dropped */
+void xbee_port_close(xbee_port_mux_t * mux, xbee_port_t * port) SPECIAL_SECTION;
+
+/*! Sets callback for the outcome of frames sent from port, called with port's ptr */
+void xbee_port_set_status(xbee_port_t * port, xbee_port_status_t status) SPECIAL_SECTION;
+
+/*! Queues payload on port and sends what the scheduler allows
+ *
+ * A queued message the XBee can't take yet is sent by a later 
+ * xbee_port_mux_run.
+ *
+ * \return 0 if queued, XBEE_ERR_QUEUE_FULL if port queue is full
+ */
+int xbee_port_send(xbee_port_mux_t * mux, xbee_port_t * port, 
+        const xbee_address_t * address, uint8_t option, 
+        size_t size, const void * data) SPECIAL_SECTION;
+
+/*! Sends queued messages, highest priority first, call from the poll loop
+ *
+ * \return 0 on success, otherwise error writing to the XBee
+ */
+int xbee_port_mux_run(xbee_port_mux_t * mux) SPECIAL_SECTION;
+
+#endif /* _XBEE_PORT_H_ */
@@ -0,0 +1,188 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_port.h"
+#include "xbee_sim.h"
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_port_mux_t mux[2];
+    xbee_port_t ports[2];
+    xbee_port_message_t queues[2][4];
+    size_t received;
+    size_t received_size;
+} test_setup_t;
+
+static void test_receive(void * ptr, xbee_port_t * port,
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data)
+{
+    test_setup_t * t = ptr;
+    t->received += 1;
+    t->received_size = size;
+}
+
+static int test_fail_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    return -1;
+}
+
+/*! Frame ids that can be allocated, every one held is freed again */
+static size_t test_free_frame_ids(xbee_interface_t * xbee)
+{
+    uint8_t held[255];
+    size_t count = 0;
+    for(uint8_t id; (id = xbee_alloc_frame_id(xbee)) != 0; )
+    {
+        held[count++] = id;
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        xbee_free_frame_id(xbee, held[i]);
+    }
+
+    return count;
+}
+
+static void test_setup(test_setup_t * t)
+{
+    memset(t, 0, sizeof(*t));
+    assert(xbee_sim_init(&t->sim, 2, 3) == 0);
+
+    for(size_t i = 0; i < 2; ++i)
+    {
+        xbee_port_mux_init(&t->mux[i], &t->sim.nodes[i].xbee, 4);
+        xbee_port_open(&t->mux[i], &t->ports[i], 5, 0, 2, 4, t->queues[i], test_receive, t);
+    }
+}
+
+/*! Statuses of frames sent before a port was closed don't count against
+ * the port opened with its number afterwards */
+void test_port_close_in_flight(void)
+{
+    static test_setup_t t;
+    test_setup(&t);
+
+    xbee_address_t peer;
+    xbee_sim_address16(&t.sim, 1, &peer);
+
+    assert(xbee_port_send(&t.mux[0], &t.ports[0], &peer, 0, 3, "abc") == 0);
+    assert(xbee_port_send(&t.mux[0], &t.ports[0], &peer, 0, 3, "def") == 0);
+    assert(t.ports[0].in_flight == 2);
+    assert(t.mux[0].in_flight == 2);
+
+    xbee_port_close(&t.mux[0], &t.ports[0]);
+    xbee_port_open(&t.mux[0], &t.ports[0], 5, 0, 2, 4, t.queues[0], test_receive, &t);
+    assert(xbee_port_send(&t.mux[0], &t.ports[0], &peer, 0, 3, "ghi") == 0);
+    assert(t.ports[0].in_flight == 1);
+    assert(t.mux[0].in_flight == 3);
+
+    xbee_sim_step(&t.sim);
+    assert(t.ports[0].in_flight == 0);
+    assert(t.ports[0].sent == 1);
+    assert(t.mux[0].in_flight == 0);
+    assert(t.received == 3);
+
+    /* Full window again */
+    assert(xbee_port_send(&t.mux[0], &t.ports[0], &peer, 0, 3, "jkl") == 0);
+    assert(xbee_port_send(&t.mux[0], &t.ports[0], &peer, 0, 3, "mno") == 0);
+    assert(xbee_port_send(&t.mux[0], &t.ports[0], &peer, 0, 3, "pqr") == 0);
+    assert(t.ports[0].in_flight == 2);
+    assert(t.ports[0].count == 1);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A queued message is reported as queued even if the XBee can't take it */
+void test_port_send_queued(void)
+{
+    static test_setup_t t;
+    test_setup(&t);
+
+    xbee_address_t peer;
+    xbee_sim_address16(&t.sim, 1, &peer);
+
+    xbee_port_mux_set_transmit(&t.mux[0], test_fail_transmit, NULL);
+    for(size_t i = 0; i < 4; ++i)
+    {
+        assert(xbee_port_send(&t.mux[0], &t.ports[0], &peer, 0, 3, "abc") == 0);
+    }
+    assert(xbee_port_send(&t.mux[0], &t.ports[0], &peer, 0, 3, "abc") == XBEE_ERR_QUEUE_FULL);
+    assert(t.ports[0].count == 4);
+    assert(test_free_frame_ids(&t.sim.nodes[0].xbee) == 255);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Messages queued while the XBee recovers from a reset go out once it
+ * is ready, however often the mux ran meanwhile */
+void test_port_not_ready(void)
+{
+    static test_setup_t t;
+    test_setup(&t);
+    xbee_interface_t * xbee = &t.sim.nodes[0].xbee;
+
+    xbee_address_t peer;
+    xbee_sim_address16(&t.sim, 1, &peer);
+
+    const uint8_t reset[] = {XBEE_MODEM_STATUS, XBEE_MODEM_HARDWARE_RESET};
+    xbee_sim_push_frame(&t.sim, 0, sizeof(reset), reset);
+    xbee_sim_step(&t.sim);
+    assert(xbee->state == XBEE_STATE_RECOVERING);
+
+    assert(xbee_port_send(&t.mux[0], &t.ports[0], &peer, 0, 3, "abc") == 0);
+    for(size_t i = 0; i < 300; ++i)
+    {
+        assert(xbee_port_mux_run(&t.mux[0]) == 0);
+    }
+    assert(t.ports[0].count == 1 && t.mux[0].in_flight == 0);
+
+    xbee_sim_step(&t.sim);
+    assert(xbee->state == XBEE_STATE_READY);
+    assert(xbee_port_mux_run(&t.mux[0]) == 0);
+    assert(t.ports[0].count == 0 && t.mux[0].in_flight == 1);
+
+    xbee_sim_step(&t.sim);
+    assert(t.received == 1 && t.ports[0].sent == 1);
+    assert(test_free_frame_ids(xbee) == 255);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Payloads longer than any port sends are dropped before the port sees them */
+void test_port_receive_oversized(void)
+{
+    static test_setup_t t;
+    test_setup(&t);
+
+    uint8_t frame[XBEE_SIM_MAX_FRAME] = {XBEE_RECEIVE_16_BIT, 0x00, 0x01, 40, 0x00, 5};
+    memset(&frame[6], 'x', XBEE_PORT_MAX_PAYLOAD + 1);
+
+    xbee_sim_push_frame(&t.sim, 1, 6 + XBEE_PORT_MAX_PAYLOAD + 1, frame);
+    xbee_sim_step(&t.sim);
+    assert(t.received == 0);
+    assert(t.mux[1].oversized == 1);
+
+    xbee_sim_push_frame(&t.sim, 1, 6 + XBEE_PORT_MAX_PAYLOAD, frame);
+    xbee_sim_step(&t.sim);
+    assert(t.received == 1);
+    assert(t.received_size == XBEE_PORT_MAX_PAYLOAD);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_port_close_in_flight();
+    test_port_send_queued();
+    test_port_not_ready();
+    test_port_receive_oversized();
+
+    return 0;
+}
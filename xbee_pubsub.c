@@ -0,0 +1,424 @@
+#include "xbee_pubsub.h"
+#include <assert.h>
+#include <string.h>
+
+/*! Message types, first byte after the port number
+ *
+ * REGISTER:    type, name
+ * TOPIC:       type, topic id, name
+ * SUBSCRIBE:   type, topic id
+ * UNSUBSCRIBE: type, topic id
+ * PUBLISH:     type, topic id, payload
+ */
+#define XBEE_PUBSUB_REGISTER    (0x01)
+#define XBEE_PUBSUB_TOPIC       (0x02)
+#define XBEE_PUBSUB_SUBSCRIBE   (0x03)
+#define XBEE_PUBSUB_UNSUBSCRIBE (0x04)
+#define XBEE_PUBSUB_PUBLISH     (0x05)
+
+static bool xbee_pubsub_same_address(const xbee_address_t * a, const xbee_address_t * b)
+{
+    if(a->type != b->type)
+    {
+        return false;
+    }
+
+    if(a->type == XBEE_16_BIT)
+    {
+        return a->addr.network_address == b->addr.network_address;
+    }
+
+    return a->addr.address == b->addr.address;
+}
+
+static bool xbee_pubsub_name_equal(const char * name, size_t size, const char * other)
+{
+    return size < XBEE_PUBSUB_NAME_SIZE && 
+           strncmp(name, other, size) == 0 && other[size] == '\0';
+}
+
+static int xbee_pubsub_send(xbee_port_mux_t * mux, xbee_port_t * port, 
+        const xbee_address_t * address, uint8_t type, int topic, 
+        size_t size, const void * data) SPECIAL_SECTION;
+static int xbee_pubsub_send(xbee_port_mux_t * mux, xbee_port_t * port, 
+        const xbee_address_t * address, uint8_t type, int topic, 
+        size_t size, const void * data)
+{
+    uint8_t message[XBEE_PORT_MAX_PAYLOAD];
+    size_t idx = 0;
+
+    message[idx++] = type;
+    if(topic >= 0)
+    {
+        message[idx++] = topic;
+    }
+
+    if(idx + size > sizeof(message))
+    {
+        return XBEE_ERR_TOO_LARGE;
+    }
+
+    memcpy(&message[idx], data, size);
+    return xbee_port_send(mux, port, address, 0, idx + size, message);
+}
+
+int xbee_pubsub_broker_topic(xbee_pubsub_broker_t * broker, const char * name)
+{
+    assert(broker);
+    assert(name);
+
+    size_t size = strlen(name);
+    xbee_pubsub_topic_t * free_topic = NULL;
+    for(size_t i = 0; i < XBEE_PUBSUB_TOPICS; ++i)
+    {
+        xbee_pubsub_topic_t * t = &broker->topics[i];
+        if(!t->valid)
+        {
+            if(free_topic == NULL)
+            {
+                free_topic = t;
+            }
+        }
+        else if(xbee_pubsub_name_equal(name, size, t->name))
+        {
+            return i;
+        }
+    }
+
+    if(free_topic == NULL || size >= XBEE_PUBSUB_NAME_SIZE)
+    {
+        return XBEE_ERR_NO_TOPIC;
+    }
+
+    memset(free_topic, 0, sizeof(*free_topic));
+    memcpy(free_topic->name, name, size);
+    free_topic->valid = true;
+    return free_topic - broker->topics;
+}
+
+static int xbee_pubsub_broker_node(xbee_pubsub_broker_t * broker, 
+        const xbee_address_t * address)
+{
+    int free_node = -1;
+    for(size_t i = 0; i < XBEE_PUBSUB_NODES; ++i)
+    {
+        xbee_pubsub_node_t * n = &broker->nodes[i];
+        if(!n->valid)
+        {
+            if(free_node < 0)
+            {
+                free_node = i;
+            }
+        }
+        else if(xbee_pubsub_same_address(&n->address, address))
+        {
+            return i;
+        }
+    }
+
+    if(free_node < 0)
+    {
+        return XBEE_ERR_NO_TOPIC;
+    }
+
+    broker->nodes[free_node].address = *address;
+    broker->nodes[free_node].valid = true;
+    return free_node;
+}
+
+/*! Relays publication to subscribers of topic, except the publisher (node index, or -1) */
+static int xbee_pubsub_broker_relay(xbee_pubsub_broker_t * broker, uint8_t topic,
+        int publisher, size_t size, const void * data) SPECIAL_SECTION;
+static int xbee_pubsub_broker_relay(xbee_pubsub_broker_t * broker, uint8_t topic,
+        int publisher, size_t size, const void * data)
+{
+    const xbee_pubsub_topic_t * t = &broker->topics[topic];
+
+    size_t subscribers = 0;
+    for(size_t i = 0; i < XBEE_PUBSUB_NODES; ++i)
+    {
+        if((int)i != publisher && (t->subscribers[i/8] & (1 << (i%8))))
+        {
+            subscribers += 1;
+        }
+    }
+
+    if(subscribers == 0)
+    {
+        return 0;
+    }
+
+    if(subscribers >= broker->broadcast_threshold)
+    {
+        xbee_address_t broadcast;
+        memset(&broadcast, 0, sizeof(broadcast));
+        broadcast.type = XBEE_16_BIT_BROADCAST;
+
+        broker->broadcasts += 1;
+        return xbee_pubsub_send(broker->mux, broker->port, &broadcast, 
+                XBEE_PUBSUB_PUBLISH, topic, size, data);
+    }
+
+    for(size_t i = 0; i < XBEE_PUBSUB_NODES; ++i)
+    {
+        if((int)i == publisher || (t->subscribers[i/8] & (1 << (i%8))) == 0)
+        {
+            continue;
+        }
+
+        broker->unicasts += 1;
+        int ret = xbee_pubsub_send(broker->mux, broker->port, &broker->nodes[i].address, 
+                XBEE_PUBSUB_PUBLISH, topic, size, data);
+        if(ret != 0)
+        {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static void xbee_pubsub_broker_receive(void * ptr, xbee_port_t * port, 
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data) SPECIAL_SECTION;
+static void xbee_pubsub_broker_receive(void * ptr, xbee_port_t * port, 
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data)
+{
+    xbee_pubsub_broker_t * broker = ptr;
+    const uint8_t * m = data;
+
+    if(size < 2)
+    {
+        return;
+    }
+
+    if(m[0] == XBEE_PUBSUB_REGISTER)
+    {
+        char name[XBEE_PUBSUB_NAME_SIZE];
+        if(size - 1 >= sizeof(name))
+        {
+            return;
+        }
+
+        memcpy(name, &m[1], size - 1);
+        name[size - 1] = '\0';
+
+        int topic = xbee_pubsub_broker_topic(broker, name);
+        if(topic >= 0)
+        {
+            xbee_pubsub_send(broker->mux, broker->port, source, 
+                    XBEE_PUBSUB_TOPIC, topic, size - 1, &m[1]);
+        }
+        return;
+    }
+
+    uint8_t topic = m[1];
+    if(topic >= XBEE_PUBSUB_TOPICS || !broker->topics[topic].valid)
+    {
+        return;
+    }
+
+    xbee_pubsub_topic_t * t = &broker->topics[topic];
+    int node = xbee_pubsub_broker_node(broker, source);
+
+    switch(m[0])
+    {
+    case XBEE_PUBSUB_SUBSCRIBE:
+        if(node >= 0)
+        {
+            t->subscribers[node/8] |= 1 << (node%8);
+        }
+        break;
+    case XBEE_PUBSUB_UNSUBSCRIBE:
+        if(node >= 0)
+        {
+            t->subscribers[node/8] &= ~(1 << (node%8));
+        }
+        break;
+    case XBEE_PUBSUB_PUBLISH:
+        if(broker->deliver)
+        {
+            broker->deliver(broker->ptr, topic, source, size - 2, &m[2]);
+        }
+
+        xbee_pubsub_broker_relay(broker, topic, node, size - 2, &m[2]);
+        break;
+    default:
+        break;
+    }
+}
+
+void xbee_pubsub_broker_init(xbee_pubsub_broker_t * broker, 
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number, uint8_t priority,
+        size_t queue_size, xbee_port_message_t * queue,
+        size_t broadcast_threshold, xbee_pubsub_fun_t deliver, void * ptr)
+{
+    assert(broker);
+    assert(mux);
+    assert(port);
+    assert(broadcast_threshold > 0);
+
+    memset(broker, 0, sizeof(*broker));
+    broker->mux = mux;
+    broker->port = port;
+    broker->broadcast_threshold = broadcast_threshold;
+    broker->deliver = deliver;
+    broker->ptr = ptr;
+
+    xbee_port_open(mux, port, number, priority, 1, queue_size, queue, 
+            xbee_pubsub_broker_receive, broker);
+}
+
+int xbee_pubsub_broker_publish(xbee_pubsub_broker_t * broker, uint8_t topic,
+        size_t size, const void * data)
+{
+    assert(broker);
+    assert(topic < XBEE_PUBSUB_TOPICS && broker->topics[topic].valid);
+
+    return xbee_pubsub_broker_relay(broker, topic, -1, size, data);
+}
+
+static void xbee_pubsub_client_receive(void * ptr, xbee_port_t * port, 
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data) SPECIAL_SECTION;
+static void xbee_pubsub_client_receive(void * ptr, xbee_port_t * port, 
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data)
+{
+    xbee_pubsub_client_t * client = ptr;
+    const uint8_t * m = data;
+
+    if(size < 2 || m[1] >= XBEE_PUBSUB_TOPICS)
+    {
+        return;
+    }
+
+    if(m[0] == XBEE_PUBSUB_PUBLISH)
+    {
+        const xbee_pubsub_subscription_t * s = &client->subscriptions[m[1]];
+        if(s->fun == NULL)
+        {
+            client->filtered += 1;
+            return;
+        }
+
+        s->fun(s->ptr, m[1], source, size - 2, &m[2]);
+    }
+    else if(m[0] == XBEE_PUBSUB_TOPIC)
+    {
+        for(size_t i = 0; i < XBEE_PUBSUB_NAMES; ++i)
+        {
+            xbee_pubsub_name_t * n = &client->names[i];
+            if(n->valid && xbee_pubsub_name_equal((const char *)&m[2], size - 2, n->name))
+            {
+                n->topic = m[1];
+            }
+        }
+    }
+}
+
+void xbee_pubsub_client_init(xbee_pubsub_client_t * client,
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number, uint8_t priority,
+        size_t queue_size, xbee_port_message_t * queue,
+        const xbee_address_t * broker)
+{
+    assert(client);
+    assert(mux);
+    assert(port);
+    assert(broker);
+    assert(mux->xbee->uart->clock);
+
+    memset(client, 0, sizeof(*client));
+    client->mux = mux;
+    client->port = port;
+    client->broker = *broker;
+
+    xbee_port_open(mux, port, number, priority, 1, queue_size, queue, 
+            xbee_pubsub_client_receive, client);
+}
+
+int xbee_pubsub_topic(xbee_pubsub_client_t * client, const char * name)
+{
+    assert(client);
+    assert(name);
+
+    size_t size = strlen(name);
+    assert(size < XBEE_PUBSUB_NAME_SIZE);
+
+    xbee_pubsub_name_t * n = NULL;
+    for(size_t i = 0; i < XBEE_PUBSUB_NAMES && n == NULL; ++i)
+    {
+        if(client->names[i].valid && xbee_pubsub_name_equal(name, size, client->names[i].name))
+        {
+            n = &client->names[i];
+        }
+    }
+
+    if(n != NULL && n->topic >= 0)
+    {
+        return n->topic;
+    }
+
+    uint32_t now = xbee_now(client->mux->xbee);
+    if(n != NULL && n->registered && now - n->register_time < XBEE_PUBSUB_REGISTER_TIMEOUT)
+    {
+        return XBEE_ERR_CACHE_MISS;
+    }
+
+    /* Unknown, or registration lost: ask the broker */
+    if(n == NULL)
+    {
+        n = &client->names[client->name_next];
+        client->name_next = (client->name_next + 1) % XBEE_PUBSUB_NAMES;
+
+        memset(n, 0, sizeof(*n));
+        memcpy(n->name, name, size);
+        n->topic = -1;
+        n->valid = true;
+    }
+
+    int ret = xbee_pubsub_send(client->mux, client->port, &client->broker, 
+            XBEE_PUBSUB_REGISTER, -1, size, name);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    n->registered = true;
+    n->register_time = now;
+    return XBEE_ERR_CACHE_MISS;
+}
+
+int xbee_pubsub_subscribe(xbee_pubsub_client_t * client, uint8_t topic,
+        xbee_pubsub_fun_t fun, void * ptr)
+{
+    assert(client);
+    assert(topic < XBEE_PUBSUB_TOPICS);
+    assert(fun);
+
+    client->subscriptions[topic].fun = fun;
+    client->subscriptions[topic].ptr = ptr;
+
+    return xbee_pubsub_send(client->mux, client->port, &client->broker, 
+            XBEE_PUBSUB_SUBSCRIBE, topic, 0, NULL);
+}
+
+int xbee_pubsub_unsubscribe(xbee_pubsub_client_t * client, uint8_t topic)
+{
+    assert(client);
+    assert(topic < XBEE_PUBSUB_TOPICS);
+
+    client->subscriptions[topic].fun = NULL;
+    client->subscriptions[topic].ptr = NULL;
+
+    return xbee_pubsub_send(client->mux, client->port, &client->broker, 
+            XBEE_PUBSUB_UNSUBSCRIBE, topic, 0, NULL);
+}
+
+int xbee_pubsub_publish(xbee_pubsub_client_t * client, uint8_t topic,
+        size_t size, const void * data)
+{
+    assert(client);
+    assert(topic < XBEE_PUBSUB_TOPICS);
+    assert(size <= XBEE_PUBSUB_MAX_PAYLOAD);
+
+    return xbee_pubsub_send(client->mux, client->port, &client->broker, 
+            XBEE_PUBSUB_PUBLISH, topic, size, data);
+}
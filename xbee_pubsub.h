@@ -0,0 +1,137 @@
+#ifndef _XBEE_PUBSUB_H_
+#define _XBEE_PUBSUB_H_
+
+#include "xbee_port.h"
+
+/*! Topics known to a broker, topic ids are 0 to XBEE_PUBSUB_TOPICS-1 */
+#ifndef XBEE_PUBSUB_TOPICS
+#define XBEE_PUBSUB_TOPICS 32
+#endif /* XBEE_PUBSUB_TOPICS */
+
+/*! Nodes a broker can track subscriptions for */
+#ifndef XBEE_PUBSUB_NODES
+#define XBEE_PUBSUB_NODES 64
+#endif /* XBEE_PUBSUB_NODES */
+
+/*! Topic names a client can cache */
+#ifndef XBEE_PUBSUB_NAMES
+#define XBEE_PUBSUB_NAMES 8
+#endif /* XBEE_PUBSUB_NAMES */
+
+#define XBEE_PUBSUB_NAME_SIZE (20)
+
+/*! Time a client waits for the broker's TOPIC before registering again, ms */
+#ifndef XBEE_PUBSUB_REGISTER_TIMEOUT
+#define XBEE_PUBSUB_REGISTER_TIMEOUT 1000
+#endif /* XBEE_PUBSUB_REGISTER_TIMEOUT */
+
+/*! Publish header is message type and topic id */
+#define XBEE_PUBSUB_MAX_PAYLOAD (XBEE_PORT_MAX_PAYLOAD - 2)
+
+#define XBEE_ERR_NO_TOPIC (-24)     /*! Broker has no room for topic or node */
+
+typedef void (*xbee_pubsub_fun_t)(void * ptr, uint8_t topic, 
+        const xbee_address_t * source, size_t size, const void * data);
+
+typedef struct {
+    char name[XBEE_PUBSUB_NAME_SIZE];
+    bool valid;
+    uint8_t subscribers[XBEE_PUBSUB_NODES/8];   /*! Bit n set if nodes[n] subscribed */
+} xbee_pubsub_topic_t;
+
+typedef struct {
+    xbee_address_t address;
+    bool valid;
+} xbee_pubsub_node_t;
+
+/*! Gateway side of publish/subscribe
+ *
+ * Interns topic names into 1 byte topic ids for clients, keeps the 
+ * subscribers of every topic, and relays publications.  A publication
+ * is unicast to each subscriber (other than the publisher) when there 
+ * are fewer than broadcast_threshold of them, otherwise one broadcast is 
+ * sent and clients drop topics they are not subscribed to.
+ *
+ * Every publication is also passed to deliver, for the gateway's own use.
+ */
+typedef struct {
+    xbee_port_mux_t * mux;
+    xbee_port_t * port;
+    size_t broadcast_threshold;
+
+    xbee_pubsub_fun_t deliver;
+    void * ptr;
+
+    xbee_pubsub_topic_t topics[XBEE_PUBSUB_TOPICS];
+    xbee_pubsub_node_t nodes[XBEE_PUBSUB_NODES];
+
+    uint32_t unicasts;
+    uint32_t broadcasts;
+} xbee_pubsub_broker_t;
+
+void xbee_pubsub_broker_init(xbee_pubsub_broker_t * broker, 
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number, uint8_t priority,
+        size_t queue_size, xbee_port_message_t * queue,
+        size_t broadcast_threshold, xbee_pubsub_fun_t deliver, void * ptr) SPECIAL_SECTION;
+
+/*! Returns topic id of name, interning it if needed, or XBEE_ERR_NO_TOPIC */
+int xbee_pubsub_broker_topic(xbee_pubsub_broker_t * broker, const char * name) SPECIAL_SECTION;
+
+/*! Publishes from the gateway to every subscriber of topic */
+int xbee_pubsub_broker_publish(xbee_pubsub_broker_t * broker, uint8_t topic,
+        size_t size, const void * data) SPECIAL_SECTION;
+
+typedef struct {
+    xbee_pubsub_fun_t fun;
+    void * ptr;
+} xbee_pubsub_subscription_t;
+
+typedef struct {
+    char name[XBEE_PUBSUB_NAME_SIZE];
+    int16_t topic;              /*! Topic id, -1 while registration is in flight */
+    bool valid;
+    bool registered;            /*! REGISTER was sent at register_time */
+    uint32_t register_time;
+} xbee_pubsub_name_t;
+
+/*! Node side of publish/subscribe
+ *
+ * Received publications are dispatched through a table indexed by topic id.
+ * The XBee's UART interface must have a clock, which paces registrations.
+ */
+typedef struct {
+    xbee_port_mux_t * mux;
+    xbee_port_t * port;
+    xbee_address_t broker;
+
+    size_t name_next;
+    xbee_pubsub_name_t names[XBEE_PUBSUB_NAMES];
+    xbee_pubsub_subscription_t subscriptions[XBEE_PUBSUB_TOPICS];
+
+    uint32_t filtered;          /*! Broadcast publications for topics not subscribed */
+} xbee_pubsub_client_t;
+
+void xbee_pubsub_client_init(xbee_pubsub_client_t * client,
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number, uint8_t priority,
+        size_t queue_size, xbee_port_message_t * queue,
+        const xbee_address_t * broker) SPECIAL_SECTION;
+
+/*! Returns topic id of name
+ *
+ * Asks the broker for an unknown name, and again only if it has not
+ * answered within XBEE_PUBSUB_REGISTER_TIMEOUT.
+ *
+ * \return Topic id, or XBEE_ERR_CACHE_MISS while the broker is being asked,
+ *         or error sending the registration
+ */
+int xbee_pubsub_topic(xbee_pubsub_client_t * client, const char * name) SPECIAL_SECTION;
+
+int xbee_pubsub_subscribe(xbee_pubsub_client_t * client, uint8_t topic,
+        xbee_pubsub_fun_t fun, void * ptr) SPECIAL_SECTION;
+
+int xbee_pubsub_unsubscribe(xbee_pubsub_client_t * client, uint8_t topic) SPECIAL_SECTION;
+
+int xbee_pubsub_publish(xbee_pubsub_client_t * client, uint8_t topic,
+        size_t size, const void * data) SPECIAL_SECTION;
+
+#endif /* _XBEE_PUBSUB_H_ */
@@ -0,0 +1,97 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_pubsub.h"
+#include "xbee_sim.h"
+
+#define TEST_PORT (9)
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_port_mux_t mux[2];
+    xbee_port_t ports[2];
+    xbee_port_message_t queues[2][4];
+    xbee_pubsub_broker_t broker;
+    xbee_pubsub_client_t client;
+    size_t registers;           /*! Frames the client's XBee took */
+} test_setup_t;
+
+static test_setup_t test;
+
+static bool test_request(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    if(node != 1 || frame[0] != XBEE_TRANSMIT_16_BIT)
+    {
+        return false;
+    }
+
+    test.registers += 1;
+    return false;
+}
+
+static void test_setup(void)
+{
+    memset(&test, 0, sizeof(test));
+    assert(xbee_sim_init(&test.sim, 2, 29) == 0);
+    test.sim.request = test_request;
+
+    for(size_t i = 0; i < 2; ++i)
+    {
+        xbee_port_mux_init(&test.mux[i], &test.sim.nodes[i].xbee, 4);
+    }
+
+    xbee_address_t gateway;
+    xbee_sim_address16(&test.sim, 0, &gateway);
+    xbee_pubsub_broker_init(&test.broker, &test.mux[0], &test.ports[0], TEST_PORT, 0,
+            4, test.queues[0], 4, NULL, NULL);
+    xbee_pubsub_client_init(&test.client, &test.mux[1], &test.ports[1], TEST_PORT, 0,
+            4, test.queues[1], &gateway);
+}
+
+/*! Asking for a topic while the broker is being asked sends nothing, and
+ * a lost registration is sent again after the timeout */
+void test_pubsub_register_paced(void)
+{
+    test_setup();
+
+    /* The broker doesn't hear the first registration */
+    test.sim.link[1][0] = false;
+    assert(xbee_pubsub_topic(&test.client, "temp") == XBEE_ERR_CACHE_MISS);
+    xbee_sim_step(&test.sim);
+    assert(test.registers == 1);
+
+    for(size_t i = 0; i < 10; ++i)
+    {
+        assert(xbee_pubsub_topic(&test.client, "temp") == XBEE_ERR_CACHE_MISS);
+        xbee_sim_advance(&test.sim, XBEE_PUBSUB_REGISTER_TIMEOUT/20);
+    }
+    assert(test.registers == 1);
+    test.sim.link[1][0] = true;
+
+    xbee_sim_advance(&test.sim, XBEE_PUBSUB_REGISTER_TIMEOUT/2);
+    assert(xbee_pubsub_topic(&test.client, "temp") == XBEE_ERR_CACHE_MISS);
+    for(size_t i = 0; i < 3; ++i)
+    {
+        xbee_sim_step(&test.sim);
+    }
+    assert(test.registers == 2);
+
+    int topic = xbee_pubsub_topic(&test.client, "temp");
+    assert(topic >= 0);
+    assert(topic == xbee_pubsub_broker_topic(&test.broker, "temp"));
+    assert(test.registers == 2);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_pubsub_register_paced();
+
+    return 0;
+}
@@ -0,0 +1,331 @@
+#include "xbee_remote_batch.h"
+#include <assert.h>
+#include <string.h>
+
+static void xbee_remote_batch_finish(xbee_remote_batch_t * batch, 
+        xbee_batch_state_t state, int error) SPECIAL_SECTION;
+static void xbee_remote_batch_finish(xbee_remote_batch_t * batch, 
+        xbee_batch_state_t state, int error)
+{
+    if(batch->error == 0)
+    {
+        batch->error = error;
+    }
+
+    batch->state = state;
+    xbee_remove_handler(batch->xbee, &batch->handler);
+}
+
+static int xbee_remote_batch_send(xbee_remote_batch_t * batch, 
+        uint8_t options, char * at_command, size_t param_size, 
+        const void * param, uint8_t * frame_id) SPECIAL_SECTION;
+static int xbee_remote_batch_send(xbee_remote_batch_t * batch, 
+        uint8_t options, char * at_command, size_t param_size, 
+        const void * param, uint8_t * frame_id)
+{
+    *frame_id = xbee_alloc_frame_id(batch->xbee);
+    if(*frame_id == 0)
+    {
+        return XBEE_ERR_NOT_READY;
+    }
+
+    int ret = xbee_remote_at_command(batch->xbee, &batch->address, options,
+            *frame_id, at_command, param_size, param);
+    if(ret != 0)
+    {
+        xbee_free_frame_id(batch->xbee, *frame_id);
+        *frame_id = 0;
+        return ret;
+    }
+
+    batch->outstanding += 1;
+    return 0;
+}
+
+/*! Sends every setting of the current phase back to back */
+static int xbee_remote_batch_burst(xbee_remote_batch_t * batch) SPECIAL_SECTION;
+static int xbee_remote_batch_burst(xbee_remote_batch_t * batch)
+{
+    batch->outstanding = 0;
+
+    for(size_t i = 0; i < batch->count; ++i)
+    {
+        xbee_remote_setting_t * s = &batch->settings[i];
+        char at_command[2] = {s->at_command[0], s->at_command[1]};
+
+        int ret;
+        switch(batch->state)
+        {
+        case XBEE_BATCH_READING:
+            ret = xbee_remote_batch_send(batch, 0, at_command, 
+                    0, NULL, &s->frame_id);
+            break;
+        case XBEE_BATCH_WRITING:
+            ret = xbee_remote_batch_send(batch, 0, at_command, 
+                    s->param_size, s->param, &s->frame_id);
+            break;
+        case XBEE_BATCH_ROLLING_BACK:
+            if(!s->written)
+            {
+                continue;
+            }
+
+            ret = xbee_remote_batch_send(batch, 0, at_command, 
+                    s->old_size, s->old, &s->frame_id);
+            break;
+        default:
+            assert(false);
+            return 0;
+        }
+
+        if(ret != 0)
+        {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static void xbee_remote_batch_next_phase(xbee_remote_batch_t * batch) SPECIAL_SECTION;
+static void xbee_remote_batch_next_phase(xbee_remote_batch_t * batch)
+{
+    int ret;
+
+    switch(batch->state)
+    {
+    case XBEE_BATCH_READING:
+        if(batch->error != 0)
+        {
+            /* Nothing written yet, so nothing to undo */
+            xbee_remote_batch_finish(batch, XBEE_BATCH_FAILED, 0);
+            return;
+        }
+
+        batch->state = XBEE_BATCH_WRITING;
+        ret = xbee_remote_batch_burst(batch);
+        if(ret != 0)
+        {
+            batch->write_failed = true;
+            batch->error = ret;
+        }
+
+        if(batch->outstanding > 0)
+        {
+            return;
+        }
+        break;
+    case XBEE_BATCH_WRITING:
+        if(!batch->write_failed)
+        {
+            batch->state = XBEE_BATCH_APPLYING;
+            ret = xbee_remote_batch_send(batch, XBEE_REMOTE_APPLY_CHANGES, 
+                    "AC", 0, NULL, &batch->apply_frame_id);
+            if(ret == 0)
+            {
+                return;
+            }
+
+            batch->error = ret;
+        }
+        break;
+    case XBEE_BATCH_APPLYING:
+        xbee_remote_batch_finish(batch, XBEE_BATCH_DONE, 0);
+        return;
+    case XBEE_BATCH_ROLLING_BACK:
+        xbee_remote_batch_finish(batch, XBEE_BATCH_FAILED, 0);
+        return;
+    default:
+        assert(false);
+        return;
+    }
+
+    /* Write phase failed, undo values that were queued */
+    batch->state = XBEE_BATCH_ROLLING_BACK;
+    ret = xbee_remote_batch_burst(batch);
+    if(ret != 0 || batch->outstanding == 0)
+    {
+        xbee_remote_batch_finish(batch, XBEE_BATCH_FAILED, ret);
+    }
+}
+
+/*! Records outcome of frame_id, status < 0 is a local failure */
+static bool xbee_remote_batch_result(xbee_remote_batch_t * batch, uint8_t frame_id, 
+        int status, size_t data_size, const uint8_t * data) SPECIAL_SECTION;
+static bool xbee_remote_batch_result(xbee_remote_batch_t * batch, uint8_t frame_id, 
+        int status, size_t data_size, const uint8_t * data)
+{
+    if(frame_id == 0)
+    {
+        return false;
+    }
+
+    int error = status < 0 ? XBEE_ERR_REMOTE_FAILED : XBEE_ERR_REMOTE_STATUS;
+
+    if(batch->state == XBEE_BATCH_APPLYING)
+    {
+        if(frame_id != batch->apply_frame_id)
+        {
+            return false;
+        }
+
+        batch->apply_frame_id = 0;
+        if(status != 0)
+        {
+            xbee_remote_batch_finish(batch, XBEE_BATCH_FAILED, error);
+        }
+        else
+        {
+            xbee_remote_batch_next_phase(batch);
+        }
+        return true;
+    }
+
+    xbee_remote_setting_t * s = NULL;
+    for(size_t i = 0; i < batch->count && s == NULL; ++i)
+    {
+        if(batch->settings[i].frame_id == frame_id)
+        {
+            s = &batch->settings[i];
+        }
+    }
+
+    if(s == NULL)
+    {
+        return false;
+    }
+
+    s->frame_id = 0;
+    s->status = status < 0 ? 0xFF : status;
+    batch->outstanding -= 1;
+
+    switch(batch->state)
+    {
+    case XBEE_BATCH_READING:
+        if(status == 0 && data_size > XBEE_MAX_AT_PARAM)
+        {
+            status = 1;
+            error = XBEE_ERR_TOO_LARGE;
+        }
+
+        if(status != 0)
+        {
+            if(batch->error == 0)
+            {
+                batch->error = error;
+            }
+        }
+        else
+        {
+            s->old_size = data_size;
+            memcpy(s->old, data, data_size);
+        }
+        break;
+    case XBEE_BATCH_WRITING:
+        if(status == 0)
+        {
+            s->written = true;
+        }
+        else if(!batch->write_failed)
+        {
+            batch->write_failed = true;
+            batch->error = error;
+        }
+        break;
+    case XBEE_BATCH_ROLLING_BACK:
+        if(status != 0 && batch->error == 0)
+        {
+            batch->error = error;
+        }
+        break;
+    default:
+        assert(false);
+        break;
+    }
+
+    if(batch->outstanding == 0)
+    {
+        xbee_remote_batch_next_phase(batch);
+    }
+
+    return true;
+}
+
+static int xbee_remote_batch_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_remote_batch_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_remote_batch_t * batch = ptr;
+
+    if(frame->api_id != XBEE_REMOTE_AT_RESPONSE)
+    {
+        return 0;
+    }
+
+    return xbee_remote_batch_result(batch, frame->frame_id, 
+            frame->frame.at_command_response.status,
+            frame->frame.at_command_response.data_size,
+            frame->frame.at_command_response.data);
+}
+
+static void xbee_remote_batch_failed(void * ptr, xbee_interface_t * xbee, 
+        uint8_t frame_id, int reason) SPECIAL_SECTION;
+static void xbee_remote_batch_failed(void * ptr, xbee_interface_t * xbee, 
+        uint8_t frame_id, int reason)
+{
+    xbee_remote_batch_result(ptr, frame_id, -reason, 0, NULL);
+}
+
+int xbee_remote_batch_start(xbee_remote_batch_t * batch, xbee_interface_t * xbee,
+        const xbee_address_t * address, size_t count, xbee_remote_setting_t * settings)
+{
+    assert(batch);
+    assert(xbee);
+    assert(address);
+    assert(count > 0 && settings);
+
+    memset(batch, 0, sizeof(*batch));
+    batch->xbee = xbee;
+    batch->address = *address;
+    batch->count = count;
+    batch->settings = settings;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        assert(settings[i].param_size <= XBEE_MAX_AT_PARAM);
+        settings[i].frame_id = 0;
+        settings[i].status = 0;
+        settings[i].written = false;
+        settings[i].old_size = 0;
+    }
+
+    batch->handler.ptr = batch;
+    batch->handler.frame = xbee_remote_batch_frame;
+    batch->handler.failed = xbee_remote_batch_failed;
+    xbee_add_handler(xbee, &batch->handler);
+
+    batch->state = XBEE_BATCH_READING;
+    int ret = xbee_remote_batch_burst(batch);
+    if(ret == 0)
+    {
+        return 0;
+    }
+
+    if(batch->outstanding > 0)
+    {
+        /* Reads already in flight fail the batch when they respond, and
+         * until then the handler must stay to catch them */
+        batch->error = ret;
+        return 0;
+    }
+
+    xbee_remote_batch_finish(batch, XBEE_BATCH_FAILED, ret);
+    return ret;
+}
+
+bool xbee_remote_batch_finished(const xbee_remote_batch_t * batch)
+{
+    assert(batch);
+    return batch->state == XBEE_BATCH_DONE || batch->state == XBEE_BATCH_FAILED;
+}
@@ -0,0 +1,77 @@
+#ifndef _XBEE_REMOTE_BATCH_H_
+#define _XBEE_REMOTE_BATCH_H_
+
+#include "xbee.h"
+
+/*! Setting written by a remote batch */
+typedef struct {
+    char at_command[2];
+    uint8_t param_size;
+    uint8_t param[XBEE_MAX_AT_PARAM];
+
+    /* Filled in by batch */
+    uint8_t frame_id;
+    uint8_t status;         /*! Status of last response, 0 is OK */
+    bool written;           /*! Remote OK'd the queued write */
+    uint8_t old_size;
+    uint8_t old[XBEE_MAX_AT_PARAM];     /*! Value before batch, used for roll back */
+} xbee_remote_setting_t;
+
+typedef enum {
+    XBEE_BATCH_IDLE,
+    XBEE_BATCH_READING,         /*! Reading current values for roll back */
+    XBEE_BATCH_WRITING,         /*! Queuing new values without applying */
+    XBEE_BATCH_APPLYING,        /*! AC sent with apply */
+    XBEE_BATCH_ROLLING_BACK,    /*! Queuing old values after a write failed */
+    XBEE_BATCH_DONE,
+    XBEE_BATCH_FAILED,
+} xbee_batch_state_t;
+
+/*! Configures a remote node with a single apply
+ *
+ * Every phase is sent as a pipelined burst of remote AT commands, and 
+ * responses are correlated by frame id from xbee_poll.  New values are 
+ * queued on the remote without XBEE_REMOTE_APPLY_CHANGES, then one AC with
+ * apply makes them take effect at once, so the remote's network stack is 
+ * restarted at most once.
+ *
+ * If any write is rejected, values that were already queued are rewritten
+ * with the values read before the batch started, so a later AC does not 
+ * apply half a configuration.
+ */
+typedef struct {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+    xbee_address_t address;
+
+    size_t count;
+    xbee_remote_setting_t * settings;
+
+    xbee_batch_state_t state;
+    size_t outstanding;     /*! Responses still expected in this phase */
+    bool write_failed;
+    uint8_t apply_frame_id;
+    int error;              /*! First error seen, valid when state is XBEE_BATCH_FAILED */
+} xbee_remote_batch_t;
+
+#define XBEE_ERR_REMOTE_STATUS (-18) /*! Remote returned non-zero AT status */
+#define XBEE_ERR_REMOTE_FAILED (-19) /*! Frame failed locally, remote outcome unknown */
+
+/*! Starts configuring the remote node at address
+ *
+ * Progress is made by xbee_poll, batch is finished when state is 
+ * XBEE_BATCH_DONE or XBEE_BATCH_FAILED.  batch and settings must remain 
+ * valid until then.
+ *
+ * If only part of the first burst could be sent, the batch still starts 
+ * and fails with that error once the commands sent have responded.
+ *
+ * \return 0 if the batch started, otherwise error sending the first command
+ */
+int xbee_remote_batch_start(xbee_remote_batch_t * batch, xbee_interface_t * xbee,
+        const xbee_address_t * address, size_t count, xbee_remote_setting_t * settings) SPECIAL_SECTION;
+
+/*! Returns true once batch is done or failed */
+bool xbee_remote_batch_finished(const xbee_remote_batch_t * batch) SPECIAL_SECTION;
+
+#endif /* _XBEE_REMOTE_BATCH_H_ */
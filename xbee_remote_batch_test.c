@@ -0,0 +1,173 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_remote_batch.h"
+#include "xbee_sim.h"
+
+static xbee_remote_setting_t test_settings[3] = {
+    {{'N', 'I'}, 3, "abc"},
+    {{'C', 'H'}, 1, {0x0F}},
+    {{'I', 'D'}, 2, {0x12, 0x34}},
+};
+
+static void test_setup(xbee_sim_t * sim)
+{
+    assert(xbee_sim_init(sim, 2, 11) == 0);
+    xbee_sim_set_register(sim, 1, "NI", 3, "old");
+    xbee_sim_set_register(sim, 1, "CH", 1, "\x0C");
+    xbee_sim_set_register(sim, 1, "ID", 2, "\x33\x32");
+    xbee_sim_set_register(sim, 1, "AC", 0, NULL);
+}
+
+/*! Holds every frame id but free */
+static void test_hold_frame_ids(xbee_interface_t * xbee, size_t free)
+{
+    uint8_t held[255];
+    size_t count = 0;
+    for(uint8_t id; (id = xbee_alloc_frame_id(xbee)) != 0; )
+    {
+        held[count++] = id;
+    }
+
+    for(size_t i = 0; i < free; ++i)
+    {
+        xbee_free_frame_id(xbee, held[--count]);
+    }
+}
+
+/*! Frame ids that can be allocated, every one held is freed again */
+static size_t test_free_frame_ids(xbee_interface_t * xbee)
+{
+    uint8_t held[255];
+    size_t count = 0;
+    for(uint8_t id; (id = xbee_alloc_frame_id(xbee)) != 0; )
+    {
+        held[count++] = id;
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        xbee_free_frame_id(xbee, held[i]);
+    }
+
+    return count;
+}
+
+/*! Reads, writes and applies every setting */
+void test_remote_batch_done(void)
+{
+    static xbee_sim_t sim;
+    static xbee_remote_batch_t batch;
+    test_setup(&sim);
+
+    xbee_address_t remote;
+    xbee_sim_address64(&sim, 1, &remote);
+    assert(xbee_remote_batch_start(&batch, &sim.nodes[0].xbee, &remote, 3, test_settings) == 0);
+    for(size_t i = 0; i < 10 && !xbee_remote_batch_finished(&batch); ++i)
+    {
+        xbee_sim_step(&sim);
+    }
+
+    assert(batch.state == XBEE_BATCH_DONE);
+    assert(test_settings[0].old_size == 3 && memcmp(test_settings[0].old, "old", 3) == 0);
+    assert(test_settings[2].written);
+    assert(sim.nodes[0].xbee.handlers == NULL);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A first burst cut short still runs until the reads sent respond */
+void test_remote_batch_start_partial(void)
+{
+    static xbee_sim_t sim;
+    static xbee_remote_batch_t batch;
+    test_setup(&sim);
+
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    xbee_address_t remote;
+    xbee_sim_address64(&sim, 1, &remote);
+
+    test_hold_frame_ids(xbee, 1);
+    assert(xbee_remote_batch_start(&batch, xbee, &remote, 3, test_settings) == 0);
+    assert(batch.outstanding == 1);
+    assert(xbee->handlers == &batch.handler);
+
+    xbee_sim_step(&sim);
+    assert(batch.state == XBEE_BATCH_FAILED);
+    assert(batch.error == XBEE_ERR_NOT_READY);
+    assert(xbee->handlers == NULL);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Nothing sent, nothing left registered */
+void test_remote_batch_start_failed(void)
+{
+    static xbee_sim_t sim;
+    static xbee_remote_batch_t batch;
+    test_setup(&sim);
+
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    xbee_address_t remote;
+    xbee_sim_address64(&sim, 1, &remote);
+
+    test_hold_frame_ids(xbee, 0);
+    assert(xbee_remote_batch_start(&batch, xbee, &remote, 3, test_settings) == XBEE_ERR_NOT_READY);
+    assert(batch.state == XBEE_BATCH_FAILED);
+    assert(xbee->handlers == NULL);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A batch refused while the XBee recovers from a reset keeps no frame
+ * ids, and runs when started again once it is ready */
+void test_remote_batch_not_ready(void)
+{
+    static xbee_sim_t sim;
+    static xbee_remote_batch_t batch;
+    test_setup(&sim);
+
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    xbee_address_t remote;
+    xbee_sim_address64(&sim, 1, &remote);
+
+    const uint8_t reset[] = {XBEE_MODEM_STATUS, XBEE_MODEM_HARDWARE_RESET};
+    xbee_sim_push_frame(&sim, 0, sizeof(reset), reset);
+    xbee_sim_step(&sim);
+    assert(xbee->state == XBEE_STATE_RECOVERING);
+
+    for(size_t i = 0; i < 300; ++i)
+    {
+        assert(xbee_remote_batch_start(&batch, xbee, &remote, 3, test_settings) ==
+                XBEE_ERR_NOT_READY);
+        assert(xbee->handlers == NULL);
+    }
+
+    xbee_sim_step(&sim);
+    assert(xbee->state == XBEE_STATE_READY);
+    assert(test_free_frame_ids(xbee) == 255);
+
+    assert(xbee_remote_batch_start(&batch, xbee, &remote, 3, test_settings) == 0);
+    for(size_t i = 0; i < 10 && !xbee_remote_batch_finished(&batch); ++i)
+    {
+        xbee_sim_step(&sim);
+    }
+    assert(batch.state == XBEE_BATCH_DONE);
+    assert(test_free_frame_ids(xbee) == 255);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_remote_batch_done();
+    test_remote_batch_start_partial();
+    test_remote_batch_start_failed();
+    test_remote_batch_not_ready();
+
+    return 0;
+}
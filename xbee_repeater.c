@@ -0,0 +1,162 @@
+#include "xbee_repeater.h"
+#include <assert.h>
+#include <string.h>
+
+static bool xbee_repeat_match(const xbee_repeat_rule_t * rule, 
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static bool xbee_repeat_match(const xbee_repeat_rule_t * rule, 
+        const xbee_parsed_frame_t * frame)
+{
+    if(!rule->any_source)
+    {
+        if(frame->api_id == XBEE_RECEIVE_16_BIT)
+        {
+            if(rule->source.type != XBEE_16_BIT || 
+               rule->source.addr.network_address != frame->frame.receive.responder_network_address)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            if(rule->source.type != XBEE_64_BIT || 
+               rule->source.addr.address != frame->frame.receive.responder_address)
+            {
+                return false;
+            }
+        }
+    }
+
+    if(rule->match_mask != 0)
+    {
+        const uint8_t * data = frame->frame.receive.packet_data;
+        if(frame->frame.receive.packet_size == 0 || 
+           (data[0] & rule->match_mask) != rule->match_value)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool xbee_repeater_from_own(const xbee_repeater_t * repeater,
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static bool xbee_repeater_from_own(const xbee_repeater_t * repeater,
+        const xbee_parsed_frame_t * frame)
+{
+    for(size_t i = 0; i < repeater->own_count; ++i)
+    {
+        const xbee_address_t * own = &repeater->own[i];
+        if(frame->api_id == XBEE_RECEIVE_16_BIT ?
+           own->type == XBEE_16_BIT &&
+           own->addr.network_address == frame->frame.receive.responder_network_address :
+           own->type == XBEE_64_BIT &&
+           own->addr.address == frame->frame.receive.responder_address)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+xbee_repeat_rule_t * xbee_repeater_forward(xbee_repeater_t * repeater, 
+        const xbee_parsed_frame_t * frame)
+{
+    assert(repeater);
+    assert(frame);
+
+    if(frame->api_id != XBEE_RECEIVE && frame->api_id != XBEE_RECEIVE_16_BIT)
+    {
+        return NULL;
+    }
+
+    if(xbee_repeater_from_own(repeater, frame))
+    {
+        repeater->own_ignored += 1;
+        return NULL;
+    }
+
+    for(size_t i = 0; i < repeater->count; ++i)
+    {
+        xbee_repeat_rule_t * rule = &repeater->rules[i];
+        if(!xbee_repeat_match(rule, frame))
+        {
+            continue;
+        }
+
+        if(rule->to == NULL)
+        {
+            rule->dropped += 1;
+            return rule;
+        }
+
+        xbee_buffer_t payload = { 
+            frame->frame.receive.packet_size, 
+            frame->frame.receive.packet_data 
+        };
+
+        if(xbee_transmit_gather(rule->to, 0, &rule->destination, 
+                    rule->option, 1, &payload) == 0)
+        {
+            rule->relayed += 1;
+        }
+        else
+        {
+            rule->dropped += 1;
+        }
+
+        return rule;
+    }
+
+    return NULL;
+}
+
+static int xbee_repeater_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_repeater_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame)
+{
+    return xbee_repeater_forward(ptr, frame) != NULL;
+}
+
+void xbee_repeater_init(xbee_repeater_t * repeater, xbee_interface_t * from,
+        size_t count, xbee_repeat_rule_t * rules)
+{
+    assert(repeater);
+    assert(from);
+    assert(count == 0 || rules);
+
+    memset(repeater, 0, sizeof(*repeater));
+    repeater->from = from;
+    repeater->count = count;
+    repeater->rules = rules;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        assert(rules[i].to != from);
+        rules[i].relayed = 0;
+        rules[i].dropped = 0;
+    }
+
+    repeater->handler.ptr = repeater;
+    repeater->handler.frame = xbee_repeater_frame;
+    xbee_add_handler(from, &repeater->handler);
+}
+
+void xbee_repeater_stop(xbee_repeater_t * repeater)
+{
+    assert(repeater);
+    xbee_remove_handler(repeater->from, &repeater->handler);
+}
+
+void xbee_repeater_set_own(xbee_repeater_t * repeater,
+        size_t count, const xbee_address_t * own)
+{
+    assert(repeater);
+    assert(count == 0 || own);
+
+    repeater->own_count = count;
+    repeater->own = own;
+}
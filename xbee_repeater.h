@@ -0,0 +1,66 @@
+#ifndef _XBEE_REPEATER_H_
+#define _XBEE_REPEATER_H_
+
+#include "xbee.h"
+
+/*! Forwarding rule, first matching rule decides what happens to a frame */
+typedef struct {
+    bool any_source;            /*! Match every source, ignoring source */
+    xbee_address_t source;      /*! XBEE_16_BIT or XBEE_64_BIT source to match */
+    uint8_t match_mask;         /*! Bits of first payload byte to compare, 0 matches all */
+    uint8_t match_value;
+
+    xbee_interface_t * to;      /*! Interface to relay on, NULL drops the frame */
+    xbee_address_t destination;
+    uint8_t option;
+
+    uint32_t relayed;
+    uint32_t dropped;           /*! Matched, but could not be written to the target */
+} xbee_repeat_rule_t;
+
+/*! Relays received frames from one interface to others
+ *
+ * Frames are relayed straight from the receive frame decoded by xbee_poll:
+ * only a new API transmit header is written, and the payload is handed to
+ * xbee_transmit_gather without being copied.  Relayed frames are sent
+ * with frame_id 0, so the target sends no transmit status for them.
+ * Frames that match no rule are passed on to the next handler.
+ *
+ * Where the gateway's radios can hear each other, a broadcast relayed
+ * out of one is received by the other, and a rule matching it would send
+ * it round for ever.  Frames from the addresses given to
+ * xbee_repeater_set_own are never relayed, and are passed on.
+ */
+typedef struct {
+    xbee_handler_t handler;
+    xbee_interface_t * from;
+
+    size_t count;
+    xbee_repeat_rule_t * rules;
+
+    size_t own_count;
+    const xbee_address_t * own;
+
+    uint32_t own_ignored;       /*! Frames from an own address not relayed */
+} xbee_repeater_t;
+
+void xbee_repeater_init(xbee_repeater_t * repeater, xbee_interface_t * from,
+        size_t count, xbee_repeat_rule_t * rules) SPECIAL_SECTION;
+
+void xbee_repeater_stop(xbee_repeater_t * repeater) SPECIAL_SECTION;
+
+/*! Sets the gateway's own radios' addresses, never relayed from
+ *
+ * \param own count addresses, 16 and 64 bit, kept by the repeater
+ */
+void xbee_repeater_set_own(xbee_repeater_t * repeater,
+        size_t count, const xbee_address_t * own) SPECIAL_SECTION;
+
+/*! Relays frame according to rules
+ *
+ * \return Matching rule, or NULL if no rule matched
+ */
+xbee_repeat_rule_t * xbee_repeater_forward(xbee_repeater_t * repeater, 
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+
+#endif /* _XBEE_REPEATER_H_ */
@@ -0,0 +1,240 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_repeater.h"
+#include "xbee_sim.h"
+
+/* Gateway radio A is node 0, radio B node 1.  Sensors 2 and 3 are on A's
+ * network, the server 4 on B's. */
+#define TEST_A (0)
+#define TEST_B (1)
+#define TEST_SENSOR (2)
+#define TEST_OTHER (3)
+#define TEST_SERVER (4)
+#define TEST_NODES (5)
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_repeater_t repeater;
+    xbee_repeat_rule_t rules[2];
+    xbee_address_t own[2];
+
+    xbee_handler_t handler;         /*! Server's */
+    size_t received;
+    uint16_t source;                /*! Of the last frame the server got */
+    uint8_t data[32];
+    size_t size;
+
+    xbee_handler_t observer;        /*! A's */
+    const uint8_t * payload;        /*! Of the frame A last decoded */
+    size_t payload_size;
+
+    xbee_write_fun_t write;         /*! B's UART, wrapped by test_write */
+    bool from_frame;                /*! B's UART was given A's decoded payload */
+    size_t transmits;               /*! Transmit requests B's module took */
+    uint8_t frame_id;               /*! Of the last one */
+} test_setup_t;
+
+static test_setup_t test;
+
+static int test_server_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame)
+{
+    if(frame->api_id != XBEE_RECEIVE_16_BIT)
+    {
+        return 0;
+    }
+
+    test.received += 1;
+    test.source = frame->frame.receive.responder_network_address;
+    test.size = frame->frame.receive.packet_size;
+    memcpy(test.data, frame->frame.receive.packet_data, test.size);
+    return 1;
+}
+
+static int test_observe(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame)
+{
+    if(frame->api_id == XBEE_RECEIVE_16_BIT)
+    {
+        test.payload = frame->frame.receive.packet_data;
+        test.payload_size = frame->frame.receive.packet_size;
+    }
+
+    return 0;
+}
+
+static int test_write(void * ptr, const void * buf, size_t nbyte)
+{
+    const uint8_t * bytes = buf;
+    if(nbyte > 0 && bytes >= test.payload && bytes + nbyte <= test.payload + test.payload_size)
+    {
+        test.from_frame = true;
+    }
+
+    return test.write(ptr, buf, nbyte);
+}
+
+static bool test_request(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    if(node == TEST_B && frame[0] == XBEE_TRANSMIT_16_BIT)
+    {
+        test.transmits += 1;
+        test.frame_id = frame[1];
+    }
+
+    return false;
+}
+
+/*! A relays what the sensor sends with the top bit set to the server,
+ * and drops the rest of the sensor's frames */
+static void test_setup(void)
+{
+    memset(&test, 0, sizeof(test));
+    assert(xbee_sim_init(&test.sim, TEST_NODES, 41) == 0);
+    test.sim.request = test_request;
+
+    memset(test.sim.link, 0, sizeof(test.sim.link));
+    static const size_t pairs[][2] = {
+        {TEST_A, TEST_SENSOR}, {TEST_A, TEST_OTHER}, {TEST_SENSOR, TEST_OTHER},
+        {TEST_B, TEST_SERVER},
+    };
+    for(size_t i = 0; i < sizeof(pairs)/sizeof(pairs[0]); ++i)
+    {
+        test.sim.link[pairs[i][0]][pairs[i][1]] = true;
+        test.sim.link[pairs[i][1]][pairs[i][0]] = true;
+    }
+
+    xbee_sim_node_t * b = &test.sim.nodes[TEST_B];
+    test.write = b->uart.write;
+    b->uart.write = test_write;
+
+    test.observer.frame = test_observe;
+    xbee_add_observer(&test.sim.nodes[TEST_A].xbee, &test.observer);
+    test.handler.frame = test_server_frame;
+    xbee_add_handler(&test.sim.nodes[TEST_SERVER].xbee, &test.handler);
+
+    xbee_repeat_rule_t * rules = test.rules;
+    xbee_sim_address16(&test.sim, TEST_SENSOR, &rules[0].source);
+    rules[0].match_mask = 0x80;
+    rules[0].match_value = 0x80;
+    rules[0].to = &b->xbee;
+    xbee_sim_address16(&test.sim, TEST_SERVER, &rules[0].destination);
+    rules[1].source = rules[0].source;
+    xbee_repeater_init(&test.repeater, &test.sim.nodes[TEST_A].xbee, 2, rules);
+}
+
+/*! Sends size bytes from node to address16 of to */
+static void test_send(size_t node, size_t to, size_t size, const void * data)
+{
+    xbee_address_t address;
+    xbee_sim_address16(&test.sim, to, &address);
+    assert(xbee_transmit(&test.sim.nodes[node].xbee, 0, &address, 0, size, data) == 0);
+    xbee_sim_step(&test.sim);
+    xbee_sim_step(&test.sim);
+    xbee_sim_step(&test.sim);
+}
+
+/*! The first rule matching source and payload decides, frames matching
+ * none are left to other handlers */
+void test_repeater_rules(void)
+{
+    test_setup();
+
+    test_send(TEST_SENSOR, TEST_A, 3, "\x81hi");
+    assert(test.received == 1 && test.size == 3 && memcmp(test.data, "\x81hi", 3) == 0);
+    assert(test.source == TEST_B + 1);
+    assert(test.rules[0].relayed == 1);
+
+    test_send(TEST_SENSOR, TEST_A, 3, "\x01hi");
+    assert(test.received == 1);
+    assert(test.rules[0].relayed == 1 && test.rules[1].dropped == 1);
+    assert(test.sim.nodes[TEST_A].unhandled == 0);
+
+    test_send(TEST_OTHER, TEST_A, 3, "\x81hi");
+    assert(test.received == 1 && test.sim.nodes[TEST_A].unhandled == 1);
+
+    /* An empty payload can't match on its first byte */
+    test_send(TEST_SENSOR, TEST_A, 0, "");
+    assert(test.received == 1 && test.rules[1].dropped == 2);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! The payload goes to B's UART straight from the frame A decoded, with
+ * frame_id 0 so no transmit status comes back */
+void test_repeater_zero_copy(void)
+{
+    test_setup();
+
+    test_send(TEST_SENSOR, TEST_A, 4, "\xF0xyz");
+    assert(test.received == 1);
+    assert(test.from_frame);
+    assert(test.transmits == 1 && test.frame_id == 0);
+    assert(test.sim.nodes[TEST_B].unhandled == 0);
+
+    /* The same payload sent from elsewhere isn't taken for it */
+    test.from_frame = false;
+    assert(xbee_transmit(&test.sim.nodes[TEST_B].xbee, 0, &test.rules[0].destination, 0,
+            4, "\xF0xyz") == 0);
+    assert(!test.from_frame);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! With the radios in range of each other, a broadcast relayed out of B
+ * is heard by A, and is not relayed again */
+void test_repeater_own(void)
+{
+    test_setup();
+    test.sim.link[TEST_A][TEST_B] = true;
+    test.sim.link[TEST_B][TEST_A] = true;
+
+    xbee_repeat_rule_t * rule = &test.rules[0];
+    rule->any_source = true;
+    rule->match_mask = 0;
+    rule->destination.addr.network_address = 0xFFFF;
+
+    /* Without the radios' addresses, it goes round */
+    test_send(TEST_SENSOR, TEST_A, 2, "up");
+    for(size_t i = 0; i < 10; ++i)
+    {
+        xbee_sim_step(&test.sim);
+    }
+    assert(test.received > 2 && rule->relayed > 2);
+
+    xbee_sim_address16(&test.sim, TEST_A, &test.own[0]);
+    xbee_sim_address16(&test.sim, TEST_B, &test.own[1]);
+    xbee_repeater_set_own(&test.repeater, 2, test.own);
+    for(size_t i = 0; i < 10; ++i)
+    {
+        xbee_sim_step(&test.sim);
+    }
+
+    size_t received = test.received;
+    uint32_t relayed = rule->relayed;
+    test_send(TEST_SENSOR, TEST_A, 2, "up");
+    for(size_t i = 0; i < 10; ++i)
+    {
+        xbee_sim_step(&test.sim);
+    }
+    assert(test.received == received + 1 && memcmp(test.data, "up", 2) == 0);
+    assert(rule->relayed == relayed + 1);
+    assert(test.repeater.own_ignored > 0);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_repeater_rules();
+    test_repeater_zero_copy();
+    test_repeater_own();
+
+    return 0;
+}
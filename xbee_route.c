@@ -0,0 +1,413 @@
+#include "xbee_route.h"
+#include <assert.h>
+#include <string.h>
+
+#define XBEE_ROUTE_ENTRY_SIZE (5)
+#define XBEE_ROUTE_BROADCAST (0xFFFF)
+
+static xbee_route_entry_t * xbee_route_find(const xbee_router_t * router, 
+        uint16_t destination) SPECIAL_SECTION;
+static xbee_route_entry_t * xbee_route_find(const xbee_router_t * router, 
+        uint16_t destination)
+{
+    for(size_t i = 0; i < XBEE_ROUTE_TABLE_SIZE; ++i)
+    {
+        const xbee_route_entry_t * r = &router->routes[i];
+        if(r->metric != XBEE_ROUTE_UNREACHABLE && r->destination == destination)
+        {
+            return (xbee_route_entry_t *)r;
+        }
+    }
+
+    return NULL;
+}
+
+const xbee_route_entry_t * xbee_route_lookup(const xbee_router_t * router, 
+        uint16_t destination)
+{
+    assert(router);
+    return xbee_route_find(router, destination);
+}
+
+/*! Link cost from RSSI (-dBm), strong links cost 1 */
+static uint8_t xbee_route_link_cost(int8_t rssi)
+{
+    if(rssi <= 40)
+    {
+        return 1;
+    }
+
+    return 1 + (rssi - 40)/8;
+}
+
+/*! Records route candidate, keeping the cheaper one
+ *
+ * Updates from the current next hop are always taken, so a worsening 
+ * route is noticed rather than kept until it times out.
+ */
+static void xbee_route_update(xbee_router_t * router, uint16_t destination,
+        uint16_t next_hop, unsigned metric) SPECIAL_SECTION;
+static void xbee_route_update(xbee_router_t * router, uint16_t destination,
+        uint16_t next_hop, unsigned metric)
+{
+    if(destination == router->address || destination == XBEE_ROUTE_BROADCAST)
+    {
+        return;
+    }
+
+    if(metric >= XBEE_ROUTE_UNREACHABLE)
+    {
+        metric = XBEE_ROUTE_UNREACHABLE;
+    }
+
+    xbee_route_entry_t * r = xbee_route_find(router, destination);
+    if(r != NULL)
+    {
+        if(r->next_hop == next_hop || metric < r->metric)
+        {
+            r->next_hop = next_hop;
+            r->metric = metric;
+            r->updated = router->now;
+        }
+        return;
+    }
+
+    if(metric == XBEE_ROUTE_UNREACHABLE)
+    {
+        return;
+    }
+
+    /* Take a free entry, or replace the most expensive route if this one is cheaper */
+    xbee_route_entry_t * victim = NULL;
+    for(size_t i = 0; i < XBEE_ROUTE_TABLE_SIZE; ++i)
+    {
+        xbee_route_entry_t * e = &router->routes[i];
+        if(e->metric == XBEE_ROUTE_UNREACHABLE)
+        {
+            victim = e;
+            break;
+        }
+
+        if(e->metric > metric && (victim == NULL || e->metric > victim->metric))
+        {
+            victim = e;
+        }
+    }
+
+    if(victim == NULL)
+    {
+        return;
+    }
+
+    victim->destination = destination;
+    victim->next_hop = next_hop;
+    victim->metric = metric;
+    victim->updated = router->now;
+}
+
+/*! Returns true if (origin, sequence) was already handled, and records it otherwise */
+static bool xbee_route_seen(xbee_router_t * router, uint16_t origin, uint8_t sequence)
+{
+    for(size_t i = 0; i < XBEE_ROUTE_SEEN_SIZE; ++i)
+    {
+        const xbee_route_seen_t * s = &router->seen[i];
+        if(s->valid && s->origin == origin && s->sequence == sequence)
+        {
+            return true;
+        }
+    }
+
+    xbee_route_seen_t * s = &router->seen[router->seen_next];
+    s->origin = origin;
+    s->sequence = sequence;
+    s->valid = true;
+
+    router->seen_next = (router->seen_next + 1) % XBEE_ROUTE_SEEN_SIZE;
+    return false;
+}
+
+static void xbee_route_write_header(const xbee_router_t * router, uint8_t * header,
+        uint8_t type, uint8_t ttl, uint16_t origin, uint16_t destination, uint8_t sequence)
+{
+    header[0] = router->port;
+    header[1] = type;
+    header[2] = ttl;
+    header[3] = origin >> 8;
+    header[4] = origin & 0xFF;
+    header[5] = destination >> 8;
+    header[6] = destination & 0xFF;
+    header[7] = sequence;
+}
+
+static int xbee_route_transmit(xbee_router_t * router, uint16_t next_hop, 
+        const uint8_t * header, size_t size, const void * data) SPECIAL_SECTION;
+static int xbee_route_transmit(xbee_router_t * router, uint16_t next_hop, 
+        const uint8_t * header, size_t size, const void * data)
+{
+    xbee_address_t address;
+    if(next_hop == XBEE_ROUTE_BROADCAST)
+    {
+        address.type = XBEE_16_BIT_BROADCAST;
+    }
+    else
+    {
+        address.type = XBEE_16_BIT;
+        address.addr.network_address = next_hop;
+    }
+
+    xbee_buffer_t buffers[2] = {
+        { XBEE_ROUTE_HEADER_SIZE, header },
+        { size, data },
+    };
+
+    return xbee_transmit_gather(router->xbee, 0, &address, 0, 2, buffers);
+}
+
+static void xbee_route_advert(xbee_router_t * router, uint16_t neighbor, int8_t rssi,
+        size_t size, const uint8_t * entries) SPECIAL_SECTION;
+static void xbee_route_advert(xbee_router_t * router, uint16_t neighbor, int8_t rssi,
+        size_t size, const uint8_t * entries)
+{
+    unsigned cost = xbee_route_link_cost(rssi);
+
+    for(size_t i = 0; i + XBEE_ROUTE_ENTRY_SIZE <= size; i += XBEE_ROUTE_ENTRY_SIZE)
+    {
+        uint16_t destination = entries[i] << 8 | entries[i+1];
+        uint8_t metric = entries[i+2];
+        uint16_t next_hop = entries[i+3] << 8 | entries[i+4];
+
+        if(next_hop == router->address)
+        {
+            /* Split horizon, neighbor reaches destination through us */
+            if(destination != neighbor)
+            {
+                xbee_route_entry_t * r = xbee_route_find(router, destination);
+                if(r != NULL && r->next_hop == neighbor)
+                {
+                    r->metric = XBEE_ROUTE_UNREACHABLE;
+                }
+            }
+            continue;
+        }
+
+        xbee_route_update(router, destination, neighbor, 
+                metric == XBEE_ROUTE_UNREACHABLE ? XBEE_ROUTE_UNREACHABLE : metric + cost);
+    }
+}
+
+static int xbee_route_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_route_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_router_t * router = ptr;
+
+    if(frame->api_id != XBEE_RECEIVE && frame->api_id != XBEE_RECEIVE_16_BIT)
+    {
+        return 0;
+    }
+
+    size_t size = frame->frame.receive.packet_size;
+    const uint8_t * header = frame->frame.receive.packet_data;
+    if(size < XBEE_ROUTE_HEADER_SIZE || header[0] != router->port ||
+       (header[1] != XBEE_ROUTE_DATA && header[1] != XBEE_ROUTE_ADVERT))
+    {
+        return 0;
+    }
+
+    uint8_t ttl = header[2];
+    uint16_t origin = header[3] << 8 | header[4];
+    uint16_t destination = header[5] << 8 | header[6];
+    uint8_t sequence = header[7];
+    const uint8_t * payload = header + XBEE_ROUTE_HEADER_SIZE;
+    size -= XBEE_ROUTE_HEADER_SIZE;
+
+    if(origin == router->address)
+    {
+        /* Our own packet came back */
+        router->dropped_duplicate += 1;
+        return 1;
+    }
+
+    if(header[1] == XBEE_ROUTE_ADVERT)
+    {
+        /* Advertisements are single hop, origin is the neighbor */
+        xbee_route_update(router, origin, origin, 
+                xbee_route_link_cost(frame->frame.receive.rssi));
+        xbee_route_advert(router, origin, frame->frame.receive.rssi, size, payload);
+        return 1;
+    }
+
+    if(xbee_route_seen(router, origin, sequence))
+    {
+        router->dropped_duplicate += 1;
+        return 1;
+    }
+
+    if(destination == router->address)
+    {
+        router->delivered += 1;
+        if(router->deliver)
+        {
+            router->deliver(router->ptr, router, origin, size, payload);
+        }
+        return 1;
+    }
+
+    if(ttl <= 1)
+    {
+        router->dropped_ttl += 1;
+        return 1;
+    }
+
+    const xbee_route_entry_t * r = xbee_route_find(router, destination);
+    if(r == NULL)
+    {
+        router->dropped_no_route += 1;
+        return 1;
+    }
+
+    uint8_t forward_header[XBEE_ROUTE_HEADER_SIZE];
+    memcpy(forward_header, header, sizeof(forward_header));
+    forward_header[2] = ttl - 1;
+
+    if(xbee_route_transmit(router, r->next_hop, forward_header, size, payload) == 0)
+    {
+        router->forwarded += 1;
+    }
+
+    return 1;
+}
+
+void xbee_router_init(xbee_router_t * router, xbee_interface_t * xbee, uint8_t port, uint16_t address,
+        uint32_t advert_interval, uint32_t route_timeout,
+        xbee_route_deliver_t deliver, void * ptr)
+{
+    assert(router);
+    assert(xbee);
+    assert(address != XBEE_ROUTE_BROADCAST);
+
+    memset(router, 0, sizeof(*router));
+    router->xbee = xbee;
+    router->port = port;
+    router->address = address;
+    router->advert_interval = advert_interval;
+    router->route_timeout = route_timeout;
+    router->deliver = deliver;
+    router->ptr = ptr;
+
+    for(size_t i = 0; i < XBEE_ROUTE_TABLE_SIZE; ++i)
+    {
+        router->routes[i].metric = XBEE_ROUTE_UNREACHABLE;
+    }
+
+    router->handler.ptr = router;
+    router->handler.frame = xbee_route_frame;
+    xbee_add_handler(xbee, &router->handler);
+}
+
+void xbee_router_stop(xbee_router_t * router)
+{
+    assert(router);
+    xbee_remove_handler(router->xbee, &router->handler);
+}
+
+/*! Broadcasts distance vector, split over as many packets as needed */
+static int xbee_route_send_advert(xbee_router_t * router) SPECIAL_SECTION;
+static int xbee_route_send_advert(xbee_router_t * router)
+{
+    uint8_t header[XBEE_ROUTE_HEADER_SIZE];
+    uint8_t entries[XBEE_ROUTE_MAX_PAYLOAD / XBEE_ROUTE_ENTRY_SIZE * XBEE_ROUTE_ENTRY_SIZE];
+    size_t size = 0;
+    bool sent = false;
+
+    for(size_t i = 0; i < XBEE_ROUTE_TABLE_SIZE; ++i)
+    {
+        const xbee_route_entry_t * r = &router->routes[i];
+        if(r->metric == XBEE_ROUTE_UNREACHABLE)
+        {
+            continue;
+        }
+
+        entries[size++] = r->destination >> 8;
+        entries[size++] = r->destination & 0xFF;
+        entries[size++] = r->metric;
+        entries[size++] = r->next_hop >> 8;
+        entries[size++] = r->next_hop & 0xFF;
+
+        if(size == sizeof(entries))
+        {
+            xbee_route_write_header(router, header, XBEE_ROUTE_ADVERT, 1, 
+                    router->address, XBEE_ROUTE_BROADCAST, router->sequence++);
+            int ret = xbee_route_transmit(router, XBEE_ROUTE_BROADCAST, header, size, entries);
+            if(ret != 0)
+            {
+                return ret;
+            }
+
+            size = 0;
+            sent = true;
+        }
+    }
+
+    if(size == 0 && sent)
+    {
+        return 0;
+    }
+
+    /* Always advertise, even an empty table tells neighbors we exist */
+    xbee_route_write_header(router, header, XBEE_ROUTE_ADVERT, 1, 
+            router->address, XBEE_ROUTE_BROADCAST, router->sequence++);
+    return xbee_route_transmit(router, XBEE_ROUTE_BROADCAST, header, size, entries);
+}
+
+int xbee_router_run(xbee_router_t * router, uint32_t now)
+{
+    assert(router);
+
+    router->now = now;
+
+    for(size_t i = 0; i < XBEE_ROUTE_TABLE_SIZE; ++i)
+    {
+        xbee_route_entry_t * r = &router->routes[i];
+        if(r->metric != XBEE_ROUTE_UNREACHABLE && now - r->updated > router->route_timeout)
+        {
+            r->metric = XBEE_ROUTE_UNREACHABLE;
+        }
+    }
+
+    if(router->started && now - router->last_advert < router->advert_interval)
+    {
+        return 0;
+    }
+
+    int ret = xbee_route_send_advert(router);
+    if(ret == XBEE_ERR_NOT_READY)
+    {
+        /* Try again once the XBee has recovered */
+        return 0;
+    }
+
+    router->started = true;
+    router->last_advert = now;
+    return ret;
+}
+
+int xbee_route_send(xbee_router_t * router, uint16_t destination, 
+        size_t size, const void * data)
+{
+    assert(router);
+    assert(size <= XBEE_ROUTE_MAX_PAYLOAD);
+
+    const xbee_route_entry_t * r = xbee_route_find(router, destination);
+    if(r == NULL)
+    {
+        return XBEE_ERR_NO_ROUTE;
+    }
+
+    uint8_t header[XBEE_ROUTE_HEADER_SIZE];
+    xbee_route_write_header(router, header, XBEE_ROUTE_DATA, XBEE_ROUTE_DEFAULT_TTL, 
+            router->address, destination, router->sequence++);
+
+    return xbee_route_transmit(router, r->next_hop, header, size, data);
+}
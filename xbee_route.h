@@ -0,0 +1,122 @@
+#ifndef _XBEE_ROUTE_H_
+#define _XBEE_ROUTE_H_
+
+#include "xbee.h"
+
+#ifndef XBEE_ROUTE_TABLE_SIZE
+#define XBEE_ROUTE_TABLE_SIZE 32
+#endif /* XBEE_ROUTE_TABLE_SIZE */
+
+#ifndef XBEE_ROUTE_SEEN_SIZE
+#define XBEE_ROUTE_SEEN_SIZE 32
+#endif /* XBEE_ROUTE_SEEN_SIZE */
+
+/*! Routing header, prepended to every routed packet
+ *
+ * byte 0: router's port number, as a xbee_port_mux_t would put it
+ * byte 1: XBEE_ROUTE_DATA or XBEE_ROUTE_ADVERT
+ * byte 2: hops remaining (TTL)
+ * byte 3-4: origin 16-bit address
+ * byte 5-6: destination 16-bit address
+ * byte 7: origin sequence number
+ */
+#define XBEE_ROUTE_HEADER_SIZE (8)
+#define XBEE_ROUTE_DATA   (0xB1)
+#define XBEE_ROUTE_ADVERT (0xB2)
+
+#define XBEE_ROUTE_MAX_PAYLOAD (XBEE_MAX_RF_PAYLOAD - XBEE_ROUTE_HEADER_SIZE)
+
+#define XBEE_ROUTE_DEFAULT_TTL (8)
+#define XBEE_ROUTE_UNREACHABLE (0xFF)
+
+typedef struct {
+    uint16_t destination;
+    uint16_t next_hop;
+    uint8_t metric;             /*! Sum of link costs, XBEE_ROUTE_UNREACHABLE if unused */
+    uint32_t updated;
+} xbee_route_entry_t;
+
+typedef struct {
+    uint16_t origin;
+    uint8_t sequence;
+    bool valid;
+} xbee_route_seen_t;
+
+typedef struct xbee_router xbee_router_t;
+
+/*! Called from xbee_poll with payload of a packet addressed to this node */
+typedef void (*xbee_route_deliver_t)(void * ptr, xbee_router_t * router, 
+        uint16_t origin, size_t size, const void * data);
+
+/*! Store and forward routing for radios that do not route themselves
+ *
+ * Nodes are identified by their 16-bit address (MY).  Each node 
+ * periodically broadcasts its distance vector; link cost to a neighbor
+ * is derived from the RSSI of the neighbor's advertisement.  Packets not
+ * addressed to this node are relayed to the next hop straight from the 
+ * receive frame, with only the TTL byte of the header rewritten.
+ *
+ * Loops are prevented by split horizon (advertised routes carry their next
+ * hop, receivers ignore routes through themselves), a hop limit, and 
+ * suppression of (origin, sequence) pairs already relayed or delivered.
+ *
+ * Only packets on the router's port number are routed.  A xbee_port_mux_t
+ * on the same XBee passes them on as long as it has no port open with
+ * that number, so the two share the radio whichever is set up first.
+ *
+ * Times are in milliseconds from any monotonic clock, and may wrap.
+ * Frames handled by the router are stamped with the time of the last
+ * xbee_router_run call.
+ */
+struct xbee_router {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+    uint8_t port;
+    uint16_t address;
+    uint8_t sequence;
+
+    uint32_t advert_interval;
+    uint32_t route_timeout;     /*! Routes not refreshed for this long are dropped */
+    bool started;
+    uint32_t now;
+    uint32_t last_advert;
+
+    xbee_route_deliver_t deliver;
+    void * ptr;
+
+    xbee_route_entry_t routes[XBEE_ROUTE_TABLE_SIZE];
+
+    size_t seen_next;
+    xbee_route_seen_t seen[XBEE_ROUTE_SEEN_SIZE];
+
+    uint32_t delivered;
+    uint32_t forwarded;
+    uint32_t dropped_duplicate;
+    uint32_t dropped_ttl;
+    uint32_t dropped_no_route;
+};
+
+#define XBEE_ERR_NO_ROUTE (-20)
+
+void xbee_router_init(xbee_router_t * router, xbee_interface_t * xbee, uint8_t port, uint16_t address,
+        uint32_t advert_interval, uint32_t route_timeout,
+        xbee_route_deliver_t deliver, void * ptr) SPECIAL_SECTION;
+
+void xbee_router_stop(xbee_router_t * router) SPECIAL_SECTION;
+
+/*! Expires stale routes and advertises routes when due, call from the poll loop */
+int xbee_router_run(xbee_router_t * router, uint32_t now) SPECIAL_SECTION;
+
+/*! Sends payload to destination over the routed mesh
+ *
+ * \return 0 on success, XBEE_ERR_NO_ROUTE if destination is unknown,
+ *         otherwise error from xbee_transmit_gather
+ */
+int xbee_route_send(xbee_router_t * router, uint16_t destination, 
+        size_t size, const void * data) SPECIAL_SECTION;
+
+/*! Returns route to destination, or NULL if there is none */
+const xbee_route_entry_t * xbee_route_lookup(const xbee_router_t * router, 
+        uint16_t destination) SPECIAL_SECTION;
+
+#endif /* _XBEE_ROUTE_H_ */
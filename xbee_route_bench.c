@@ -0,0 +1,144 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_route.h"
+#include "xbee_sim.h"
+
+/* Node 0 sends 32 byte packets to the far end of a line of nodes, each
+ * hearing only its neighbours, keeping up to window packets on their way.
+ * Every frame a module sends holds the channel for 2 ms plus its bytes at
+ * 250 kbps, during which the clock moves on, as if all the nodes shared
+ * one channel, and reaches the next host BENCH_DELAY ms after that, the
+ * UARTs and the modules' turnaround.  Routes are learned from adverts
+ * before the packets start, and adverts go on meanwhile. */
+
+#define BENCH_PORT (0x52)
+#define BENCH_PACKETS (1000)
+#define BENCH_PAYLOAD (32)
+#define BENCH_DELAY (3)
+#define BENCH_ADVERT_INTERVAL (1000)
+
+typedef struct {
+    xbee_sim_t sim;
+    uint32_t air_us;                /*! Channel time not yet on the clock */
+    xbee_router_t routers[XBEE_SIM_NODES];
+    size_t nodes;
+
+    size_t delivered;
+    uint64_t latency;               /*! Sum over delivered packets, ms */
+    uint32_t max_latency;
+} bench_t;
+
+static bench_t bench;
+
+static bool bench_request(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    if(frame[0] == XBEE_TRANSMIT_16_BIT || frame[0] == XBEE_TRANSMIT)
+    {
+        bench.air_us += 2000 + size*8*1000/250;
+        sim->clock.now += bench.air_us/1000;
+        bench.air_us %= 1000;
+    }
+
+    return false;
+}
+
+static void bench_deliver(void * ptr, xbee_router_t * router,
+        uint16_t origin, size_t size, const void * data)
+{
+    uint32_t sent;
+    assert(size == BENCH_PAYLOAD);
+    memcpy(&sent, data, sizeof(sent));
+
+    uint32_t latency = bench.sim.clock.now - sent;
+    bench.delivered += 1;
+    bench.latency += latency;
+    if(latency > bench.max_latency)
+    {
+        bench.max_latency = latency;
+    }
+}
+
+/*! Steps a ms, running every router */
+static void bench_step(void)
+{
+    xbee_sim_advance(&bench.sim, 1);
+    for(size_t i = 0; i < bench.nodes; ++i)
+    {
+        assert(xbee_router_run(&bench.routers[i], bench.sim.clock.now) == 0);
+    }
+}
+
+/*! ms for BENCH_PACKETS packets over hops, window at a time */
+static uint32_t bench_run(size_t hops, size_t window)
+{
+    memset(&bench, 0, sizeof(bench));
+    bench.nodes = hops + 1;
+    assert(xbee_sim_init(&bench.sim, bench.nodes, 17) == 0);
+    bench.sim.request = bench_request;
+    bench.sim.delay = BENCH_DELAY;
+
+    for(size_t i = 0; i < bench.nodes; ++i)
+    {
+        for(size_t j = 0; j < bench.nodes; ++j)
+        {
+            bench.sim.link[i][j] = i + 1 == j || j + 1 == i;
+        }
+        xbee_router_init(&bench.routers[i], &bench.sim.nodes[i].xbee, BENCH_PORT, i + 1,
+                BENCH_ADVERT_INTERVAL, 4*BENCH_ADVERT_INTERVAL,
+                i == hops ? bench_deliver : NULL, NULL);
+    }
+
+    uint16_t destination = bench.nodes;
+    while(xbee_route_lookup(&bench.routers[0], destination) == NULL)
+    {
+        bench_step();
+    }
+
+    uint8_t payload[BENCH_PAYLOAD];
+    memset(payload, 'r', sizeof(payload));
+    uint32_t start = bench.sim.clock.now;
+    size_t sent = 0;
+    while(bench.delivered < BENCH_PACKETS)
+    {
+        while(sent < BENCH_PACKETS && sent - bench.delivered < window)
+        {
+            uint32_t now = bench.sim.clock.now;
+            memcpy(payload, &now, sizeof(now));
+            assert(xbee_route_send(&bench.routers[0], destination, sizeof(payload), payload) == 0);
+            sent += 1;
+        }
+
+        bench_step();
+    }
+    assert(bench.routers[0].dropped_no_route == 0);
+
+    return bench.sim.clock.now - start;
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const size_t windows[] = {1, 4};
+
+    printf("%u packets of %u bytes, %u ms per frame on top of its air time, times in ms\n",
+            BENCH_PACKETS, BENCH_PAYLOAD, BENCH_DELAY);
+    printf("  %4s %7s %8s %10s %12s %11s\n", "hops", "window", "elapsed", "packets/s",
+            "mean latency", "max latency");
+    for(size_t hops = 1; hops <= 5; ++hops)
+    {
+        for(size_t w = 0; w < sizeof(windows)/sizeof(windows[0]); ++w)
+        {
+            uint32_t elapsed = bench_run(hops, windows[w]);
+            printf("  %4zu %7zu %8u %10.1f %12.1f %11u\n", hops, windows[w], elapsed,
+                    1000.0*BENCH_PACKETS/elapsed, (double)bench.latency/BENCH_PACKETS,
+                    bench.max_latency);
+        }
+    }
+
+    return 0;
+}
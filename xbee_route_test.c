@@ -0,0 +1,153 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_port.h"
+#include "xbee_route.h"
+#include "xbee_sim.h"
+
+#define TEST_NODES (4)
+#define TEST_ROUTE_PORT (0x52)
+#define TEST_MUX_PORT (XBEE_ROUTE_DATA)
+#define TEST_ADVERT_INTERVAL (1000)
+#define TEST_PACKETS (50)
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_router_t routers[TEST_NODES];
+    xbee_port_mux_t mux[TEST_NODES];
+    xbee_port_t ports[TEST_NODES];
+    xbee_port_message_t queues[TEST_NODES][4];
+    size_t delivered[TEST_NODES];
+    size_t received[TEST_NODES];
+} test_setup_t;
+
+static test_setup_t test;
+
+static void test_deliver(void * ptr, xbee_router_t * router,
+        uint16_t origin, size_t size, const void * data)
+{
+    test.delivered[router - test.routers] += 1;
+}
+
+static void test_receive(void * ptr, xbee_port_t * port,
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data)
+{
+    test.received[port - test.ports] += 1;
+}
+
+static void test_router_init(size_t node)
+{
+    xbee_router_init(&test.routers[node], &test.sim.nodes[node].xbee, TEST_ROUTE_PORT,
+            node + 1, TEST_ADVERT_INTERVAL, 4*TEST_ADVERT_INTERVAL, test_deliver, NULL);
+}
+
+static void test_mux_init(size_t node)
+{
+    xbee_port_mux_init(&test.mux[node], &test.sim.nodes[node].xbee, 4);
+    xbee_port_open(&test.mux[node], &test.ports[node], TEST_MUX_PORT, 0, 2, 4,
+            test.queues[node], test_receive, NULL);
+}
+
+/*! Advertises for count intervals */
+static void test_advertise(size_t nodes, size_t count)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        for(size_t n = 0; n < nodes; ++n)
+        {
+            assert(xbee_router_run(&test.routers[n], test.sim.clock.now) == 0);
+            xbee_sim_step(&test.sim);
+        }
+        xbee_sim_advance(&test.sim, TEST_ADVERT_INTERVAL);
+    }
+}
+
+/*! Packets cross a line of nodes, one frame per hop */
+void test_route_line(void)
+{
+    memset(&test, 0, sizeof(test));
+    assert(xbee_sim_init(&test.sim, TEST_NODES, 31) == 0);
+    for(size_t i = 0; i < TEST_NODES; ++i)
+    {
+        for(size_t j = 0; j < TEST_NODES; ++j)
+        {
+            test.sim.link[i][j] = i + 1 == j || j + 1 == i;
+        }
+        test_router_init(i);
+    }
+
+    test_advertise(TEST_NODES, TEST_NODES);
+    const xbee_route_entry_t * r = xbee_route_lookup(&test.routers[0], TEST_NODES);
+    assert(r != NULL && r->next_hop == 2);
+
+    uint32_t before = 0;
+    for(size_t i = 0; i < TEST_NODES; ++i)
+    {
+        before += test.sim.nodes[i].frames_in;
+    }
+
+    for(size_t i = 0; i < TEST_PACKETS; ++i)
+    {
+        assert(xbee_route_send(&test.routers[0], TEST_NODES, 5, "hello") == 0);
+        for(size_t hop = 0; hop < TEST_NODES; ++hop)
+        {
+            xbee_sim_step(&test.sim);
+        }
+    }
+
+    uint32_t frames = 0;
+    for(size_t i = 0; i < TEST_NODES; ++i)
+    {
+        frames += test.sim.nodes[i].frames_in;
+    }
+    frames -= before;
+
+    assert(test.delivered[TEST_NODES-1] == TEST_PACKETS);
+    assert(frames == TEST_PACKETS*(TEST_NODES-1));
+    printf("%s passed, %u of %u delivered over %u hops, %u frames\n", __func__,
+            (unsigned)test.delivered[TEST_NODES-1], TEST_PACKETS, TEST_NODES - 1,
+            (unsigned)frames);
+}
+
+/*! A port mux and a router share an XBee, set up in either order, and a
+ * port message that looks like a routing header stays with its port */
+void test_route_with_mux(void)
+{
+    memset(&test, 0, sizeof(test));
+    assert(xbee_sim_init(&test.sim, 2, 37) == 0);
+    test_mux_init(0);
+    test_router_init(0);
+    test_router_init(1);
+    test_mux_init(1);
+
+    test_advertise(2, 2);
+    assert(xbee_route_lookup(&test.routers[0], 2) != NULL);
+    assert(xbee_route_lookup(&test.routers[1], 1) != NULL);
+
+    uint8_t message[XBEE_ROUTE_HEADER_SIZE] = {XBEE_ROUTE_DATA, 8, 0x00, 0x01, 0x00, 0x02, 0};
+    xbee_address_t peer;
+    xbee_sim_address16(&test.sim, 1, &peer);
+    assert(xbee_port_send(&test.mux[0], &test.ports[0], &peer, 0, sizeof(message), message) == 0);
+    xbee_sim_step(&test.sim);
+    assert(test.received[1] == 1);
+    assert(test.delivered[1] == 0);
+
+    assert(xbee_route_send(&test.routers[1], 1, 5, "hello") == 0);
+    xbee_sim_step(&test.sim);
+    assert(test.delivered[0] == 1);
+    assert(test.received[0] == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_route_line();
+    test_route_with_mux();
+
+    return 0;
+}
@@ -0,0 +1,270 @@
+#include "xbee_rpc.h"
+#include <assert.h>
+#include <string.h>
+
+/*! Message kinds, first byte after the port number
+ *
+ * REQUEST:  kind, correlation id, method id, arguments
+ * RESPONSE: kind, correlation id, status, reply
+ */
+#define XBEE_RPC_REQUEST    (0x01)
+#define XBEE_RPC_RESPONSE   (0x02)
+
+static bool xbee_rpc_same_address(const xbee_address_t * a, const xbee_address_t * b)
+{
+    if(a->type != b->type)
+    {
+        return false;
+    }
+
+    if(a->type == XBEE_16_BIT)
+    {
+        return a->addr.network_address == b->addr.network_address;
+    }
+
+    return a->addr.address == b->addr.address;
+}
+
+/*! True if source, a reply's sender, is the node c called */
+static bool xbee_rpc_from_callee(xbee_rpc_t * rpc, const xbee_rpc_call_t * c,
+        const xbee_address_t * source)
+{
+    if(xbee_rpc_same_address(&c->address, source))
+    {
+        return true;
+    }
+
+    if(rpc->nodes == NULL)
+    {
+        return false;
+    }
+
+    xbee_node_t * callee = xbee_node_find(rpc->nodes, &c->address, false);
+    return callee != NULL && callee == xbee_node_find(rpc->nodes, source, false);
+}
+
+static xbee_rpc_call_t * xbee_rpc_find(xbee_rpc_t * rpc, uint8_t correlation_id)
+{
+    for(size_t i = 0; i < XBEE_RPC_MAX_CALLS; ++i)
+    {
+        xbee_rpc_call_t * c = &rpc->calls[i];
+        if(c->active && c->correlation_id == correlation_id)
+        {
+            return c;
+        }
+    }
+
+    return NULL;
+}
+
+static void xbee_rpc_complete(xbee_rpc_call_t * c, int status, 
+        size_t size, const void * data) SPECIAL_SECTION;
+static void xbee_rpc_complete(xbee_rpc_call_t * c, int status, 
+        size_t size, const void * data)
+{
+    /* Slot is free before done runs, so done may start another call */
+    c->active = false;
+    c->done(c->ptr, status, size, data);
+}
+
+static void xbee_rpc_serve(xbee_rpc_t * rpc, const xbee_address_t * source,
+        const uint8_t * m, size_t size) SPECIAL_SECTION;
+static void xbee_rpc_serve(xbee_rpc_t * rpc, const xbee_address_t * source,
+        const uint8_t * m, size_t size)
+{
+    uint8_t response[XBEE_PORT_MAX_PAYLOAD];
+    size_t reply_size = 0;
+
+    response[0] = XBEE_RPC_RESPONSE;
+    response[1] = m[1];
+    response[2] = XBEE_RPC_UNKNOWN_METHOD;
+
+    for(size_t i = 0; i < rpc->method_count; ++i)
+    {
+        const xbee_rpc_method_t * method = &rpc->methods[i];
+        if(method->method == m[2])
+        {
+            response[2] = method->fun(method->ptr, source, 
+                    size - XBEE_RPC_HEADER_SIZE, &m[XBEE_RPC_HEADER_SIZE],
+                    XBEE_RPC_MAX_PAYLOAD, &response[XBEE_RPC_HEADER_SIZE], &reply_size);
+            assert(reply_size <= XBEE_RPC_MAX_PAYLOAD);
+            break;
+        }
+    }
+
+    rpc->served += 1;
+
+    /* A response lost to a full queue shows up as a timeout at the caller */
+    xbee_port_send(rpc->mux, rpc->port, source, 0, 
+            XBEE_RPC_HEADER_SIZE + reply_size, response);
+}
+
+static void xbee_rpc_receive(void * ptr, xbee_port_t * port, 
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data) SPECIAL_SECTION;
+static void xbee_rpc_receive(void * ptr, xbee_port_t * port, 
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data)
+{
+    xbee_rpc_t * rpc = ptr;
+    const uint8_t * m = data;
+
+    if(size < XBEE_RPC_HEADER_SIZE)
+    {
+        return;
+    }
+
+    if(m[0] == XBEE_RPC_REQUEST)
+    {
+        xbee_rpc_serve(rpc, source, m, size);
+    }
+    else if(m[0] == XBEE_RPC_RESPONSE)
+    {
+        xbee_rpc_call_t * c = xbee_rpc_find(rpc, m[1]);
+        if(c == NULL || !xbee_rpc_from_callee(rpc, c, source))
+        {
+            rpc->unmatched += 1;
+            return;
+        }
+
+        rpc->completed += 1;
+        xbee_rpc_complete(c, m[2], size - XBEE_RPC_HEADER_SIZE, &m[XBEE_RPC_HEADER_SIZE]);
+    }
+}
+
+void xbee_rpc_init(xbee_rpc_t * rpc, 
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number, uint8_t priority,
+        uint8_t max_in_flight, size_t queue_size, xbee_port_message_t * queue,
+        size_t method_count, const xbee_rpc_method_t * methods)
+{
+    assert(rpc);
+    assert(mux);
+    assert(port);
+    assert(methods || method_count == 0);
+
+    memset(rpc, 0, sizeof(*rpc));
+    rpc->mux = mux;
+    rpc->port = port;
+    rpc->method_count = method_count;
+    rpc->methods = methods;
+
+    xbee_port_open(mux, port, number, priority, max_in_flight, queue_size, queue,
+            xbee_rpc_receive, rpc);
+}
+
+void xbee_rpc_set_nodes(xbee_rpc_t * rpc, xbee_node_table_t * table)
+{
+    assert(rpc);
+
+    rpc->nodes = table;
+}
+
+void xbee_rpc_stop(xbee_rpc_t * rpc)
+{
+    assert(rpc);
+
+    xbee_port_close(rpc->mux, rpc->port);
+
+    for(size_t i = 0; i < XBEE_RPC_MAX_CALLS; ++i)
+    {
+        if(rpc->calls[i].active)
+        {
+            xbee_rpc_complete(&rpc->calls[i], XBEE_ERR_RPC_CANCELLED, 0, NULL);
+        }
+    }
+}
+
+int xbee_rpc_call(xbee_rpc_t * rpc, const xbee_address_t * address, 
+        uint8_t method, size_t size, const void * data,
+        uint32_t now, uint32_t timeout, xbee_rpc_done_t done, void * ptr)
+{
+    assert(rpc);
+    assert(address);
+    assert(size <= XBEE_RPC_MAX_PAYLOAD);
+    assert(data || size == 0);
+    assert(done);
+
+    xbee_rpc_call_t * c = NULL;
+    for(size_t i = 0; i < XBEE_RPC_MAX_CALLS && c == NULL; ++i)
+    {
+        if(!rpc->calls[i].active)
+        {
+            c = &rpc->calls[i];
+        }
+    }
+
+    if(c == NULL)
+    {
+        return XBEE_ERR_QUEUE_FULL;
+    }
+
+    /* Skip ids still outstanding, so a response matches exactly one call */
+    uint8_t correlation_id = rpc->next_correlation_id;
+    while(xbee_rpc_find(rpc, correlation_id) != NULL)
+    {
+        correlation_id += 1;
+    }
+    rpc->next_correlation_id = correlation_id + 1;
+
+    uint8_t request[XBEE_PORT_MAX_PAYLOAD];
+    request[0] = XBEE_RPC_REQUEST;
+    request[1] = correlation_id;
+    request[2] = method;
+    if(size > 0)
+    {
+        memcpy(&request[XBEE_RPC_HEADER_SIZE], data, size);
+    }
+
+    int ret = xbee_port_send(rpc->mux, rpc->port, address, 0, 
+            XBEE_RPC_HEADER_SIZE + size, request);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    c->active = true;
+    c->address = *address;
+    c->correlation_id = correlation_id;
+    c->method = method;
+    c->deadline = now + timeout;
+    c->done = done;
+    c->ptr = ptr;
+
+    return correlation_id;
+}
+
+void xbee_rpc_cancel(xbee_rpc_t * rpc, uint8_t correlation_id)
+{
+    assert(rpc);
+
+    xbee_rpc_call_t * c = xbee_rpc_find(rpc, correlation_id);
+    if(c != NULL)
+    {
+        xbee_rpc_complete(c, XBEE_ERR_RPC_CANCELLED, 0, NULL);
+    }
+}
+
+size_t xbee_rpc_run(xbee_rpc_t * rpc, uint32_t now)
+{
+    assert(rpc);
+
+    size_t outstanding = 0;
+    for(size_t i = 0; i < XBEE_RPC_MAX_CALLS; ++i)
+    {
+        xbee_rpc_call_t * c = &rpc->calls[i];
+        if(!c->active)
+        {
+            continue;
+        }
+
+        if((int32_t)(now - c->deadline) >= 0)
+        {
+            rpc->timeouts += 1;
+            xbee_rpc_complete(c, XBEE_ERR_RPC_TIMEOUT, 0, NULL);
+        }
+        else
+        {
+            outstanding += 1;
+        }
+    }
+
+    return outstanding;
+}
@@ -0,0 +1,124 @@
+#ifndef _XBEE_RPC_H_
+#define _XBEE_RPC_H_
+
+#include "xbee_node.h"
+
+/*! Calls that may be in flight at once from one endpoint, at most 256 */
+#ifndef XBEE_RPC_MAX_CALLS
+#define XBEE_RPC_MAX_CALLS 16
+#endif /* XBEE_RPC_MAX_CALLS */
+
+/*! Header is kind, correlation id and method id or status */
+#define XBEE_RPC_HEADER_SIZE (3)
+#define XBEE_RPC_MAX_PAYLOAD (XBEE_PORT_MAX_PAYLOAD - XBEE_RPC_HEADER_SIZE)
+
+/*! Response status when the remote has no such method */
+#define XBEE_RPC_UNKNOWN_METHOD (0xFF)
+
+#define XBEE_ERR_RPC_TIMEOUT (-25)      /*! No response before deadline */
+#define XBEE_ERR_RPC_CANCELLED (-26)    /*! Call cancelled or endpoint stopped */
+
+/*! Completion of a call
+ *
+ * status is the remote status (0 on success, XBEE_RPC_UNKNOWN_METHOD, or 
+ * method specific), or negative local error.  data is only valid during 
+ * the call.
+ */
+typedef void (*xbee_rpc_done_t)(void * ptr, int status, size_t size, const void * data);
+
+/*! Serves a method
+ *
+ * Writes at most reply_max bytes of reply and sets *reply_size.
+ *
+ * \return Status sent back to caller, 0 on success
+ */
+typedef uint8_t (*xbee_rpc_method_fun_t)(void * ptr, const xbee_address_t * source,
+        size_t size, const void * data, 
+        size_t reply_max, void * reply, size_t * reply_size);
+
+typedef struct {
+    uint8_t method;
+    xbee_rpc_method_fun_t fun;
+    void * ptr;
+} xbee_rpc_method_t;
+
+typedef struct {
+    bool active;
+    xbee_address_t address;
+    uint8_t correlation_id;
+    uint8_t method;
+    uint32_t deadline;
+    xbee_rpc_done_t done;
+    void * ptr;
+} xbee_rpc_call_t;
+
+/*! Request/response endpoint on a port
+ *
+ * Any number of calls (up to XBEE_RPC_MAX_CALLS) may be outstanding, to 
+ * one node or many.  Requests are only queued on the port, so calls are 
+ * pipelined up to the port's max_in_flight rather than waiting a round 
+ * trip each.  Responses are matched on source and correlation id from 
+ * xbee_poll, deadlines are checked by xbee_rpc_run.
+ *
+ * A reply comes from the address type the callee's XBee was sent from,
+ * which needn't be the one the call went to, e.g. a call to a 64 bit
+ * address through xbee_node_transmit is answered from the 16 bit one.
+ * Without a node table, see xbee_rpc_set_nodes, a reply only matches a
+ * call to the exact address it came from, and any other counts as
+ * unmatched and the call times out.
+ *
+ * The same endpoint serves requests from a table of methods.
+ */
+typedef struct {
+    xbee_port_mux_t * mux;
+    xbee_port_t * port;
+
+    size_t method_count;
+    const xbee_rpc_method_t * methods;
+    xbee_node_table_t * nodes;  /*! Matches replies on either address of a node */
+
+    uint8_t next_correlation_id;
+    xbee_rpc_call_t calls[XBEE_RPC_MAX_CALLS];
+
+    uint32_t completed;
+    uint32_t timeouts;
+    uint32_t served;
+    uint32_t unmatched;         /*! Responses for no outstanding call, e.g. late */
+} xbee_rpc_t;
+
+/*! Opens port number on mux for RPC, methods may be NULL if method_count is 0 */
+void xbee_rpc_init(xbee_rpc_t * rpc, 
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number, uint8_t priority,
+        uint8_t max_in_flight, size_t queue_size, xbee_port_message_t * queue,
+        size_t method_count, const xbee_rpc_method_t * methods) SPECIAL_SECTION;
+
+/*! Matches replies to calls by node in table rather than by address
+ *
+ * A reply from either the 16 or the 64 bit address of the node called
+ * matches, once table knows both, see xbee_node_resolve.  table may be
+ * NULL to match on the exact address again.
+ */
+void xbee_rpc_set_nodes(xbee_rpc_t * rpc, xbee_node_table_t * table) SPECIAL_SECTION;
+
+/*! Closes port and completes outstanding calls with XBEE_ERR_RPC_CANCELLED */
+void xbee_rpc_stop(xbee_rpc_t * rpc) SPECIAL_SECTION;
+
+/*! Starts call of method on address, done is called exactly once on success
+ *
+ * \return Correlation id, XBEE_ERR_QUEUE_FULL if no call slot or port queue 
+ *         is free, otherwise error writing to the XBee
+ */
+int xbee_rpc_call(xbee_rpc_t * rpc, const xbee_address_t * address, 
+        uint8_t method, size_t size, const void * data,
+        uint32_t now, uint32_t timeout, xbee_rpc_done_t done, void * ptr) SPECIAL_SECTION;
+
+/*! Completes call with XBEE_ERR_RPC_CANCELLED, a late response is dropped */
+void xbee_rpc_cancel(xbee_rpc_t * rpc, uint8_t correlation_id) SPECIAL_SECTION;
+
+/*! Times out expired calls, call from the poll loop
+ *
+ * \return Calls outstanding
+ */
+size_t xbee_rpc_run(xbee_rpc_t * rpc, uint32_t now) SPECIAL_SECTION;
+
+#endif /* _XBEE_RPC_H_ */
@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_rpc.h"
+#include "xbee_sim.h"
+
+/* Node 0 calls an 8 byte echo on node 1, keeping up to window calls
+ * outstanding.  Every frame a module sends holds the shared channel for
+ * 2 ms plus its bytes at 250 kbps, during which the clock moves on, and
+ * reaches the other host delay ms after that, the UARTs and the modules'
+ * turnaround.  Window 1 is a caller that waits out each round trip. */
+
+#define BENCH_PORT (7)
+#define BENCH_ECHO (1)
+#define BENCH_CALLS (2000)
+#define BENCH_ARG_SIZE (8)
+
+typedef struct {
+    xbee_sim_t sim;
+    uint32_t air_us;                /*! Channel time not yet on the clock */
+    xbee_port_mux_t mux[2];
+    xbee_port_t port[2];
+    xbee_port_message_t queue[2][XBEE_RPC_MAX_CALLS];
+    xbee_rpc_t rpc[2];
+
+    size_t outstanding;
+    size_t done;
+    uint64_t latency;               /*! Sum over calls, ms */
+    uint32_t started[256];          /*! Start of the call by correlation id */
+} bench_t;
+
+static bench_t bench;
+
+static bool bench_request(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    if(frame[0] == XBEE_TRANSMIT_16_BIT || frame[0] == XBEE_TRANSMIT)
+    {
+        bench.air_us += 2000 + size*8*1000/250;
+        sim->clock.now += bench.air_us/1000;
+        bench.air_us %= 1000;
+    }
+
+    return false;
+}
+
+static uint8_t bench_echo(void * ptr, const xbee_address_t * source,
+        size_t size, const void * data,
+        size_t reply_max, void * reply, size_t * reply_size)
+{
+    memcpy(reply, data, size);
+    *reply_size = size;
+    return 0;
+}
+
+static const xbee_rpc_method_t bench_methods[] = {
+    { BENCH_ECHO, bench_echo, NULL },
+};
+
+static void bench_done(void * ptr, int status, size_t size, const void * data)
+{
+    uint32_t started = *(uint32_t *)ptr;
+    assert(status == 0 && size == BENCH_ARG_SIZE);
+    bench.outstanding -= 1;
+    bench.done += 1;
+    bench.latency += bench.sim.clock.now - started;
+}
+
+/*! ms for BENCH_CALLS calls, window at a time, each frame delay ms late */
+static uint32_t bench_run(size_t window, uint32_t delay)
+{
+    memset(&bench, 0, sizeof(bench));
+    assert(xbee_sim_init(&bench.sim, 2, 11) == 0);
+    bench.sim.request = bench_request;
+    bench.sim.delay = delay;
+
+    for(size_t i = 0; i < 2; ++i)
+    {
+        xbee_port_mux_init(&bench.mux[i], &bench.sim.nodes[i].xbee, window);
+        xbee_rpc_init(&bench.rpc[i], &bench.mux[i], &bench.port[i], BENCH_PORT, 0, window,
+                XBEE_RPC_MAX_CALLS, bench.queue[i],
+                i == 0 ? 0 : 1, i == 0 ? NULL : bench_methods);
+    }
+
+    xbee_address_t peer;
+    xbee_sim_address16(&bench.sim, 1, &peer);
+    uint8_t arg[BENCH_ARG_SIZE] = "abcdefgh";
+
+    uint32_t start = bench.sim.clock.now;
+    size_t called = 0;
+    while(bench.done < BENCH_CALLS)
+    {
+        while(called < BENCH_CALLS && bench.outstanding < window)
+        {
+            uint32_t now = bench.sim.clock.now;
+            int id = xbee_rpc_call(&bench.rpc[0], &peer, BENCH_ECHO, sizeof(arg), arg,
+                    now, 1000, bench_done, &bench.started[called % 256]);
+            assert(id >= 0);
+            bench.started[called % 256] = now;
+            bench.outstanding += 1;
+            called += 1;
+        }
+
+        xbee_sim_advance(&bench.sim, 1);
+        for(size_t i = 0; i < 2; ++i)
+        {
+            assert(xbee_port_mux_run(&bench.mux[i]) == 0);
+            xbee_rpc_run(&bench.rpc[i], bench.sim.clock.now);
+        }
+    }
+    assert(bench.rpc[0].timeouts == 0 && bench.rpc[0].unmatched == 0);
+
+    return bench.sim.clock.now - start;
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const size_t windows[] = {1, 2, 4, 8};
+    static const uint32_t delays[] = {0, 5, 20};
+
+    printf("%u calls of %u bytes, times in ms\n", BENCH_CALLS, BENCH_ARG_SIZE);
+    printf("  %6s %7s %8s %8s %12s\n", "delay", "window", "elapsed", "calls/s", "mean latency");
+    for(size_t d = 0; d < sizeof(delays)/sizeof(delays[0]); ++d)
+    {
+        for(size_t w = 0; w < sizeof(windows)/sizeof(windows[0]); ++w)
+        {
+            uint32_t elapsed = bench_run(windows[w], delays[d]);
+            printf("  %6u %7zu %8u %8.1f %12.1f\n", delays[d], windows[w], elapsed,
+                    1000.0*BENCH_CALLS/elapsed, (double)bench.latency/BENCH_CALLS);
+        }
+    }
+
+    return 0;
+}
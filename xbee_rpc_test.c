@@ -0,0 +1,281 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_rpc.h"
+#include "xbee_sim.h"
+
+#define TEST_PORT (7)
+#define TEST_ECHO (1)
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_port_mux_t mux[3];
+    xbee_port_t port[3];
+    xbee_port_message_t queue[3][XBEE_RPC_MAX_CALLS];
+    xbee_rpc_t rpc[3];
+    xbee_node_table_t nodes;
+} test_setup_t;
+
+/*! What a call completed with */
+typedef struct {
+    size_t done;
+    int status;
+    size_t size;
+    uint8_t data[XBEE_RPC_MAX_PAYLOAD];
+} test_result_t;
+
+static test_setup_t test;
+
+static uint8_t test_echo(void * ptr, const xbee_address_t * source,
+        size_t size, const void * data,
+        size_t reply_max, void * reply, size_t * reply_size)
+{
+    memcpy(reply, data, size);
+    *reply_size = size;
+    return 0;
+}
+
+static const xbee_rpc_method_t test_methods[] = {
+    { TEST_ECHO, test_echo, NULL },
+};
+
+static int test_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    return xbee_transmit_gather(ptr, frame_id, address, option, count, buffers);
+}
+
+static void test_done(void * ptr, int status, size_t size, const void * data)
+{
+    test_result_t * r = ptr;
+    r->done += 1;
+    r->status = status;
+    r->size = size;
+    memcpy(r->data, data, size);
+}
+
+/*! Node 0 calls, nodes 1 and 2 serve echo */
+static void test_setup(void)
+{
+    memset(&test, 0, sizeof(test));
+    assert(xbee_sim_init(&test.sim, 3, 31) == 0);
+
+    for(size_t i = 0; i < 3; ++i)
+    {
+        xbee_port_mux_init(&test.mux[i], &test.sim.nodes[i].xbee, 4);
+        xbee_rpc_init(&test.rpc[i], &test.mux[i], &test.port[i], TEST_PORT, 0, 4,
+                XBEE_RPC_MAX_CALLS, test.queue[i],
+                i == 0 ? 0 : 1, i == 0 ? NULL : test_methods);
+    }
+}
+
+/*! Steps ms times, running every mux and endpoint each ms */
+static void test_run(uint32_t ms)
+{
+    for(uint32_t i = 0; i < ms; ++i)
+    {
+        xbee_sim_advance(&test.sim, 1);
+        for(size_t n = 0; n < 3; ++n)
+        {
+            assert(xbee_port_mux_run(&test.mux[n]) == 0);
+            xbee_rpc_run(&test.rpc[n], test.sim.clock.now);
+        }
+    }
+}
+
+/*! A call gets its reply, a call of no such method says so */
+void test_rpc_call(void)
+{
+    test_setup();
+
+    xbee_address_t peer;
+    xbee_sim_address16(&test.sim, 1, &peer);
+    test_result_t echo = {0}, unknown = {0};
+    uint32_t now = test.sim.clock.now;
+
+    assert(xbee_rpc_call(&test.rpc[0], &peer, TEST_ECHO, 4, "ping", now, 100,
+            test_done, &echo) >= 0);
+    assert(xbee_rpc_call(&test.rpc[0], &peer, 9, 0, NULL, now, 100,
+            test_done, &unknown) >= 0);
+    test_run(2);
+
+    assert(echo.done == 1 && echo.status == 0);
+    assert(echo.size == 4 && memcmp(echo.data, "ping", 4) == 0);
+    assert(unknown.done == 1 && unknown.status == XBEE_RPC_UNKNOWN_METHOD && unknown.size == 0);
+    assert(test.rpc[0].completed == 2 && test.rpc[1].served == 2);
+    assert(xbee_rpc_run(&test.rpc[0], test.sim.clock.now) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Every call slot busy at once across two nodes, each reply reaches its
+ * own call, and the calls overlap rather than take a round trip each */
+void test_rpc_concurrent(void)
+{
+    test_setup();
+    test.sim.delay = 10;
+    test.sim.jitter = 5;
+
+    xbee_address_t peers[2];
+    xbee_sim_address16(&test.sim, 1, &peers[0]);
+    xbee_sim_address64(&test.sim, 2, &peers[1]);
+
+    static test_result_t results[XBEE_RPC_MAX_CALLS];
+    memset(results, 0, sizeof(results));
+    uint32_t start = test.sim.clock.now;
+    for(size_t i = 0; i < XBEE_RPC_MAX_CALLS; ++i)
+    {
+        uint8_t arg = i;
+        assert(xbee_rpc_call(&test.rpc[0], &peers[i % 2], TEST_ECHO, 1, &arg, start, 1000,
+                test_done, &results[i]) >= 0);
+    }
+    assert(xbee_rpc_call(&test.rpc[0], &peers[0], TEST_ECHO, 0, NULL, start, 1000,
+            test_done, &results[0]) == XBEE_ERR_QUEUE_FULL);
+
+    uint32_t elapsed = 0;
+    while(xbee_rpc_run(&test.rpc[0], test.sim.clock.now) > 0)
+    {
+        test_run(1);
+        elapsed += 1;
+        assert(elapsed < 1000);
+    }
+
+    for(size_t i = 0; i < XBEE_RPC_MAX_CALLS; ++i)
+    {
+        assert(results[i].done == 1 && results[i].status == 0);
+        assert(results[i].size == 1 && results[i].data[0] == i);
+    }
+    assert(test.rpc[0].completed == XBEE_RPC_MAX_CALLS && test.rpc[0].unmatched == 0);
+    assert(test.rpc[1].served + test.rpc[2].served == XBEE_RPC_MAX_CALLS);
+
+    /* A round trip is at least 20 ms, 4 calls in flight at a time */
+    assert(elapsed < XBEE_RPC_MAX_CALLS*20/2);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A call whose reply is slower than its timeout times out once, and the
+ * reply when it comes is counted as unmatched */
+void test_rpc_timeout(void)
+{
+    test_setup();
+    test.sim.delay = 40;
+
+    xbee_address_t peer;
+    xbee_sim_address16(&test.sim, 1, &peer);
+    test_result_t r = {0};
+
+    assert(xbee_rpc_call(&test.rpc[0], &peer, TEST_ECHO, 2, "hi", test.sim.clock.now, 50,
+            test_done, &r) >= 0);
+    test_run(49);
+    assert(r.done == 0);
+    assert(xbee_rpc_run(&test.rpc[0], test.sim.clock.now) == 1);
+
+    test_run(1);
+    assert(r.done == 1 && r.status == XBEE_ERR_RPC_TIMEOUT);
+    assert(test.rpc[0].timeouts == 1);
+
+    test_run(40);
+    assert(test.rpc[1].served == 1);
+    assert(r.done == 1);
+    assert(test.rpc[0].unmatched == 1 && test.rpc[0].completed == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A reply with the right correlation id from another node is ignored,
+ * and so are short messages */
+void test_rpc_unmatched(void)
+{
+    test_setup();
+    test.sim.delay = 10;
+
+    xbee_address_t peer;
+    xbee_sim_address16(&test.sim, 1, &peer);
+    test_result_t r = {0};
+
+    int id = xbee_rpc_call(&test.rpc[0], &peer, TEST_ECHO, 2, "hi", test.sim.clock.now, 100,
+            test_done, &r);
+    assert(id >= 0);
+
+    /* Node 2 replies first, then a header cut short */
+    const uint8_t forged[] = {XBEE_RECEIVE_16_BIT, 0x00, 0x03, 40, 0x00, TEST_PORT,
+        0x02, id, 0x00, 'n', 'o'};
+    xbee_sim_push_frame(&test.sim, 0, sizeof(forged), forged);
+    xbee_sim_push_frame(&test.sim, 0, 8, forged);
+    xbee_sim_step(&test.sim);
+    assert(r.done == 0);
+    assert(test.rpc[0].unmatched == 1);
+
+    test_run(25);
+    assert(r.done == 1 && r.status == 0);
+    assert(r.size == 2 && memcmp(r.data, "hi", 2) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Calls to a 64 bit address sent by the node's 16 bit one, as
+ * xbee_node_transmit does, get their replies from the 16 bit address.
+ * These only match with the node table set. */
+void test_rpc_mixed_address(void)
+{
+    test_setup();
+    xbee_interface_t * xbee = &test.sim.nodes[0].xbee;
+    xbee_node_table_t * table = &test.nodes;
+    xbee_node_table_init(table, xbee);
+    xbee_node_table_set_transmit(table, test_transmit, xbee);
+    xbee_port_mux_set_transmit(&test.mux[0], xbee_node_transmit, table);
+
+    xbee_address_t peer;
+    xbee_sim_address64(&test.sim, 1, &peer);
+    uint8_t frame_id = xbee_alloc_frame_id(xbee);
+    assert(xbee_remote_at_command(xbee, &peer, 0, frame_id, "MY", 0, NULL) == 0);
+    xbee_sim_step(&test.sim);
+    assert(xbee_node_find(table, &peer, false)->network_address == 2);
+
+    test_result_t r = {0};
+    assert(xbee_rpc_call(&test.rpc[0], &peer, TEST_ECHO, 1, "a", test.sim.clock.now, 10,
+            test_done, &r) >= 0);
+    test_run(10);
+    assert(table->resolved == 1);
+    assert(r.done == 1 && r.status == XBEE_ERR_RPC_TIMEOUT);
+    assert(test.rpc[0].unmatched == 1);
+
+    xbee_rpc_set_nodes(&test.rpc[0], table);
+    assert(xbee_rpc_call(&test.rpc[0], &peer, TEST_ECHO, 1, "b", test.sim.clock.now, 10,
+            test_done, &r) >= 0);
+    test_run(2);
+    assert(table->resolved == 2);
+    assert(r.done == 2 && r.status == 0 && r.data[0] == 'b');
+    assert(test.rpc[0].unmatched == 1 && test.rpc[0].completed == 1);
+
+    /* Node 2 is still no match for a call to node 1 */
+    int id = xbee_rpc_call(&test.rpc[0], &peer, 9, 0, NULL, test.sim.clock.now, 10,
+            test_done, &r);
+    assert(id >= 0);
+    const uint8_t forged[] = {XBEE_RECEIVE_16_BIT, 0x00, 0x03, 40, 0x00, TEST_PORT,
+        0x02, id, 0x00};
+    xbee_sim_push_frame(&test.sim, 0, sizeof(forged), forged);
+    xbee_sim_step(&test.sim);
+    assert(test.rpc[0].unmatched == 2);
+    test_run(1);
+    assert(r.done == 3 && r.status == XBEE_RPC_UNKNOWN_METHOD);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_rpc_call();
+    test_rpc_concurrent();
+    test_rpc_timeout();
+    test_rpc_unmatched();
+    test_rpc_mixed_address();
+
+    return 0;
+}
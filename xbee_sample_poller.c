@@ -0,0 +1,222 @@
+#include "xbee_sample_poller.h"
+#include <assert.h>
+#include <string.h>
+
+static xbee_sample_node_t * xbee_sample_find(xbee_sample_poller_t * poller, 
+        uint8_t frame_id) SPECIAL_SECTION;
+static xbee_sample_node_t * xbee_sample_find(xbee_sample_poller_t * poller, 
+        uint8_t frame_id)
+{
+    if(frame_id == 0)
+    {
+        return NULL;
+    }
+
+    for(size_t i = 0; i < poller->count; ++i)
+    {
+        if(poller->nodes[i].frame_id == frame_id)
+        {
+            return &poller->nodes[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int xbee_sample_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_sample_frame(void * ptr, xbee_interface_t * xbee, 
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_sample_poller_t * poller = ptr;
+
+    if(frame->api_id != XBEE_REMOTE_AT_RESPONSE)
+    {
+        return 0;
+    }
+
+    xbee_sample_node_t * node = xbee_sample_find(poller, frame->frame_id);
+    if(node == NULL)
+    {
+        return 0;
+    }
+
+    node->frame_id = 0;
+    poller->in_flight -= 1;
+
+    xbee_io_sample_t sample;
+    if(frame->frame.at_command_response.status != 0 ||
+       xbee_parse_io_sample(&sample, frame->frame.at_command_response.data_size,
+                            frame->frame.at_command_response.data) != 0)
+    {
+        if(node->failures < UINT8_MAX)
+        {
+            node->failures += 1;
+        }
+        return 1;
+    }
+
+    node->sample = sample;
+    node->have_sample = true;
+    node->failures = 0;
+    node->sample_time = node->request_time;
+
+    if(poller->sample)
+    {
+        poller->sample(poller->ptr, poller, node);
+    }
+
+    return 1;
+}
+
+/*! Counts node's IS as unanswered */
+static void xbee_sample_unanswered(xbee_sample_poller_t * poller, xbee_sample_node_t * node)
+{
+    node->frame_id = 0;
+    poller->in_flight -= 1;
+    if(node->failures < UINT8_MAX)
+    {
+        node->failures += 1;
+    }
+}
+
+static void xbee_sample_failed(void * ptr, xbee_interface_t * xbee, 
+        uint8_t frame_id, int reason) SPECIAL_SECTION;
+static void xbee_sample_failed(void * ptr, xbee_interface_t * xbee, 
+        uint8_t frame_id, int reason)
+{
+    xbee_sample_poller_t * poller = ptr;
+
+    xbee_sample_node_t * node = xbee_sample_find(poller, frame_id);
+    if(node != NULL)
+    {
+        xbee_sample_unanswered(poller, node);
+    }
+}
+
+void xbee_sample_poller_init(xbee_sample_poller_t * poller, xbee_interface_t * xbee,
+        size_t count, xbee_sample_node_t * nodes, 
+        size_t max_in_flight, uint32_t spacing, uint32_t timeout,
+        xbee_sample_fun_t sample, void * ptr)
+{
+    assert(poller);
+    assert(xbee);
+    assert(count > 0 && nodes);
+    assert(max_in_flight > 0);
+    assert(timeout > 0);
+
+    memset(poller, 0, sizeof(*poller));
+    poller->xbee = xbee;
+    poller->count = count;
+    poller->nodes = nodes;
+    poller->max_in_flight = max_in_flight;
+    poller->spacing = spacing;
+    poller->timeout = timeout;
+    poller->sample = sample;
+    poller->ptr = ptr;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        nodes[i].frame_id = 0;
+        nodes[i].have_sample = false;
+        nodes[i].failures = 0;
+    }
+
+    poller->handler.ptr = poller;
+    poller->handler.frame = xbee_sample_frame;
+    poller->handler.failed = xbee_sample_failed;
+    xbee_add_handler(xbee, &poller->handler);
+}
+
+void xbee_sample_poller_stop(xbee_sample_poller_t * poller)
+{
+    assert(poller);
+    xbee_remove_handler(poller->xbee, &poller->handler);
+}
+
+int xbee_sample_poller_run(xbee_sample_poller_t * poller, uint32_t now)
+{
+    assert(poller);
+
+    for(size_t i = 0; i < poller->count && poller->in_flight > 0; ++i)
+    {
+        xbee_sample_node_t * node = &poller->nodes[i];
+        if(node->frame_id != 0 && now - node->request_time >= poller->timeout)
+        {
+            /* A late response now matches no node */
+            xbee_free_frame_id(poller->xbee, node->frame_id);
+            xbee_sample_unanswered(poller, node);
+        }
+    }
+
+    for(size_t tries = 0; tries < poller->count; ++tries)
+    {
+        if(poller->in_flight >= poller->max_in_flight)
+        {
+            return 0;
+        }
+
+        xbee_sample_node_t * node = &poller->nodes[poller->next];
+        if(node->frame_id != 0)
+        {
+            /* Still waiting on this node from the previous sweep */
+            return 0;
+        }
+
+        if(poller->started && now - poller->last_request_time < poller->spacing)
+        {
+            return 0;
+        }
+
+        uint8_t frame_id = xbee_alloc_frame_id(poller->xbee);
+        if(frame_id == 0)
+        {
+            return 0;
+        }
+
+        int ret = xbee_remote_at_command(poller->xbee, &node->address, 0, 
+                frame_id, "IS", 0, NULL);
+        if(ret != 0)
+        {
+            /* Node is asked again with a new id on a later run */
+            xbee_free_frame_id(poller->xbee, frame_id);
+            return ret == XBEE_ERR_NOT_READY ? 0 : ret;
+        }
+
+        node->frame_id = frame_id;
+        node->request_time = now;
+        poller->in_flight += 1;
+        poller->last_request_time = now;
+
+        if(poller->next == 0)
+        {
+            if(poller->started)
+            {
+                poller->sweep_time = now - poller->sweep_start;
+            }
+            poller->sweep_start = now;
+            poller->started = true;
+        }
+
+        poller->next += 1;
+        if(poller->next == poller->count)
+        {
+            poller->next = 0;
+            poller->sweeps += 1;
+        }
+    }
+
+    return 0;
+}
+
+uint32_t xbee_sample_age(const xbee_sample_node_t * node, uint32_t now)
+{
+    assert(node);
+
+    if(!node->have_sample)
+    {
+        return UINT32_MAX;
+    }
+
+    return now - node->sample_time;
+}
@@ -0,0 +1,77 @@
+#ifndef _XBEE_SAMPLE_POLLER_H_
+#define _XBEE_SAMPLE_POLLER_H_
+
+#include "xbee.h"
+
+/*! Remote node polled with IS */
+typedef struct {
+    xbee_address_t address;
+
+    /* Filled in by poller */
+    uint8_t frame_id;           /*! Frame id of IS in flight, 0 if none */
+    bool have_sample;
+    uint8_t failures;           /*! Consecutive IS that were not answered */
+    uint32_t request_time;      /*! When last IS was sent */
+    uint32_t sample_time;       /*! When the IS that produced sample was sent */
+    xbee_io_sample_t sample;
+} xbee_sample_node_t;
+
+typedef struct xbee_sample_poller xbee_sample_poller_t;
+
+/*! Called from xbee_poll when node has a new sample */
+typedef void (*xbee_sample_fun_t)(void * ptr, xbee_sample_poller_t * poller, xbee_sample_node_t * node);
+
+/*! Polls passive nodes with remote IS, keeping several queries in flight
+ *
+ * Nodes are polled round robin.  At most max_in_flight IS queries are 
+ * outstanding at once and consecutive queries are at least spacing apart,
+ * so a sweep is paced by the channel rather than by each node's round trip.
+ *
+ * An IS not answered within timeout is abandoned and counted as a failure,
+ * so a lost response never holds up the sweep.  This does not depend on
+ * xbee_set_frame_timeout.
+ *
+ * Times are in milliseconds from any monotonic clock, and may wrap.
+ */
+struct xbee_sample_poller {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+
+    size_t count;
+    xbee_sample_node_t * nodes;
+
+    size_t max_in_flight;
+    uint32_t spacing;           /*! Minimum time between two IS queries */
+    uint32_t timeout;           /*! Time an IS is waited on before it counts as unanswered */
+
+    xbee_sample_fun_t sample;
+    void * ptr;
+
+    size_t next;                /*! Next node to poll */
+    size_t in_flight;
+    bool started;
+    uint32_t last_request_time;
+
+    uint32_t sweep_start;
+    uint32_t sweep_time;        /*! Duration of last complete sweep */
+    uint32_t sweeps;
+};
+
+void xbee_sample_poller_init(xbee_sample_poller_t * poller, xbee_interface_t * xbee,
+        size_t count, xbee_sample_node_t * nodes, 
+        size_t max_in_flight, uint32_t spacing, uint32_t timeout,
+        xbee_sample_fun_t sample, void * ptr) SPECIAL_SECTION;
+
+void xbee_sample_poller_stop(xbee_sample_poller_t * poller) SPECIAL_SECTION;
+
+/*! Abandons IS queries older than timeout and sends due ones, call from
+ * the poll loop
+ *
+ * \return 0 on success, otherwise error from xbee_remote_at_command
+ */
+int xbee_sample_poller_run(xbee_sample_poller_t * poller, uint32_t now) SPECIAL_SECTION;
+
+/*! Returns age of node's last sample, or UINT32_MAX if it never answered */
+uint32_t xbee_sample_age(const xbee_sample_node_t * node, uint32_t now) SPECIAL_SECTION;
+
+#endif /* _XBEE_SAMPLE_POLLER_H_ */
@@ -0,0 +1,153 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_sample_poller.h"
+#include "xbee_sim.h"
+
+#define TEST_REMOTES (2)
+#define TEST_TIMEOUT (500)
+
+static xbee_sim_t test_sim;
+static xbee_sample_poller_t test_poller;
+static xbee_sample_node_t test_nodes[TEST_REMOTES];
+static size_t test_drop;
+static size_t test_samples;
+
+/*! Loses the next test_drop remote AT commands */
+static bool test_request(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    if(frame[0] != XBEE_REMOTE_AT_COMMAND || test_drop == 0)
+    {
+        return false;
+    }
+
+    test_drop -= 1;
+    return true;
+}
+
+static void test_sample(void * ptr, xbee_sample_poller_t * poller, xbee_sample_node_t * node)
+{
+    test_samples += 1;
+}
+
+/*! Frame ids that can be allocated, every one held is freed again */
+static size_t test_free_frame_ids(xbee_interface_t * xbee)
+{
+    uint8_t held[255];
+    size_t count = 0;
+    for(uint8_t id; (id = xbee_alloc_frame_id(xbee)) != 0; )
+    {
+        held[count++] = id;
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        xbee_free_frame_id(xbee, held[i]);
+    }
+
+    return count;
+}
+
+/*! A lost IS response is given up on after the timeout, and the sweep
+ * goes on without frame timeouts */
+void test_sample_poller_lost(void)
+{
+    assert(xbee_sim_init(&test_sim, 1 + TEST_REMOTES, 19) == 0);
+    test_sim.request = test_request;
+    test_drop = 1;
+    test_samples = 0;
+
+    xbee_interface_t * xbee = &test_sim.nodes[0].xbee;
+    for(size_t i = 0; i < TEST_REMOTES; ++i)
+    {
+        xbee_sim_set_register(&test_sim, 1 + i, "IS", 5, "\x01\x00\x01\x00\x01");
+        xbee_sim_address16(&test_sim, 1 + i, &test_nodes[i].address);
+    }
+    xbee_sample_poller_init(&test_poller, xbee, TEST_REMOTES, test_nodes, 2, 0,
+            TEST_TIMEOUT, test_sample, NULL);
+
+    /* The first node's IS is lost */
+    assert(xbee_sample_poller_run(&test_poller, test_sim.clock.now) == 0);
+    xbee_sim_step(&test_sim);
+    uint8_t lost_id = test_nodes[0].frame_id;
+    assert(lost_id != 0);
+    assert(test_nodes[1].have_sample);
+    assert(test_samples == 1);
+
+    assert(xbee_sample_poller_run(&test_poller, test_sim.clock.now) == 0);
+    assert(test_nodes[0].frame_id == lost_id);
+    assert(test_poller.in_flight == 1);
+
+    xbee_sim_advance(&test_sim, TEST_TIMEOUT);
+    assert(xbee_sample_poller_run(&test_poller, test_sim.clock.now) == 0);
+    assert(test_nodes[0].failures == 1);
+    xbee_sim_step(&test_sim);
+    assert(test_nodes[0].have_sample);
+    assert(test_nodes[0].failures == 0);
+    assert(test_samples >= 2);
+    assert(test_poller.sweeps >= 1);
+
+    /* The given up IS answering late matches no node */
+    uint8_t late[] = {XBEE_REMOTE_AT_RESPONSE, lost_id, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x00, 0x02, 'I', 'S', 0, 0x01, 0x00, 0x01, 0x00, 0x01};
+    size_t in_flight = test_poller.in_flight;
+    xbee_sim_push_frame(&test_sim, 0, sizeof(late), late);
+    xbee_sim_step(&test_sim);
+    assert(test_poller.in_flight == in_flight);
+
+    xbee_sample_poller_stop(&test_poller);
+    printf("%s passed\n", __func__);
+}
+
+/*! Runs while the XBee recovers from a reset keep no frame ids, and the
+ * sweep starts once it is ready */
+void test_sample_poller_not_ready(void)
+{
+    assert(xbee_sim_init(&test_sim, 1 + TEST_REMOTES, 43) == 0);
+    test_samples = 0;
+
+    xbee_interface_t * xbee = &test_sim.nodes[0].xbee;
+    for(size_t i = 0; i < TEST_REMOTES; ++i)
+    {
+        xbee_sim_set_register(&test_sim, 1 + i, "IS", 5, "\x01\x00\x01\x00\x01");
+        xbee_sim_address16(&test_sim, 1 + i, &test_nodes[i].address);
+    }
+    xbee_sample_poller_init(&test_poller, xbee, TEST_REMOTES, test_nodes, 2, 0,
+            TEST_TIMEOUT, test_sample, NULL);
+
+    const uint8_t reset[] = {XBEE_MODEM_STATUS, XBEE_MODEM_HARDWARE_RESET};
+    xbee_sim_push_frame(&test_sim, 0, sizeof(reset), reset);
+    xbee_sim_step(&test_sim);
+    assert(xbee->state == XBEE_STATE_RECOVERING);
+
+    for(size_t i = 0; i < 300; ++i)
+    {
+        assert(xbee_sample_poller_run(&test_poller, test_sim.clock.now + i) == 0);
+    }
+    assert(test_poller.in_flight == 0);
+
+    xbee_sim_step(&test_sim);
+    assert(xbee->state == XBEE_STATE_READY);
+    assert(test_free_frame_ids(xbee) == 255);
+
+    assert(xbee_sample_poller_run(&test_poller, test_sim.clock.now) == 0);
+    xbee_sim_step(&test_sim);
+    assert(test_samples == TEST_REMOTES);
+    assert(test_free_frame_ids(xbee) == 255);
+
+    xbee_sample_poller_stop(&test_poller);
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_sample_poller_lost();
+    test_sample_poller_not_ready();
+
+    return 0;
+}
@@ -0,0 +1,276 @@
+#include "xbee_schedule.h"
+#include <assert.h>
+#include <string.h>
+
+static void xbee_schedule_remove(xbee_scheduler_t * scheduler, xbee_scheduled_t * scheduled)
+{
+    for(xbee_scheduled_t ** p = &scheduler->active; *p != NULL; p = &(*p)->next)
+    {
+        if(*p == scheduled)
+        {
+            *p = scheduled->next;
+            scheduled->next = NULL;
+            return;
+        }
+    }
+}
+
+static xbee_scheduled_t * xbee_schedule_find(xbee_scheduler_t * scheduler, uint8_t frame_id)
+{
+    for(xbee_scheduled_t * s = scheduler->active; s != NULL; s = s->next)
+    {
+        if(s->frame.frame_id == frame_id)
+        {
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
+/*! UART and air time of frame, us */
+static uint32_t xbee_schedule_size_time(const xbee_scheduler_t * scheduler,
+        const xbee_encoded_frame_t * frame)
+{
+    return (uint64_t)10000000*frame->size/scheduler->baud +
+        (uint64_t)8000000*frame->payload_size/scheduler->bitrate;
+}
+
+static void xbee_schedule_finish(xbee_scheduler_t * scheduler, xbee_scheduled_t * scheduled,
+        int status)
+{
+    xbee_schedule_remove(scheduler, scheduled);
+    if(status != 0)
+    {
+        scheduler->failed += 1;
+    }
+
+    scheduled->done(scheduled->ptr, scheduled, status);
+}
+
+static void xbee_schedule_expired(void * ptr, xbee_timer_t * timer) SPECIAL_SECTION;
+static void xbee_schedule_expired(void * ptr, xbee_timer_t * timer)
+{
+    xbee_scheduled_t * scheduled = ptr;
+    xbee_scheduler_t * scheduler = scheduled->scheduler;
+    xbee_interface_t * xbee = scheduler->xbee;
+
+    scheduled->write_start = xbee_now(xbee);
+    uint8_t frame_id = scheduled->frame.frame_id;
+
+    if(scheduler->admit != NULL &&
+       !scheduler->admit(scheduler->admit_ptr, &scheduled->address, scheduler->priority,
+            scheduled->frame.payload_size))
+    {
+        scheduler->refused += 1;
+        xbee_free_frame_id(xbee, frame_id);
+        xbee_schedule_finish(scheduler, scheduled, XBEE_ERR_NOT_ADMITTED);
+        return;
+    }
+
+    int ret;
+    if(scheduler->transmit != NULL)
+    {
+        xbee_buffer_t buffer = { scheduled->frame.payload_size, scheduled->data };
+        ret = scheduler->transmit(scheduler->transmit_ptr, frame_id, &scheduled->address,
+                scheduled->option, 1, &buffer);
+    }
+    else
+    {
+        ret = xbee_transmit_encoded(xbee, &scheduled->frame);
+    }
+
+    if(ret != 0)
+    {
+        /* A stage may fail before the frame id reaches xbee_transmit_gather */
+        xbee_free_frame_id(xbee, frame_id);
+        xbee_schedule_finish(scheduler, scheduled, ret);
+        return;
+    }
+
+    scheduled->written = true;
+    scheduler->sent += 1;
+    if((int32_t)(scheduled->write_start - timer->deadline) > 0)
+    {
+        scheduler->late += 1;
+    }
+}
+
+static int xbee_schedule_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_schedule_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_scheduler_t * scheduler = ptr;
+
+    if(frame->api_id != XBEE_TRANSMIT_STATUS)
+    {
+        return 0;
+    }
+
+    xbee_scheduled_t * scheduled = xbee_schedule_find(scheduler, frame->frame_id);
+    if(scheduled == NULL || !scheduled->written)
+    {
+        return 0;
+    }
+
+    uint32_t now = xbee_now(xbee);
+    scheduled->error = (int32_t)(now - scheduled->target);
+
+    /* Failed frames went through every retry, their timing says nothing */
+    if(frame->frame.status == 0)
+    {
+        int32_t sample = 1000*(int32_t)(now - scheduled->write_start) -
+            (int32_t)xbee_schedule_size_time(scheduler, &scheduled->frame);
+        scheduler->residual += (sample - scheduler->residual) / 8;
+    }
+
+    xbee_schedule_finish(scheduler, scheduled, frame->frame.status);
+    return 0;
+}
+
+static void xbee_schedule_failed(void * ptr, xbee_interface_t * xbee,
+        uint8_t frame_id, int reason) SPECIAL_SECTION;
+static void xbee_schedule_failed(void * ptr, xbee_interface_t * xbee,
+        uint8_t frame_id, int reason)
+{
+    xbee_scheduler_t * scheduler = ptr;
+
+    /* A reset also fails frame ids allocated for frames not written yet */
+    xbee_scheduled_t * scheduled = xbee_schedule_find(scheduler, frame_id);
+    if(scheduled != NULL)
+    {
+        xbee_timer_cancel(xbee->timers, &scheduled->timer);
+        xbee_schedule_finish(scheduler, scheduled, -reason);
+    }
+}
+
+void xbee_scheduler_init(xbee_scheduler_t * scheduler, xbee_interface_t * xbee,
+        uint32_t baud, uint32_t bitrate, int32_t initial_residual)
+{
+    assert(scheduler);
+    assert(xbee);
+    assert(xbee->timers);
+    assert(baud > 0);
+    assert(bitrate > 0);
+
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->xbee = xbee;
+    scheduler->baud = baud;
+    scheduler->bitrate = bitrate;
+    scheduler->residual = initial_residual;
+
+    scheduler->handler.ptr = scheduler;
+    scheduler->handler.frame = xbee_schedule_frame;
+    scheduler->handler.failed = xbee_schedule_failed;
+    xbee_add_handler(xbee, &scheduler->handler);
+}
+
+void xbee_scheduler_stop(xbee_scheduler_t * scheduler)
+{
+    assert(scheduler);
+
+    while(scheduler->active != NULL)
+    {
+        xbee_scheduled_t * scheduled = scheduler->active;
+        scheduler->active = scheduled->next;
+        scheduled->next = NULL;
+
+        if(!scheduled->written)
+        {
+            xbee_timer_cancel(scheduler->xbee->timers, &scheduled->timer);
+            xbee_free_frame_id(scheduler->xbee, scheduled->frame.frame_id);
+        }
+    }
+
+    xbee_remove_handler(scheduler->xbee, &scheduler->handler);
+}
+
+void xbee_scheduler_set_admit(xbee_scheduler_t * scheduler,
+        xbee_port_admit_t admit, void * ptr, uint8_t priority)
+{
+    assert(scheduler);
+
+    scheduler->admit = admit;
+    scheduler->admit_ptr = ptr;
+    scheduler->priority = priority;
+}
+
+void xbee_scheduler_set_transmit(xbee_scheduler_t * scheduler,
+        xbee_port_transmit_t transmit, void * ptr)
+{
+    assert(scheduler);
+
+    scheduler->transmit = transmit;
+    scheduler->transmit_ptr = ptr;
+}
+
+uint32_t xbee_scheduler_lead(const xbee_scheduler_t * scheduler,
+        const xbee_encoded_frame_t * frame)
+{
+    assert(scheduler);
+    assert(frame);
+
+    int32_t lead = (int32_t)xbee_schedule_size_time(scheduler, frame) + scheduler->residual;
+    return lead > 0 ? (lead + 500) / 1000 : 0;
+}
+
+int xbee_schedule_transmit(xbee_scheduler_t * scheduler, xbee_scheduled_t * scheduled,
+        uint32_t target, const xbee_address_t * address, uint8_t option,
+        size_t data_size, const void * data,
+        xbee_scheduled_done_t done, void * ptr)
+{
+    assert(scheduler);
+    assert(scheduled);
+    assert(address);
+    assert(done);
+
+    uint8_t frame_id = xbee_alloc_frame_id(scheduler->xbee);
+    if(frame_id == 0)
+    {
+        return XBEE_ERR_NOT_READY;
+    }
+
+    memset(scheduled, 0, sizeof(*scheduled));
+    int ret = xbee_encode_transmit(&scheduled->frame, frame_id, address, option,
+            data_size, data);
+    if(ret != 0)
+    {
+        xbee_free_frame_id(scheduler->xbee, frame_id);
+        return ret;
+    }
+
+    scheduled->address = *address;
+    scheduled->option = option;
+    if(data_size > 0)
+    {
+        memcpy(scheduled->data, data, data_size);
+    }
+    scheduled->scheduler = scheduler;
+    scheduled->target = target;
+    scheduled->done = done;
+    scheduled->ptr = ptr;
+    scheduled->next = scheduler->active;
+    scheduler->active = scheduled;
+
+    xbee_timer_init(&scheduled->timer, xbee_schedule_expired, scheduled);
+    xbee_timer_start(scheduler->xbee->timers, &scheduled->timer,
+            target - xbee_scheduler_lead(scheduler, &scheduled->frame));
+    return 0;
+}
+
+bool xbee_schedule_cancel(xbee_scheduled_t * scheduled)
+{
+    assert(scheduled);
+
+    xbee_scheduler_t * scheduler = scheduled->scheduler;
+    if(!xbee_timer_pending(&scheduled->timer))
+    {
+        return false;
+    }
+
+    xbee_timer_cancel(scheduler->xbee->timers, &scheduled->timer);
+    xbee_schedule_remove(scheduler, scheduled);
+    xbee_free_frame_id(scheduler->xbee, scheduled->frame.frame_id);
+    return true;
+}
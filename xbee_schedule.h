@@ -0,0 +1,133 @@
+#ifndef _XBEE_SCHEDULE_H_
+#define _XBEE_SCHEDULE_H_
+
+#include "xbee_port.h"
+#include "xbee_timer.h"
+
+#define XBEE_ERR_NOT_ADMITTED (-35)     /*! Admission check refused the frame at its deadline */
+
+typedef struct xbee_scheduler xbee_scheduler_t;
+typedef struct xbee_scheduled xbee_scheduled_t;
+
+/*! Called once a scheduled frame is done
+ *
+ * \param status XBEE_TRANSMIT_STATUS status, -reason (XBEE_FAIL_*) if the
+ *        library failed the frame, XBEE_ERR_NOT_ADMITTED, or error from
+ *        xbee_transmit_encoded or the scheduler's transmit stage.
+ *        scheduled->error is valid when status is 0.
+ */
+typedef void (*xbee_scheduled_done_t)(void * ptr, xbee_scheduled_t * scheduled, int status);
+
+/*! Frame to transmit at a given time, owned by the caller until done */
+struct xbee_scheduled {
+    xbee_timer_t timer;
+    xbee_scheduler_t * scheduler;
+    xbee_scheduled_t * next;
+
+    xbee_encoded_frame_t frame;
+    xbee_address_t address;
+    uint8_t option;
+    uint8_t data[XBEE_MAX_RF_PAYLOAD];  /*! Payload for the transmit stage, if set */
+    uint32_t target;            /*! When XBEE_TRANSMIT_STATUS should arrive */
+    bool written;
+    uint32_t write_start;
+    int32_t error;              /*! Status arrival minus target, ms */
+
+    xbee_scheduled_done_t done;
+    void * ptr;
+};
+
+/*! Transmits pre-encoded frames at set times
+ *
+ * A frame is encoded when it is scheduled, and written whole when its
+ * timer expires, so nothing is left to compute at the deadline.  The
+ * target is when the XBee reports the frame sent: its XBEE_TRANSMIT_STATUS
+ * follows the MAC ack, so the peer received it one ack time earlier.
+ *
+ * The timer is set ahead of the target by the frame's lead: its UART
+ * time at baud and its payload's airtime at bitrate, which scale with
+ * size, plus a measured residual covering the rest (bytes already queued
+ * in the UART driver, the XBee's processing, CCA backoff, headers and the
+ * ack).  The residual is the status arrival less the write start and the
+ * size terms, smoothed over successful frames, 1/8 per sample, starting
+ * from initial_residual us.
+ *
+ * With an admission check set, e.g. xbee_duty_cycle_admit, a frame is
+ * checked at its deadline and finished with XBEE_ERR_NOT_ADMITTED if
+ * refused.  With a transmit stage set, e.g. xbee_duty_cycle_transmit, the
+ * frame is written through it rather than from its encoding, so the
+ * stage charges it like the mux's frames; the residual takes in the
+ * stage's time.
+ *
+ * Statuses are left for later handlers and the caller of xbee_poll, so
+ * observers and the mux's stages see the scheduler's frames complete.
+ *
+ * Each frame's send-time error, status arrival minus target, is reported
+ * through its done callback.  Accuracy is bounded by the clock's 1 ms
+ * resolution and how often xbee_poll runs the timers, and frames written
+ * just before a scheduled one delay it.  The XBee must have timers set
+ * with xbee_set_frame_timeout.
+ */
+struct xbee_scheduler {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+    xbee_scheduled_t * active;      /*! Scheduled and not done */
+
+    uint32_t baud;
+    uint32_t bitrate;
+    int32_t residual;               /*! Smoothed lead not explained by size, us */
+
+    xbee_port_admit_t admit;        /*! Optional, checked at each deadline */
+    void * admit_ptr;
+    uint8_t priority;               /*! Passed to admit, as for a port */
+    xbee_port_transmit_t transmit;  /*! Optional, writes frames instead of xbee_transmit_encoded */
+    void * transmit_ptr;
+
+    uint32_t sent;
+    uint32_t late;                  /*! Written after target less lead, e.g. target too close */
+    uint32_t failed;
+    uint32_t refused;               /*! Not admitted at their deadline */
+};
+
+/*! \param baud UART bits per second, 10 bits per byte
+ * \param bitrate RF bits per second, e.g. 250000
+ */
+void xbee_scheduler_init(xbee_scheduler_t * scheduler, xbee_interface_t * xbee,
+        uint32_t baud, uint32_t bitrate, int32_t initial_residual) SPECIAL_SECTION;
+
+/*! Cancels every active frame, without calling done */
+void xbee_scheduler_stop(xbee_scheduler_t * scheduler) SPECIAL_SECTION;
+
+/*! Sets the admission check applied to each frame at its deadline, as
+ * xbee_port_mux_set_admit does for ports */
+void xbee_scheduler_set_admit(xbee_scheduler_t * scheduler,
+        xbee_port_admit_t admit, void * ptr, uint8_t priority) SPECIAL_SECTION;
+
+/*! Sets the stage frames are written through, as xbee_port_mux_set_transmit
+ * does for ports */
+void xbee_scheduler_set_transmit(xbee_scheduler_t * scheduler,
+        xbee_port_transmit_t transmit, void * ptr) SPECIAL_SECTION;
+
+/*! Returns how long before its target frame would be written now, ms */
+uint32_t xbee_scheduler_lead(const xbee_scheduler_t * scheduler,
+        const xbee_encoded_frame_t * frame) SPECIAL_SECTION;
+
+/*! Encodes a transmit frame and schedules it so its status arrives at target
+ *
+ * A target closer than the frame's lead is written on the next xbee_poll.
+ *
+ * \return 0 if scheduled, XBEE_ERR_NOT_READY if no frame id is free,
+ *         XBEE_ERR_TOO_LARGE if data is over XBEE_MAX_RF_PAYLOAD
+ */
+int xbee_schedule_transmit(xbee_scheduler_t * scheduler, xbee_scheduled_t * scheduled,
+        uint32_t target, const xbee_address_t * address, uint8_t option,
+        size_t data_size, const void * data,
+        xbee_scheduled_done_t done, void * ptr) SPECIAL_SECTION;
+
+/*! Cancels a frame not written yet, without calling done
+ *
+ * \return true if cancelled, false if already written or done
+ */
+bool xbee_schedule_cancel(xbee_scheduled_t * scheduled) SPECIAL_SECTION;
+
+#endif /* _XBEE_SCHEDULE_H_ */
@@ -0,0 +1,312 @@
+#define _DEFAULT_SOURCE
+#include <assert.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xbee_schedule.h"
+#include "xbee_sim.h"
+#include "xbee_tunnel_unix.h"
+
+/* The host runs on the slave side of a pseudo-terminal and a child
+ * process runs a simulated XBee on the master side, so every byte
+ * crosses the kernel and both ends keep real time.  The module holds the
+ * channel for 2 ms plus the frame's bytes at 250 kbps before it reports
+ * a frame sent.  Each frame's error is when its status arrived less its
+ * target, in us.  "at target" writes each frame when its target comes
+ * round, "scheduled" uses xbee_scheduler_t. */
+
+#define BENCH_FRAMES (500)
+#define BENCH_PERIOD (20)           /* ms between targets */
+#define BENCH_AHEAD (50)            /* ms from scheduling to target */
+#define BENCH_PAYLOAD (60)
+#define BENCH_BAUD (115200)
+#define BENCH_BITRATE (250000)
+
+typedef struct {
+    xbee_uart_interface_t uart;
+    xbee_interface_t xbee;
+    uint8_t recv[2*XBEE_REC_BUF_SIZE];
+    int fd;
+
+    xbee_timer_wheel_t wheel;
+    xbee_timer_t frame_timers[256];
+    xbee_scheduler_t scheduler;
+    xbee_scheduled_t scheduled[BENCH_AHEAD/BENCH_PERIOD + 2];
+    xbee_handler_t handler;
+
+    /* At target */
+    xbee_timer_t timers[BENCH_AHEAD/BENCH_PERIOD + 2];
+    xbee_encoded_frame_t frames[BENCH_AHEAD/BENCH_PERIOD + 2];
+    uint32_t targets[256];
+
+    int32_t errors[BENCH_FRAMES];
+    size_t done;
+} bench_t;
+
+static bench_t bench;
+
+static uint64_t bench_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static uint32_t bench_clock(void * ptr)
+{
+    return bench_us()/1000;
+}
+
+static void bench_sleep(void * ptr, uint32_t ms)
+{
+    usleep(ms*1000);
+}
+
+/* Module side, in the child */
+
+static uint64_t bench_release;      /*! us before which the module says nothing */
+
+static bool bench_request(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    if(frame[0] == XBEE_TRANSMIT_16_BIT || frame[0] == XBEE_TRANSMIT)
+    {
+        uint64_t now = bench_us();
+        bench_release = (bench_release > now ? bench_release : now) +
+            2000 + size*8*1000000/BENCH_BITRATE;
+    }
+
+    return false;
+}
+
+static int bench_no_read(void * ptr, void * buf, size_t nbyte)
+{
+    return 0;
+}
+
+/*! Runs the module until the host closes its end or parent exits
+ *
+ * xbee_pty_read reads a closed slave side as nothing to read, so the
+ * parent going away is only seen by it no longer being the parent.
+ */
+static void bench_module(int fd, pid_t parent)
+{
+    static xbee_sim_t sim;
+    assert(xbee_sim_init(&sim, 2, 31) == 0);
+    sim.request = bench_request;
+
+    /* What the module has for its host goes to the pseudo-terminal */
+    xbee_sim_node_t * node = &sim.nodes[0];
+    node->uart.read = bench_no_read;
+
+    uint32_t base = sim.clock.now;
+    uint32_t start = bench_clock(NULL);
+    while(getppid() == parent)
+    {
+        sim.clock.now = base + (bench_clock(NULL) - start);
+
+        uint8_t buf[256];
+        int n = xbee_pty_read(&fd, buf, sizeof(buf));
+        if(n < 0)
+        {
+            return;
+        }
+        if(n > 0)
+        {
+            node->uart.write(node->uart.ptr, buf, n);
+        }
+        xbee_sim_step(&sim);
+
+        xbee_sim_fifo_t * fifo = &node->to_host;
+        if(fifo->head < fifo->size && bench_us() >= bench_release)
+        {
+            n = xbee_pty_write(&fd, fifo->data + fifo->head, fifo->size - fifo->head);
+            if(n < 0)
+            {
+                return;
+            }
+            fifo->head += n;
+            if(fifo->head == fifo->size)
+            {
+                fifo->head = 0;
+                fifo->size = 0;
+            }
+        }
+
+        usleep(50);
+    }
+}
+
+/* Host side */
+
+static void bench_record(uint32_t target)
+{
+    int64_t error = (int64_t)bench_us() - (int64_t)target*1000;
+    if(bench.done < BENCH_FRAMES)
+    {
+        bench.errors[bench.done] = error;
+    }
+    bench.done += 1;
+}
+
+static void bench_done(void * ptr, xbee_scheduled_t * scheduled, int status)
+{
+    assert(status == 0);
+    bench_record(scheduled->target);
+}
+
+static void bench_expired(void * ptr, xbee_timer_t * timer)
+{
+    xbee_encoded_frame_t * frame = ptr;
+    bench.targets[frame->frame_id] = timer->deadline;
+    assert(xbee_transmit_encoded(&bench.xbee, frame) == 0);
+}
+
+static int bench_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame)
+{
+    if(frame->api_id == XBEE_TRANSMIT_STATUS && bench.targets[frame->frame_id] != 0)
+    {
+        assert(frame->frame.status == 0);
+        bench_record(bench.targets[frame->frame_id]);
+        bench.targets[frame->frame_id] = 0;
+    }
+
+    return 0;
+}
+
+static void bench_open(const char * name)
+{
+    bench.fd = open(name, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    assert(bench.fd >= 0);
+
+    struct termios tty;
+    assert(tcgetattr(bench.fd, &tty) == 0);
+    cfmakeraw(&tty);
+    assert(tcsetattr(bench.fd, TCSANOW, &tty) == 0);
+
+    bench.uart.ptr = &bench.fd;
+    bench.uart.write = xbee_pty_write;
+    bench.uart.read = xbee_pty_read;
+    bench.uart.clock = bench_clock;
+    bench.uart.sleep_ms = bench_sleep;
+    assert(xbee_open(&bench.xbee, &bench.uart, sizeof(bench.recv), bench.recv) == 0);
+
+    xbee_timer_wheel_init(&bench.wheel, xbee_now(&bench.xbee));
+    xbee_set_frame_timeout(&bench.xbee, &bench.wheel, 1000, bench.frame_timers);
+    xbee_scheduler_init(&bench.scheduler, &bench.xbee, BENCH_BAUD, BENCH_BITRATE, 0);
+
+    bench.handler.frame = bench_frame;
+    xbee_add_handler(&bench.xbee, &bench.handler);
+}
+
+static int bench_compare(const void * a, const void * b)
+{
+    int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_run(const char * name, bool scheduled)
+{
+    xbee_address_t peer = {XBEE_16_BIT, {.network_address = 2}};
+    uint8_t payload[BENCH_PAYLOAD];
+    memset(payload, 'x', sizeof(payload));
+
+    bench.done = 0;
+    uint32_t next = xbee_now(&bench.xbee);
+    for(size_t sent = 0; bench.done < BENCH_FRAMES; )
+    {
+        uint32_t now = xbee_now(&bench.xbee);
+        if(sent < BENCH_FRAMES && (int32_t)(now - next) >= 0)
+        {
+            size_t slot = sent % (BENCH_AHEAD/BENCH_PERIOD + 2);
+            uint32_t target = now + BENCH_AHEAD;
+            if(scheduled)
+            {
+                assert(xbee_schedule_transmit(&bench.scheduler, &bench.scheduled[slot],
+                        target, &peer, 0, sizeof(payload), payload, bench_done, NULL) == 0);
+            }
+            else
+            {
+                uint8_t frame_id = xbee_alloc_frame_id(&bench.xbee);
+                assert(frame_id != 0);
+                assert(xbee_encode_transmit(&bench.frames[slot], frame_id, &peer, 0,
+                        sizeof(payload), payload) == 0);
+                xbee_timer_init(&bench.timers[slot], bench_expired, &bench.frames[slot]);
+                xbee_timer_start(&bench.wheel, &bench.timers[slot], target);
+            }
+            sent += 1;
+            next += BENCH_PERIOD;
+        }
+
+        uint8_t frame[XBEE_MAX_FRAME_SIZE];
+        xbee_parsed_frame_t parsed;
+        while(xbee_poll(&bench.xbee, sizeof(frame), frame, &parsed) > 0)
+        {
+        }
+        usleep(50);
+    }
+
+    /* The first frames are skipped while the scheduler learns its lead */
+    size_t skip = BENCH_FRAMES/10;
+    size_t count = BENCH_FRAMES - skip;
+    int32_t * errors = bench.errors + skip;
+    double mean = 0;
+    size_t within = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        mean += errors[i];
+        within += errors[i] >= -1000 && errors[i] <= 1000;
+    }
+    mean /= count;
+
+    qsort(errors, count, sizeof(errors[0]), bench_compare);
+    printf("  %-10s %8.0f %8d %8d %8d %8d %7.1f%%\n", name, mean,
+            errors[0], errors[count/2], errors[count*99/100], errors[count - 1],
+            100.0*within/count);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    char name[64];
+    int master = xbee_pty_open(name, sizeof(name));
+    assert(master >= 0);
+
+    pid_t parent = getpid();
+    pid_t child = fork();
+    assert(child >= 0);
+    if(child == 0)
+    {
+        bench_module(master, parent);
+        _exit(0);
+    }
+    close(master);
+
+    bench_open(name);
+
+    printf("%u frames of %u bytes, targets %u ms ahead, status error in us\n",
+            BENCH_FRAMES, BENCH_PAYLOAD, BENCH_AHEAD);
+    printf("  %-10s %8s %8s %8s %8s %8s %8s\n", "", "mean", "min", "median", "p99", "max",
+            "|e|<=1ms");
+    bench_run("at target", false);
+    bench_run("scheduled", true);
+    printf("  lead learnt: %u ms, residual %d us, late %u\n",
+            xbee_scheduler_lead(&bench.scheduler, &bench.frames[0]),
+            bench.scheduler.residual, bench.scheduler.late);
+
+    close(bench.fd);
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_duty_cycle.h"
+#include "xbee_schedule.h"
+#include "xbee_sim.h"
+
+#define TEST_BITRATE (250000)
+#define TEST_RETRIES (3)
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_timer_wheel_t wheel;
+    xbee_timer_t frame_timers[256];
+    xbee_scheduler_t scheduler;
+    xbee_scheduled_t scheduled[2];
+    xbee_handler_t observer;
+    xbee_duty_cycle_t duty;
+
+    size_t done;
+    int status;
+    size_t statuses;            /*! Seen by the handler after the scheduler */
+} test_setup_t;
+
+static test_setup_t test;
+
+static int test_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    return xbee_transmit_gather(ptr, frame_id, address, option, count, buffers);
+}
+
+static bool test_refuse(void * ptr, const xbee_address_t * address,
+        uint8_t priority, size_t size)
+{
+    return false;
+}
+
+static void test_done(void * ptr, xbee_scheduled_t * scheduled, int status)
+{
+    test.done += 1;
+    test.status = status;
+}
+
+static int test_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame)
+{
+    if(frame->api_id == XBEE_TRANSMIT_STATUS)
+    {
+        test.statuses += 1;
+    }
+
+    return 0;
+}
+
+static void test_setup(void)
+{
+    memset(&test, 0, sizeof(test));
+    assert(xbee_sim_init(&test.sim, 2, 29) == 0);
+
+    xbee_interface_t * xbee = &test.sim.nodes[0].xbee;
+    xbee_timer_wheel_init(&test.wheel, test.sim.clock.now);
+    xbee_set_frame_timeout(xbee, &test.wheel, 1000, test.frame_timers);
+    xbee_scheduler_init(&test.scheduler, xbee, 115200, TEST_BITRATE, 0);
+
+    test.observer.frame = test_frame;
+    xbee_add_handler(xbee, &test.observer);
+}
+
+static int test_schedule(size_t i, uint32_t delay)
+{
+    xbee_address_t peer;
+    xbee_sim_address16(&test.sim, 1, &peer);
+    return xbee_schedule_transmit(&test.scheduler, &test.scheduled[i],
+            test.sim.clock.now + delay, &peer, 0, 5, "hello", test_done, NULL);
+}
+
+/*! Frame ids that can be allocated, every one held is freed again */
+static size_t test_free_frame_ids(xbee_interface_t * xbee)
+{
+    uint8_t held[255];
+    size_t count = 0;
+    for(uint8_t id; (id = xbee_alloc_frame_id(xbee)) != 0; )
+    {
+        held[count++] = id;
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        xbee_free_frame_id(xbee, held[i]);
+    }
+
+    return count;
+}
+
+/*! A scheduled frame's status still reaches the handlers after the
+ * scheduler */
+void test_schedule_status_passed_on(void)
+{
+    test_setup();
+
+    assert(test_schedule(0, 20) == 0);
+    xbee_sim_advance(&test.sim, 10);
+    assert(test.done == 0);
+    xbee_sim_advance(&test.sim, 20);
+
+    assert(test.done == 1 && test.status == 0);
+    assert(test.scheduler.sent == 1);
+    assert(test.statuses == 1);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A frame refused at its deadline is never written and gives up its id */
+void test_schedule_refused(void)
+{
+    test_setup();
+    xbee_interface_t * xbee = &test.sim.nodes[0].xbee;
+    xbee_scheduler_set_admit(&test.scheduler, test_refuse, NULL, 0);
+
+    uint32_t frames = test.sim.nodes[0].frames_in;
+    assert(test_schedule(0, 10) == 0);
+    xbee_sim_advance(&test.sim, 20);
+
+    assert(test.done == 1 && test.status == XBEE_ERR_NOT_ADMITTED);
+    assert(test.scheduler.refused == 1 && test.scheduler.sent == 0);
+    assert(test.sim.nodes[0].frames_in == frames);
+    assert(test_free_frame_ids(xbee) == 255);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Frames through the duty cycle stage are charged, and count against
+ * the limit for the next */
+void test_schedule_duty_cycle(void)
+{
+    test_setup();
+    xbee_interface_t * xbee = &test.sim.nodes[0].xbee;
+
+    /* Room for one frame with every retry, not for a second after it */
+    xbee_duty_cycle_t * duty = &test.duty;
+    xbee_duty_cycle_init(duty, xbee, TEST_BITRATE, 0, TEST_RETRIES,
+            1000, 0, 0, 0, test_transmit, xbee);
+    uint32_t airtime = xbee_duty_cycle_airtime(duty, 5);
+    duty->limit = (1 + TEST_RETRIES)*airtime + airtime/2;
+    xbee_scheduler_set_admit(&test.scheduler, xbee_duty_cycle_admit, duty, 0);
+    xbee_scheduler_set_transmit(&test.scheduler, xbee_duty_cycle_transmit, duty);
+
+    assert(test_schedule(0, 10) == 0);
+    assert(test_schedule(1, 20) == 0);
+    xbee_sim_advance(&test.sim, 15);
+    assert(test.done == 1 && test.status == 0);
+    assert(duty->used == airtime);
+
+    xbee_sim_advance(&test.sim, 15);
+    assert(test.done == 2 && test.status == XBEE_ERR_NOT_ADMITTED);
+    assert(duty->deferred == 1);
+    assert(test.statuses == 1);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_schedule_status_passed_on();
+    test_schedule_refused();
+    test_schedule_duty_cycle();
+
+    return 0;
+}
@@ -0,0 +1,661 @@
+/*! Message schema compiler
+ *
+ *     xbee_schema <schema> <output>
+ *
+ * writes <output>.h and <output>.c with a struct, encoder, decoder and
+ * zero-copy accessors per message, built on xbee_pack.h.  A schema lists
+ * messages, each with a one byte id sent first and its fields in order:
+ *
+ *     # Comments run to the end of the line, C comments work too
+ *     message sensor_report = 0x10 {
+ *         u12 temperature;        # unsigned, 1 to 32 bits
+ *         i10 offset;             # two's complement, 1 to 32 bits
+ *         bool alarm;             # 1 bit
+ *         u8 serial[6];           # fixed count of any fixed width type
+ *         varint uptime;          # 32 bit LEB128, 1 to 5 bytes
+ *         svarint delta;          # 32 bit zigzag LEB128
+ *     }
+ *
+ * Fields are bit-packed with no padding.  The worst case size, counting
+ * 5 bytes per varint, must fit XBEE_MAX_RF_PAYLOAD here and
+ * XBEE_SCHEMA_PAYLOAD_LIMIT when the output is compiled.
+ *
+ * Fields ahead of the first varint sit at a fixed bit offset, and get a
+ * name_get_field(buf) accessor reading straight from a received payload
+ * once name_check passes.  A u8 array that starts on a byte boundary is
+ * returned as a pointer into the payload.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+
+#include "xbee.h"
+#include "xbee_pack.h"
+
+#define SCHEMA_MAX_INPUT (64*1024)
+#define SCHEMA_MAX_NAME (48)
+#define SCHEMA_MAX_MESSAGES (64)
+#define SCHEMA_MAX_FIELDS (32)
+
+typedef enum {
+    FIELD_UINT,
+    FIELD_INT,
+    FIELD_BOOL,
+    FIELD_VARINT,
+    FIELD_SVARINT,
+} field_kind_t;
+
+typedef struct {
+    char name[SCHEMA_MAX_NAME];
+    field_kind_t kind;
+    unsigned width;             /*! Bits per element, XBEE_PACK_VARINT_MAX_BITS for varints */
+    unsigned count;             /*! Elements, 0 if not an array */
+    long offset;                /*! Bit offset in the payload, -1 after a varint */
+} field_t;
+
+typedef struct {
+    char name[SCHEMA_MAX_NAME];
+    unsigned id;
+    field_t fields[SCHEMA_MAX_FIELDS];
+    size_t field_count;
+    unsigned max_bits;
+    unsigned fixed_bits;        /*! Id and fields at fixed offsets */
+} message_t;
+
+static const char * schema_path;
+static char schema_text[SCHEMA_MAX_INPUT + 1];
+static const char * cursor;
+static int line = 1;
+
+static char token[SCHEMA_MAX_NAME];
+
+static message_t messages[SCHEMA_MAX_MESSAGES];
+static size_t message_count;
+
+static void fail(const char * format, ...)
+{
+    va_list args;
+
+    fprintf(stderr, "%s:%d: ", schema_path, line);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+static void skip_space(void)
+{
+    for(;;)
+    {
+        if(*cursor == '\n')
+        {
+            line += 1;
+            cursor += 1;
+        }
+        else if(isspace((unsigned char)*cursor))
+        {
+            cursor += 1;
+        }
+        else if(*cursor == '#' || (cursor[0] == '/' && cursor[1] == '/'))
+        {
+            while(*cursor != '\0' && *cursor != '\n')
+            {
+                cursor += 1;
+            }
+        }
+        else if(cursor[0] == '/' && cursor[1] == '*')
+        {
+            cursor += 2;
+            while(*cursor != '\0' && !(cursor[0] == '*' && cursor[1] == '/'))
+            {
+                line += *cursor == '\n';
+                cursor += 1;
+            }
+            if(*cursor == '\0')
+            {
+                fail("unterminated comment");
+            }
+            cursor += 2;
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+/*! Reads the next identifier, number or punctuation character into token
+ *
+ * \return false at the end of input
+ */
+static int next_token(void)
+{
+    size_t size = 0;
+
+    skip_space();
+    if(*cursor == '\0')
+    {
+        token[0] = '\0';
+        return 0;
+    }
+
+    if(isalnum((unsigned char)*cursor) || *cursor == '_')
+    {
+        while(isalnum((unsigned char)*cursor) || *cursor == '_')
+        {
+            if(size + 1 == sizeof(token))
+            {
+                fail("name too long");
+            }
+            token[size++] = *cursor++;
+        }
+    }
+    else
+    {
+        token[size++] = *cursor++;
+    }
+
+    token[size] = '\0';
+    return 1;
+}
+
+static void expect(const char * expected)
+{
+    if(!next_token() || strcmp(token, expected) != 0)
+    {
+        fail("expected '%s', got '%s'", expected, token);
+    }
+}
+
+static void expect_name(char * name)
+{
+    if(!next_token() || !(isalpha((unsigned char)token[0]) || token[0] == '_'))
+    {
+        fail("expected name, got '%s'", token);
+    }
+    strcpy(name, token);
+}
+
+static unsigned long expect_number(unsigned long max)
+{
+    char * end;
+
+    if(!next_token() || !isdigit((unsigned char)token[0]))
+    {
+        fail("expected number, got '%s'", token);
+    }
+
+    unsigned long value = strtoul(token, &end, 0);
+    if(*end != '\0' || value > max)
+    {
+        fail("bad number '%s', at most %lu", token, max);
+    }
+
+    return value;
+}
+
+/*! Parses a type name such as u12, i7, bool or varint */
+static void parse_type(field_t * field)
+{
+    char * end;
+
+    if(strcmp(token, "bool") == 0)
+    {
+        field->kind = FIELD_BOOL;
+        field->width = 1;
+        return;
+    }
+    if(strcmp(token, "varint") == 0 || strcmp(token, "svarint") == 0)
+    {
+        field->kind = token[0] == 's' ? FIELD_SVARINT : FIELD_VARINT;
+        field->width = XBEE_PACK_VARINT_MAX_BITS;
+        return;
+    }
+    if((token[0] == 'u' || token[0] == 'i') && isdigit((unsigned char)token[1]))
+    {
+        field->kind = token[0] == 'u' ? FIELD_UINT : FIELD_INT;
+        field->width = strtoul(token + 1, &end, 10);
+        if(*end == '\0' && field->width >= 1 && field->width <= 32)
+        {
+            return;
+        }
+    }
+
+    fail("unknown type '%s'", token);
+}
+
+static void parse_message(void)
+{
+    if(message_count == SCHEMA_MAX_MESSAGES)
+    {
+        fail("more than %d messages", SCHEMA_MAX_MESSAGES);
+    }
+
+    message_t * message = &messages[message_count];
+    expect_name(message->name);
+    expect("=");
+    message->id = expect_number(0xFF);
+    expect("{");
+
+    for(size_t i = 0; i < message_count; ++i)
+    {
+        if(strcmp(messages[i].name, message->name) == 0)
+        {
+            fail("message '%s' defined twice", message->name);
+        }
+        if(messages[i].id == message->id)
+        {
+            fail("message '%s' reuses id 0x%02X of '%s'",
+                    message->name, message->id, messages[i].name);
+        }
+    }
+
+    message->max_bits = 8;
+    message->fixed_bits = 8;
+    int fixed = 1;
+
+    while(next_token() && strcmp(token, "}") != 0)
+    {
+        if(message->field_count == SCHEMA_MAX_FIELDS)
+        {
+            fail("more than %d fields", SCHEMA_MAX_FIELDS);
+        }
+
+        field_t * field = &message->fields[message->field_count];
+        parse_type(field);
+        expect_name(field->name);
+
+        for(size_t i = 0; i < message->field_count; ++i)
+        {
+            if(strcmp(message->fields[i].name, field->name) == 0)
+            {
+                fail("field '%s' defined twice", field->name);
+            }
+        }
+
+        if(!next_token())
+        {
+            fail("expected ';'");
+        }
+        if(strcmp(token, "[") == 0)
+        {
+            field->count = expect_number(8*XBEE_MAX_RF_PAYLOAD);
+            if(field->count == 0)
+            {
+                fail("empty array '%s'", field->name);
+            }
+            expect("]");
+            expect(";");
+        }
+        else if(strcmp(token, ";") != 0)
+        {
+            fail("expected ';', got '%s'", token);
+        }
+
+        unsigned elements = field->count > 0 ? field->count : 1;
+        fixed = fixed && field->kind != FIELD_VARINT && field->kind != FIELD_SVARINT;
+        field->offset = fixed ? (long)message->max_bits : -1;
+        message->max_bits += elements*field->width;
+        if(fixed)
+        {
+            message->fixed_bits = message->max_bits;
+        }
+        message->field_count += 1;
+
+        if((message->max_bits + 7) / 8 > XBEE_MAX_RF_PAYLOAD)
+        {
+            fail("message '%s' may take more than %d bytes",
+                    message->name, XBEE_MAX_RF_PAYLOAD);
+        }
+    }
+
+    if(strcmp(token, "}") != 0)
+    {
+        fail("expected '}' closing message '%s'", message->name);
+    }
+
+    message_count += 1;
+}
+
+static void parse(void)
+{
+    cursor = schema_text;
+
+    while(next_token())
+    {
+        if(strcmp(token, "message") != 0)
+        {
+            fail("expected 'message', got '%s'", token);
+        }
+        parse_message();
+
+        /* Allow C style ';' after the closing brace */
+        skip_space();
+        if(*cursor == ';')
+        {
+            cursor += 1;
+        }
+    }
+}
+
+static void upper(char * out, const char * in)
+{
+    do
+    {
+        *out++ = isalnum((unsigned char)*in) ? toupper((unsigned char)*in) : '_';
+    }
+    while(*in++ != '\0');
+    out[-1] = '\0';
+}
+
+static const char * c_type(const field_t * field)
+{
+    switch(field->kind)
+    {
+    case FIELD_BOOL:
+        return "bool";
+    case FIELD_VARINT:
+        return "uint32_t";
+    case FIELD_SVARINT:
+        return "int32_t";
+    case FIELD_UINT:
+        return field->width <= 8 ? "uint8_t" : field->width <= 16 ? "uint16_t" : "uint32_t";
+    case FIELD_INT:
+        return field->width <= 8 ? "int8_t" : field->width <= 16 ? "int16_t" : "int32_t";
+    }
+
+    return "";
+}
+
+/*! Writes the encode or decode statement for one element, value is the
+ * C expression naming it */
+static void write_field_code(FILE * out, const field_t * field, const char * value, int encode)
+{
+    switch(field->kind)
+    {
+    case FIELD_BOOL:
+        if(encode)
+        {
+            fprintf(out, "xbee_pack_uint(&packer, 1, %s ? 1 : 0);\n", value);
+        }
+        else
+        {
+            fprintf(out, "%s = xbee_unpack_uint(&unpacker, 1) != 0;\n", value);
+        }
+        break;
+    case FIELD_UINT:
+        if(encode)
+        {
+            fprintf(out, "xbee_pack_uint(&packer, %u, %s);\n", field->width, value);
+        }
+        else
+        {
+            fprintf(out, "%s = xbee_unpack_uint(&unpacker, %u);\n", value, field->width);
+        }
+        break;
+    case FIELD_INT:
+        if(encode)
+        {
+            fprintf(out, "xbee_pack_int(&packer, %u, %s);\n", field->width, value);
+        }
+        else
+        {
+            fprintf(out, "%s = xbee_unpack_int(&unpacker, %u);\n", value, field->width);
+        }
+        break;
+    case FIELD_VARINT:
+        if(encode)
+        {
+            fprintf(out, "xbee_pack_varint(&packer, %s);\n", value);
+        }
+        else
+        {
+            fprintf(out, "%s = xbee_unpack_varint(&unpacker);\n", value);
+        }
+        break;
+    case FIELD_SVARINT:
+        if(encode)
+        {
+            fprintf(out, "xbee_pack_svarint(&packer, %s);\n", value);
+        }
+        else
+        {
+            fprintf(out, "%s = xbee_unpack_svarint(&unpacker);\n", value);
+        }
+        break;
+    }
+}
+
+static void write_fields(FILE * out, const message_t * message, int encode)
+{
+    char value[SCHEMA_MAX_NAME + 16];
+
+    for(size_t i = 0; i < message->field_count; ++i)
+    {
+        const field_t * field = &message->fields[i];
+
+        if(field->count > 0)
+        {
+            snprintf(value, sizeof(value), "msg->%s[i]", field->name);
+            fprintf(out, "    for(size_t i = 0; i < %u; ++i)\n    {\n        ", field->count);
+            write_field_code(out, field, value, encode);
+            fprintf(out, "    }\n");
+        }
+        else
+        {
+            snprintf(value, sizeof(value), "msg->%s", field->name);
+            fprintf(out, "    ");
+            write_field_code(out, field, value, encode);
+        }
+    }
+}
+
+static void write_accessor(FILE * out, const message_t * message, const field_t * field)
+{
+    const char * type = c_type(field);
+    const char * index = field->count > 0 ? ", size_t i" : "";
+    char offset[64];
+
+    if(field->count > 0 && field->kind == FIELD_UINT && field->width == 8 && field->offset % 8 == 0)
+    {
+        fprintf(out, "\nstatic inline const uint8_t * %s_get_%s(const void * buf)\n{\n"
+                "    return (const uint8_t *)buf + %ld;\n}\n",
+                message->name, field->name, field->offset / 8);
+        return;
+    }
+
+    if(field->count > 0)
+    {
+        snprintf(offset, sizeof(offset), "%ld + %u*i", field->offset, field->width);
+    }
+    else
+    {
+        snprintf(offset, sizeof(offset), "%ld", field->offset);
+    }
+
+    fprintf(out, "\nstatic inline %s %s_get_%s(const void * buf%s)\n{\n",
+            type, message->name, field->name, index);
+    if(field->count > 0)
+    {
+        fprintf(out, "    assert(i < %u);\n", field->count);
+    }
+    switch(field->kind)
+    {
+    case FIELD_BOOL:
+        fprintf(out, "    return xbee_unpack_bits(buf, %s, 1) != 0;\n", offset);
+        break;
+    case FIELD_INT:
+        fprintf(out, "    return xbee_sign_extend(xbee_unpack_bits(buf, %s, %u), %u);\n",
+                offset, field->width, field->width);
+        break;
+    default:
+        fprintf(out, "    return xbee_unpack_bits(buf, %s, %u);\n", offset, field->width);
+        break;
+    }
+    fprintf(out, "}\n");
+}
+
+static void write_header(FILE * out, const char * guard)
+{
+    char name[SCHEMA_MAX_NAME];
+
+    fprintf(out, "/* Generated by xbee_schema from %s, do not edit */\n", schema_path);
+    fprintf(out, "#ifndef _%s_H_\n#define _%s_H_\n\n", guard, guard);
+    fprintf(out, "#include <assert.h>\n#include \"xbee_pack.h\"\n");
+
+    for(size_t m = 0; m < message_count; ++m)
+    {
+        const message_t * message = &messages[m];
+        upper(name, message->name);
+
+        fprintf(out, "\n#define %s_ID (0x%02X)\n", name, message->id);
+        fprintf(out, "#define %s_MAX_SIZE (%u)\n", name, (message->max_bits + 7) / 8);
+        fprintf(out, "#define %s_FIXED_SIZE (%u)\n", name, (message->fixed_bits + 7) / 8);
+        fprintf(out, "\n#if %s_MAX_SIZE > XBEE_SCHEMA_PAYLOAD_LIMIT\n"
+                "#error %s may not fit XBEE_SCHEMA_PAYLOAD_LIMIT\n#endif\n",
+                name, message->name);
+
+        fprintf(out, "\ntypedef struct {\n");
+        for(size_t i = 0; i < message->field_count; ++i)
+        {
+            const field_t * field = &message->fields[i];
+            if(field->count > 0)
+            {
+                fprintf(out, "    %s %s[%u];\n", c_type(field), field->name, field->count);
+            }
+            else
+            {
+                fprintf(out, "    %s %s;\n", c_type(field), field->name);
+            }
+        }
+        fprintf(out, "} %s_t;\n", message->name);
+
+        fprintf(out, "\n/*! \\return Bytes written, at most %s_MAX_SIZE, XBEE_ERR_TOO_LARGE\n"
+                " *         if size is too small or XBEE_ERR_PACK_RANGE */\n", name);
+        fprintf(out, "int %s_encode(const %s_t * msg, size_t size, void * buf) SPECIAL_SECTION;\n",
+                message->name, message->name);
+        fprintf(out, "\n/*! \\return Bytes read, or XBEE_ERR_PACK_MALFORMED */\n");
+        fprintf(out, "int %s_decode(%s_t * msg, size_t size, const void * buf) SPECIAL_SECTION;\n",
+                message->name, message->name);
+
+        fprintf(out, "\n/*! Returns true if buf holds this message's id and fixed fields,\n"
+                " * which the accessors below then read in place */\n");
+        fprintf(out, "static inline bool %s_check(size_t size, const void * buf)\n{\n"
+                "    return size >= %s_FIXED_SIZE && ((const uint8_t *)buf)[0] == %s_ID;\n}\n",
+                message->name, name, name);
+
+        for(size_t i = 0; i < message->field_count && message->fields[i].offset >= 0; ++i)
+        {
+            write_accessor(out, message, &message->fields[i]);
+        }
+    }
+
+    fprintf(out, "\n#endif /* _%s_H_ */\n", guard);
+}
+
+static void write_source(FILE * out, const char * header)
+{
+    char name[SCHEMA_MAX_NAME];
+
+    fprintf(out, "/* Generated by xbee_schema from %s, do not edit */\n", schema_path);
+    fprintf(out, "#include \"%s\"\n", header);
+
+    for(size_t m = 0; m < message_count; ++m)
+    {
+        const message_t * message = &messages[m];
+        upper(name, message->name);
+
+        fprintf(out, "\nint %s_encode(const %s_t * msg, size_t size, void * buf)\n{\n",
+                message->name, message->name);
+        fprintf(out, "    xbee_packer_t packer;\n\n    assert(msg);\n\n");
+        fprintf(out, "    xbee_packer_init(&packer, size, buf);\n");
+        fprintf(out, "    xbee_pack_uint(&packer, 8, %s_ID);\n", name);
+        write_fields(out, message, 1);
+        fprintf(out, "    return xbee_packer_finish(&packer);\n}\n");
+
+        fprintf(out, "\nint %s_decode(%s_t * msg, size_t size, const void * buf)\n{\n",
+                message->name, message->name);
+        fprintf(out, "    xbee_unpacker_t unpacker;\n\n    assert(msg);\n\n");
+        fprintf(out, "    xbee_unpacker_init(&unpacker, size, buf);\n");
+        fprintf(out, "    if(xbee_unpack_uint(&unpacker, 8) != %s_ID)\n    {\n"
+                "        xbee_unpacker_fail(&unpacker);\n    }\n", name);
+        write_fields(out, message, 0);
+        fprintf(out, "    return xbee_unpacker_finish(&unpacker);\n}\n");
+    }
+}
+
+static FILE * open_output(const char * base, const char * suffix, char * path, size_t size)
+{
+    if((size_t)snprintf(path, size, "%s%s", base, suffix) >= size)
+    {
+        fprintf(stderr, "%s%s: path too long\n", base, suffix);
+        exit(1);
+    }
+
+    FILE * out = fopen(path, "w");
+    if(out == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    return out;
+}
+
+int main(int argc, char * argv[])
+{
+    char header_path[4096];
+    char source_path[4096];
+    char guard[4096];
+
+    if(argc != 3)
+    {
+        fprintf(stderr, "usage: %s <schema> <output>\n", argv[0]);
+        return 2;
+    }
+
+    schema_path = argv[1];
+    FILE * in = fopen(schema_path, "r");
+    if(in == NULL)
+    {
+        perror(schema_path);
+        return 1;
+    }
+    size_t size = fread(schema_text, 1, sizeof(schema_text), in);
+    fclose(in);
+    if(size > SCHEMA_MAX_INPUT)
+    {
+        fprintf(stderr, "%s: larger than %d bytes\n", schema_path, SCHEMA_MAX_INPUT);
+        return 1;
+    }
+    schema_text[size] = '\0';
+
+    parse();
+
+    const char * base = strrchr(argv[2], '/');
+    base = base != NULL ? base + 1 : argv[2];
+    upper(guard, base);
+
+    FILE * out = open_output(argv[2], ".h", header_path, sizeof(header_path));
+    write_header(out, guard);
+    if(fclose(out) != 0)
+    {
+        perror(header_path);
+        return 1;
+    }
+
+    char header[4096];
+    snprintf(header, sizeof(header), "%s.h", base);
+    out = open_output(argv[2], ".c", source_path, sizeof(source_path));
+    write_source(out, header);
+    if(fclose(out) != 0)
+    {
+        perror(source_path);
+        return 1;
+    }
+
+    return 0;
+}
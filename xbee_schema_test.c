@@ -0,0 +1,131 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "schema_test_messages.h"
+
+static const sensor_report_t test_report = {
+    .temperature = 0xFFF,
+    .offset = -512,
+    .alarm = true,
+    .serial = {0x01, 0x80, 0xFF, 0x00, 0x7E, 0xA5},
+    .uptime = 0xFFFFFFFF,
+    .delta = INT32_MIN,
+    .trend = {-8, 7, 0},
+};
+
+/*! Every field comes back as written, through decode and the accessors */
+void test_schema_round_trip(void)
+{
+    uint8_t buf[SENSOR_REPORT_MAX_SIZE];
+    int size = sensor_report_encode(&test_report, sizeof(buf), buf);
+    assert(size == SENSOR_REPORT_MAX_SIZE);
+    assert(buf[0] == SENSOR_REPORT_ID);
+
+    sensor_report_t report;
+    memset(&report, 0, sizeof(report));
+    assert(sensor_report_decode(&report, size, buf) == size);
+    assert(memcmp(&report, &test_report, sizeof(report)) == 0);
+
+    assert(sensor_report_check(size, buf));
+    assert(sensor_report_get_temperature(buf) == test_report.temperature);
+    assert(sensor_report_get_offset(buf) == test_report.offset);
+    assert(sensor_report_get_alarm(buf));
+    for(size_t i = 0; i < 6; ++i)
+    {
+        assert(sensor_report_get_serial(buf, i) == test_report.serial[i]);
+    }
+
+    /* Small varints take fewer bytes */
+    sensor_report_t small = test_report;
+    small.uptime = 1;
+    small.delta = -1;
+    size = sensor_report_encode(&small, sizeof(buf), buf);
+    assert(size == SENSOR_REPORT_MAX_SIZE - 8);
+    assert(sensor_report_decode(&report, size, buf) == size);
+    assert(memcmp(&report, &small, sizeof(report)) == 0);
+
+    /* Byte aligned arrays are read in place */
+    config_t config = {7, {1, 2, 3, 4}, 0x89ABCDEF, -2, true};
+    uint8_t cbuf[CONFIG_MAX_SIZE];
+    assert(config_encode(&config, sizeof(cbuf), cbuf) == CONFIG_FIXED_SIZE);
+    assert(config_check(sizeof(cbuf), cbuf));
+    assert(config_get_key(cbuf) == &cbuf[2]);
+    assert(memcmp(config_get_key(cbuf), config.key, 4) == 0);
+    assert(config_get_interval(cbuf) == config.interval);
+    assert(config_get_calibration(cbuf) == -2);
+    assert(config_get_enabled(cbuf));
+    assert(!sensor_report_check(sizeof(cbuf), cbuf));
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Values wider than their field are refused, not truncated */
+void test_schema_range(void)
+{
+    uint8_t buf[SENSOR_REPORT_MAX_SIZE];
+    sensor_report_t report;
+
+    report = test_report;
+    report.temperature = 0x1000;
+    assert(sensor_report_encode(&report, sizeof(buf), buf) == XBEE_ERR_PACK_RANGE);
+
+    report = test_report;
+    report.offset = 512;
+    assert(sensor_report_encode(&report, sizeof(buf), buf) == XBEE_ERR_PACK_RANGE);
+
+    report = test_report;
+    report.offset = -513;
+    assert(sensor_report_encode(&report, sizeof(buf), buf) == XBEE_ERR_PACK_RANGE);
+
+    report = test_report;
+    report.trend[2] = 8;
+    assert(sensor_report_encode(&report, sizeof(buf), buf) == XBEE_ERR_PACK_RANGE);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Short buffers fail on both sides, as does another message's id */
+void test_schema_short(void)
+{
+    uint8_t buf[SENSOR_REPORT_MAX_SIZE];
+    sensor_report_t report;
+
+    assert(sensor_report_encode(&test_report, sizeof(buf) - 1, buf) == XBEE_ERR_TOO_LARGE);
+    assert(sensor_report_encode(&test_report, 0, buf) == XBEE_ERR_TOO_LARGE);
+
+    int size = sensor_report_encode(&test_report, sizeof(buf), buf);
+    for(int i = 0; i < size; ++i)
+    {
+        assert(sensor_report_decode(&report, i, buf) == XBEE_ERR_PACK_MALFORMED);
+    }
+    assert(!sensor_report_check(SENSOR_REPORT_FIXED_SIZE - 1, buf));
+
+    buf[0] = CONFIG_ID;
+    assert(sensor_report_decode(&report, size, buf) == XBEE_ERR_PACK_MALFORMED);
+
+    /* An uptime varint that runs past 32 bits, it follows 79 bits of
+     * id and fixed fields */
+    memset(buf, 0, sizeof(buf));
+    buf[0] = SENSOR_REPORT_ID;
+    for(size_t i = 0; i < 5; ++i)
+    {
+        xbee_pack_bits(buf, 79 + 8*i, 8, 0xFF);
+    }
+    xbee_pack_bits(buf, 79 + 8*5, 8, 0x01);
+    assert(sensor_report_decode(&report, sizeof(buf), buf) == XBEE_ERR_PACK_MALFORMED);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_schema_round_trip();
+    test_schema_range();
+    test_schema_short();
+
+    return 0;
+}
@@ -0,0 +1,815 @@
+#include "xbee_sim.h"
+#include <assert.h>
+#include <string.h>
+
+#define XBEE_SIM_DELIM 0x7E
+#define XBEE_SIM_ESCAPE 0x7D
+
+static bool xbee_sim_fifo_put(xbee_sim_fifo_t * fifo, size_t size, const void * data)
+{
+    if(fifo->head > 0 && fifo->size + size > XBEE_SIM_FIFO_SIZE)
+    {
+        memmove(fifo->data, fifo->data + fifo->head, fifo->size - fifo->head);
+        fifo->size -= fifo->head;
+        fifo->head = 0;
+    }
+
+    if(fifo->size + size > XBEE_SIM_FIFO_SIZE)
+    {
+        return false;
+    }
+
+    memcpy(fifo->data + fifo->size, data, size);
+    fifo->size += size;
+    return true;
+}
+
+static void xbee_sim_fifo_drop(xbee_sim_fifo_t * fifo, size_t size)
+{
+    fifo->head += size;
+    if(fifo->head == fifo->size)
+    {
+        fifo->head = 0;
+        fifo->size = 0;
+    }
+}
+
+static bool xbee_sim_needs_escape(uint8_t byte)
+{
+    return byte == XBEE_SIM_DELIM || byte == XBEE_SIM_ESCAPE ||
+           byte == 0x11 || byte == 0x13;
+}
+
+static size_t xbee_sim_escape(uint8_t * out, uint8_t byte)
+{
+    if(xbee_sim_needs_escape(byte))
+    {
+        out[0] = XBEE_SIM_ESCAPE;
+        out[1] = byte ^ 0x20;
+        return 2;
+    }
+
+    out[0] = byte;
+    return 1;
+}
+
+static xbee_sim_register_t * xbee_sim_register(xbee_sim_node_t * node, const char * at_command)
+{
+    for(size_t i = 0; i < XBEE_SIM_REGISTERS; ++i)
+    {
+        xbee_sim_register_t * r = &node->registers[i];
+        if(r->at_command[0] == at_command[0] && r->at_command[1] == at_command[1])
+        {
+            return r;
+        }
+    }
+
+    return NULL;
+}
+
+static void xbee_sim_put_register(xbee_sim_node_t * node, const char * at_command,
+        size_t size, const void * value)
+{
+    assert(size <= XBEE_MAX_AT_PARAM);
+
+    xbee_sim_register_t * r = xbee_sim_register(node, at_command);
+    if(r == NULL)
+    {
+        char empty[2] = {0, 0};
+        r = xbee_sim_register(node, empty);
+        assert(r != NULL);
+        memcpy(r->at_command, at_command, sizeof(r->at_command));
+    }
+
+    r->value_size = size;
+    memcpy(r->value, value, size);
+}
+
+/*! Big endian value of node's register, or fallback if it has none */
+static uint64_t xbee_sim_register_value(xbee_sim_node_t * node, const char * at_command,
+        uint64_t fallback)
+{
+    const xbee_sim_register_t * r = xbee_sim_register(node, at_command);
+    if(r == NULL)
+    {
+        return fallback;
+    }
+
+    uint64_t value = 0;
+    for(size_t i = 0; i < r->value_size; ++i)
+    {
+        value = value << 8 | r->value[i];
+    }
+
+    return value;
+}
+
+/*! Silence needed either side of +++, ms */
+static uint32_t xbee_sim_guard_time(xbee_sim_node_t * node)
+{
+    return xbee_sim_register_value(node, "GT", XBEE_GUARD_TIME*1000);
+}
+
+/*! True while the module passes its host's bytes through raw (AP 0) */
+static bool xbee_sim_transparent(xbee_sim_node_t * node)
+{
+    return !node->command_mode && xbee_sim_register_value(node, "AP", 2) == 0;
+}
+
+/*! Runs one command mode line, such as "ATAP 2" */
+static void xbee_sim_command_line(xbee_sim_node_t * node, size_t size, const char * line)
+{
+    if(size < 4 || line[0] != 'A' || line[1] != 'T')
+    {
+        return;
+    }
+
+    if(line[2] == 'C' && line[3] == 'N')
+    {
+        node->plus_count = 0;
+        node->command_mode = false;
+        return;
+    }
+
+    uint8_t value = 0;
+    for(size_t i = 4; i < size; ++i)
+    {
+        if(line[i] >= '0' && line[i] <= '9')
+        {
+            value = value*16 + (line[i] - '0');
+        }
+    }
+    xbee_sim_put_register(node, line + 2, 1, &value);
+}
+
+static int xbee_sim_write(void * ptr, const void * buf, size_t nbyte)
+{
+    xbee_sim_node_t * node = ptr;
+    const uint8_t * b = buf;
+    uint32_t now = node->sim->clock.now;
+
+    if(!node->command_mode)
+    {
+        size_t plus = 0;
+        while(plus < nbyte && b[plus] == '+')
+        {
+            plus += 1;
+        }
+
+        /* Escape sequence, '+' alone after the guard time.  Command mode
+         * starts once the guard time passes again, see xbee_sim_process */
+        if(plus == nbyte && nbyte > 0 && node->plus_count + nbyte <= 3 &&
+           (node->plus_count > 0 ||
+            (uint32_t)(now - node->last_write) >= xbee_sim_guard_time(node)))
+        {
+            node->plus_count += nbyte;
+            node->last_write = now;
+            return nbyte;
+        }
+
+        node->plus_count = 0;
+    }
+
+    for(size_t i = 0; i < nbyte; ++i)
+    {
+        if(node->command_mode && b[i] == '\r')
+        {
+            /* Command mode takes text lines */
+            xbee_sim_command_line(node, node->from_host.size - node->from_host.head,
+                    (const char *)node->from_host.data + node->from_host.head);
+            xbee_sim_fifo_drop(&node->from_host, node->from_host.size - node->from_host.head);
+            xbee_sim_fifo_put(&node->to_host, 3, "OK\r");
+            continue;
+        }
+
+        if(!xbee_sim_fifo_put(&node->from_host, 1, &b[i]))
+        {
+            return i;
+        }
+    }
+
+    node->last_write = now;
+    return nbyte;
+}
+
+static int xbee_sim_read(void * ptr, void * buf, size_t nbyte)
+{
+    xbee_sim_node_t * node = ptr;
+    xbee_sim_fifo_t * fifo = &node->to_host;
+
+    size_t size = fifo->size - fifo->head;
+    if(size > nbyte)
+    {
+        size = nbyte;
+    }
+
+    memcpy(buf, fifo->data + fifo->head, size);
+    xbee_sim_fifo_drop(fifo, size);
+    return size;
+}
+
+static void xbee_sim_process(xbee_sim_t * sim);
+
+static void xbee_sim_sleep(void * ptr, uint32_t ms)
+{
+    xbee_sim_t * sim = ptr;
+
+    sim->clock.now += ms;
+    xbee_sim_process(sim);
+}
+
+static uint32_t xbee_sim_now(void * ptr)
+{
+    xbee_sim_t * sim = ptr;
+    return sim->clock.now;
+}
+
+uint32_t xbee_sim_random(xbee_sim_t * sim)
+{
+    assert(sim);
+
+    uint32_t x = sim->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->random = x;
+    return x;
+}
+
+int xbee_sim_init(xbee_sim_t * sim, size_t count, uint32_t seed)
+{
+    assert(sim);
+    assert(count > 0 && count <= XBEE_SIM_NODES);
+
+    memset(sim, 0, sizeof(*sim));
+    sim->random = seed != 0 ? seed : 1;
+    sim->count = count;
+    sim->rssi = 40;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        for(size_t j = 0; j < count; ++j)
+        {
+            sim->link[i][j] = i != j;
+        }
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        xbee_sim_node_t * node = &sim->nodes[i];
+        node->sim = sim;
+        node->uart.ptr = node;
+        node->uart.write = xbee_sim_write;
+        node->uart.read = xbee_sim_read;
+        node->uart.clock_ptr = sim;
+        node->uart.clock = xbee_sim_now;
+        node->uart.sleep_ms = xbee_sim_sleep;
+
+        uint64_t address = XBEE_SIM_ADDRESS_BASE + i + 1;
+        uint8_t sh[4] = {address >> 56, address >> 48, address >> 40, address >> 32};
+        uint8_t sl[4] = {address >> 24, address >> 16, address >> 8, address};
+        uint8_t my[2] = {(i + 1) >> 8, i + 1};
+        xbee_sim_put_register(node, "SH", sizeof(sh), sh);
+        xbee_sim_put_register(node, "SL", sizeof(sl), sl);
+        xbee_sim_put_register(node, "MY", sizeof(my), my);
+
+        int ret = xbee_open(&node->xbee, &node->uart, sizeof(node->recv), node->recv);
+        if(ret != 0)
+        {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+void xbee_sim_address16(const xbee_sim_t * sim, size_t node, xbee_address_t * address)
+{
+    assert(sim);
+    assert(node < sim->count);
+    assert(address);
+
+    memset(address, 0, sizeof(*address));
+    address->type = XBEE_16_BIT;
+    address->addr.network_address = node + 1;
+}
+
+void xbee_sim_address64(const xbee_sim_t * sim, size_t node, xbee_address_t * address)
+{
+    assert(sim);
+    assert(node < sim->count);
+    assert(address);
+
+    memset(address, 0, sizeof(*address));
+    address->type = XBEE_64_BIT;
+    address->addr.address = XBEE_SIM_ADDRESS_BASE + node + 1;
+}
+
+void xbee_sim_set_register(xbee_sim_t * sim, size_t node, const char * at_command,
+        size_t size, const void * value)
+{
+    assert(sim);
+    assert(node < sim->count);
+    assert(at_command);
+
+    xbee_sim_put_register(&sim->nodes[node], at_command, size, value);
+}
+
+void xbee_sim_push_frame(xbee_sim_t * sim, size_t node, size_t size, const void * frame)
+{
+    assert(sim);
+    assert(node < sim->count);
+    assert(size > 0 && size <= XBEE_SIM_MAX_FRAME);
+
+    const uint8_t * f = frame;
+    uint8_t out[2*(2 + XBEE_SIM_MAX_FRAME + 1) + 1];
+    size_t n = 0;
+    uint8_t sum = 0;
+
+    out[n++] = XBEE_SIM_DELIM;
+    n += xbee_sim_escape(out + n, size >> 8);
+    n += xbee_sim_escape(out + n, size & 0xFF);
+    for(size_t i = 0; i < size; ++i)
+    {
+        n += xbee_sim_escape(out + n, f[i]);
+        sum += f[i];
+    }
+    n += xbee_sim_escape(out + n, 0xFF - sum);
+
+    bool ok = xbee_sim_fifo_put(&sim->nodes[node].to_host, n, out);
+    assert(ok);
+    (void)ok;
+    sim->nodes[node].frames_out += 1;
+}
+
+void xbee_sim_push_bytes(xbee_sim_t * sim, size_t node, size_t size, const void * data)
+{
+    assert(sim);
+    assert(node < sim->count);
+    assert(data || size == 0);
+
+    bool ok = xbee_sim_fifo_put(&sim->nodes[node].to_host, size, data);
+    assert(ok);
+    (void)ok;
+}
+
+/*! Unescapes the byte at *idx of fifo, or returns false if it isn't there yet */
+static bool xbee_sim_fifo_byte(const xbee_sim_fifo_t * fifo, size_t * idx, uint8_t * out)
+{
+    if(*idx >= fifo->size)
+    {
+        return false;
+    }
+
+    uint8_t b = fifo->data[(*idx)++];
+    if(b == XBEE_SIM_ESCAPE)
+    {
+        if(*idx >= fifo->size)
+        {
+            return false;
+        }
+        b = fifo->data[(*idx)++] ^ 0x20;
+    }
+
+    *out = b;
+    return true;
+}
+
+int xbee_sim_pop_frame(xbee_sim_t * sim, size_t node, size_t frame_out_size, void * frame_out)
+{
+    assert(sim);
+    assert(node < sim->count);
+    assert(frame_out);
+
+    xbee_sim_fifo_t * fifo = &sim->nodes[node].from_host;
+    uint8_t * out = frame_out;
+
+    while(fifo->head < fifo->size && fifo->data[fifo->head] != XBEE_SIM_DELIM)
+    {
+        xbee_sim_fifo_drop(fifo, 1);
+    }
+
+    size_t idx = fifo->head + 1;
+    uint8_t hi, lo;
+    if(!xbee_sim_fifo_byte(fifo, &idx, &hi) || !xbee_sim_fifo_byte(fifo, &idx, &lo))
+    {
+        return 0;
+    }
+
+    size_t size = hi << 8 | lo;
+    uint8_t sum = 0;
+    for(size_t i = 0; i <= size; ++i)
+    {
+        uint8_t b;
+        if(!xbee_sim_fifo_byte(fifo, &idx, &b))
+        {
+            return 0;
+        }
+
+        if(i < size && i < frame_out_size)
+        {
+            out[i] = b;
+        }
+        sum += b;
+    }
+
+    xbee_sim_fifo_drop(fifo, idx - fifo->head);
+    if(sum != 0xFF || size > frame_out_size)
+    {
+        return -1;
+    }
+
+    return size;
+}
+
+/*! Runs an AT command on node n's registers, appending status and value to out
+ *
+ * \return Size of out
+ */
+static size_t xbee_sim_at_execute(xbee_sim_node_t * node, uint8_t * out, size_t size,
+        const uint8_t * at_command, size_t param_size, const uint8_t * param)
+{
+    if(param_size > XBEE_MAX_AT_PARAM)
+    {
+        out[size++] = 3;
+    }
+    else if(param_size > 0)
+    {
+        xbee_sim_put_register(node, (const char *)at_command, param_size, param);
+        out[size++] = 0;
+    }
+    else
+    {
+        const xbee_sim_register_t * r = xbee_sim_register(node, (const char *)at_command);
+        if(r == NULL)
+        {
+            out[size++] = 2;
+        }
+        else
+        {
+            out[size++] = 0;
+            memcpy(out + size, r->value, r->value_size);
+            size += r->value_size;
+        }
+    }
+
+    return size;
+}
+
+static void xbee_sim_local_at(xbee_sim_t * sim, size_t n, size_t size, const uint8_t * f)
+{
+    if(size < 4)
+    {
+        return;
+    }
+
+    uint8_t out[5 + XBEE_MAX_AT_PARAM] = {XBEE_AT_RESPONSE, f[1], f[2], f[3]};
+    size_t out_size = xbee_sim_at_execute(&sim->nodes[n], out, 4, f + 2, size - 4, f + 4);
+
+    if(f[1] != 0)
+    {
+        xbee_sim_push_frame(sim, n, out_size, out);
+    }
+}
+
+/*! Looks a destination up, returning sim->count if no node has it */
+static size_t xbee_sim_find(const xbee_sim_t * sim, bool wide, uint64_t address)
+{
+    for(size_t i = 0; i < sim->count; ++i)
+    {
+        if(( wide && address == XBEE_SIM_ADDRESS_BASE + i + 1) ||
+           (!wide && address == i + 1))
+        {
+            return i;
+        }
+    }
+
+    return sim->count;
+}
+
+/*! Pushes frame for node's host now, or holds it until due */
+static void xbee_sim_deliver(xbee_sim_t * sim, uint32_t due, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    if(due == sim->clock.now)
+    {
+        xbee_sim_push_frame(sim, node, size, frame);
+        return;
+    }
+
+    assert(sim->delayed_count < XBEE_SIM_DELAYED);
+    xbee_sim_delayed_t * d = &sim->delayed[sim->delayed_count++];
+    d->due = due;
+    d->node = node;
+    d->size = size;
+    memcpy(d->frame, frame, size);
+}
+
+/*! Pushes the held frames now due, in the order they were sent */
+static void xbee_sim_deliver_due(xbee_sim_t * sim)
+{
+    size_t kept = 0;
+    for(size_t i = 0; i < sim->delayed_count; ++i)
+    {
+        xbee_sim_delayed_t * d = &sim->delayed[i];
+        if((int32_t)(sim->clock.now - d->due) >= 0)
+        {
+            xbee_sim_push_frame(sim, d->node, d->size, d->frame);
+        }
+        else
+        {
+            sim->delayed[kept++] = *d;
+        }
+    }
+    sim->delayed_count = kept;
+}
+
+static void xbee_sim_transmit(xbee_sim_t * sim, size_t n, size_t size, const uint8_t * f)
+{
+    bool wide = f[0] == XBEE_TRANSMIT;
+    size_t address_size = wide ? 8 : 2;
+    if(size < 3 + address_size || size + 1 > XBEE_SIM_MAX_FRAME)
+    {
+        return;
+    }
+
+    uint64_t dest = 0;
+    for(size_t i = 0; i < address_size; ++i)
+    {
+        dest = dest << 8 | f[2 + i];
+    }
+    bool broadcast = dest == 0xFFFF;
+    size_t data_offset = 3 + address_size;
+
+    uint8_t out[XBEE_SIM_MAX_FRAME];
+    size_t out_size = 0;
+    out[out_size++] = wide ? XBEE_RECEIVE : XBEE_RECEIVE_16_BIT;
+    uint64_t source = wide ? XBEE_SIM_ADDRESS_BASE + n + 1 : n + 1;
+    for(size_t i = address_size; i > 0; --i)
+    {
+        out[out_size++] = source >> (8*(i - 1));
+    }
+    out[out_size++] = sim->rssi;
+    out[out_size++] = broadcast ? 0x02 : 0x00;
+    memcpy(out + out_size, f + data_offset, size - data_offset);
+    out_size += size - data_offset;
+
+    uint32_t due = sim->clock.now + sim->delay;
+    if(sim->jitter != 0)
+    {
+        due += xbee_sim_random(sim) % (sim->jitter + 1);
+    }
+
+    uint8_t status = 0;
+    size_t target = broadcast ? sim->count : xbee_sim_find(sim, wide, dest);
+    if(!broadcast && (target == sim->count || !sim->link[n][target]))
+    {
+        status = XBEE_SIM_NO_ACK;
+    }
+
+    for(size_t m = 0; m < sim->count; ++m)
+    {
+        if(!sim->link[n][m] || (!broadcast && m != target))
+        {
+            continue;
+        }
+
+        if(sim->loss != 0 && xbee_sim_random(sim) % 1000000 < sim->loss)
+        {
+            sim->lost += 1;
+            if(!broadcast)
+            {
+                status = XBEE_SIM_NO_ACK;
+            }
+            continue;
+        }
+
+        if(xbee_sim_transparent(&sim->nodes[m]))
+        {
+            xbee_sim_fifo_put(&sim->nodes[m].to_host, size - data_offset, f + data_offset);
+        }
+        else
+        {
+            xbee_sim_deliver(sim, due, m, out_size, out);
+        }
+        sim->delivered += 1;
+    }
+
+    if(f[1] != 0)
+    {
+        uint8_t tx_status[3] = {XBEE_TRANSMIT_STATUS, f[1], status};
+        xbee_sim_deliver(sim, due, n, sizeof(tx_status), tx_status);
+    }
+}
+
+static void xbee_sim_remote_at(xbee_sim_t * sim, size_t n, size_t size, const uint8_t * f)
+{
+    if(size < 15)
+    {
+        return;
+    }
+
+    uint64_t dest = 0;
+    for(size_t i = 0; i < 8; ++i)
+    {
+        dest = dest << 8 | f[2 + i];
+    }
+    uint16_t dest16 = f[10] << 8 | f[11];
+
+    size_t target = dest16 != 0xFFFE ? xbee_sim_find(sim, false, dest16) :
+                                       xbee_sim_find(sim, true, dest);
+    if(target == sim->count || !sim->link[n][target])
+    {
+        if(f[1] != 0)
+        {
+            uint8_t timeout[15] = {XBEE_REMOTE_AT_RESPONSE, f[1]};
+            memcpy(timeout + 2, f + 2, 10);
+            timeout[12] = f[13];
+            timeout[13] = f[14];
+            timeout[14] = 4;
+            xbee_sim_push_frame(sim, n, sizeof(timeout), timeout);
+        }
+        return;
+    }
+
+    uint64_t address = XBEE_SIM_ADDRESS_BASE + target + 1;
+    uint8_t out[1 + 1 + 10 + 2 + 1 + XBEE_MAX_AT_PARAM];
+    size_t out_size = 0;
+    out[out_size++] = XBEE_REMOTE_AT_RESPONSE;
+    out[out_size++] = f[1];
+    for(size_t i = 0; i < 8; ++i)
+    {
+        out[out_size++] = address >> (8*(7 - i));
+    }
+    out[out_size++] = (target + 1) >> 8;
+    out[out_size++] = target + 1;
+    out[out_size++] = f[13];
+    out[out_size++] = f[14];
+    out_size = xbee_sim_at_execute(&sim->nodes[target], out, out_size,
+            f + 13, size - 15, f + 15);
+
+    if(f[1] != 0)
+    {
+        xbee_sim_push_frame(sim, n, out_size, out);
+    }
+}
+
+/*! Sends what a host in transparent mode wrote to its module's DH, DL */
+static void xbee_sim_forward(xbee_sim_t * sim, size_t n)
+{
+    xbee_sim_node_t * node = &sim->nodes[n];
+    xbee_sim_fifo_t * fifo = &node->from_host;
+    size_t size = fifo->size - fifo->head;
+    if(size == 0)
+    {
+        return;
+    }
+
+    uint64_t dest = xbee_sim_register_value(node, "DH", 0) << 32 |
+                    xbee_sim_register_value(node, "DL", 0);
+    bool broadcast = dest == 0xFFFF;
+    size_t target = dest < 0xFFFF ? xbee_sim_find(sim, false, dest) :
+                                    xbee_sim_find(sim, true, dest);
+
+    for(size_t m = 0; m < sim->count; ++m)
+    {
+        if(!sim->link[n][m] || (!broadcast && m != target))
+        {
+            continue;
+        }
+
+        if(sim->loss != 0 && xbee_sim_random(sim) % 1000000 < sim->loss)
+        {
+            sim->lost += 1;
+            continue;
+        }
+
+        xbee_sim_fifo_put(&sim->nodes[m].to_host, size, fifo->data + fifo->head);
+        sim->delivered += 1;
+    }
+
+    xbee_sim_fifo_drop(fifo, size);
+}
+
+/*! Modules act on every whole frame their hosts wrote, or pass the bytes
+ * on in transparent mode */
+static void xbee_sim_process(xbee_sim_t * sim)
+{
+    uint8_t frame[XBEE_SIM_MAX_FRAME];
+
+    xbee_sim_deliver_due(sim);
+
+    for(size_t n = 0; n < sim->count; ++n)
+    {
+        xbee_sim_node_t * node = &sim->nodes[n];
+        if(node->plus_count == 3 && !node->command_mode &&
+           (uint32_t)(sim->clock.now - node->last_write) >= xbee_sim_guard_time(node))
+        {
+            node->command_mode = true;
+            xbee_sim_fifo_put(&node->to_host, 3, "OK\r");
+        }
+
+        if(node->command_mode)
+        {
+            continue;
+        }
+
+        if(xbee_sim_transparent(node))
+        {
+            xbee_sim_forward(sim, n);
+            continue;
+        }
+
+        int size;
+        while((size = xbee_sim_pop_frame(sim, n, sizeof(frame), frame)) != 0)
+        {
+            if(size < 0)
+            {
+                continue;
+            }
+
+            sim->nodes[n].frames_in += 1;
+            if(sim->request && sim->request(sim->request_ptr, sim, n, size, frame))
+            {
+                continue;
+            }
+
+            switch(frame[0])
+            {
+            case XBEE_TRANSMIT:
+            case XBEE_TRANSMIT_16_BIT:
+                xbee_sim_transmit(sim, n, size, frame);
+                break;
+            case XBEE_AT_COMMAND:
+            case XBEE_AT_QUEUE_PARAMETER:
+                xbee_sim_local_at(sim, n, size, frame);
+                break;
+            case XBEE_REMOTE_AT_COMMAND:
+                xbee_sim_remote_at(sim, n, size, frame);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+size_t xbee_sim_step(xbee_sim_t * sim)
+{
+    assert(sim);
+
+    size_t before = 0;
+    for(size_t n = 0; n < sim->count; ++n)
+    {
+        before += sim->nodes[n].frames_in;
+    }
+
+    xbee_sim_process(sim);
+
+    for(size_t n = 0; n < sim->count; ++n)
+    {
+        xbee_sim_node_t * node = &sim->nodes[n];
+        uint8_t frame[XBEE_MAX_FRAME_SIZE];
+        xbee_parsed_frame_t parsed;
+
+        /* Until a poll neither reads nor decodes anything */
+        for(;;)
+        {
+            size_t head = node->to_host.head;
+            size_t idx = node->xbee.recv_idx;
+            size_t pending = node->xbee.recv_size;
+
+            int ret = xbee_poll(&node->xbee, sizeof(frame), frame, &parsed);
+            if(ret > 0)
+            {
+                node->unhandled += 1;
+                continue;
+            }
+
+            if(node->to_host.head == head && node->xbee.recv_idx == idx &&
+               node->xbee.recv_size == pending)
+            {
+                break;
+            }
+        }
+    }
+
+    size_t after = 0;
+    for(size_t n = 0; n < sim->count; ++n)
+    {
+        after += sim->nodes[n].frames_in;
+    }
+
+    return after - before;
+}
+
+void xbee_sim_advance(xbee_sim_t * sim, uint32_t ms)
+{
+    assert(sim);
+
+    for(uint32_t i = 0; i < ms; ++i)
+    {
+        sim->clock.now += 1;
+        xbee_sim_step(sim);
+    }
+}
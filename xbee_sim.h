@@ -0,0 +1,160 @@
+#ifndef _XBEE_SIM_H_
+#define _XBEE_SIM_H_
+
+#include "xbee.h"
+
+/*! Simulated XBees for the tests and benchmarks
+ *
+ * Each node is a host xbee_interface_t whose UART is a pair of byte
+ * FIFOs, and a module that takes the API frames the host writes.
+ * Transmit requests are delivered as receive frames to the linked nodes
+ * they address and answered with a transmit status; local and remote AT
+ * commands are answered from a small table of registers per node.  A
+ * module whose AP register is 0 passes its host's bytes raw to the node
+ * at its DH, DL, and hands received payloads over raw.  +++ with GT (or
+ * XBEE_GUARD_TIME) of silence either side enters command mode.  All
+ * nodes share one virtual clock, which only moves in xbee_sim_advance
+ * or when the library sleeps.  With delay or jitter set, a transmit
+ * request's receive frames and status reach the hosts in a later step.
+ *
+ * Node i has 16 bit address i + 1 and 64 bit address
+ * XBEE_SIM_ADDRESS_BASE + i + 1.
+ */
+
+#ifndef XBEE_SIM_NODES
+#define XBEE_SIM_NODES 8
+#endif /* XBEE_SIM_NODES */
+
+#ifndef XBEE_SIM_FIFO_SIZE
+#define XBEE_SIM_FIFO_SIZE 16384
+#endif /* XBEE_SIM_FIFO_SIZE */
+
+#ifndef XBEE_SIM_REGISTERS
+#define XBEE_SIM_REGISTERS 16
+#endif /* XBEE_SIM_REGISTERS */
+
+/*! Largest API frame the simulated modules take or give */
+#define XBEE_SIM_MAX_FRAME (256)
+
+/*! Frames in the air at once with xbee_sim_t::delay or jitter set */
+#ifndef XBEE_SIM_DELAYED
+#define XBEE_SIM_DELAYED 64
+#endif /* XBEE_SIM_DELAYED */
+
+#define XBEE_SIM_ADDRESS_BASE (0x0013A20040000000ULL)
+
+/*! Transmit status the simulated module reports for an unacknowledged unicast */
+#define XBEE_SIM_NO_ACK (0x01)
+
+typedef struct {
+    uint8_t data[XBEE_SIM_FIFO_SIZE];
+    size_t head;
+    size_t size;
+} xbee_sim_fifo_t;
+
+typedef struct {
+    char at_command[2];
+    uint8_t value_size;
+    uint8_t value[XBEE_MAX_AT_PARAM];
+} xbee_sim_register_t;
+
+/*! API frame due for a host at a later time */
+typedef struct {
+    uint32_t due;
+    size_t node;
+    size_t size;
+    uint8_t frame[XBEE_SIM_MAX_FRAME];
+} xbee_sim_delayed_t;
+
+typedef struct xbee_sim xbee_sim_t;
+
+/*! Sees each frame a host wrote before the module does
+ *
+ * \return true if the frame was dealt with, and the module should ignore it
+ */
+typedef bool (*xbee_sim_request_t)(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame);
+
+typedef struct {
+    xbee_sim_t * sim;
+    xbee_uart_interface_t uart;
+    xbee_interface_t xbee;
+    uint8_t recv[2*XBEE_REC_BUF_SIZE];
+
+    xbee_sim_fifo_t to_host;        /*! Bytes for the host to read */
+    xbee_sim_fifo_t from_host;      /*! Bytes the host wrote */
+    size_t plus_count;              /*! '+' of an escape sequence written so far */
+    bool command_mode;
+    uint32_t last_write;
+
+    xbee_sim_register_t registers[XBEE_SIM_REGISTERS];
+
+    uint32_t frames_in;             /*! API frames taken from the host */
+    uint32_t frames_out;            /*! API frames given to the host */
+    uint32_t unhandled;             /*! Frames xbee_poll returned to xbee_sim_step */
+} xbee_sim_node_t;
+
+struct xbee_sim {
+    xbee_virtual_clock_t clock;
+    uint32_t random;
+
+    size_t count;
+    xbee_sim_node_t nodes[XBEE_SIM_NODES];
+    bool link[XBEE_SIM_NODES][XBEE_SIM_NODES];  /*! link[i][j] if j hears i */
+
+    uint8_t rssi;                   /*! -dBm reported for every packet */
+    uint32_t loss;                  /*! Per million packets not delivered */
+    uint32_t delay;                 /*! ms from a transmit request to its receive frames and status */
+    uint32_t jitter;                /*! Up to this many ms more, at random per packet, so
+                                        packets may arrive out of order */
+
+    xbee_sim_request_t request;
+    void * request_ptr;
+
+    uint32_t delivered;
+    uint32_t lost;
+
+    xbee_sim_delayed_t delayed[XBEE_SIM_DELAYED];
+    size_t delayed_count;
+};
+
+/*! Opens count hosts with xbee_open on fully linked nodes
+ *
+ * \return 0 on success, or xbee_open's error
+ */
+int xbee_sim_init(xbee_sim_t * sim, size_t count, uint32_t seed) SPECIAL_SECTION;
+
+/*! Addresses of node, as a host would send to it */
+void xbee_sim_address16(const xbee_sim_t * sim, size_t node, xbee_address_t * address) SPECIAL_SECTION;
+void xbee_sim_address64(const xbee_sim_t * sim, size_t node, xbee_address_t * address) SPECIAL_SECTION;
+
+/*! Sets the value node's module answers queries of at_command with */
+void xbee_sim_set_register(xbee_sim_t * sim, size_t node, const char * at_command,
+        size_t size, const void * value) SPECIAL_SECTION;
+
+/*! Frames and escapes an API frame for node's host to read */
+void xbee_sim_push_frame(xbee_sim_t * sim, size_t node, size_t size, const void * frame) SPECIAL_SECTION;
+
+/*! Queues bytes as they are for node's host to read, e.g. a broken frame */
+void xbee_sim_push_bytes(xbee_sim_t * sim, size_t node, size_t size, const void * data) SPECIAL_SECTION;
+
+/*! Takes the next API frame node's host wrote, skipping bytes outside frames
+ *
+ * \return Frame size, 0 if there is no whole frame, -1 on a bad checksum
+ */
+int xbee_sim_pop_frame(xbee_sim_t * sim, size_t node, size_t frame_out_size, void * frame_out) SPECIAL_SECTION;
+
+/*! Lets every module act on what its host wrote, then polls every host
+ * until it has read everything
+ *
+ * \return Frames the modules took from hosts
+ */
+size_t xbee_sim_step(xbee_sim_t * sim) SPECIAL_SECTION;
+
+/*! Steps once per ms for ms ms */
+void xbee_sim_advance(xbee_sim_t * sim, uint32_t ms) SPECIAL_SECTION;
+
+/*! xorshift32 over the simulation's seed, for tests wanting repeatable noise */
+uint32_t xbee_sim_random(xbee_sim_t * sim) SPECIAL_SECTION;
+
+#endif /* _XBEE_SIM_H_ */
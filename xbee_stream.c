@@ -0,0 +1,628 @@
+#include "xbee_stream.h"
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+/*! Message types, first byte after the port number
+ *
+ * DATA: type, session, sequence (16 bit), bytes
+ * ACK:  type, session, next sequence expected (16 bit),
+ *       selective ack bitmap (32 bit, bit n is sequence + 1 + n), window
+ */
+#define XBEE_STREAM_DATA (0x01)
+#define XBEE_STREAM_ACK  (0x02)
+
+#define XBEE_STREAM_ACK_SIZE (9)
+
+/*! Selectively acked segments past a hole that mark it lost */
+#define XBEE_STREAM_DUPLICATE_THRESHOLD (3)
+
+static inline int16_t xbee_stream_diff(uint16_t a, uint16_t b)
+{
+    return (int16_t)(a - b);
+}
+
+static inline xbee_stream_segment_t * xbee_stream_segment(xbee_stream_t * stream, uint16_t seq)
+{
+    return &stream->segments[seq % XBEE_STREAM_WINDOW];
+}
+
+static inline xbee_stream_slot_t * xbee_stream_slot(xbee_stream_t * stream, uint16_t seq)
+{
+    return &stream->slots[seq % XBEE_STREAM_WINDOW];
+}
+
+static inline uint32_t xbee_stream_now(const xbee_stream_t * stream)
+{
+    return xbee_now(stream->mux->xbee);
+}
+
+static bool xbee_stream_same_address(const xbee_address_t * a, const xbee_address_t * b)
+{
+    if(a->type != b->type)
+    {
+        return false;
+    }
+
+    if(a->type == XBEE_16_BIT)
+    {
+        return a->addr.network_address == b->addr.network_address;
+    }
+
+    return a->addr.address == b->addr.address;
+}
+
+/*! Updates the retransmit timeout from an RTT sample as in RFC 6298
+ *
+ * \return true if the sample shows frames queueing
+ */
+static bool xbee_stream_rtt(xbee_stream_t * stream, uint32_t rtt)
+{
+    if(rtt == 0)
+    {
+        rtt = 1;
+    }
+
+    if(stream->srtt == 0)
+    {
+        stream->srtt = rtt;
+        stream->rttvar = rtt / 2;
+        stream->min_rtt = rtt;
+    }
+    else
+    {
+        uint32_t error = rtt > stream->srtt ? rtt - stream->srtt : stream->srtt - rtt;
+        stream->rttvar = (3*stream->rttvar + error) / 4;
+        stream->srtt = (7*stream->srtt + rtt + 4) / 8;
+        if(rtt < stream->min_rtt)
+        {
+            stream->min_rtt = rtt;
+        }
+    }
+
+    uint32_t rto = stream->srtt + 4*stream->rttvar;
+    if(rto < XBEE_STREAM_MIN_RTO)
+    {
+        rto = XBEE_STREAM_MIN_RTO;
+    }
+    else if(rto > XBEE_STREAM_MAX_RTO)
+    {
+        rto = XBEE_STREAM_MAX_RTO;
+    }
+    stream->rto = rto;
+
+    return rtt > 2*stream->min_rtt;
+}
+
+/*! Multiplicative decrease, at most once per window of data */
+static void xbee_stream_congestion(xbee_stream_t * stream)
+{
+    if(stream->recovering)
+    {
+        return;
+    }
+
+    stream->ssthresh = stream->cwnd / 2 < 2 ? 2 : stream->cwnd / 2;
+    stream->cwnd = stream->ssthresh;
+    stream->cwnd_count = 0;
+    stream->recovering = true;
+    stream->recover = stream->send_next;
+}
+
+/*! Additive increase for a newly acked segment */
+static void xbee_stream_grow(xbee_stream_t * stream)
+{
+    if(stream->cwnd >= XBEE_STREAM_WINDOW)
+    {
+        return;
+    }
+
+    if(stream->cwnd < stream->ssthresh)
+    {
+        stream->cwnd += 1;
+    }
+    else if(++stream->cwnd_count >= stream->cwnd)
+    {
+        stream->cwnd += 1;
+        stream->cwnd_count = 0;
+    }
+}
+
+/*! Segments sent and presumed still on their way */
+static uint16_t xbee_stream_pipe(xbee_stream_t * stream)
+{
+    uint16_t pipe = 0;
+    for(uint16_t seq = stream->send_unacked; seq != stream->send_next; ++seq)
+    {
+        const xbee_stream_segment_t * s = xbee_stream_segment(stream, seq);
+        if(!s->sacked && !s->lost)
+        {
+            pipe += 1;
+        }
+    }
+
+    return pipe;
+}
+
+static int xbee_stream_send_segment(xbee_stream_t * stream, uint16_t seq) SPECIAL_SECTION;
+static int xbee_stream_send_segment(xbee_stream_t * stream, uint16_t seq)
+{
+    xbee_stream_segment_t * s = xbee_stream_segment(stream, seq);
+
+    uint8_t message[XBEE_PORT_MAX_PAYLOAD];
+    message[0] = XBEE_STREAM_DATA;
+    message[1] = stream->session;
+    message[2] = seq >> 8;
+    message[3] = seq & 0xFF;
+    memcpy(&message[XBEE_STREAM_HEADER_SIZE], s->data, s->size);
+
+    int ret = xbee_port_send(stream->mux, stream->port, &stream->peer, 0,
+            XBEE_STREAM_HEADER_SIZE + s->size, message);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    if(s->sent)
+    {
+        s->retransmitted = true;
+        stream->retransmits += 1;
+    }
+
+    s->sent = true;
+    s->lost = false;
+    s->sent_at = xbee_stream_now(stream);
+    stream->segments_sent += 1;
+    return ret;
+}
+
+/*! Sends lost segments, then new ones, as far as the windows allow */
+static int xbee_stream_push(xbee_stream_t * stream) SPECIAL_SECTION;
+static int xbee_stream_push(xbee_stream_t * stream)
+{
+    uint16_t pipe = xbee_stream_pipe(stream);
+
+    /* Lost segments hold up the peer's in order delivery, so they go first */
+    for(uint16_t seq = stream->send_unacked;
+        seq != stream->send_next && pipe < stream->cwnd; ++seq)
+    {
+        if(!xbee_stream_segment(stream, seq)->lost)
+        {
+            continue;
+        }
+
+        int ret = xbee_stream_send_segment(stream, seq);
+        if(ret != 0)
+        {
+            return ret == XBEE_ERR_QUEUE_FULL ? 0 : ret;
+        }
+        pipe += 1;
+    }
+
+    while(stream->send_next != stream->send_end)
+    {
+        /* With nothing on the way, one segment may go even into a closed
+         * window, and probes it until the peer reads */
+        uint16_t outstanding = stream->send_next - stream->send_unacked;
+        if(pipe > 0 && (pipe >= stream->cwnd || outstanding >= stream->peer_window))
+        {
+            break;
+        }
+
+        /* Partial segment may still be appended to while data is on its way */
+        const xbee_stream_segment_t * s = xbee_stream_segment(stream, stream->send_next);
+        if(pipe > 0 && s->size < XBEE_STREAM_MAX_SEGMENT)
+        {
+            break;
+        }
+
+        int ret = xbee_stream_send_segment(stream, stream->send_next);
+        if(ret == XBEE_ERR_QUEUE_FULL)
+        {
+            return 0;
+        }
+
+        stream->send_next += 1;
+        pipe += 1;
+
+        if(ret != 0)
+        {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static void xbee_stream_send_ack(xbee_stream_t * stream) SPECIAL_SECTION;
+static void xbee_stream_send_ack(xbee_stream_t * stream)
+{
+    uint32_t sack = 0;
+    for(uint16_t i = 0; i < 32; ++i)
+    {
+        uint16_t seq = stream->receive_next + 1 + i;
+        if(xbee_stream_diff(seq, stream->read_next) >= XBEE_STREAM_WINDOW)
+        {
+            break;
+        }
+
+        if(xbee_stream_slot(stream, seq)->received)
+        {
+            sack |= (uint32_t)1 << i;
+        }
+    }
+
+    uint8_t message[XBEE_STREAM_ACK_SIZE];
+    message[0] = XBEE_STREAM_ACK;
+    message[1] = stream->peer_session;
+    message[2] = stream->receive_next >> 8;
+    message[3] = stream->receive_next & 0xFF;
+    message[4] = sack >> 24;
+    message[5] = (sack >> 16) & 0xFF;
+    message[6] = (sack >> 8) & 0xFF;
+    message[7] = sack & 0xFF;
+    message[8] = (uint16_t)(stream->read_next + XBEE_STREAM_WINDOW - stream->receive_next);
+
+    /* A dropped ack is covered by the next one, or by a retransmit */
+    xbee_port_send(stream->mux, stream->port, &stream->peer, 0, sizeof(message), message);
+}
+
+static void xbee_stream_data(xbee_stream_t * stream, size_t size, const uint8_t * m) SPECIAL_SECTION;
+static void xbee_stream_data(xbee_stream_t * stream, size_t size, const uint8_t * m)
+{
+    uint16_t seq = m[2] << 8 | m[3];
+    if(!stream->peer_session_valid || m[1] != stream->peer_session)
+    {
+        /* Only the first segment starts a session, anything else from
+         * another session is a late packet from one the peer has left */
+        if(seq != 0 || (stream->peer_session_valid && m[1] == stream->previous_session))
+        {
+            stream->stale += 1;
+            return;
+        }
+
+        /* Peer reopened, what is left of its last session is stale */
+        stream->previous_session = stream->peer_session_valid ? stream->peer_session : m[1];
+        stream->peer_session = m[1];
+        stream->peer_session_valid = true;
+        stream->receive_next = 0;
+        stream->read_next = 0;
+        stream->read_offset = 0;
+        for(size_t i = 0; i < XBEE_STREAM_WINDOW; ++i)
+        {
+            stream->slots[i].received = false;
+        }
+    }
+
+    if(xbee_stream_diff(seq, stream->receive_next) >= 0 &&
+       xbee_stream_diff(seq, stream->read_next) < XBEE_STREAM_WINDOW)
+    {
+        xbee_stream_slot_t * slot = xbee_stream_slot(stream, seq);
+        if(!slot->received)
+        {
+            slot->size = size - XBEE_STREAM_HEADER_SIZE;
+            memcpy(slot->data, &m[XBEE_STREAM_HEADER_SIZE], slot->size);
+            slot->received = true;
+        }
+
+        while(xbee_stream_diff(stream->receive_next, stream->read_next) < XBEE_STREAM_WINDOW &&
+              xbee_stream_slot(stream, stream->receive_next)->received)
+        {
+            stream->receive_next += 1;
+        }
+    }
+
+    /* Duplicates are acked too, the last ack may have been lost */
+    xbee_stream_send_ack(stream);
+}
+
+static void xbee_stream_ack(xbee_stream_t * stream, const uint8_t * m) SPECIAL_SECTION;
+static void xbee_stream_ack(xbee_stream_t * stream, const uint8_t * m)
+{
+    uint16_t cumulative = m[2] << 8 | m[3];
+    uint32_t sack = (uint32_t)m[4] << 24 | (uint32_t)m[5] << 16 | m[6] << 8 | m[7];
+
+    if(m[1] != stream->session ||
+       xbee_stream_diff(cumulative, stream->send_unacked) < 0 ||
+       xbee_stream_diff(cumulative, stream->send_next) > 0)
+    {
+        return;
+    }
+
+    size_t acked = 0;
+    bool sampled = false;
+    uint32_t latest = 0;    /*! Send time of the newest segment acked by this ack */
+
+    stream->peer_window = m[8];
+
+    for(; stream->send_unacked != cumulative; ++stream->send_unacked)
+    {
+        xbee_stream_segment_t * s = xbee_stream_segment(stream, stream->send_unacked);
+        if(!s->sacked)
+        {
+            if(!s->retransmitted && !s->lost && (!sampled || (int32_t)(s->sent_at - latest) > 0))
+            {
+                latest = s->sent_at;
+                sampled = true;
+            }
+            acked += 1;
+        }
+
+        s->size = 0;
+        s->sent = false;
+        s->sacked = false;
+        s->lost = false;
+        s->retransmitted = false;
+    }
+
+    for(uint16_t i = 0; i < 32; ++i)
+    {
+        uint16_t seq = cumulative + 1 + i;
+        if(xbee_stream_diff(seq, stream->send_next) >= 0)
+        {
+            break;
+        }
+
+        xbee_stream_segment_t * s = xbee_stream_segment(stream, seq);
+        if((sack & ((uint32_t)1 << i)) && !s->sacked)
+        {
+            if(!s->retransmitted && !s->lost && (!sampled || (int32_t)(s->sent_at - latest) > 0))
+            {
+                latest = s->sent_at;
+                sampled = true;
+            }
+            s->sacked = true;
+            s->lost = false;
+            acked += 1;
+        }
+    }
+
+    /* Older segments acked by the same ack may have had their acks lost,
+     * only the newest times the path */
+    bool delayed = sampled &&
+        xbee_stream_rtt(stream, xbee_stream_now(stream) - latest);
+
+    if(stream->recovering &&
+       xbee_stream_diff(stream->send_unacked, stream->recover) >= 0)
+    {
+        stream->recovering = false;
+    }
+
+    /* Holes with enough selectively acked segments past them were lost */
+    size_t above = 0;
+    for(uint16_t seq = stream->send_next; seq != stream->send_unacked; )
+    {
+        --seq;
+        xbee_stream_segment_t * s = xbee_stream_segment(stream, seq);
+        if(s->sacked)
+        {
+            above += 1;
+        }
+        else if(above >= XBEE_STREAM_DUPLICATE_THRESHOLD && !s->lost && !s->retransmitted)
+        {
+            s->lost = true;
+            stream->fast_retransmits += 1;
+            xbee_stream_congestion(stream);
+        }
+    }
+
+    if(!delayed && !stream->recovering)
+    {
+        for(size_t i = 0; i < acked; ++i)
+        {
+            xbee_stream_grow(stream);
+        }
+    }
+}
+
+static void xbee_stream_receive(void * ptr, xbee_port_t * port,
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data) SPECIAL_SECTION;
+static void xbee_stream_receive(void * ptr, xbee_port_t * port,
+        const xbee_address_t * source, int8_t rssi, size_t size, const void * data)
+{
+    xbee_stream_t * stream = ptr;
+    const uint8_t * m = data;
+
+    if(!xbee_stream_same_address(source, &stream->peer) || size < 1)
+    {
+        return;
+    }
+
+    if(m[0] == XBEE_STREAM_DATA && size > XBEE_STREAM_HEADER_SIZE &&
+       size - XBEE_STREAM_HEADER_SIZE <= XBEE_STREAM_MAX_SEGMENT)
+    {
+        xbee_stream_data(stream, size, m);
+    }
+    else if(m[0] == XBEE_STREAM_ACK && size >= XBEE_STREAM_ACK_SIZE)
+    {
+        xbee_stream_ack(stream, m);
+        xbee_stream_push(stream);
+    }
+}
+
+static void xbee_stream_status(void * ptr, xbee_port_t * port, bool ok) SPECIAL_SECTION;
+static void xbee_stream_status(void * ptr, xbee_port_t * port, bool ok)
+{
+    xbee_stream_t * stream = ptr;
+
+    if(!ok)
+    {
+        /* MAC gave up after its retries, the channel is congested */
+        stream->status_failures += 1;
+        xbee_stream_congestion(stream);
+    }
+}
+
+void xbee_stream_open(xbee_stream_t * stream,
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number, uint8_t priority,
+        size_t queue_size, xbee_port_message_t * queue,
+        const xbee_address_t * peer)
+{
+    assert(stream);
+    assert(mux);
+    assert(port);
+    assert(peer);
+    assert(mux->xbee->uart->clock);
+
+    memset(stream, 0, sizeof(*stream));
+    stream->mux = mux;
+    stream->port = port;
+    stream->peer = *peer;
+
+    /* Differs from the last session unless reopened within the same ms */
+    stream->session = xbee_now(mux->xbee);
+    stream->cwnd = 2;
+    stream->ssthresh = XBEE_STREAM_WINDOW;
+    stream->peer_window = XBEE_STREAM_WINDOW;
+    stream->rto = XBEE_STREAM_INITIAL_RTO;
+
+    xbee_port_open(mux, port, number, priority, XBEE_STREAM_PORT_IN_FLIGHT,
+            queue_size, queue, xbee_stream_receive, stream);
+    xbee_port_set_status(port, xbee_stream_status);
+}
+
+void xbee_stream_close(xbee_stream_t * stream)
+{
+    assert(stream);
+
+    xbee_port_close(stream->mux, stream->port);
+}
+
+int xbee_stream_write(xbee_stream_t * stream, size_t size, const void * data)
+{
+    assert(stream);
+    assert(data || size == 0);
+
+    const uint8_t * d = data;
+    size_t written = 0;
+
+    while(written < size)
+    {
+        /* Top up the last segment if it has not been sent */
+        xbee_stream_segment_t * s = NULL;
+        if(stream->send_end != stream->send_next)
+        {
+            s = xbee_stream_segment(stream, stream->send_end - 1);
+            if(s->size == XBEE_STREAM_MAX_SEGMENT)
+            {
+                s = NULL;
+            }
+        }
+
+        if(s == NULL)
+        {
+            if((uint16_t)(stream->send_end - stream->send_unacked) >= XBEE_STREAM_WINDOW)
+            {
+                break;
+            }
+
+            s = xbee_stream_segment(stream, stream->send_end++);
+            memset(s, 0, offsetof(xbee_stream_segment_t, data));
+        }
+
+        size_t n = XBEE_STREAM_MAX_SEGMENT - s->size;
+        if(n > size - written)
+        {
+            n = size - written;
+        }
+
+        memcpy(&s->data[s->size], &d[written], n);
+        s->size += n;
+        written += n;
+    }
+
+    /* Bytes taken are sent later if not now, so they are still reported */
+    int ret = xbee_stream_push(stream);
+    return ret != 0 && written == 0 ? ret : (int)written;
+}
+
+int xbee_stream_read(xbee_stream_t * stream, size_t size, void * data)
+{
+    assert(stream);
+    assert(data || size == 0);
+
+    uint8_t * d = data;
+    size_t read = 0;
+    bool closed = (uint16_t)(stream->read_next + XBEE_STREAM_WINDOW - stream->receive_next) == 0;
+
+    while(read < size && stream->read_next != stream->receive_next)
+    {
+        xbee_stream_slot_t * slot = xbee_stream_slot(stream, stream->read_next);
+
+        size_t n = slot->size - stream->read_offset;
+        if(n > size - read)
+        {
+            n = size - read;
+        }
+
+        memcpy(&d[read], &slot->data[stream->read_offset], n);
+        read += n;
+        stream->read_offset += n;
+
+        if(stream->read_offset == slot->size)
+        {
+            slot->received = false;
+            stream->read_next += 1;
+            stream->read_offset = 0;
+        }
+    }
+
+    /* Tell the peer the window opened rather than wait for its probe */
+    if(closed && stream->read_next != (uint16_t)(stream->receive_next - XBEE_STREAM_WINDOW))
+    {
+        xbee_stream_send_ack(stream);
+    }
+
+    return read;
+}
+
+size_t xbee_stream_unacked(const xbee_stream_t * stream)
+{
+    assert(stream);
+
+    size_t size = 0;
+    for(uint16_t seq = stream->send_unacked; seq != stream->send_end; ++seq)
+    {
+        size += stream->segments[seq % XBEE_STREAM_WINDOW].size;
+    }
+
+    return size;
+}
+
+int xbee_stream_run(xbee_stream_t * stream)
+{
+    assert(stream);
+
+    uint32_t now = xbee_stream_now(stream);
+
+    /* One timer, on the oldest segment still on its way */
+    for(uint16_t seq = stream->send_unacked; seq != stream->send_next; ++seq)
+    {
+        xbee_stream_segment_t * s = xbee_stream_segment(stream, seq);
+        if(s->sacked || s->lost)
+        {
+            continue;
+        }
+
+        if(now - s->sent_at >= stream->rto)
+        {
+            /* Everything on its way is presumed lost, restart from one segment */
+            for(uint16_t lost = seq; lost != stream->send_next; ++lost)
+            {
+                xbee_stream_segment_t * l = xbee_stream_segment(stream, lost);
+                l->lost = !l->sacked;
+            }
+
+            stream->timeouts += 1;
+            stream->ssthresh = stream->cwnd / 2 < 2 ? 2 : stream->cwnd / 2;
+            stream->cwnd = 1;
+            stream->cwnd_count = 0;
+            stream->recovering = true;
+            stream->recover = stream->send_next;
+            stream->rto = stream->rto * 2 > XBEE_STREAM_MAX_RTO ? XBEE_STREAM_MAX_RTO : stream->rto * 2;
+        }
+        break;
+    }
+
+    return xbee_stream_push(stream);
+}
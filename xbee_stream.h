@@ -0,0 +1,154 @@
+#ifndef _XBEE_STREAM_H_
+#define _XBEE_STREAM_H_
+
+#include "xbee_port.h"
+
+/*! Segments buffered per direction, also the largest congestion window.
+ * A power of two, at most 32 so selective acks cover the whole window */
+#ifndef XBEE_STREAM_WINDOW
+#define XBEE_STREAM_WINDOW 16
+#endif /* XBEE_STREAM_WINDOW */
+
+#if (XBEE_STREAM_WINDOW & (XBEE_STREAM_WINDOW - 1)) != 0 || XBEE_STREAM_WINDOW > 32
+#error XBEE_STREAM_WINDOW must be a power of two, at most 32
+#endif
+
+/*! Frames a stream's port may have awaiting XBEE_TRANSMIT_STATUS */
+#ifndef XBEE_STREAM_PORT_IN_FLIGHT
+#define XBEE_STREAM_PORT_IN_FLIGHT 2
+#endif /* XBEE_STREAM_PORT_IN_FLIGHT */
+
+/*! Retransmit timeout bounds and initial value, ms */
+#ifndef XBEE_STREAM_MIN_RTO
+#define XBEE_STREAM_MIN_RTO 50
+#endif /* XBEE_STREAM_MIN_RTO */
+
+#ifndef XBEE_STREAM_MAX_RTO
+#define XBEE_STREAM_MAX_RTO 4000
+#endif /* XBEE_STREAM_MAX_RTO */
+
+#ifndef XBEE_STREAM_INITIAL_RTO
+#define XBEE_STREAM_INITIAL_RTO 1000
+#endif /* XBEE_STREAM_INITIAL_RTO */
+
+/*! Data header is type, session and 16 bit sequence number */
+#define XBEE_STREAM_HEADER_SIZE (4)
+#define XBEE_STREAM_MAX_SEGMENT (XBEE_PORT_MAX_PAYLOAD - XBEE_STREAM_HEADER_SIZE)
+
+typedef struct {
+    uint8_t size;
+    bool sent;
+    bool sacked;
+    bool lost;              /*! Needs retransmitting */
+    bool retransmitted;     /*! Sent more than once, no RTT sample (Karn) */
+    uint32_t sent_at;
+    uint8_t data[XBEE_STREAM_MAX_SEGMENT];
+} xbee_stream_segment_t;
+
+typedef struct {
+    uint8_t size;
+    bool received;
+    uint8_t data[XBEE_STREAM_MAX_SEGMENT];
+} xbee_stream_slot_t;
+
+/*! Reliable, ordered byte stream to one peer, over its own port
+ *
+ * Bytes written are cut into segments numbered in sequence.  The receiver
+ * acks every segment with the next sequence number it expects, a bitmap
+ * of the segments it holds past that (selective ack) and how many more
+ * segments it can buffer.  A segment is retransmitted when three later
+ * segments are selectively acked, or when it is the oldest unacked one
+ * and the retransmit timeout passes.  The timeout follows the smoothed
+ * RTT and its variance, and doubles on every expiry.  Segments sent more
+ * than once, or presumed lost, give no RTT sample.
+ *
+ * Unacked segments are bounded by an AIMD congestion window.  It grows
+ * by one segment per ack in slow start, and by one per window after.  It
+ * is halved (once per window of data) on a fast retransmit or a failed
+ * XBEE_TRANSMIT_STATUS, and drops to one segment on a timeout.  Growth
+ * pauses while RTT samples exceed twice the lowest RTT seen, since the
+ * frames are queueing in the XBee.
+ *
+ * Each stream has its own port, so the mux round robin between ports of
+ * the same priority shares the link fairly between streams.  Both ends
+ * open a stream on the same port number, with each other as peer.  Each
+ * open starts a new session, and the receiver drops what was left of the
+ * previous one once the new session's first segment arrives.  Late
+ * packets from the previous session are ignored.
+ *
+ * Time comes from xbee_now, so the XBee's clock must be set.
+ */
+typedef struct {
+    xbee_port_mux_t * mux;
+    xbee_port_t * port;
+    xbee_address_t peer;
+
+    /* Sending */
+    uint8_t session;
+    uint16_t send_unacked;      /*! Oldest segment not cumulatively acked */
+    uint16_t send_next;         /*! Next segment never sent */
+    uint16_t send_end;          /*! One past the last segment holding data */
+    xbee_stream_segment_t segments[XBEE_STREAM_WINDOW];
+
+    uint16_t cwnd;              /*! Congestion window, segments */
+    uint16_t cwnd_count;        /*! Acks toward the next additive increase */
+    uint16_t ssthresh;
+    uint16_t peer_window;       /*! Segments past send_unacked peer can buffer */
+    bool recovering;            /*! Window already cut for data before recover */
+    uint16_t recover;
+
+    uint32_t srtt;              /*! ms, 0 until the first sample */
+    uint32_t rttvar;
+    uint32_t min_rtt;
+    uint32_t rto;
+
+    /* Receiving */
+    uint8_t peer_session;
+    uint8_t previous_session;   /*! Session peer_session replaced */
+    bool peer_session_valid;
+    uint16_t receive_next;      /*! Next segment expected in order */
+    uint16_t read_next;         /*! Segment read consumes next */
+    uint8_t read_offset;
+    xbee_stream_slot_t slots[XBEE_STREAM_WINDOW];
+
+    uint32_t segments_sent;
+    uint32_t retransmits;
+    uint32_t timeouts;
+    uint32_t fast_retransmits;
+    uint32_t status_failures;
+    uint32_t stale;             /*! Data from a previous or not yet started session */
+} xbee_stream_t;
+
+void xbee_stream_open(xbee_stream_t * stream,
+        xbee_port_mux_t * mux, xbee_port_t * port, uint8_t number, uint8_t priority,
+        size_t queue_size, xbee_port_message_t * queue,
+        const xbee_address_t * peer) SPECIAL_SECTION;
+
+void xbee_stream_close(xbee_stream_t * stream) SPECIAL_SECTION;
+
+/*! Copies as much of data as the send buffer has room for and sends what
+ * the windows allow
+ *
+ * Bytes accepted are sent by later runs if sending fails now.
+ *
+ * \return Bytes accepted, possibly 0, or error from xbee_port_send if
+ *         none were
+ */
+int xbee_stream_write(xbee_stream_t * stream, size_t size, const void * data) SPECIAL_SECTION;
+
+/*! Copies up to size bytes received in order into data
+ *
+ * \return Bytes read, 0 if none are ready
+ */
+int xbee_stream_read(xbee_stream_t * stream, size_t size, void * data) SPECIAL_SECTION;
+
+/*! Returns bytes written but not yet acked by the peer */
+size_t xbee_stream_unacked(const xbee_stream_t * stream) SPECIAL_SECTION;
+
+/*! Retransmits on timeout and sends what the windows allow, call from the poll loop
+ *
+ * \return 0 on success, otherwise error from xbee_port_send
+ */
+int xbee_stream_run(xbee_stream_t * stream) SPECIAL_SECTION;
+
+#endif /* _XBEE_STREAM_H_ */
@@ -0,0 +1,293 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_stream.h"
+#include "xbee_sim.h"
+
+#define TEST_PORT (10)
+#define TEST_BYTES (20000)
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_port_mux_t mux[2];
+    xbee_stream_t stream[2];
+    xbee_port_t port[2];
+    xbee_port_message_t queue[2][4];
+} test_setup_t;
+
+static void test_setup(test_setup_t * t, uint32_t loss)
+{
+    assert(xbee_sim_init(&t->sim, 2, 7) == 0);
+    t->sim.loss = loss;
+
+    for(size_t i = 0; i < 2; ++i)
+    {
+        xbee_address_t peer;
+        xbee_sim_address16(&t->sim, 1 - i, &peer);
+        xbee_port_mux_init(&t->mux[i], &t->sim.nodes[i].xbee, 4);
+        xbee_stream_open(&t->stream[i], &t->mux[i], &t->port[i], TEST_PORT, 1,
+                4, t->queue[i], &peer);
+    }
+}
+
+/*! Bytes arrive in order and intact through loss */
+void test_stream_transfer(uint32_t loss)
+{
+    static test_setup_t t;
+    static uint8_t data[TEST_BYTES], got[TEST_BYTES];
+    test_setup(&t, loss);
+
+    for(size_t i = 0; i < sizeof(data); ++i)
+    {
+        data[i] = xbee_sim_random(&t.sim);
+    }
+
+    size_t written = 0, read = 0;
+    uint32_t start = t.sim.clock.now;
+    while(read < sizeof(data))
+    {
+        assert(t.sim.clock.now - start < 600000);
+
+        if(written < sizeof(data))
+        {
+            size_t n = sizeof(data) - written > 150 ? 150 : sizeof(data) - written;
+            int ret = xbee_stream_write(&t.stream[0], n, data + written);
+            assert(ret >= 0);
+            written += ret;
+        }
+
+        xbee_stream_run(&t.stream[0]);
+        xbee_stream_run(&t.stream[1]);
+        xbee_sim_advance(&t.sim, 2);
+
+        int ret = xbee_stream_read(&t.stream[1], sizeof(got) - read, got + read);
+        assert(ret >= 0);
+        read += ret;
+    }
+
+    assert(memcmp(data, got, sizeof(data)) == 0);
+    assert(xbee_stream_unacked(&t.stream[0]) < XBEE_STREAM_WINDOW*XBEE_STREAM_MAX_SEGMENT);
+
+    const xbee_stream_t * s = &t.stream[0];
+    printf("%s(%u ppm) passed, %u ms, sent %u, retransmits %u, timeouts %u, fast %u, status failures %u\n",
+            __func__, loss, t.sim.clock.now - start, s->segments_sent, s->retransmits,
+            s->timeouts, s->fast_retransmits, s->status_failures);
+}
+
+static int test_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    return xbee_transmit_gather(ptr, frame_id, address, option, count, buffers);
+}
+
+static int test_fail_transmit(void * ptr, uint8_t frame_id,
+        const xbee_address_t * address, uint8_t option,
+        size_t count, const xbee_buffer_t * buffers)
+{
+    return -1;
+}
+
+/*! Bytes taken into the send buffer are reported even if sending fails */
+void test_stream_write_partial(void)
+{
+    static test_setup_t t;
+    test_setup(&t, 0);
+
+    xbee_port_mux_set_transmit(&t.mux[0], test_fail_transmit, NULL);
+
+    uint8_t data[3*XBEE_STREAM_MAX_SEGMENT];
+    memset(data, 'x', sizeof(data));
+    assert(xbee_stream_write(&t.stream[0], sizeof(data), data) == sizeof(data));
+    assert(xbee_stream_unacked(&t.stream[0]) == sizeof(data));
+
+    /* Once the XBee takes frames again, the bytes go out */
+    xbee_port_mux_set_transmit(&t.mux[0], test_transmit, &t.sim.nodes[0].xbee);
+    uint8_t got[sizeof(data)];
+    size_t read = 0;
+    for(size_t i = 0; i < 2000 && read < sizeof(got); ++i)
+    {
+        xbee_stream_run(&t.stream[0]);
+        xbee_stream_run(&t.stream[1]);
+        xbee_sim_advance(&t.sim, 1);
+        read += xbee_stream_read(&t.stream[1], sizeof(got) - read, got + read);
+    }
+    assert(read == sizeof(got));
+    assert(memcmp(data, got, sizeof(got)) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Pushes a stream DATA message from node 0 to node 1 as node 1's XBee would */
+static void test_push_data(test_setup_t * t, uint8_t session, uint16_t seq,
+        size_t size, const void * data)
+{
+    uint8_t frame[XBEE_SIM_MAX_FRAME] = {XBEE_RECEIVE_16_BIT, 0x00, 0x01, 40, 0x00,
+        TEST_PORT, 0x01, session, seq >> 8, seq & 0xFF};
+    memcpy(&frame[10], data, size);
+    xbee_sim_push_frame(&t->sim, 1, 10 + size, frame);
+    xbee_sim_step(&t->sim);
+}
+
+/*! A segment longer than any sender cuts is dropped */
+void test_stream_oversized(void)
+{
+    static test_setup_t t;
+    test_setup(&t, 0);
+
+    uint8_t data[XBEE_STREAM_MAX_SEGMENT + 1];
+    memset(data, 'x', sizeof(data));
+    test_push_data(&t, t.stream[0].session, 0, sizeof(data), data);
+
+    assert(t.stream[1].receive_next == 0);
+    uint8_t got[sizeof(data)];
+    assert(xbee_stream_read(&t.stream[1], sizeof(got), got) == 0);
+
+    test_push_data(&t, t.stream[0].session, 0, sizeof(data) - 1, data);
+    assert(xbee_stream_read(&t.stream[1], sizeof(got), got) == sizeof(data) - 1);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Late packets of the peer's last session don't reset the new one */
+void test_stream_stale_session(void)
+{
+    static test_setup_t t;
+    test_setup(&t, 0);
+
+    uint8_t old = t.stream[0].session;
+    test_push_data(&t, old, 0, 3, "old");
+
+    /* Peer reopens, its new session starts */
+    uint8_t session = old + 1;
+    test_push_data(&t, session, 0, 3, "new");
+    test_push_data(&t, session, 1, 3, "est");
+
+    /* Retransmits of the old session arriving late */
+    test_push_data(&t, old, 0, 3, "old");
+    test_push_data(&t, old, 1, 3, "old");
+
+    /* Neither does a session that hasn't started */
+    test_push_data(&t, session + 1, 5, 3, "bad");
+
+    assert(t.stream[1].stale == 3);
+    uint8_t got[16];
+    assert(xbee_stream_read(&t.stream[1], sizeof(got), got) == 6);
+    assert(memcmp(got, "newest", 6) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+#define TEST_STREAMS (3)
+
+typedef struct {
+    xbee_sim_t sim;
+    uint32_t air_us;                /*! Channel time not yet on the clock */
+    xbee_port_mux_t mux[2];
+    xbee_stream_t stream[TEST_STREAMS][2];
+    xbee_port_t port[TEST_STREAMS][2];
+    xbee_port_message_t queue[TEST_STREAMS][2][4];
+} test_shared_t;
+
+/*! Every frame sent holds the channel for 2 ms plus its bytes at 250 kbps */
+static bool test_air_time(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    test_shared_t * t = ptr;
+    if(frame[0] == XBEE_TRANSMIT_16_BIT)
+    {
+        t->air_us += 2000 + size*8*1000/250;
+        sim->clock.now += t->air_us/1000;
+        t->air_us %= 1000;
+    }
+
+    return false;
+}
+
+/*! Streams between the same two nodes, always with bytes to send, get
+ * close to equal shares of a busy channel, each in order */
+void test_stream_fairness(uint32_t loss)
+{
+    static test_shared_t t;
+    memset(&t, 0, sizeof(t));
+    assert(xbee_sim_init(&t.sim, 2, 13) == 0);
+    t.sim.loss = loss;
+    t.sim.request = test_air_time;
+    t.sim.request_ptr = &t;
+
+    for(size_t i = 0; i < 2; ++i)
+    {
+        xbee_address_t peer;
+        xbee_sim_address16(&t.sim, 1 - i, &peer);
+        xbee_port_mux_init(&t.mux[i], &t.sim.nodes[i].xbee, 4);
+        for(size_t k = 0; k < TEST_STREAMS; ++k)
+        {
+            xbee_stream_open(&t.stream[k][i], &t.mux[i], &t.port[k][i], TEST_PORT + k, 1,
+                    4, t.queue[k][i], &peer);
+        }
+    }
+
+    size_t written[TEST_STREAMS] = {0}, read[TEST_STREAMS] = {0};
+    uint32_t start = t.sim.clock.now;
+    while(t.sim.clock.now - start < 20000)
+    {
+        for(size_t k = 0; k < TEST_STREAMS; ++k)
+        {
+            uint8_t data[150];
+            for(size_t j = 0; j < sizeof(data); ++j)
+            {
+                data[j] = (written[k] + j)*7 + k;
+            }
+            int ret = xbee_stream_write(&t.stream[k][0], sizeof(data), data);
+            assert(ret >= 0);
+            written[k] += ret;
+        }
+
+        for(size_t k = 0; k < TEST_STREAMS; ++k)
+        {
+            xbee_stream_run(&t.stream[k][0]);
+            xbee_stream_run(&t.stream[k][1]);
+        }
+        xbee_sim_advance(&t.sim, 1);
+
+        for(size_t k = 0; k < TEST_STREAMS; ++k)
+        {
+            uint8_t got[256];
+            int ret = xbee_stream_read(&t.stream[k][1], sizeof(got), got);
+            assert(ret >= 0);
+            for(int j = 0; j < ret; ++j)
+            {
+                assert(got[j] == (uint8_t)((read[k] + j)*7 + k));
+            }
+            read[k] += ret;
+        }
+    }
+
+    size_t least = read[0], most = read[0];
+    for(size_t k = 1; k < TEST_STREAMS; ++k)
+    {
+        least = read[k] < least ? read[k] : least;
+        most = read[k] > most ? read[k] : most;
+    }
+    assert(least > 0);
+    assert(least*10 >= most*9);
+
+    printf("%s(%u ppm) passed, bytes read %zu to %zu\n", __func__, loss, least, most);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_stream_transfer(0);
+    test_stream_transfer(100000);
+    test_stream_write_partial();
+    test_stream_oversized();
+    test_stream_stale_session();
+    test_stream_fairness(0);
+    test_stream_fairness(50000);
+
+    return 0;
+}
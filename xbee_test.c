@@ -1,11 +1,18 @@
+#include <assert.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <errno.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <string.h>
+#include <time.h>
 
 #include "xbee.h"
+#include "xbee_sim.h"
+#include "xbee_timer.h"
+
+/* Decoder and clock tests run against a simulated XBee.  Given a device, e.g.
+ * /dev/ttyUSB0, the test then talks to the XBee on it as well. */
 
 int write_fd(void * ptr, const void *buf, size_t nbyte)
 {
@@ -73,11 +80,486 @@ int set_baud_rate(xbee_interface_t * xbee, int speed)
         return -1;
     }
 
+    return 0;
+}
+
+/*! Returns the next frame node's host decodes, 0 if there is none */
+static int test_recv(xbee_sim_t * sim, size_t node, size_t size, void * frame)
+{
+    for(size_t i = 0; i < 4; ++i)
+    {
+        int ret = xbee_recv_frame(&sim->nodes[node].xbee, size, frame);
+        if(ret != 0)
+        {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static const uint8_t test_modem_status[] = {XBEE_MODEM_STATUS, XBEE_MODEM_ASSOCIATED};
+
+/*! A frame cut short by the next one's delimiter is dropped, and the
+ * next one decoded */
+void test_decode_delimiter_in_frame(void)
+{
+    static xbee_sim_t sim;
+    assert(xbee_sim_init(&sim, 1, 53) == 0);
+
+    const uint8_t cut[] = {0x7E, 0x00, 0x02, 0xFF};
+    xbee_sim_push_bytes(&sim, 0, sizeof(cut), cut);
+    xbee_sim_push_frame(&sim, 0, sizeof(test_modem_status), test_modem_status);
+
+    uint8_t frame[XBEE_MAX_FRAME_SIZE];
+    assert(test_recv(&sim, 0, sizeof(frame), frame) == sizeof(test_modem_status));
+    assert(memcmp(frame, test_modem_status, sizeof(test_modem_status)) == 0);
+    assert(test_recv(&sim, 0, sizeof(frame), frame) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A frame is only returned once all of it has arrived */
+void test_decode_truncated(void)
+{
+    static xbee_sim_t sim;
+    assert(xbee_sim_init(&sim, 1, 59) == 0);
+
+    const uint8_t head[] = {0x7E, 0x00, 0x02, XBEE_MODEM_STATUS};
+    const uint8_t tail[] = {XBEE_MODEM_ASSOCIATED, 0xFF - XBEE_MODEM_STATUS - XBEE_MODEM_ASSOCIATED};
+    xbee_sim_push_bytes(&sim, 0, sizeof(head), head);
+
+    uint8_t frame[XBEE_MAX_FRAME_SIZE];
+    assert(test_recv(&sim, 0, sizeof(frame), frame) == 0);
+
+    xbee_sim_push_bytes(&sim, 0, sizeof(tail), tail);
+    assert(test_recv(&sim, 0, sizeof(frame), frame) == sizeof(test_modem_status));
+    assert(memcmp(frame, test_modem_status, sizeof(test_modem_status)) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A frame failing its checksum is dropped, and the next one decoded */
+void test_decode_bad_checksum(void)
+{
+    static xbee_sim_t sim;
+    assert(xbee_sim_init(&sim, 1, 61) == 0);
+
+    const uint8_t bad[] = {0x7E, 0x00, 0x02, XBEE_MODEM_STATUS, XBEE_MODEM_DISASSOCIATED,
+        0xFF - XBEE_MODEM_STATUS - XBEE_MODEM_DISASSOCIATED + 1};
+    xbee_sim_push_bytes(&sim, 0, sizeof(bad), bad);
+    xbee_sim_push_frame(&sim, 0, sizeof(test_modem_status), test_modem_status);
+
+    uint8_t frame[XBEE_MAX_FRAME_SIZE];
+    assert(test_recv(&sim, 0, sizeof(frame), frame) == sizeof(test_modem_status));
+    assert(memcmp(frame, test_modem_status, sizeof(test_modem_status)) == 0);
+    assert(test_recv(&sim, 0, sizeof(frame), frame) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+static xbee_sleep_ms_t test_sim_sleep;
+
+/*! Sleeps half as long as asked, as a host with a broken clock would */
+static void test_short_sleep(void * ptr, uint32_t ms)
+{
+    test_sim_sleep(ptr, ms/2);
+}
+
+static double test_wall_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000.0 + ts.tv_nsec/1e6;
+}
+
+/*! xbee_open waits out both guard times and the check in virtual time,
+ * and fails as it would on hardware if the waits are cut short */
+void test_open_virtual_time(void)
+{
+    static xbee_sim_t sim;
+    assert(xbee_sim_init(&sim, 1, 61) == 0);
+    xbee_sim_node_t * node = &sim.nodes[0];
+
+    uint32_t start = sim.clock.now;
+    double wall = test_wall_ms();
+    assert(xbee_open(&node->xbee, &node->uart, sizeof(node->recv), node->recv) == 0);
+    wall = test_wall_ms() - wall;
+    uint32_t elapsed = sim.clock.now - start;
+    assert(elapsed >= 2*XBEE_GUARD_TIME*1000 + 1000);
+    assert(wall < elapsed);
+
+    /* The module only answers +++ after a full guard time */
+    test_sim_sleep = node->uart.sleep_ms;
+    node->uart.sleep_ms = test_short_sleep;
+    assert(xbee_open(&node->xbee, &node->uart, sizeof(node->recv), node->recv) == -2);
+
+    node->uart.sleep_ms = test_sim_sleep;
+    assert(xbee_open(&node->xbee, &node->uart, sizeof(node->recv), node->recv) == 0);
+
+    printf("%s passed, %u ms of virtual time in %.3f ms\n", __func__, elapsed, wall);
+}
+
+static unsigned test_slept;
+
+static unsigned test_sleep_seconds(unsigned sec)
+{
+    test_slept += sec;
+    return 0;
+}
+
+/*! Without sleep_ms, waits round up to whole seconds of sleep */
+void test_sleep_fallback(void)
+{
+    xbee_uart_interface_t uart = {.sleep = test_sleep_seconds};
+    xbee_interface_t xbee;
+    memset(&xbee, 0, sizeof(xbee));
+    xbee.uart = &uart;
+
+    xbee_sleep_ms(&xbee, 1500);
+    assert(test_slept == 2);
+    xbee_sleep_ms(&xbee, 1000);
+    assert(test_slept == 3);
+
+    xbee_virtual_clock_t clock = {0xFFFFFF00};
+    xbee_virtual_clock_sleep(&clock, 0x200);
+    assert(xbee_virtual_clock_now(&clock) == 0x100);
+
+    printf("%s passed\n", __func__);
+}
+
+static bool test_drop(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    return true;
+}
+
+static int test_failed_reason;
+
+static void test_failed(void * ptr, xbee_interface_t * xbee, uint8_t frame_id, int reason)
+{
+    test_failed_reason = reason;
+}
+
+/*! Frame timeouts run on the same virtual clock */
+void test_frame_timeout_virtual(void)
+{
+    static xbee_sim_t sim;
+    static xbee_timer_wheel_t wheel;
+    static xbee_timer_t frame_timers[256];
+    static xbee_handler_t handler;
+    assert(xbee_sim_init(&sim, 2, 67) == 0);
+
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    xbee_timer_wheel_init(&wheel, xbee_now(xbee));
+    xbee_set_frame_timeout(xbee, &wheel, 500, frame_timers);
+    handler.failed = test_failed;
+    xbee_add_handler(xbee, &handler);
+    sim.request = test_drop;
+
+    xbee_address_t peer;
+    xbee_sim_address16(&sim, 1, &peer);
+    uint8_t frame_id = xbee_alloc_frame_id(xbee);
+    assert(xbee_transmit(xbee, frame_id, &peer, 0, 2, "hi") == 0);
+
+    xbee_sim_advance(&sim, 499);
+    assert(test_failed_reason == 0);
+    xbee_sim_advance(&sim, 2);
+    assert(test_failed_reason == XBEE_FAIL_TIMEOUT);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Frame ids that can be allocated, every one held is freed again */
+static size_t test_free_frame_ids(xbee_interface_t * xbee)
+{
+    uint8_t held[255];
+    size_t count = 0;
+    for(uint8_t id; (id = xbee_alloc_frame_id(xbee)) != 0; )
+    {
+        held[count++] = id;
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        xbee_free_frame_id(xbee, held[i]);
+    }
+
+    return count;
+}
+
+static const uint8_t test_hardware_reset[] = {XBEE_MODEM_STATUS, XBEE_MODEM_HARDWARE_RESET};
+
+/*! A reset mid-traffic fails the frame in flight, refuses traffic until
+ * the settings are back without using up frame ids, then takes the held
+ * traffic */
+void test_reset_resume(void)
+{
+    static xbee_sim_t sim;
+    static xbee_handler_t handler;
+    assert(xbee_sim_init(&sim, 2, 71) == 0);
+
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    static const xbee_at_setting_t restore[] = {{{'C', 'H'}, 1, {0x0C}}};
+    xbee_set_restore_settings(xbee, 1, restore);
+    handler.failed = test_failed;
+    xbee_add_handler(xbee, &handler);
+    test_failed_reason = 0;
+
+    xbee_address_t peer;
+    xbee_sim_address16(&sim, 1, &peer);
+    assert(xbee_transmit(xbee, xbee_alloc_frame_id(xbee), &peer, 0, 2, "hi") == 0);
+    xbee_sim_push_frame(&sim, 0, sizeof(test_hardware_reset), test_hardware_reset);
+    xbee_sim_step(&sim);
+    assert(xbee->state == XBEE_STATE_RECOVERING);
+    assert(test_failed_reason == XBEE_FAIL_MODULE_RESET);
+    assert(xbee->stats.resets == 1);
+
+    /* The caller retries its held traffic many times over meanwhile */
+    xbee_encoded_frame_t encoded;
+    for(size_t i = 0; i < 300; ++i)
+    {
+        uint8_t frame_id = xbee_alloc_frame_id(xbee);
+        assert(frame_id != 0);
+        switch(i % 3)
+        {
+        case 0:
+            assert(xbee_transmit(xbee, frame_id, &peer, 0, 4, "held") == XBEE_ERR_NOT_READY);
+            break;
+        case 1:
+            assert(xbee_encode_transmit(&encoded, frame_id, &peer, 0, 4, "held") == 0);
+            assert(xbee_transmit_encoded(xbee, &encoded) == XBEE_ERR_NOT_READY);
+            break;
+        default:
+            assert(xbee_remote_at_command(xbee, &peer, 0, frame_id, "CH", 0, NULL) ==
+                    XBEE_ERR_NOT_READY);
+            break;
+        }
+    }
+
+    xbee_sim_step(&sim);
+    assert(xbee->state == XBEE_STATE_READY);
+    uint8_t ch;
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == 1 && ch == 0x0C);
+
+    uint32_t delivered = sim.delivered;
+    uint32_t unhandled = sim.nodes[1].unhandled;
+    for(size_t i = 0; i < 3; ++i)
+    {
+        assert(xbee_transmit(xbee, xbee_alloc_frame_id(xbee), &peer, 0, 4, "held") == 0);
+    }
+    xbee_sim_step(&sim);
+    assert(sim.delivered == delivered + 3);
+    assert(sim.nodes[1].unhandled == unhandled + 3);
+    assert(test_free_frame_ids(xbee) == 255);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Frames node 0's host has written to its module so far */
+static uint32_t test_frames_in(xbee_sim_t * sim)
+{
+    return sim->nodes[0].frames_in;
+}
+
+/*! A value read once is answered from the cache after, refresh and
+ * measurements go to the XBee every time */
+void test_at_cache_hit(void)
+{
+    static xbee_sim_t sim;
+    assert(xbee_sim_init(&sim, 1, 73) == 0);
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    xbee_sim_set_register(&sim, 0, "CH", 1, "\x0C");
+    xbee_sim_set_register(&sim, 0, "DB", 1, "\x28");
+
+    uint32_t frames = test_frames_in(&sim);
+    uint8_t ch = 0;
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == XBEE_ERR_CACHE_MISS);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == XBEE_ERR_CACHE_MISS);
+    xbee_sim_step(&sim);
+    assert(test_frames_in(&sim) == frames + 1);
+
+    frames = test_frames_in(&sim);
+    for(size_t i = 0; i < 3; ++i)
+    {
+        assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == 1 && ch == 0x0C);
+        xbee_sim_step(&sim);
+    }
+    assert(test_frames_in(&sim) == frames);
+    assert(xbee_at_cached(xbee, "CH", false, 0, &ch) == XBEE_ERR_TOO_LARGE);
+
+    /* Changed behind the library's back, e.g. in command mode */
+    xbee_sim_set_register(&sim, 0, "CH", 1, "\x0D");
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == 1 && ch == 0x0C);
+    assert(xbee_at_cached(xbee, "CH", true, 1, &ch) == XBEE_ERR_CACHE_MISS);
+    xbee_sim_step(&sim);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == 1 && ch == 0x0D);
+    assert(test_frames_in(&sim) == frames + 1);
+
+    uint8_t db;
+    for(size_t i = 0; i < 2; ++i)
+    {
+        assert(xbee_at_cached(xbee, "DB", false, 1, &db) == XBEE_ERR_CACHE_MISS);
+        xbee_sim_step(&sim);
+    }
+    assert(test_frames_in(&sim) == frames + 3);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! A write with a frame id becomes the cached value once the XBee OKs it,
+ * without a query; a write without one, or a queued one, is read again */
+void test_at_cache_write(void)
+{
+    static xbee_sim_t sim;
+    assert(xbee_sim_init(&sim, 1, 73) == 0);
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    xbee_sim_set_register(&sim, 0, "CH", 1, "\x0C");
+
+    uint8_t ch;
+    uint32_t frames = test_frames_in(&sim);
+    assert(xbee_at_command(xbee, xbee_alloc_frame_id(xbee), "CH", 1, "\x0E") == 0);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == XBEE_ERR_CACHE_MISS);
+    xbee_sim_step(&sim);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == 1 && ch == 0x0E);
+    assert(test_frames_in(&sim) == frames + 1);
+
+    assert(xbee_at_command(xbee, 0, "CH", 1, "\x0F") == 0);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == XBEE_ERR_CACHE_MISS);
+    xbee_sim_step(&sim);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == 1 && ch == 0x0F);
+
+    /* A query answered before the queued value is applied isn't kept,
+     * whichever value it shows */
+    assert(xbee_at_cached(xbee, "CH", true, 1, &ch) == XBEE_ERR_CACHE_MISS);
+    assert(xbee_at_queue_parameter(xbee, xbee_alloc_frame_id(xbee), "CH", 1, "\x10") == 0);
+    xbee_sim_step(&sim);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == XBEE_ERR_CACHE_MISS);
+    assert(xbee_at_queue_parameter(xbee, xbee_alloc_frame_id(xbee), "CH", 1, "\x11") == 0);
+    assert(xbee_at_command(xbee, xbee_alloc_frame_id(xbee), "AC", 0, NULL) == 0);
+    xbee_sim_step(&sim);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == XBEE_ERR_CACHE_MISS);
+    xbee_sim_step(&sim);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == 1 && ch == 0x11);
+
+    /* WR saves the running values, the cache stays */
+    frames = test_frames_in(&sim);
+    assert(xbee_at_command(xbee, xbee_alloc_frame_id(xbee), "WR", 0, NULL) == 0);
+    xbee_sim_step(&sim);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == 1 && ch == 0x11);
+    assert(test_frames_in(&sim) == frames + 1);
+
+    /* A refused write leaves nothing cached */
+    uint8_t big[XBEE_MAX_AT_PARAM + 1] = {0};
+    assert(xbee_at_command(xbee, xbee_alloc_frame_id(xbee), "CH", sizeof(big), big) == 0);
+    xbee_sim_step(&sim);
+    assert(xbee_at_cached(xbee, "CH", false, 1, &ch) == XBEE_ERR_CACHE_MISS);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! RE, FR and a reset of the XBee forget every cached value */
+void test_at_cache_flush(void)
+{
+    static xbee_sim_t sim;
+    assert(xbee_sim_init(&sim, 1, 73) == 0);
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    xbee_sim_set_register(&sim, 0, "CH", 1, "\x0C");
+    xbee_sim_set_register(&sim, 0, "ID", 2, "\x33\x32");
+
+    static const char * resets[] = {"RE", "FR", NULL};
+    for(size_t i = 0; i < sizeof(resets)/sizeof(resets[0]); ++i)
+    {
+        uint8_t value[2];
+        xbee_at_cached(xbee, "CH", false, sizeof(value), value);
+        xbee_at_cached(xbee, "ID", false, sizeof(value), value);
+        xbee_sim_step(&sim);
+        assert(xbee_at_cached(xbee, "CH", false, sizeof(value), value) == 1);
+        assert(xbee_at_cached(xbee, "ID", false, sizeof(value), value) == 2);
+
+        if(resets[i] != NULL)
+        {
+            assert(xbee_at_command(xbee, xbee_alloc_frame_id(xbee), (char *)resets[i],
+                    0, NULL) == 0);
+        }
+        else
+        {
+            xbee_sim_push_frame(&sim, 0, sizeof(test_hardware_reset), test_hardware_reset);
+        }
+        xbee_sim_step(&sim);
+        assert(xbee_at_cached(xbee, "CH", false, sizeof(value), value) == XBEE_ERR_CACHE_MISS);
+        assert(xbee_at_cached(xbee, "ID", false, sizeof(value), value) == XBEE_ERR_CACHE_MISS);
+        xbee_sim_step(&sim);
+    }
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Flags of the cache entry for at_command, 0 if there is none */
+static uint8_t test_at_flags(xbee_interface_t * xbee, const char * at_command)
+{
+    for(size_t i = 0; i < XBEE_AT_CACHE_SIZE; ++i)
+    {
+        const xbee_at_cache_entry_t * e = &xbee->at_cache[i];
+        if(e->flags != 0 && memcmp(e->at_command, at_command, 2) == 0)
+        {
+            return e->flags;
+        }
+    }
+
+    return 0;
+}
+
+/*! Values valid when WR is OK'd are saved until they change */
+void test_at_cache_saved(void)
+{
+    static xbee_sim_t sim;
+    assert(xbee_sim_init(&sim, 1, 79) == 0);
+    xbee_interface_t * xbee = &sim.nodes[0].xbee;
+    xbee_sim_set_register(&sim, 0, "CH", 1, "\x0C");
+    xbee_sim_set_register(&sim, 0, "ID", 2, "\x33\x32");
+    xbee_sim_set_register(&sim, 0, "WR", 0, "");
+
+    uint8_t value[2];
+    xbee_at_cached(xbee, "CH", false, sizeof(value), value);
+    xbee_sim_step(&sim);
+    assert(test_at_flags(xbee, "CH") == XBEE_AT_CACHE_VALID);
+
+    /* Without a frame id there is no OK to go by */
+    assert(xbee_at_command(xbee, 0, "WR", 0, NULL) == 0);
+    xbee_sim_step(&sim);
+    assert(test_at_flags(xbee, "CH") == XBEE_AT_CACHE_VALID);
+
+    assert(xbee_at_command(xbee, xbee_alloc_frame_id(xbee), "WR", 0, NULL) == 0);
+    xbee_sim_step(&sim);
+    assert(test_at_flags(xbee, "CH") == (XBEE_AT_CACHE_VALID | XBEE_AT_CACHE_SAVED));
+
+    /* Read again unchanged it stays saved, values cached later aren't */
+    xbee_at_cached(xbee, "CH", true, sizeof(value), value);
+    xbee_at_cached(xbee, "ID", false, sizeof(value), value);
+    xbee_sim_step(&sim);
+    assert(test_at_flags(xbee, "CH") == (XBEE_AT_CACHE_VALID | XBEE_AT_CACHE_SAVED));
+    assert(test_at_flags(xbee, "ID") == XBEE_AT_CACHE_VALID);
+
+    /* Changed on the XBee behind the cache's back, or written */
+    xbee_sim_set_register(&sim, 0, "CH", 1, "\x0D");
+    xbee_at_cached(xbee, "CH", true, sizeof(value), value);
+    xbee_sim_step(&sim);
+    assert(test_at_flags(xbee, "CH") == XBEE_AT_CACHE_VALID);
+
+    assert(xbee_at_command(xbee, xbee_alloc_frame_id(xbee), "WR", 0, NULL) == 0);
+    xbee_sim_step(&sim);
+    assert(test_at_flags(xbee, "ID") == (XBEE_AT_CACHE_VALID | XBEE_AT_CACHE_SAVED));
+    assert(xbee_at_command(xbee, xbee_alloc_frame_id(xbee), "ID", 2, "\x11\x11") == 0);
+    xbee_sim_step(&sim);
+    assert(test_at_flags(xbee, "ID") == XBEE_AT_CACHE_VALID);
+
+    printf("%s passed\n", __func__);
 }
 
 void test_xbee(xbee_interface_t * xbee)
 {
-    char buf[1];
+    char buf[1] = {0};
     int ret = xbee_at_command(xbee, 1, "BD", 0, buf);
     if(ret < 0)
     {
@@ -161,6 +643,23 @@ void test_xbee(xbee_interface_t * xbee)
 
 int main(int argc, char * argv[])
 {
+    test_decode_delimiter_in_frame();
+    test_decode_truncated();
+    test_decode_bad_checksum();
+    test_open_virtual_time();
+    test_sleep_fallback();
+    test_frame_timeout_virtual();
+    test_reset_resume();
+    test_at_cache_hit();
+    test_at_cache_write();
+    test_at_cache_flush();
+    test_at_cache_saved();
+
+    if(argc < 2)
+    {
+        return 0;
+    }
+
     int fd;
     xbee_uart_interface_t uart = {
         .ptr = &fd,
@@ -171,7 +670,7 @@ int main(int argc, char * argv[])
 
     uint8_t buf[XBEE_REC_BUF_SIZE];
 
-    fd = open("/dev/ttyUSB0", O_RDWR | O_NOCTTY | O_NONBLOCK);
+    fd = open(argv[1], O_RDWR | O_NOCTTY | O_NONBLOCK);
     if(fd < 0)
     {
         printf("fd = %d, errno = %d, strerror = %s\n", fd, errno, strerror(errno));
@@ -0,0 +1,231 @@
+#include "xbee_timer.h"
+#include <assert.h>
+#include <string.h>
+
+static void xbee_timer_link(xbee_timer_t ** head, xbee_timer_t * timer)
+{
+    timer->next = *head;
+    if(timer->next != NULL)
+    {
+        timer->next->pprev = &timer->next;
+    }
+
+    timer->pprev = head;
+    *head = timer;
+}
+
+static void xbee_timer_unlink(xbee_timer_t * timer)
+{
+    *timer->pprev = timer->next;
+    if(timer->next != NULL)
+    {
+        timer->next->pprev = timer->pprev;
+    }
+
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/*! Links timer into the slot its deadline falls in, seen from wheel->now */
+static void xbee_timer_place(xbee_timer_wheel_t * wheel, xbee_timer_t * timer)
+{
+    uint32_t delta = timer->deadline - wheel->now;
+
+    size_t level = 0;
+    while(level < XBEE_TIMER_LEVELS - 1 && 
+          (delta >> (XBEE_TIMER_LEVEL_BITS*(level + 1))) != 0)
+    {
+        level += 1;
+    }
+
+    size_t slot = (timer->deadline >> (XBEE_TIMER_LEVEL_BITS*level)) & (XBEE_TIMER_SLOTS - 1);
+    xbee_timer_link(&wheel->slots[level][slot], timer);
+}
+
+void xbee_timer_wheel_init(xbee_timer_wheel_t * wheel, uint32_t now)
+{
+    assert(wheel);
+
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now;
+}
+
+void xbee_timer_init(xbee_timer_t * timer, xbee_timer_fun_t fun, void * ptr)
+{
+    assert(timer);
+    assert(fun);
+
+    memset(timer, 0, sizeof(*timer));
+    timer->fun = fun;
+    timer->ptr = ptr;
+}
+
+void xbee_timer_start(xbee_timer_wheel_t * wheel, xbee_timer_t * timer, 
+        uint32_t deadline)
+{
+    assert(wheel);
+    assert(timer);
+    assert(timer->fun);
+
+    xbee_timer_cancel(wheel, timer);
+
+    if((int32_t)(deadline - wheel->now) <= 0)
+    {
+        deadline = wheel->now + 1;
+    }
+
+    timer->deadline = deadline;
+    xbee_timer_place(wheel, timer);
+    wheel->count += 1;
+}
+
+void xbee_timer_cancel(xbee_timer_wheel_t * wheel, xbee_timer_t * timer)
+{
+    assert(wheel);
+    assert(timer);
+
+    if(timer->pprev != NULL)
+    {
+        xbee_timer_unlink(timer);
+        wheel->count -= 1;
+    }
+}
+
+/*! Moves every timer in slot down to the level its deadline now falls in */
+static void xbee_timer_cascade(xbee_timer_wheel_t * wheel, size_t level, size_t slot)
+{
+    xbee_timer_t * timer = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+
+    while(timer != NULL)
+    {
+        xbee_timer_t * next = timer->next;
+        xbee_timer_place(wheel, timer);
+        timer = next;
+    }
+}
+
+/*! Gets the first time after wheel->now, up to limit, that a slot holding
+ * timers is cascaded or expired, or limit if there is none
+ *
+ * Every time skipped over would only have processed empty slots. */
+static uint32_t xbee_timer_next_work(const xbee_timer_wheel_t * wheel, uint32_t limit)
+{
+    uint32_t best = limit - wheel->now;
+
+    for(size_t level = 0; level < XBEE_TIMER_LEVELS; ++level)
+    {
+        size_t shift = XBEE_TIMER_LEVEL_BITS*level;
+        uint32_t block = wheel->now >> shift;
+
+        /* Level's slots are processed in turn at each multiple of its
+         * slot width, the first non-empty one is the level's next work.
+         * The top level's times wrap round after 4 slots. */
+        for(uint32_t i = 1; i <= XBEE_TIMER_SLOTS; ++i)
+        {
+            uint32_t time = (block + i) << shift;
+            uint32_t delta = time - wheel->now;
+            if(delta == 0 || delta >= best)
+            {
+                break;
+            }
+
+            if(wheel->slots[level][(time >> shift) & (XBEE_TIMER_SLOTS - 1)] != NULL)
+            {
+                best = delta;
+                break;
+            }
+        }
+    }
+
+    return wheel->now + best;
+}
+
+size_t xbee_timer_run(xbee_timer_wheel_t * wheel, uint32_t now)
+{
+    assert(wheel);
+
+    size_t expired = 0;
+    while((int32_t)(now - wheel->now) > 0)
+    {
+        if(wheel->count == 0)
+        {
+            wheel->now = now;
+            break;
+        }
+
+        wheel->now = xbee_timer_next_work(wheel, now);
+
+        /* Entering a new slot of a level pulls the matching slot of the 
+         * level above down, before this ms's timers are expired */
+        for(size_t level = 1; level < XBEE_TIMER_LEVELS; ++level)
+        {
+            if((wheel->now & ((1UL << (XBEE_TIMER_LEVEL_BITS*level)) - 1)) != 0)
+            {
+                break;
+            }
+
+            xbee_timer_cascade(wheel, level, 
+                    (wheel->now >> (XBEE_TIMER_LEVEL_BITS*level)) & (XBEE_TIMER_SLOTS - 1));
+        }
+
+        /* Detach the slot, so timer functions may start timers into it */
+        xbee_timer_t * list = wheel->slots[0][wheel->now & (XBEE_TIMER_SLOTS - 1)];
+        wheel->slots[0][wheel->now & (XBEE_TIMER_SLOTS - 1)] = NULL;
+        if(list != NULL)
+        {
+            list->pprev = &list;
+        }
+
+        while(list != NULL)
+        {
+            xbee_timer_t * timer = list;
+            xbee_timer_unlink(timer);
+            wheel->count -= 1;
+            expired += 1;
+
+            timer->fun(timer->ptr, timer);
+        }
+    }
+
+    return expired;
+}
+
+bool xbee_timer_next(const xbee_timer_wheel_t * wheel, uint32_t * deadline)
+{
+    assert(wheel);
+    assert(deadline);
+
+    if(wheel->count == 0)
+    {
+        return false;
+    }
+
+    /* Slots of a level are in deadline order starting after the current 
+     * one, so the earliest timer of a level is in its first non-empty slot */
+    bool found = false;
+    for(size_t level = 0; level < XBEE_TIMER_LEVELS; ++level)
+    {
+        size_t current = (wheel->now >> (XBEE_TIMER_LEVEL_BITS*level)) & (XBEE_TIMER_SLOTS - 1);
+        for(size_t i = 1; i <= XBEE_TIMER_SLOTS; ++i)
+        {
+            const xbee_timer_t * timer = wheel->slots[level][(current + i) & (XBEE_TIMER_SLOTS - 1)];
+            if(timer == NULL)
+            {
+                continue;
+            }
+
+            for(; timer != NULL; timer = timer->next)
+            {
+                if(!found || (int32_t)(timer->deadline - *deadline) < 0)
+                {
+                    *deadline = timer->deadline;
+                    found = true;
+                }
+            }
+            break;
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,77 @@
+#ifndef _XBEE_TIMER_H_
+#define _XBEE_TIMER_H_
+
+#include "xbee.h"
+
+#define XBEE_TIMER_LEVEL_BITS (6)
+#define XBEE_TIMER_SLOTS (1 << XBEE_TIMER_LEVEL_BITS)
+#define XBEE_TIMER_LEVELS (6)   /*! 6 levels of 6 bits cover all 32 bit times */
+
+typedef void (*xbee_timer_fun_t)(void * ptr, xbee_timer_t * timer);
+
+/*! Intrusive timer, embed in the object that times out
+ *
+ * A timer is pending from xbee_timer_start until it expires or is 
+ * cancelled.
+ */
+struct xbee_timer {
+    xbee_timer_t * next;
+    xbee_timer_t ** pprev;      /*! NULL when not pending */
+    uint32_t deadline;
+
+    xbee_timer_fun_t fun;
+    void * ptr;
+};
+
+/*! Hierarchical timing wheel, times in milliseconds
+ *
+ * Level n has 64 slots of 64^n ms.  Starting and cancelling a timer is 
+ * O(1).  Advancing jumps from one non-empty slot to the next, costing 
+ * O(levels*slots) per slot processed plus the timers expired, however 
+ * long since the last advance; a timer moves down a level at most 5 
+ * times over its life.
+ *
+ * Timers must be due within 2^31 ms.
+ */
+struct xbee_timer_wheel {
+    uint32_t now;               /*! Last ms processed */
+    size_t count;               /*! Pending timers */
+    xbee_timer_t * slots[XBEE_TIMER_LEVELS][XBEE_TIMER_SLOTS];
+};
+
+void xbee_timer_wheel_init(xbee_timer_wheel_t * wheel, uint32_t now) SPECIAL_SECTION;
+
+void xbee_timer_init(xbee_timer_t * timer, xbee_timer_fun_t fun, void * ptr) SPECIAL_SECTION;
+
+/*! Starts (or restarts) timer to expire at deadline
+ *
+ * A deadline not after the wheel's current time expires on the next 
+ * xbee_timer_run that advances time.
+ */
+void xbee_timer_start(xbee_timer_wheel_t * wheel, xbee_timer_t * timer, 
+        uint32_t deadline) SPECIAL_SECTION;
+
+/*! Stops timer, does nothing if timer is not pending */
+void xbee_timer_cancel(xbee_timer_wheel_t * wheel, xbee_timer_t * timer) SPECIAL_SECTION;
+
+static inline bool xbee_timer_pending(const xbee_timer_t * timer)
+{
+    return timer->pprev != NULL;
+}
+
+/*! Advances wheel to now, calling each expired timer's function
+ *
+ * Timer functions may start and cancel timers, including their own.
+ *
+ * \return Number of timers expired
+ */
+size_t xbee_timer_run(xbee_timer_wheel_t * wheel, uint32_t now) SPECIAL_SECTION;
+
+/*! Gets the earliest deadline of pending timers, so the caller can sleep 
+ * until then
+ *
+ * \return false if no timer is pending
+ */
+bool xbee_timer_next(const xbee_timer_wheel_t * wheel, uint32_t * deadline) SPECIAL_SECTION;
+
+#endif /* _XBEE_TIMER_H_ */
@@ -0,0 +1,194 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "xbee_timer.h"
+
+#define TEST_TIMERS 256
+
+typedef struct {
+    xbee_timer_t timer;
+    uint32_t deadline;
+    uint32_t fired_at;
+    size_t fired;
+    uint32_t period;            /* Restarts itself this long after firing when non-zero */
+    xbee_timer_wheel_t * wheel;
+} test_timer_t;
+
+static uint32_t test_random_state = 12345;
+
+static uint32_t test_random(void)
+{
+    uint32_t x = test_random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    test_random_state = x;
+    return x;
+}
+
+static void test_fire(void * ptr, xbee_timer_t * timer)
+{
+    test_timer_t * t = ptr;
+
+    assert(!xbee_timer_pending(timer));
+    t->fired += 1;
+    t->fired_at = t->wheel->now;
+
+    if(t->period != 0)
+    {
+        t->deadline = t->wheel->now + t->period;
+        xbee_timer_start(t->wheel, timer, t->deadline);
+    }
+}
+
+/*! Timers fire in the run that first reaches their deadline, at it */
+void test_timer_random(uint32_t start)
+{
+    static test_timer_t timers[TEST_TIMERS];
+    xbee_timer_wheel_t wheel;
+    xbee_timer_wheel_init(&wheel, start);
+
+    for(size_t i = 0; i < TEST_TIMERS; ++i)
+    {
+        test_timer_t * t = &timers[i];
+        memset(t, 0, sizeof(*t));
+        t->wheel = &wheel;
+        xbee_timer_init(&t->timer, test_fire, t);
+
+        /* Spread over every level */
+        uint32_t delta = 1 + (test_random() >> (test_random() % 32));
+        if(delta >= (1UL << 31))
+        {
+            delta = (1UL << 31) - 1;
+        }
+        t->deadline = start + delta;
+        xbee_timer_start(&wheel, &t->timer, t->deadline);
+    }
+    assert(wheel.count == TEST_TIMERS);
+
+    uint32_t now = start;
+    size_t expired = 0;
+    while(wheel.count > 0)
+    {
+        uint32_t next;
+        assert(xbee_timer_next(&wheel, &next));
+
+        /* Sometimes stop short of the next deadline, sometimes jump far past it */
+        uint32_t step;
+        switch(test_random() % 3)
+        {
+        case 0:
+            step = 1 + test_random() % 64;
+            break;
+        case 1:
+            step = next - now;
+            break;
+        default:
+            step = 1 + (test_random() >> (2 + test_random() % 30));
+            break;
+        }
+        now += step;
+
+        expired += xbee_timer_run(&wheel, now);
+        assert(wheel.now == now);
+
+        for(size_t i = 0; i < TEST_TIMERS; ++i)
+        {
+            test_timer_t * t = &timers[i];
+            if(t->fired > 0)
+            {
+                assert(t->fired == 1);
+                assert(t->fired_at == t->deadline);
+            }
+            else
+            {
+                assert((int32_t)(t->deadline - now) > 0);
+                assert(xbee_timer_pending(&t->timer));
+                assert((int32_t)(t->deadline - next) >= 0);
+            }
+        }
+    }
+
+    assert(expired == TEST_TIMERS);
+    printf("%s(%08x) passed\n", __func__, start);
+}
+
+/*! Periodic timers restarting from their callbacks keep exact time */
+void test_timer_periodic(void)
+{
+    static test_timer_t timers[3];
+    uint32_t periods[3] = {1, 63, 4097};
+    xbee_timer_wheel_t wheel;
+    xbee_timer_wheel_init(&wheel, 0xFFFFF000);
+
+    for(size_t i = 0; i < 3; ++i)
+    {
+        test_timer_t * t = &timers[i];
+        memset(t, 0, sizeof(*t));
+        t->wheel = &wheel;
+        t->period = periods[i];
+        xbee_timer_init(&t->timer, test_fire, t);
+        xbee_timer_start(&wheel, &t->timer, 0xFFFFF000 + t->period);
+    }
+
+    /* Across the 32 bit wrap */
+    for(uint32_t ms = 0; ms < 50000; ms += 7)
+    {
+        xbee_timer_run(&wheel, 0xFFFFF000 + ms);
+    }
+    xbee_timer_run(&wheel, 0xFFFFF000 + 50000);
+
+    for(size_t i = 0; i < 3; ++i)
+    {
+        assert(timers[i].fired == 50000/periods[i]);
+        assert(timers[i].fired_at == (uint32_t)(0xFFFFF000 + timers[i].fired*periods[i]));
+    }
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Advancing across a long idle gap doesn't walk every ms of it */
+void test_timer_long_gap(void)
+{
+    test_timer_t t;
+    xbee_timer_wheel_t wheel;
+    xbee_timer_wheel_init(&wheel, 1000);
+
+    memset(&t, 0, sizeof(t));
+    t.wheel = &wheel;
+    xbee_timer_init(&t.timer, test_fire, &t);
+    t.deadline = 1000 + (1UL << 31) - 1;
+    xbee_timer_start(&wheel, &t.timer, t.deadline);
+
+    clock_t begin = clock();
+    for(size_t i = 0; i < 1000; ++i)
+    {
+        xbee_timer_run(&wheel, t.deadline - 1 - 1000 + i);
+    }
+    assert(t.fired == 0);
+    xbee_timer_run(&wheel, 1000 + (1UL << 31));
+    double seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+    assert(t.fired == 1);
+    assert(t.fired_at == t.deadline);
+    assert(seconds < 0.1);
+
+    printf("%s passed, %.3f ms\n", __func__, seconds*1000);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_timer_random(0);
+    test_timer_random(0x12345678);
+    test_timer_random(0xFFFFFF00);
+    test_timer_random(0x7FFFFFC0);
+    test_timer_periodic();
+    test_timer_long_gap();
+
+    return 0;
+}
@@ -0,0 +1,575 @@
+#include "xbee_transparent.h"
+#include <assert.h>
+#include <string.h>
+
+static void xbee_transparent_error(xbee_transparent_t * session, int error)
+{
+    if(session->error == 0)
+    {
+        session->error = error;
+    }
+}
+
+static void xbee_transparent_finish(xbee_transparent_t * session,
+        xbee_transparent_state_t state) SPECIAL_SECTION;
+static void xbee_transparent_finish(xbee_transparent_t * session,
+        xbee_transparent_state_t state)
+{
+    session->state = state;
+    xbee_remove_handler(session->xbee, &session->handler);
+}
+
+/*! Fills setting with value as a size byte, big endian AT parameter */
+static void xbee_transparent_setting(xbee_remote_setting_t * setting,
+        const char * at_command, uint32_t value, size_t size)
+{
+    memset(setting, 0, sizeof(*setting));
+    setting->at_command[0] = at_command[0];
+    setting->at_command[1] = at_command[1];
+    setting->param_size = size;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        setting->param[i] = value >> (8*(size - 1 - i));
+    }
+}
+
+static void xbee_transparent_destination(xbee_remote_setting_t * settings,
+        const xbee_address_t * address)
+{
+    uint64_t destination;
+    switch(address->type)
+    {
+    case XBEE_16_BIT:
+        destination = address->addr.network_address;
+        break;
+    case XBEE_64_BIT:
+        destination = address->addr.address;
+        break;
+    default:
+        destination = 0xFFFF;
+        break;
+    }
+
+    xbee_transparent_setting(&settings[0], "DH", destination >> 32, 4);
+    xbee_transparent_setting(&settings[1], "DL", destination & 0xFFFFFFFF, 4);
+}
+
+/*! Sends a local AT frame, queued or applied, counting the response it awaits */
+static int xbee_transparent_send(xbee_transparent_t * session, bool queue,
+        char * at_command, size_t param_size, const void * param,
+        uint8_t * frame_id) SPECIAL_SECTION;
+static int xbee_transparent_send(xbee_transparent_t * session, bool queue,
+        char * at_command, size_t param_size, const void * param,
+        uint8_t * frame_id)
+{
+    *frame_id = xbee_alloc_frame_id(session->xbee);
+    if(*frame_id == 0)
+    {
+        return XBEE_ERR_NOT_READY;
+    }
+
+    int ret;
+    if(queue)
+    {
+        ret = xbee_at_queue_parameter(session->xbee, *frame_id,
+                at_command, param_size, param);
+    }
+    else
+    {
+        ret = xbee_at_command(session->xbee, *frame_id,
+                at_command, param_size, param);
+    }
+
+    if(ret != 0)
+    {
+        *frame_id = 0;
+        return ret;
+    }
+
+    session->outstanding += 1;
+    return 0;
+}
+
+/*! Sends every local setting of the current phase back to back */
+static int xbee_transparent_burst(xbee_transparent_t * session) SPECIAL_SECTION;
+static int xbee_transparent_burst(xbee_transparent_t * session)
+{
+    session->outstanding = 0;
+
+    for(size_t i = 0; i < XBEE_TRANSPARENT_SETTINGS; ++i)
+    {
+        xbee_remote_setting_t * s = &session->local[i];
+        char at_command[2] = {s->at_command[0], s->at_command[1]};
+
+        int ret;
+        switch(session->state)
+        {
+        case XBEE_TRANSPARENT_READING:
+            ret = xbee_transparent_send(session, false, at_command,
+                    0, NULL, &s->frame_id);
+            break;
+        case XBEE_TRANSPARENT_WRITING:
+            ret = xbee_transparent_send(session, true, at_command,
+                    s->param_size, s->param, &s->frame_id);
+            break;
+        case XBEE_TRANSPARENT_RESTORING:
+            ret = xbee_transparent_send(session, true, at_command,
+                    s->old_size, s->old, &s->frame_id);
+            break;
+        default:
+            assert(false);
+            return 0;
+        }
+
+        if(ret != 0)
+        {
+            return ret;
+        }
+    }
+
+    if(session->state == XBEE_TRANSPARENT_RESTORING)
+    {
+        return xbee_transparent_send(session, false, "AC", 0, NULL,
+                &session->apply_frame_id);
+    }
+
+    return 0;
+}
+
+/*! Writes the peer's old values back with one apply */
+static void xbee_transparent_restore_remote(xbee_transparent_t * session) SPECIAL_SECTION;
+static void xbee_transparent_restore_remote(xbee_transparent_t * session)
+{
+    for(size_t i = 0; i < XBEE_TRANSPARENT_SETTINGS; ++i)
+    {
+        xbee_remote_setting_t * s = &session->remote[i];
+        s->param_size = s->old_size;
+        memcpy(s->param, s->old, s->old_size);
+    }
+
+    session->state = XBEE_TRANSPARENT_REMOTE_RESTORING;
+    int ret = xbee_remote_batch_start(&session->batch, session->xbee,
+            &session->peer, XBEE_TRANSPARENT_SETTINGS, session->remote);
+    if(ret != 0)
+    {
+        /* Batch finishes itself, xbee_transparent_run picks that up */
+        xbee_transparent_error(session, ret);
+    }
+}
+
+/*! Writes local old values back, then the peer's */
+static void xbee_transparent_restore_local(xbee_transparent_t * session) SPECIAL_SECTION;
+static void xbee_transparent_restore_local(xbee_transparent_t * session)
+{
+    session->state = XBEE_TRANSPARENT_RESTORING;
+    int ret = xbee_transparent_burst(session);
+    if(ret != 0)
+    {
+        xbee_transparent_error(session, ret);
+    }
+
+    if(session->outstanding == 0)
+    {
+        xbee_transparent_restore_remote(session);
+    }
+}
+
+static void xbee_transparent_next_phase(xbee_transparent_t * session) SPECIAL_SECTION;
+static void xbee_transparent_next_phase(xbee_transparent_t * session)
+{
+    int ret;
+
+    switch(session->state)
+    {
+    case XBEE_TRANSPARENT_READING:
+        if(session->error != 0)
+        {
+            /* Nothing written locally, only the peer needs undoing */
+            xbee_transparent_restore_remote(session);
+            return;
+        }
+
+        session->state = XBEE_TRANSPARENT_WRITING;
+        ret = xbee_transparent_burst(session);
+        if(ret != 0)
+        {
+            xbee_transparent_error(session, ret);
+        }
+
+        if(session->outstanding > 0)
+        {
+            return;
+        }
+        break;
+    case XBEE_TRANSPARENT_WRITING:
+        if(session->error == 0)
+        {
+            uint8_t api_mode = 0;
+
+            session->state = XBEE_TRANSPARENT_SWITCHING;
+            ret = xbee_transparent_send(session, false, "AP",
+                    sizeof(api_mode), &api_mode, &session->apply_frame_id);
+            if(ret == 0)
+            {
+                return;
+            }
+
+            xbee_transparent_error(session, ret);
+        }
+        break;
+    case XBEE_TRANSPARENT_SWITCHING:
+        if(session->error == 0)
+        {
+            session->state = XBEE_TRANSPARENT_STREAMING;
+            session->xbee->state = XBEE_STATE_TRANSPARENT;
+            return;
+        }
+        break;
+    case XBEE_TRANSPARENT_RESTORING:
+        xbee_transparent_restore_remote(session);
+        return;
+    default:
+        assert(false);
+        return;
+    }
+
+    /* Queued values would take effect at the next AC, put the old ones back */
+    xbee_transparent_restore_local(session);
+}
+
+/*! Records outcome of frame_id, status < 0 is a local failure */
+static bool xbee_transparent_result(xbee_transparent_t * session, uint8_t frame_id,
+        int status, size_t data_size, const uint8_t * data) SPECIAL_SECTION;
+static bool xbee_transparent_result(xbee_transparent_t * session, uint8_t frame_id,
+        int status, size_t data_size, const uint8_t * data)
+{
+    if(frame_id == 0)
+    {
+        return false;
+    }
+
+    xbee_remote_setting_t * s = NULL;
+    for(size_t i = 0; i < XBEE_TRANSPARENT_SETTINGS && s == NULL; ++i)
+    {
+        if(session->local[i].frame_id == frame_id)
+        {
+            s = &session->local[i];
+        }
+    }
+
+    if(s != NULL)
+    {
+        s->frame_id = 0;
+        s->status = status < 0 ? 0xFF : status;
+    }
+    else if(frame_id == session->apply_frame_id)
+    {
+        session->apply_frame_id = 0;
+    }
+    else
+    {
+        return false;
+    }
+
+    session->outstanding -= 1;
+
+    if(status == 0 && s != NULL && session->state == XBEE_TRANSPARENT_READING)
+    {
+        if(data_size > XBEE_MAX_AT_PARAM)
+        {
+            status = 1;
+        }
+        else
+        {
+            s->old_size = data_size;
+            memcpy(s->old, data, data_size);
+        }
+    }
+
+    if(status != 0)
+    {
+        xbee_transparent_error(session, XBEE_ERR_TRANSPARENT_LOCAL);
+    }
+
+    if(session->outstanding == 0)
+    {
+        xbee_transparent_next_phase(session);
+    }
+
+    return true;
+}
+
+static int xbee_transparent_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame) SPECIAL_SECTION;
+static int xbee_transparent_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame)
+{
+    xbee_transparent_t * session = ptr;
+
+    if(frame->api_id != XBEE_AT_RESPONSE)
+    {
+        return 0;
+    }
+
+    return xbee_transparent_result(session, frame->frame_id,
+            frame->frame.at_command_response.status,
+            frame->frame.at_command_response.data_size,
+            frame->frame.at_command_response.data);
+}
+
+static void xbee_transparent_failed(void * ptr, xbee_interface_t * xbee,
+        uint8_t frame_id, int reason) SPECIAL_SECTION;
+static void xbee_transparent_failed(void * ptr, xbee_interface_t * xbee,
+        uint8_t frame_id, int reason)
+{
+    xbee_transparent_result(ptr, frame_id, -reason, 0, NULL);
+}
+
+int xbee_transparent_start(xbee_transparent_t * session, xbee_interface_t * xbee,
+        const xbee_address_t * peer, const xbee_address_t * local,
+        uint8_t packetization, uint16_t guard_time)
+{
+    assert(session);
+    assert(xbee);
+    assert(xbee->uart->clock);
+    assert(peer);
+    assert(local);
+
+    memset(session, 0, sizeof(*session));
+    session->xbee = xbee;
+    session->peer = *peer;
+    session->guard_time = guard_time;
+
+    xbee_transparent_destination(&session->remote[0], local);
+    xbee_transparent_setting(&session->remote[2], "RO", packetization, 1);
+    xbee_transparent_setting(&session->remote[3], "AP", 0, 1);
+
+    xbee_transparent_destination(&session->local[0], peer);
+    xbee_transparent_setting(&session->local[2], "RO", packetization, 1);
+    xbee_transparent_setting(&session->local[3], "GT", guard_time, 2);
+
+    session->handler.ptr = session;
+    session->handler.frame = xbee_transparent_frame;
+    session->handler.failed = xbee_transparent_failed;
+    xbee_add_handler(xbee, &session->handler);
+
+    session->state = XBEE_TRANSPARENT_REMOTE;
+    int ret = xbee_remote_batch_start(&session->batch, xbee, peer,
+            XBEE_TRANSPARENT_SETTINGS, session->remote);
+    if(ret != 0)
+    {
+        /* Nothing was sent, so nothing will respond */
+        xbee_transparent_error(session, ret);
+        xbee_transparent_finish(session, XBEE_TRANSPARENT_FAILED);
+    }
+
+    return ret;
+}
+
+void xbee_transparent_run(xbee_transparent_t * session)
+{
+    assert(session);
+
+    if((session->state != XBEE_TRANSPARENT_REMOTE &&
+        session->state != XBEE_TRANSPARENT_REMOTE_RESTORING) ||
+       !xbee_remote_batch_finished(&session->batch))
+    {
+        return;
+    }
+
+    bool batch_failed = session->batch.state == XBEE_BATCH_FAILED;
+    if(batch_failed)
+    {
+        xbee_transparent_error(session, session->batch.error);
+    }
+
+    if(session->state == XBEE_TRANSPARENT_REMOTE)
+    {
+        if(batch_failed)
+        {
+            /* Batch rolled the peer back itself */
+            xbee_transparent_finish(session, XBEE_TRANSPARENT_FAILED);
+            return;
+        }
+
+        session->state = XBEE_TRANSPARENT_READING;
+        int ret = xbee_transparent_burst(session);
+        if(ret != 0)
+        {
+            xbee_transparent_error(session, ret);
+            if(session->outstanding == 0)
+            {
+                xbee_transparent_next_phase(session);
+            }
+        }
+    }
+    else if(session->state == XBEE_TRANSPARENT_REMOTE_RESTORING)
+    {
+        xbee_transparent_finish(session, session->error != 0 ?
+                XBEE_TRANSPARENT_FAILED : XBEE_TRANSPARENT_DONE);
+    }
+}
+
+int xbee_transparent_write(xbee_transparent_t * session,
+        size_t size, const void * data)
+{
+    assert(session);
+    assert(session->state == XBEE_TRANSPARENT_STREAMING);
+    assert(data || size == 0);
+
+    xbee_uart_interface_t * uart = session->xbee->uart;
+    return uart->write(uart->ptr, data, size);
+}
+
+int xbee_transparent_read(xbee_transparent_t * session,
+        size_t size, void * data)
+{
+    assert(session);
+    assert(session->state == XBEE_TRANSPARENT_STREAMING);
+    assert(data || size == 0);
+
+    xbee_uart_interface_t * uart = session->xbee->uart;
+    return uart->read(uart->ptr, data, size);
+}
+
+/*! Discards every byte the XBee sends until ms after start, without writing to it */
+static int xbee_transparent_drain(xbee_transparent_t * session, uint32_t start,
+        uint32_t ms) SPECIAL_SECTION;
+static int xbee_transparent_drain(xbee_transparent_t * session, uint32_t start,
+        uint32_t ms)
+{
+    xbee_interface_t * xbee = session->xbee;
+
+    while(xbee_now(xbee) - start < ms)
+    {
+        char buf[32];
+        int ret = xbee->uart->read(xbee->uart->ptr, buf, sizeof(buf));
+        if(ret < 0)
+        {
+            return ret;
+        }
+
+        if(ret == 0)
+        {
+            xbee_sleep_ms(xbee, 1);
+        }
+    }
+
+    return 0;
+}
+
+/*! Waits for count "OK\r" in command mode
+ *
+ * Nothing but OKs comes from an XBee in command mode, so any other byte
+ * means it is still streaming and the escape failed.
+ */
+static int xbee_transparent_expect_ok(xbee_transparent_t * session, size_t count) SPECIAL_SECTION;
+static int xbee_transparent_expect_ok(xbee_transparent_t * session, size_t count)
+{
+    xbee_interface_t * xbee = session->xbee;
+    const char ok[] = "OK\r";
+    size_t matched = 0;
+    uint32_t start = xbee_now(xbee);
+
+    while(count > 0)
+    {
+        char c;
+        int ret = xbee->uart->read(xbee->uart->ptr, &c, 1);
+        if(ret < 0)
+        {
+            return ret;
+        }
+
+        if(ret == 0)
+        {
+            if(xbee_now(xbee) - start >= XBEE_TRANSPARENT_RESPONSE_TIME)
+            {
+                return XBEE_ERR_TRANSPARENT_ESCAPE;
+            }
+
+            xbee_sleep_ms(xbee, 1);
+            continue;
+        }
+
+        if(c != ok[matched])
+        {
+            return XBEE_ERR_TRANSPARENT_ESCAPE;
+        }
+
+        matched += 1;
+        if(matched == sizeof(ok) - 1)
+        {
+            matched = 0;
+            count -= 1;
+        }
+    }
+
+    return 0;
+}
+
+int xbee_transparent_stop(xbee_transparent_t * session)
+{
+    assert(session);
+    assert(session->state == XBEE_TRANSPARENT_STREAMING);
+
+    xbee_interface_t * xbee = session->xbee;
+    uint32_t guard = session->guard_time + XBEE_TRANSPARENT_GUARD_MARGIN;
+
+    /* Escape needs silence of GT either side of +++.  The XBee answers
+     * no sooner than GT after it, so stream bytes up to then are dropped
+     * and can't pass for the OK.  That is GT from when the write began,
+     * the last '+' may have reached the XBee well before it returned */
+    int ret = xbee_transparent_drain(session, xbee_now(xbee), guard);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    char escape[] = "+++";
+    uint32_t escaped = xbee_now(xbee);
+    ret = xbee->uart->write(xbee->uart->ptr, escape, sizeof(escape) - 1);
+    if(ret != sizeof(escape) - 1)
+    {
+        return ret < 0 ? ret : XBEE_ERR_TRANSPARENT_ESCAPE;
+    }
+
+    ret = xbee_transparent_drain(session, escaped, session->guard_time);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    ret = xbee_transparent_expect_ok(session, 1);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    /* Only the mode goes through command mode, the rest is restored in API mode */
+    char api_seq[] = "ATAP 2\rATCN\r";
+    ret = xbee->uart->write(xbee->uart->ptr, api_seq, sizeof(api_seq) - 1);
+    if(ret != sizeof(api_seq) - 1)
+    {
+        return ret < 0 ? ret : XBEE_ERR_TRANSPARENT_ESCAPE;
+    }
+
+    ret = xbee_transparent_expect_ok(session, 2);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    /* The cache still holds the AP 0 the session wrote */
+    xbee_at_cache_invalidate(xbee, "AP");
+    xbee->state = XBEE_STATE_READY;
+    xbee_transparent_restore_local(session);
+    return 0;
+}
+
+bool xbee_transparent_finished(const xbee_transparent_t * session)
+{
+    assert(session);
+    return session->state == XBEE_TRANSPARENT_DONE ||
+           session->state == XBEE_TRANSPARENT_FAILED;
+}
@@ -0,0 +1,116 @@
+#ifndef _XBEE_TRANSPARENT_H_
+#define _XBEE_TRANSPARENT_H_
+
+#include "xbee_remote_batch.h"
+
+/*! Silence kept around +++ on top of the session's guard time, in ms */
+#ifndef XBEE_TRANSPARENT_GUARD_MARGIN
+#define XBEE_TRANSPARENT_GUARD_MARGIN 10
+#endif /* XBEE_TRANSPARENT_GUARD_MARGIN */
+
+/*! Longest wait for an OK in command mode, in ms */
+#ifndef XBEE_TRANSPARENT_RESPONSE_TIME
+#define XBEE_TRANSPARENT_RESPONSE_TIME 100
+#endif /* XBEE_TRANSPARENT_RESPONSE_TIME */
+
+#define XBEE_TRANSPARENT_SETTINGS (4)
+
+#define XBEE_ERR_TRANSPARENT_ESCAPE (-31)   /*! XBee did not answer +++ or ATCN with OK */
+#define XBEE_ERR_TRANSPARENT_LOCAL (-32)    /*! Local XBee rejected or never answered a setting */
+
+typedef enum {
+    XBEE_TRANSPARENT_IDLE,
+    XBEE_TRANSPARENT_REMOTE,            /*! Remote batch pointing peer at us in AP 0 */
+    XBEE_TRANSPARENT_READING,           /*! Reading local values to restore afterwards */
+    XBEE_TRANSPARENT_WRITING,           /*! Queuing local DH, DL, RO and GT */
+    XBEE_TRANSPARENT_SWITCHING,         /*! AP 0 sent, which applies the queued values */
+    XBEE_TRANSPARENT_STREAMING,
+    XBEE_TRANSPARENT_RESTORING,         /*! Local values queued back, AC sent */
+    XBEE_TRANSPARENT_REMOTE_RESTORING,  /*! Remote batch writing back the peer's values */
+    XBEE_TRANSPARENT_DONE,
+    XBEE_TRANSPARENT_FAILED,
+} xbee_transparent_state_t;
+
+/*! Raw byte stream between two radios in transparent mode (AP 0)
+ *
+ * For bulk transfers between two fixed radios, where API framing and
+ * escaping cost UART bandwidth for nothing.  Both radios are pointed at
+ * each other (DH, DL), given packetization timeout RO and switched to
+ * AP 0, and the XBee packetizes the stream itself, sending once RO
+ * character times pass without input or an RF payload is full.
+ *
+ * The peer is configured first with a remote batch, applied at once.
+ * Local values are queued and applied by AP 0, with guard time GT cut to
+ * guard_time ms so the session can escape with +++ quickly.  Stopping
+ * escapes, returns to API mode with ATAP 2 and restores every value that
+ * was changed, locally and then on the peer, with one apply each.
+ *
+ * Progress is made by xbee_poll and xbee_transparent_run.  While
+ * streaming, xbee->state is XBEE_STATE_TRANSPARENT, xbee_poll reads
+ * nothing and frames cannot be sent.  The peer's host reads the stream
+ * raw from its UART.  Time comes from xbee_now, so the XBee's clock must
+ * be set.
+ */
+typedef struct {
+    xbee_handler_t handler;
+    xbee_interface_t * xbee;
+    xbee_address_t peer;
+
+    xbee_transparent_state_t state;
+    uint16_t guard_time;        /*! GT while streaming, ms */
+
+    xbee_remote_batch_t batch;
+    xbee_remote_setting_t remote[XBEE_TRANSPARENT_SETTINGS];    /*! DH, DL, RO, AP on peer */
+    xbee_remote_setting_t local[XBEE_TRANSPARENT_SETTINGS];     /*! DH, DL, RO, GT */
+
+    size_t outstanding;         /*! Local responses still expected in this phase */
+    uint8_t apply_frame_id;     /*! AP 0, or AC when restoring */
+    int error;                  /*! First error seen, valid when state is XBEE_TRANSPARENT_FAILED */
+} xbee_transparent_t;
+
+/*! Starts switching xbee and the radio at peer to transparent mode
+ *
+ * \param local Address peer should send the stream to, i.e. this XBee's
+ * \param packetization RO, character times of silence that end a packet
+ * \param guard_time GT while streaming, ms
+ *
+ * \return 0 if the session started, otherwise error sending to the peer,
+ *         and session is XBEE_TRANSPARENT_FAILED
+ */
+int xbee_transparent_start(xbee_transparent_t * session, xbee_interface_t * xbee,
+        const xbee_address_t * peer, const xbee_address_t * local,
+        uint8_t packetization, uint16_t guard_time) SPECIAL_SECTION;
+
+/*! Advances phases waiting on the remote batch, call from the poll loop */
+void xbee_transparent_run(xbee_transparent_t * session) SPECIAL_SECTION;
+
+/*! Writes stream bytes, only while XBEE_TRANSPARENT_STREAMING
+ *
+ * \return Bytes written, or error from xbee_write_fun_t
+ */
+int xbee_transparent_write(xbee_transparent_t * session,
+        size_t size, const void * data) SPECIAL_SECTION;
+
+/*! Reads stream bytes, only while XBEE_TRANSPARENT_STREAMING
+ *
+ * \return Bytes read, or error from xbee_read_fun_t
+ */
+int xbee_transparent_read(xbee_transparent_t * session,
+        size_t size, void * data) SPECIAL_SECTION;
+
+/*! Escapes to command mode, returns to API mode and starts restoring
+ *
+ * Blocks for two guard times and the command mode responses.  Stream
+ * bytes not read yet, and any arriving before the XBee can answer +++,
+ * are discarded.  Only OKs that come alone after that count.
+ *
+ * \return 0 if back in API mode, XBEE_ERR_TRANSPARENT_ESCAPE if the XBee
+ *         did not answer (still streaming, may be retried), otherwise
+ *         error writing to the XBee
+ */
+int xbee_transparent_stop(xbee_transparent_t * session) SPECIAL_SECTION;
+
+/*! Returns true once session is done or failed */
+bool xbee_transparent_finished(const xbee_transparent_t * session) SPECIAL_SECTION;
+
+#endif /* _XBEE_TRANSPARENT_H_ */
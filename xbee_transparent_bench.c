@@ -0,0 +1,231 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_transparent.h"
+#include "xbee_sim.h"
+
+/* Bulk transfer of random bytes from node 0 to node 1, in API frames
+ * with xbee_transmit and through a transparent mode session.  Node 0's
+ * host UART runs at 115200 baud, 10 bits a byte, and a write takes until
+ * its bytes are out, so the clock moves on by their time.  Every RF
+ * packet, an API frame's payload or XBEE_MAX_RF_PAYLOAD bytes of the
+ * stream, holds the channel 2 ms plus its bytes at 250 kbps, overlapping
+ * the UART.  A transfer is done once node 1's host has every byte and
+ * the channel is free.  Frames go without a frame id, the stream has no
+ * host visible acks either. */
+
+#define BENCH_BAUD (115200)
+#define BENCH_BITRATE (250000)
+#define BENCH_GUARD_TIME (20)
+#define BENCH_CHUNK (256)
+#define BENCH_MAX_SIZE (100000)
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_write_fun_t sim_write;
+    uint32_t uart_us;               /*! UART time not yet on the clock */
+    uint64_t air_free;              /*! us when the channel is next free */
+    xbee_handler_t handler;
+    xbee_transparent_t session;
+
+    uint8_t data[BENCH_MAX_SIZE];
+    size_t received;
+} bench_t;
+
+static bench_t bench;
+
+static uint64_t bench_now_us(void)
+{
+    return (uint64_t)bench.sim.clock.now*1000 + bench.uart_us;
+}
+
+static void bench_air(size_t size)
+{
+    uint64_t now = bench_now_us();
+    bench.air_free = (bench.air_free > now ? bench.air_free : now) +
+        2000 + size*8*1000000/BENCH_BITRATE;
+}
+
+static int bench_write(void * ptr, const void * buf, size_t nbyte)
+{
+    int ret = bench.sim_write(ptr, buf, nbyte);
+    if(ret > 0)
+    {
+        bench.uart_us += (uint64_t)ret*10*1000000/BENCH_BAUD;
+        bench.sim.clock.now += bench.uart_us/1000;
+        bench.uart_us %= 1000;
+    }
+
+    return ret;
+}
+
+static bool bench_request(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    if(frame[0] == XBEE_TRANSMIT_16_BIT || frame[0] == XBEE_TRANSMIT ||
+       frame[0] == XBEE_REMOTE_AT_COMMAND)
+    {
+        bench_air(size);
+    }
+
+    return false;
+}
+
+static int bench_frame(void * ptr, xbee_interface_t * xbee,
+        const xbee_parsed_frame_t * frame)
+{
+    if(frame->api_id != XBEE_RECEIVE_16_BIT)
+    {
+        return 0;
+    }
+
+    size_t size = frame->frame.receive.packet_size;
+    assert(memcmp(frame->frame.receive.packet_data, bench.data + bench.received, size) == 0);
+    bench.received += size;
+    return 1;
+}
+
+/*! Takes what the peer's module hands its host raw */
+static void bench_read_stream(void)
+{
+    xbee_uart_interface_t * uart = &bench.sim.nodes[1].uart;
+    uint8_t buf[BENCH_CHUNK];
+    int n;
+    while((n = uart->read(uart->ptr, buf, sizeof(buf))) > 0)
+    {
+        assert(memcmp(buf, bench.data + bench.received, n) == 0);
+        bench.received += n;
+    }
+}
+
+static void bench_setup(void)
+{
+    memset(&bench, 0, sizeof(bench));
+    assert(xbee_sim_init(&bench.sim, 2, 47) == 0);
+    bench.sim.request = bench_request;
+
+    xbee_uart_interface_t * uart = &bench.sim.nodes[0].uart;
+    bench.sim_write = uart->write;
+    uart->write = bench_write;
+
+    for(size_t i = 0; i < sizeof(bench.data); ++i)
+    {
+        bench.data[i] = xbee_sim_random(&bench.sim);
+    }
+}
+
+/*! ms until the transfer is done, from start */
+static uint32_t bench_elapsed(uint32_t start)
+{
+    uint64_t done = bench.air_free > bench_now_us() ? bench.air_free : bench_now_us();
+    return done/1000 - start;
+}
+
+static uint32_t bench_api(size_t size)
+{
+    bench_setup();
+    bench.handler.frame = bench_frame;
+    xbee_add_handler(&bench.sim.nodes[1].xbee, &bench.handler);
+
+    xbee_interface_t * xbee = &bench.sim.nodes[0].xbee;
+    xbee_address_t peer;
+    xbee_sim_address16(&bench.sim, 1, &peer);
+
+    uint32_t start = bench.sim.clock.now;
+    for(size_t sent = 0; sent < size; )
+    {
+        size_t n = size - sent < XBEE_MAX_RF_PAYLOAD ? size - sent : XBEE_MAX_RF_PAYLOAD;
+        assert(xbee_transmit(xbee, 0, &peer, 0, n, bench.data + sent) == 0);
+        sent += n;
+        xbee_sim_step(&bench.sim);
+    }
+    assert(bench.received == size);
+
+    return bench_elapsed(start);
+}
+
+/*! ms for the whole session, *streaming set to the ms spent streaming */
+static uint32_t bench_transparent(size_t size, uint32_t * streaming)
+{
+    bench_setup();
+    for(size_t i = 0; i < 2; ++i)
+    {
+        xbee_sim_set_register(&bench.sim, i, "DH", 4, "\0\0\0\0");
+        xbee_sim_set_register(&bench.sim, i, "DL", 4, "\0\0\0\0");
+        xbee_sim_set_register(&bench.sim, i, "RO", 1, "\x03");
+        xbee_sim_set_register(&bench.sim, i, "GT", 2, "\x03\xE8");
+        xbee_sim_set_register(&bench.sim, i, "AC", 0, NULL);
+    }
+    bench.sim.nodes[1].xbee.state = XBEE_STATE_TRANSPARENT;
+
+    xbee_address_t peer, local;
+    xbee_sim_address16(&bench.sim, 1, &peer);
+    xbee_sim_address16(&bench.sim, 0, &local);
+
+    uint32_t start = bench.sim.clock.now;
+    assert(xbee_transparent_start(&bench.session, &bench.sim.nodes[0].xbee, &peer, &local,
+            3, BENCH_GUARD_TIME) == 0);
+    while(bench.session.state != XBEE_TRANSPARENT_STREAMING)
+    {
+        xbee_sim_step(&bench.sim);
+        xbee_transparent_run(&bench.session);
+    }
+
+    uint32_t stream_start = bench_elapsed(0);
+    size_t packet = 0;
+    for(size_t sent = 0; sent < size; )
+    {
+        size_t n = size - sent < BENCH_CHUNK ? size - sent : BENCH_CHUNK;
+        assert(xbee_transparent_write(&bench.session, n, bench.data + sent) == n);
+        sent += n;
+
+        /* The module sends full packets as the stream fills them, and the
+         * rest once RO passes without input */
+        for(packet += n; packet >= XBEE_MAX_RF_PAYLOAD; packet -= XBEE_MAX_RF_PAYLOAD)
+        {
+            bench_air(XBEE_MAX_RF_PAYLOAD);
+        }
+        xbee_sim_step(&bench.sim);
+        bench_read_stream();
+    }
+    if(packet > 0)
+    {
+        bench_air(packet);
+    }
+    assert(bench.received == size);
+    *streaming = bench_elapsed(stream_start);
+
+    assert(xbee_transparent_stop(&bench.session) == 0);
+    while(!xbee_transparent_finished(&bench.session))
+    {
+        xbee_sim_step(&bench.sim);
+        xbee_transparent_run(&bench.session);
+    }
+    assert(bench.session.state == XBEE_TRANSPARENT_DONE);
+
+    return bench_elapsed(start);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const size_t sizes[] = {1000, 10000, BENCH_MAX_SIZE};
+
+    printf("%u baud UART, guard time %u ms, times in ms\n", BENCH_BAUD, BENCH_GUARD_TIME);
+    printf("  %8s %8s %10s %8s %11s %9s %12s\n", "bytes", "API", "streaming", "session",
+            "stream/API", "API kB/s", "stream kB/s");
+    for(size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); ++i)
+    {
+        uint32_t streaming;
+        uint32_t api = bench_api(sizes[i]);
+        uint32_t session = bench_transparent(sizes[i], &streaming);
+        printf("  %8zu %8u %10u %8u %10.1f%% %9.1f %12.1f\n", sizes[i], api, streaming,
+                session, 100.0*streaming/api, (double)sizes[i]/api,
+                (double)sizes[i]/streaming);
+    }
+
+    return 0;
+}
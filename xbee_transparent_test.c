@@ -0,0 +1,195 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_transparent.h"
+#include "xbee_sim.h"
+
+#define TEST_GUARD_TIME (50)
+
+static xbee_sim_t test_sim;
+static xbee_transparent_t test_session;
+
+/* Peer stream bytes written once the clock reaches test_inject_at */
+static xbee_sleep_ms_t test_sim_sleep;
+static uint32_t test_inject_at;
+static const char * test_inject;
+
+static void test_sleep(void * ptr, uint32_t ms)
+{
+    test_sim_sleep(ptr, ms);
+
+    xbee_uart_interface_t * peer = &test_sim.nodes[1].uart;
+    if(test_inject != NULL && (int32_t)(test_sim.clock.now - test_inject_at) >= 0)
+    {
+        peer->write(peer->ptr, test_inject, strlen(test_inject));
+        test_inject = NULL;
+    }
+}
+
+static size_t test_pending(size_t node)
+{
+    const xbee_sim_fifo_t * fifo = &test_sim.nodes[node].to_host;
+    return fifo->size - fifo->head;
+}
+
+static bool test_register(size_t node, const char * at_command, size_t size, const void * value)
+{
+    for(size_t i = 0; i < XBEE_SIM_REGISTERS; ++i)
+    {
+        const xbee_sim_register_t * r = &test_sim.nodes[node].registers[i];
+        if(memcmp(r->at_command, at_command, 2) == 0)
+        {
+            return r->value_size == size && memcmp(r->value, value, size) == 0;
+        }
+    }
+
+    return false;
+}
+
+/*! Runs session up to streaming between node 0 and node 1 */
+static void test_setup(void)
+{
+    assert(xbee_sim_init(&test_sim, 2, 13) == 0);
+    for(size_t i = 0; i < 2; ++i)
+    {
+        xbee_sim_set_register(&test_sim, i, "DH", 4, "\0\0\0\0");
+        xbee_sim_set_register(&test_sim, i, "DL", 4, "\0\0\0\0");
+        xbee_sim_set_register(&test_sim, i, "RO", 1, "\x03");
+        xbee_sim_set_register(&test_sim, i, "GT", 2, "\x07\xD0");
+        xbee_sim_set_register(&test_sim, i, "AC", 0, NULL);
+    }
+
+    xbee_uart_interface_t * uart = &test_sim.nodes[0].uart;
+    test_sim_sleep = uart->sleep_ms;
+    uart->sleep_ms = test_sleep;
+    test_inject = NULL;
+
+    /* The peer's host reads the stream raw once its XBee switches */
+    test_sim.nodes[1].xbee.state = XBEE_STATE_TRANSPARENT;
+
+    xbee_address_t peer, local;
+    xbee_sim_address16(&test_sim, 1, &peer);
+    xbee_sim_address16(&test_sim, 0, &local);
+    assert(xbee_transparent_start(&test_session, &test_sim.nodes[0].xbee, &peer, &local,
+            3, TEST_GUARD_TIME) == 0);
+
+    for(size_t i = 0; i < 20 && test_session.state != XBEE_TRANSPARENT_STREAMING; ++i)
+    {
+        xbee_sim_step(&test_sim);
+        xbee_transparent_run(&test_session);
+    }
+    assert(test_session.state == XBEE_TRANSPARENT_STREAMING);
+}
+
+/*! Streams both ways and restores both radios, with stream bytes
+ * arriving while the escape is answered */
+void test_transparent_session(void)
+{
+    test_setup();
+
+    xbee_uart_interface_t * peer = &test_sim.nodes[1].uart;
+    xbee_interface_t * xbee = &test_sim.nodes[0].xbee;
+    char buf[16];
+
+    uint8_t ap;
+    assert(xbee_at_cached(xbee, "AP", false, 1, &ap) == 1 && ap == 0);
+
+    assert(xbee_transparent_write(&test_session, 5, "hello") == 5);
+    xbee_sim_step(&test_sim);
+    assert(peer->read(peer->ptr, buf, sizeof(buf)) == 5);
+    assert(memcmp(buf, "hello", 5) == 0);
+
+    assert(peer->write(peer->ptr, "world", 5) == 5);
+    xbee_sim_step(&test_sim);
+    assert(xbee_transparent_read(&test_session, sizeof(buf), buf) == 5);
+    assert(memcmp(buf, "world", 5) == 0);
+
+    /* Unread stream bytes, then an OK in the stream just after +++ */
+    assert(peer->write(peer->ptr, "OK\rOK\r", 6) == 6);
+    test_inject_at = test_sim.clock.now + TEST_GUARD_TIME + XBEE_TRANSPARENT_GUARD_MARGIN + 5;
+    test_inject = "OK\r";
+    assert(xbee_transparent_stop(&test_session) == 0);
+    assert(test_inject == NULL);
+    assert(test_pending(0) == 0);
+
+    for(size_t i = 0; i < 20 && !xbee_transparent_finished(&test_session); ++i)
+    {
+        xbee_sim_step(&test_sim);
+        xbee_transparent_run(&test_session);
+    }
+    assert(test_session.state == XBEE_TRANSPARENT_DONE);
+    assert(test_sim.nodes[0].xbee.handlers == NULL);
+
+    /* Both XBees back in API mode with their old values */
+    for(size_t i = 0; i < 2; ++i)
+    {
+        assert(test_register(i, "AP", 1, "\x02"));
+        assert(test_register(i, "DL", 4, "\0\0\0\0"));
+        assert(test_register(i, "RO", 1, "\x03"));
+    }
+    assert(test_register(0, "GT", 2, "\x07\xD0"));
+
+    /* AP went back to 2 in command mode, the cache asks rather than
+     * answer with the session's 0 */
+    assert(xbee_at_cached(xbee, "AP", false, 1, &ap) == XBEE_ERR_CACHE_MISS);
+    xbee_sim_step(&test_sim);
+    assert(xbee_at_cached(xbee, "AP", false, 1, &ap) == 1 && ap == 2);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! An escape the XBee ignored isn't taken for one because the stream
+ * carries OKs */
+void test_transparent_stop_ignored(void)
+{
+    test_setup();
+
+    /* The XBee wants more silence than the session keeps */
+    xbee_sim_set_register(&test_sim, 0, "GT", 2, "\xFF\xFF");
+    test_inject_at = test_sim.clock.now + TEST_GUARD_TIME + XBEE_TRANSPARENT_GUARD_MARGIN + 5;
+    test_inject = "OK\rOK\rOK\r";
+    assert(xbee_transparent_stop(&test_session) == XBEE_ERR_TRANSPARENT_ESCAPE);
+    assert(test_session.state == XBEE_TRANSPARENT_STREAMING);
+    assert(test_sim.nodes[0].xbee.state == XBEE_STATE_TRANSPARENT);
+
+    /* +++ went out as stream data */
+    xbee_uart_interface_t * peer = &test_sim.nodes[1].uart;
+    char buf[16];
+    assert(peer->read(peer->ptr, buf, sizeof(buf)) == 3);
+    assert(memcmp(buf, "+++", 3) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Nothing sent to the peer, nothing left registered */
+void test_transparent_start_failed(void)
+{
+    assert(xbee_sim_init(&test_sim, 2, 13) == 0);
+    xbee_interface_t * xbee = &test_sim.nodes[0].xbee;
+    while(xbee_alloc_frame_id(xbee) != 0)
+    {
+    }
+
+    xbee_address_t peer, local;
+    xbee_sim_address16(&test_sim, 1, &peer);
+    xbee_sim_address16(&test_sim, 0, &local);
+    assert(xbee_transparent_start(&test_session, xbee, &peer, &local,
+            3, TEST_GUARD_TIME) == XBEE_ERR_NOT_READY);
+    assert(test_session.state == XBEE_TRANSPARENT_FAILED);
+    assert(xbee->handlers == NULL);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_transparent_session();
+    test_transparent_stop_ignored();
+    test_transparent_start_failed();
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "xbee_tunnel.h"
+#include <assert.h>
+#include <string.h>
+
+static bool xbee_tunnel_has_newline(const uint8_t * data, size_t size)
+{
+    return memchr(data, '\n', size) || memchr(data, '\r', size);
+}
+
+/*! Reads device input into the batch and writes the batch to the stream
+ * once the stream and the input are idle, or it holds a line, fills a
+ * segment or has waited flush_delay */
+static int xbee_tunnel_input(xbee_tunnel_t * tunnel) SPECIAL_SECTION;
+static int xbee_tunnel_input(xbee_tunnel_t * tunnel)
+{
+    uint32_t now = xbee_now(tunnel->stream->mux->xbee);
+
+    while(tunnel->batch_size < sizeof(tunnel->batch))
+    {
+        int ret = tunnel->read(tunnel->ptr, tunnel->batch + tunnel->batch_size,
+                sizeof(tunnel->batch) - tunnel->batch_size);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        if(ret == 0)
+        {
+            break;
+        }
+
+        if(tunnel->batch_size == 0)
+        {
+            tunnel->batch_started = now;
+        }
+        tunnel->batch_size += ret;
+    }
+
+    if(tunnel->batch_size == 0)
+    {
+        return 0;
+    }
+
+    uint32_t * flushes;
+    if(xbee_stream_unacked(tunnel->stream) == 0 &&
+       now - tunnel->last_flush >= tunnel->flush_delay)
+    {
+        /* Nothing in flight for more input to catch up with, and no
+         * typing going on that more input could join */
+        flushes = &tunnel->idle_flushes;
+    }
+    else if(xbee_tunnel_has_newline(tunnel->batch, tunnel->batch_size))
+    {
+        flushes = &tunnel->newline_flushes;
+    }
+    else if(tunnel->batch_size == sizeof(tunnel->batch))
+    {
+        flushes = &tunnel->size_flushes;
+    }
+    else if(now - tunnel->batch_started >= tunnel->flush_delay)
+    {
+        flushes = &tunnel->timer_flushes;
+    }
+    else
+    {
+        return 0;
+    }
+
+    int ret = xbee_stream_write(tunnel->stream, tunnel->batch_size, tunnel->batch);
+    if(ret <= 0)
+    {
+        /* Send buffer full, retried on the next run */
+        return ret;
+    }
+
+    /* What the stream did not take yet stays due, so keeps its start time */
+    *flushes += 1;
+    tunnel->last_flush = now;
+    tunnel->batch_size -= ret;
+    memmove(tunnel->batch, tunnel->batch + ret, tunnel->batch_size);
+    return 0;
+}
+
+/*! Writes bytes received from the stream to the device */
+static int xbee_tunnel_output(xbee_tunnel_t * tunnel) SPECIAL_SECTION;
+static int xbee_tunnel_output(xbee_tunnel_t * tunnel)
+{
+    for(;;)
+    {
+        if(tunnel->output_offset == tunnel->output_size)
+        {
+            int ret = xbee_stream_read(tunnel->stream, sizeof(tunnel->output), tunnel->output);
+            if(ret <= 0)
+            {
+                return ret;
+            }
+
+            tunnel->output_size = ret;
+            tunnel->output_offset = 0;
+        }
+
+        int ret = tunnel->write(tunnel->ptr, tunnel->output + tunnel->output_offset,
+                tunnel->output_size - tunnel->output_offset);
+        if(ret <= 0)
+        {
+            return ret;
+        }
+
+        tunnel->output_offset += ret;
+    }
+}
+
+void xbee_tunnel_init(xbee_tunnel_t * tunnel, xbee_stream_t * stream,
+        void * ptr, xbee_read_fun_t read, xbee_write_fun_t write,
+        uint32_t flush_delay)
+{
+    assert(tunnel);
+    assert(stream);
+    assert(read);
+    assert(write);
+
+    memset(tunnel, 0, sizeof(*tunnel));
+    tunnel->stream = stream;
+    tunnel->ptr = ptr;
+    tunnel->read = read;
+    tunnel->write = write;
+    tunnel->flush_delay = flush_delay;
+    tunnel->last_flush = xbee_now(stream->mux->xbee) - flush_delay;
+}
+
+int xbee_tunnel_run(xbee_tunnel_t * tunnel)
+{
+    assert(tunnel);
+
+    int ret = xbee_tunnel_input(tunnel);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    ret = xbee_stream_run(tunnel->stream);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    return xbee_tunnel_output(tunnel);
+}
@@ -0,0 +1,70 @@
+#ifndef _XBEE_TUNNEL_H_
+#define _XBEE_TUNNEL_H_
+
+#include "xbee_stream.h"
+
+/*! Longest a partial batch waits for more input, ms
+ *
+ * Longer than the gap between keys in a burst of typing or key repeat,
+ * so those share segments, and short next to the echo delay a user
+ * notices, some 50 ms.
+ */
+#ifndef XBEE_TUNNEL_FLUSH_DELAY
+#define XBEE_TUNNEL_FLUSH_DELAY 30
+#endif /* XBEE_TUNNEL_FLUSH_DELAY */
+
+/*! Serial console carried over a stream, between a local byte device and a
+ * remote node's serial port
+ *
+ * Input from the local device is batched before it is written to the
+ * stream, so typing does not cost a frame per keystroke while whole lines
+ * go out at once.  A batch is flushed at once while the stream has nothing
+ * unacked and nothing was flushed in the last flush_delay ms, so a lone
+ * keystroke is echoed without waiting.  Otherwise it is flushed when it
+ * holds a newline or carriage return, when it fills a segment, or
+ * flush_delay ms after its first byte.  A keystroke thus waits at most
+ * flush_delay, and keys typed less than flush_delay apart are batched.
+ * Everything received from the stream is written to the local device,
+ * which may take it in pieces.
+ *
+ * On the gateway the device is usually a pseudo-terminal master (see
+ * xbee_tunnel_unix.h), on the node its console UART.  read and write
+ * conform to xbee_read_fun_t and xbee_write_fun_t, and must not block.
+ */
+typedef struct {
+    xbee_stream_t * stream;
+    void * ptr;
+    xbee_read_fun_t read;
+    xbee_write_fun_t write;
+    uint32_t flush_delay;
+
+    uint8_t batch[XBEE_STREAM_MAX_SEGMENT];
+    size_t batch_size;
+    uint32_t batch_started;     /*! xbee_now when the first byte was batched */
+    uint32_t last_flush;        /*! xbee_now of the last write to the stream */
+
+    uint8_t output[XBEE_STREAM_MAX_SEGMENT];
+    size_t output_size;
+    size_t output_offset;       /*! Bytes of output already written */
+
+    uint32_t idle_flushes;
+    uint32_t newline_flushes;
+    uint32_t size_flushes;
+    uint32_t timer_flushes;
+} xbee_tunnel_t;
+
+/*! Connects device to stream, which must be open
+ *
+ * \param flush_delay ms, e.g. XBEE_TUNNEL_FLUSH_DELAY
+ */
+void xbee_tunnel_init(xbee_tunnel_t * tunnel, xbee_stream_t * stream,
+        void * ptr, xbee_read_fun_t read, xbee_write_fun_t write,
+        uint32_t flush_delay) SPECIAL_SECTION;
+
+/*! Moves bytes both ways and runs the stream, call from the poll loop
+ *
+ * \return 0 on success, otherwise error from the device or the stream
+ */
+int xbee_tunnel_run(xbee_tunnel_t * tunnel) SPECIAL_SECTION;
+
+#endif /* _XBEE_TUNNEL_H_ */
@@ -0,0 +1,174 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_tunnel.h"
+#include "xbee_sim.h"
+
+/* Gateway terminal on node 0, remote console on node 1 echoing what it
+ * gets.  Every frame a module sends holds the shared channel for 2 ms
+ * plus its bytes at 250 kbps, during which the clock moves on.  A key
+ * unbatched takes 4 frames: data and ack each way.  Keys typed faster
+ * than the channel carries them batch up behind the stream's window
+ * whatever the flush delay, slower ones only with a longer delay. */
+
+#define BENCH_PORT (12)
+#define BENCH_KEYS (20000)
+
+typedef struct {
+    xbee_sim_t sim;
+    uint32_t air_us;                /*! Channel time not yet on the clock */
+    uint32_t frames;                /*! Sent by either module, data and acks */
+    xbee_port_mux_t mux[2];
+    xbee_stream_t stream[2];
+    xbee_port_t port[2];
+    xbee_port_message_t queue[2][4];
+    xbee_tunnel_t tunnel[2];
+
+    /* Terminal */
+    uint32_t key_time[BENCH_KEYS];  /*! When each key may be read */
+    size_t keys;
+    size_t typed;                   /*! Keys read by the tunnel */
+    size_t echoed;
+    uint64_t latency;               /*! Sum over echoed keys, ms */
+
+    /* Console */
+    uint8_t echo[4096];
+    size_t echo_size;
+} bench_t;
+
+static bench_t bench;
+
+static bool bench_request(void * ptr, xbee_sim_t * sim, size_t node,
+        size_t size, const uint8_t * frame)
+{
+    if(frame[0] == XBEE_TRANSMIT_16_BIT || frame[0] == XBEE_TRANSMIT)
+    {
+        bench.frames += 1;
+        bench.air_us += 2000 + size*8*1000/250;
+        sim->clock.now += bench.air_us/1000;
+        bench.air_us %= 1000;
+    }
+
+    return false;
+}
+
+static int bench_terminal_read(void * ptr, void * buf, size_t nbyte)
+{
+    size_t n = 0;
+    while(n < nbyte && bench.typed < bench.keys &&
+          (int32_t)(bench.sim.clock.now - bench.key_time[bench.typed]) >= 0)
+    {
+        ((uint8_t *)buf)[n++] = 'a' + bench.typed % 26;
+        bench.typed += 1;
+    }
+
+    return n;
+}
+
+static int bench_terminal_write(void * ptr, const void * buf, size_t nbyte)
+{
+    for(size_t i = 0; i < nbyte; ++i)
+    {
+        assert(((const uint8_t *)buf)[i] == 'a' + bench.echoed % 26);
+        bench.latency += bench.sim.clock.now - bench.key_time[bench.echoed];
+        bench.echoed += 1;
+    }
+
+    return nbyte;
+}
+
+static int bench_console_read(void * ptr, void * buf, size_t nbyte)
+{
+    size_t n = nbyte < bench.echo_size ? nbyte : bench.echo_size;
+    memcpy(buf, bench.echo, n);
+    bench.echo_size -= n;
+    memmove(bench.echo, bench.echo + n, bench.echo_size);
+    return n;
+}
+
+static int bench_console_write(void * ptr, const void * buf, size_t nbyte)
+{
+    size_t room = sizeof(bench.echo) - bench.echo_size;
+    size_t n = nbyte < room ? nbyte : room;
+    memcpy(bench.echo + bench.echo_size, buf, n);
+    bench.echo_size += n;
+    return n;
+}
+
+/*! Types keys spaced apart, all at once if spacing is 0, and runs until
+ * they are echoed
+ *
+ * \return ms taken
+ */
+static uint32_t bench_run(uint32_t flush_delay, size_t keys, uint32_t spacing)
+{
+    memset(&bench, 0, sizeof(bench));
+    assert(xbee_sim_init(&bench.sim, 2, 41) == 0);
+    bench.sim.request = bench_request;
+
+    for(size_t i = 0; i < 2; ++i)
+    {
+        xbee_address_t peer;
+        xbee_sim_address16(&bench.sim, 1 - i, &peer);
+        xbee_port_mux_init(&bench.mux[i], &bench.sim.nodes[i].xbee, 4);
+        xbee_stream_open(&bench.stream[i], &bench.mux[i], &bench.port[i], BENCH_PORT, 1,
+                4, bench.queue[i], &peer);
+    }
+    xbee_tunnel_init(&bench.tunnel[0], &bench.stream[0], NULL,
+            bench_terminal_read, bench_terminal_write, flush_delay);
+    xbee_tunnel_init(&bench.tunnel[1], &bench.stream[1], NULL,
+            bench_console_read, bench_console_write, flush_delay);
+
+    uint32_t start = bench.sim.clock.now;
+    assert(keys <= BENCH_KEYS);
+    bench.keys = keys;
+    for(size_t i = 0; i < keys; ++i)
+    {
+        bench.key_time[i] = start + i*spacing;
+    }
+
+    while(bench.echoed < keys)
+    {
+        assert(bench.sim.clock.now - start < 600000);
+        assert(xbee_tunnel_run(&bench.tunnel[0]) == 0);
+        assert(xbee_tunnel_run(&bench.tunnel[1]) == 0);
+        xbee_sim_advance(&bench.sim, 1);
+    }
+
+    return bench.sim.clock.now - start;
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    static const uint32_t delays[] = {0, 10, XBEE_TUNNEL_FLUSH_DELAY, 50};
+    static const uint32_t gaps[] = {8, 20, 40};
+
+    printf("Flush delay 0 is unbatched, times in ms\n");
+    printf("  %5s %9s %7s %15s %13s\n", "flush", "lone key", "typing", "frames per key",
+            "key to echo");
+    for(size_t d = 0; d < sizeof(delays)/sizeof(delays[0]); ++d)
+    {
+        bench_run(delays[d], 20, 150);
+        double lone = (double)bench.latency/bench.echoed;
+
+        for(size_t g = 0; g < sizeof(gaps)/sizeof(gaps[0]); ++g)
+        {
+            bench_run(delays[d], 2000, gaps[g]);
+            printf("  %5u %9.1f %7u %15.2f %13.1f\n", delays[d], lone, gaps[g],
+                    (double)bench.frames/bench.keys, (double)bench.latency/bench.echoed);
+        }
+    }
+
+    for(size_t d = 0; d < sizeof(delays)/sizeof(delays[0]); ++d)
+    {
+        uint32_t ms = bench_run(delays[d], BENCH_KEYS, 0);
+        printf("Flush delay %u: %u byte paste echoed back in %u ms (%.1f kB/s)\n", delays[d],
+                BENCH_KEYS, (unsigned)ms, (double)BENCH_KEYS/ms);
+    }
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xbee_tunnel.h"
+#include "xbee_sim.h"
+
+#define TEST_PORT (12)
+#define TEST_FLUSH_DELAY (10)
+
+typedef struct {
+    xbee_sim_t sim;
+    xbee_port_mux_t mux[2];
+    xbee_stream_t stream[2];
+    xbee_port_t port[2];
+    xbee_port_message_t queue[2][4];
+    xbee_tunnel_t tunnel;
+    const char * input;         /*! Bytes the device has for the tunnel */
+} test_setup_t;
+
+static test_setup_t test;
+
+static int test_read(void * ptr, void * buf, size_t nbyte)
+{
+    size_t n = strlen(test.input);
+    n = n < nbyte ? n : nbyte;
+    memcpy(buf, test.input, n);
+    test.input += n;
+    return n;
+}
+
+static int test_write(void * ptr, const void * buf, size_t nbyte)
+{
+    return nbyte;
+}
+
+static void test_setup(void)
+{
+    memset(&test, 0, sizeof(test));
+    assert(xbee_sim_init(&test.sim, 2, 43) == 0);
+    for(size_t i = 0; i < 2; ++i)
+    {
+        xbee_address_t peer;
+        xbee_sim_address16(&test.sim, 1 - i, &peer);
+        xbee_port_mux_init(&test.mux[i], &test.sim.nodes[i].xbee, 4);
+        xbee_stream_open(&test.stream[i], &test.mux[i], &test.port[i], TEST_PORT, 1,
+                4, test.queue[i], &peer);
+    }
+    xbee_tunnel_init(&test.tunnel, &test.stream[0], NULL, test_read, test_write,
+            TEST_FLUSH_DELAY);
+    test.input = "";
+}
+
+/*! A key typed on an idle stream goes at once, keys typed while it is
+ * in flight are batched */
+void test_tunnel_interactive(void)
+{
+    test_setup();
+
+    test.input = "a";
+    assert(xbee_tunnel_run(&test.tunnel) == 0);
+    assert(test.tunnel.idle_flushes == 1);
+    assert(test.tunnel.batch_size == 0);
+    assert(xbee_stream_unacked(&test.stream[0]) == 1);
+
+    test.input = "b";
+    assert(xbee_tunnel_run(&test.tunnel) == 0);
+    test.input = "c";
+    assert(xbee_tunnel_run(&test.tunnel) == 0);
+    assert(test.tunnel.batch_size == 2);
+    assert(xbee_stream_unacked(&test.stream[0]) == 1);
+
+    xbee_sim_advance(&test.sim, TEST_FLUSH_DELAY);
+    assert(xbee_tunnel_run(&test.tunnel) == 0);
+    assert(test.tunnel.batch_size == 0);
+
+    xbee_sim_step(&test.sim);
+    char buf[8];
+    assert(xbee_stream_read(&test.stream[1], sizeof(buf), buf) == 3);
+    assert(memcmp(buf, "abc", 3) == 0);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Keys typed less than the flush delay after the last flush are
+ * batched even with the stream idle, a key after a pause goes at once */
+void test_tunnel_typing(void)
+{
+    test_setup();
+
+    test.input = "a";
+    assert(xbee_tunnel_run(&test.tunnel) == 0);
+    assert(test.tunnel.idle_flushes == 1);
+    for(size_t i = 0; i < 4 && xbee_stream_unacked(&test.stream[0]) > 0; ++i)
+    {
+        xbee_sim_step(&test.sim);
+        assert(xbee_stream_run(&test.stream[1]) == 0);
+    }
+    assert(xbee_stream_unacked(&test.stream[0]) == 0);
+
+    xbee_sim_advance(&test.sim, 3);
+    test.input = "b";
+    assert(xbee_tunnel_run(&test.tunnel) == 0);
+    xbee_sim_advance(&test.sim, 3);
+    test.input = "c";
+    assert(xbee_tunnel_run(&test.tunnel) == 0);
+    assert(test.tunnel.batch_size == 2 && test.tunnel.idle_flushes == 1);
+
+    /* Held until flush delay after the last flush */
+    xbee_sim_advance(&test.sim, TEST_FLUSH_DELAY - 7);
+    assert(xbee_tunnel_run(&test.tunnel) == 0);
+    assert(test.tunnel.batch_size == 2);
+    xbee_sim_advance(&test.sim, 1);
+    assert(xbee_tunnel_run(&test.tunnel) == 0);
+    assert(test.tunnel.batch_size == 0 && test.tunnel.idle_flushes == 2);
+
+    for(size_t i = 0; i < 4 && xbee_stream_unacked(&test.stream[0]) > 0; ++i)
+    {
+        xbee_sim_step(&test.sim);
+        assert(xbee_stream_run(&test.stream[1]) == 0);
+    }
+    xbee_sim_advance(&test.sim, TEST_FLUSH_DELAY);
+    test.input = "d";
+    assert(xbee_tunnel_run(&test.tunnel) == 0);
+    assert(test.tunnel.batch_size == 0 && test.tunnel.idle_flushes == 3);
+
+    xbee_sim_step(&test.sim);
+    char buf[8];
+    assert(xbee_stream_read(&test.stream[1], sizeof(buf), buf) == 4);
+    assert(memcmp(buf, "abcd", 4) == 0);
+    assert(test.stream[0].segments_sent == 3);
+
+    printf("%s passed\n", __func__);
+}
+
+/*! Bytes the stream has no room for stay in the batch, in order */
+void test_tunnel_write_partial(void)
+{
+    static uint8_t fill[XBEE_STREAM_WINDOW*XBEE_STREAM_MAX_SEGMENT];
+    test_setup();
+
+    assert(xbee_stream_write(&test.stream[0], sizeof(fill) - 3, fill) == sizeof(fill) - 3);
+    test.input = "0123456789\n";
+    assert(xbee_tunnel_run(&test.tunnel) == 0);
+    assert(test.tunnel.batch_size == 8);
+    assert(memcmp(test.tunnel.batch, "3456789\n", 8) == 0);
+    assert(test.tunnel.newline_flushes == 1);
+
+    printf("%s passed\n", __func__);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_tunnel_interactive();
+    test_tunnel_typing();
+    test_tunnel_write_partial();
+
+    return 0;
+}
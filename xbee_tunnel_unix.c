@@ -0,0 +1,91 @@
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include "xbee_tunnel_unix.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+/*! Unlocks the slave, copies its path to name and sets raw, nonblocking mode
+ *
+ * \return 0 on success, or -1 and errno set
+ */
+static int xbee_pty_setup(int fd, char * name, size_t name_size)
+{
+    if(grantpt(fd) != 0 || unlockpt(fd) != 0)
+    {
+        return -1;
+    }
+
+    const char * path = ptsname(fd);
+    if(path == NULL)
+    {
+        return -1;
+    }
+    if(strlen(path) >= name_size)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(name, path);
+
+    struct termios tty;
+    if(tcgetattr(fd, &tty) != 0)
+    {
+        return -1;
+    }
+    cfmakeraw(&tty);
+
+    if(tcsetattr(fd, TCSANOW, &tty) != 0 ||
+       fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+int xbee_pty_open(char * name, size_t name_size)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    if(xbee_pty_setup(fd, name, name_size) != 0)
+    {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+int xbee_pty_read(void * ptr, void * buf, size_t nbyte)
+{
+    int ret = read(*((int*)ptr), buf, nbyte);
+
+    /* EIO while no terminal has the slave open */
+    if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EIO))
+    {
+        return 0;
+    }
+
+    return ret;
+}
+
+int xbee_pty_write(void * ptr, const void * buf, size_t nbyte)
+{
+    int ret = write(*((int*)ptr), buf, nbyte);
+    if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return 0;
+    }
+
+    return ret;
+}
@@ -0,0 +1,28 @@
+#ifndef _XBEE_TUNNEL_UNIX_H_
+#define _XBEE_TUNNEL_UNIX_H_
+
+#include "xbee_tunnel.h"
+
+/*! Opens nonblocking pseudo-terminal master in raw mode
+ *
+ * Terminal programs attach to the slave, whose path is copied to name.
+ * Raw mode keeps the line discipline from echoing or translating bytes,
+ * since echo and line editing are the remote console's job.
+ *
+ * \return File descriptor, or -1 and errno set
+ */
+int xbee_pty_open(char * name, size_t name_size);
+
+/*! Reads from the master whose fd ptr points to, conforms to xbee_read_fun_t
+ *
+ * \return Bytes read, 0 if none are waiting or no terminal is attached, <0 on error
+ */
+int xbee_pty_read(void * ptr, void * buf, size_t nbyte);
+
+/*! Writes to the master whose fd ptr points to, conforms to xbee_write_fun_t
+ *
+ * \return Bytes written, 0 if the terminal is not keeping up, <0 on error
+ */
+int xbee_pty_write(void * ptr, const void * buf, size_t nbyte);
+
+#endif /* _XBEE_TUNNEL_UNIX_H_ */